@@ -127,6 +127,7 @@ enum {                  // Action Codes
 	DNSA_DREC = 20,
 	DNSA_DPREFA = 21,
 	DNSA_CNAME = 22,
+	DNSA_IMPORT = 23,
 	CBC_SERVER = 30,
 	DOWNLOAD = 31,
 	HELP = 32,
@@ -233,6 +234,9 @@ enum {                  // Error codes
 	AILSA_STRING_FAIL = 240,
 	AILSA_XML_DEFINED = 241,
 	AILSA_REV_ZONE_OVERLAP = 242,
+	AILSA_RNDC_FAIL = 243,
+	AILSA_DNS_UPDATE_FAIL = 244,
+	AILSA_IMPORT_INVALID = 245,
 	AILSA_NO_QUERY = 300,
 	AILSA_NO_DBTYPE = 301,
 	AILSA_INVALID_DBTYPE = 302,
@@ -247,6 +251,9 @@ enum {                  // Error codes
 	AILSA_WRONG_DBTYPE = 311,
 	AILSA_MY_CONN_FAIL = 312,
 	AILSA_MY_INIT_FAIL = 313,
+	AILSA_TRANSACTION_FAIL = 314,
+	AILSA_PG_CONN_FAIL = 315,
+	AILSA_POOL_FAIL = 316,
 	UUID_REGEX_ERROR = 400,
 	NAME_REGEX_ERROR = 401,
 	ID_REGEX_ERROR = 402,
@@ -369,6 +376,13 @@ enum {
 
 // Hash table types
 
+# define AILSA_HASH_SEED 14695981039346656037ULL	// Start for ailsa_hash_bytes
+
+enum {
+	AILSA_SHA256_BLOCK = 64,
+	AILSA_SHA256_LEN = 32
+};
+
 typedef struct ailsa_hash_s {
 	unsigned int	buckets;
 	unsigned int	(*h)(const void *key);
@@ -487,6 +501,8 @@ struct cmdbd_config {
 
 // Various data types
 
+struct ailsa_sql_conn_s;
+
 typedef struct ailsa_cmdb_s {
 	char *dbtype;
 	char *db;
@@ -499,7 +515,6 @@ typedef struct ailsa_cmdb_s {
 	char *dnsa;
 	char *rev;
 	char *rndc;
-	char *chkz;
 	char *chkc;
 	char *socket;
 	char *hostmaster;
@@ -512,12 +527,33 @@ typedef struct ailsa_cmdb_s {
 	char *tmpdir;
 	char *tftpdir;
 	char *dhcpconf;
+	char *sqlite_journal;
+	char *sqlite_sync;
+	char *sql_stats;
+	char *sql_stats_file;
+	char *final_check;
+	char *rndc_key;
+	char *rndc_server;
+	char *update_key;
+	char *update_server;
+	char *dhcp_reload;
 	unsigned int port;
+	unsigned int rndc_port;
+	unsigned int update_port;
 	unsigned long int refresh;
 	unsigned long int retry;
 	unsigned long int expire;
 	unsigned long int ttl;
 	unsigned long int cliflag;
+	unsigned long int sqlite_mmap;
+	unsigned long int sqlite_cache;
+	unsigned long int sqlite_timeout;
+	unsigned long int pool_size;
+	unsigned long int zone_workers;
+	struct ailsa_sql_conn_s *conn;	// Persistent DB session; see ailsasql.h
+	struct ailsa_sql_pool_s *pool;	// Sessions for threaded callers; see sql.c
+	struct ailsa_sql_stats_s *stats;	// Per query timings; see sql_stats.c
+	void (*disconnect)(struct ailsa_cmdb_s *cmdb);
 } ailsa_cmdb_s;
 
 struct cmdbc_config {
@@ -713,6 +749,26 @@ typedef struct ailsa_rev_zone_s {
 	char *in_addr;
 } ailsa_rev_zone_s;
 
+typedef struct ailsa_zone_tokens_s {	// Fields of one master file entry
+	char **tok;
+	size_t total;
+	size_t size;
+	int depth;			// ( still open at the end of the last line
+	const char *error;		// Why the last line would not split
+} ailsa_zone_tokens_s;
+
+enum {
+	RNDC_SECRET_LEN = 128
+};
+
+typedef struct ailsa_rndc_s {	// A connection to the name server control channel
+	int fd;
+	unsigned long int serial;
+	unsigned long int nonce;
+	size_t slen;
+	unsigned char secret[RNDC_SECRET_LEN];
+} ailsa_rndc_s;
+
 enum {
 	CBCSCRIPT = 1,
 	CBCSCRARG = 2
@@ -870,6 +926,43 @@ int
 ailsa_hash_remove(AILHASH *htbl, void **data, const char *key);
 int
 ailsa_hash_lookup(AILHASH *htbl, void **data, const char *key);
+unsigned long long int
+ailsa_hash_bytes(const void *data, size_t len, unsigned long long int hash);
+void
+ailsa_hmac_sha256(const unsigned char *key, size_t klen, const unsigned char *data, size_t len, unsigned char *mac);
+
+// Zone files
+
+int
+ailsa_check_zone_file(const char *zone, const char *file);
+
+int
+ailsa_zone_tokenise(ailsa_zone_tokens_s *t, const char *line);
+
+void
+ailsa_zone_tokens_clear(ailsa_zone_tokens_s *t);
+
+void
+ailsa_zone_tokens_free(ailsa_zone_tokens_s *t);
+
+// Name server control channel
+
+int
+ailsa_rndc_open(ailsa_cmdb_s *cbs, ailsa_rndc_s **rndc);
+
+int
+ailsa_rndc_command(ailsa_rndc_s *r, const char *command, char *text, size_t size);
+
+void
+ailsa_rndc_close(ailsa_rndc_s *r);
+
+int
+ailsa_rndc_reload(ailsa_cmdb_s *cbs, AILLIST *zones, short int reconfig);
+
+// Dynamic DNS updates
+
+int
+ailsa_dns_update(ailsa_cmdb_s *cbs, const char *zone, const char *soa, const char *owner, const char *type, unsigned long int ttl, AILLIST *rdata);
 
 // memory functions
 
@@ -896,6 +989,12 @@ void
 ailsa_resize_string(ailsa_string_s *str);
 void
 ailsa_fill_string(ailsa_string_s *str, const char *s);
+void
+ailsa_printf_string(ailsa_string_s *str, const char *fmt, ...);
+int
+ailsa_cmp_string_file(const char *file, ailsa_string_s *str);
+int
+ailsa_write_string_file(const char *file, ailsa_string_s *str);
 
 // UUID functions
 char *
@@ -913,6 +1012,8 @@ void
 parse_mkvm_config(ailsa_mkvm_s *vm);
 void
 parse_cmdb_config(ailsa_cmdb_s *cmdb);
+int
+ailsa_read_key_file(const char *file, char *name, size_t nsize, unsigned char *secret, size_t *len);
 
 
 // Path and various string functions
@@ -151,6 +151,25 @@ enum {			// SQL BASIC QUERIES
 	DEFAULT_CUSTOMER_DETAILS,
 	IDENTITIES,
 	IDENTITIES_NO_SERVER_NAME,
+	FWD_ZONE_COMMIT_STATE,
+	REV_ZONE_COMMIT_STATE,
+	REV_ZONE_RANGES,
+	DUP_IP_PREF_A,
+	AAAA_RECORDS,
+	BUILD_COUNT,
+	SERVER_IDS_WITH_BUILD,
+	IP_NET_ON_ALL_BUILDS,
+	BUILD_OS_DETAILS_ON_ALL_BUILDS,
+	FULL_LOCALE_DETAILS_ON_ALL_BUILDS,
+	TFTP_DETAILS_ON_ALL_BUILDS,
+	BUILD_TYPE_ON_ALL_BUILDS,
+	BUILD_DETAILS_ON_ALL_BUILDS,
+	IDENTITIES_ON_ALL_BUILDS,
+	DISK_DEV_DETAILS_ON_ALL_BUILDS,
+	BUILD_PARTITIONS_ON_ALL_BUILDS,
+	BUILD_PACKAGES_ON_ALL_BUILDS,
+	SYSTEM_PACKAGES_ON_ALL_BUILDS,
+	DOMAIN_BUILD_ALIAS_ON_ALL_BUILDS,
 };
 
 enum {			// SQL ARGUMENT QUERIES
@@ -278,6 +297,12 @@ enum {			// SQL ARGUMENT QUERIES
 	SERVERS_IN_LOCALE,
 	SERVERS_IN_SCHEME,
 	SERVERS_IN_VARIENT,
+	ZONE_HASH_ON_NAME,
+	REV_ZONE_HASH_ON_NET_RANGE,
+	REV_RECORDS_ALL_ON_NET_RANGE,
+	RECORDS_ON_ZONE_TYPE,
+	RECORDS_ALL_ON_ZONE,
+	DHCP_INFORMATION_ON_SERVER_ID,
 };
 
 enum {			// SQL INSERT QUERIES
@@ -360,6 +385,7 @@ enum {			// SQL UPDATE QUERIES
 	FWD_ZONE_SERIAL_UPDATE,
 	REV_ZONE_VALIDATE,
 	REV_ZONE_SERIAL_UPDATE,
+	FWD_ZONE_SERIAL_SET,
 	SET_FWD_ZONE_UPDATED,
 	SET_FWD_ZONE_UPDATED_ON_NAME,
 	SET_REV_ZONE_UPDATED,
@@ -399,11 +425,102 @@ typedef struct ailsa_sql_multi_s {
 	unsigned int *fields;
 } ailsa_sql_multi_s;
 
+# ifdef HAVE_MYSQL
+#  include <mysql.h>
+# endif // HAVE_MYSQL
+# ifdef HAVE_SQLITE3
+#  include <sqlite3.h>
+# endif // HAVE_SQLITE3
+# ifdef HAVE_LIBPQ
+#  include <libpq-fe.h>
+# endif // HAVE_LIBPQ
+
+typedef struct ailsa_sql_conn_s {	// One per process; hangs off ailsa_cmdb_s
+# ifdef HAVE_MYSQL
+	MYSQL *mysql;
+	MYSQL_STMT **my_stmt;		// Prepared statements, indexed by argument query
+	unsigned long int max_packet;	// Server max_allowed_packet, once looked up
+# endif // HAVE_MYSQL
+# ifdef HAVE_SQLITE3
+	sqlite3 *sqlite;
+	sqlite3_stmt **lite_stmt;	// Prepared statements, indexed by argument query
+	short int rw;
+# endif // HAVE_SQLITE3
+# ifdef HAVE_LIBPQ
+	PGconn *pg;
+	unsigned char *pg_stmt;		// Non zero once argument query n is prepared as "ailsa_<n>"
+# endif // HAVE_LIBPQ
+	unsigned long int hits;
+	unsigned long int misses;
+	unsigned int txn;		// Transaction nesting depth
+	short int aborted;		// Rolled back; callers above must not commit
+	struct ailsa_sql_pool_s *pool;	// Owning pool, if checked out of one
+	time_t used;			// Last checkin; idle connections are pinged
+} ailsa_sql_conn_s;
+
+typedef struct ailsa_sql_pool_stats_s {
+	size_t size;			// Connections the pool may open
+	size_t open;			// Connections opened so far
+	unsigned long int checkouts;
+	unsigned long int waits;	// Checkouts that found no idle connection
+	unsigned long int reconnects;	// Connections dropped by a failed health check
+	unsigned long long int wait_total;	// Nanoseconds spent waiting
+	unsigned long long int wait_max;
+} ailsa_sql_pool_stats_s;
+
+enum {			// Query tables kept apart in the per query statistics
+	AILSA_STATS_BASIC = 0,
+	AILSA_STATS_ARGUMENT,
+	AILSA_STATS_INSERT,
+	AILSA_STATS_TABLES
+};
 
+typedef struct ailsa_query_stats_s {
+	unsigned long int calls;
+	unsigned long long int total;	// Nanoseconds
+	unsigned long long int min;
+	unsigned long long int max;
+	unsigned long long int rows;	// Returned, or inserted for insert queries
+	unsigned long long int bytes;	// Copied into result sets
+} ailsa_query_stats_s;
+
+typedef struct ailsa_result_col_s {
+	unsigned int *type;		// AILSA_DB_* type of each row
+	ailsa_data_u *data;		// TEXT and TIME cells hold an offset into the arena
+} ailsa_result_col_s;
+
+typedef struct ailsa_result_s {		// Columnar query results; see sql_result.c
+	size_t rows;
+	size_t cols;
+	size_t size;			// Rows allocated in each column
+	ailsa_result_col_s *col;
+	char *arena;
+	size_t arena_len;
+	size_t arena_size;
+	size_t fetched;			// Rows added since init; a reset does not clear it
+	size_t copied;			// Bytes of values stored since init
+} ailsa_result_s;
+
+// Called once per row by ailsa_query_foreach(); non zero stops the query
+typedef int (*ailsa_row_fn)(ailsa_result_s *row, void *ctx);
+
+typedef struct ailsa_sql_batch_s {	// One query for ailsa_query_batch()
+	unsigned int query_no;
+	AILLIST *args;			// NULL runs basic_queries[query_no]
+	AILLIST *results;
+	size_t total;			// Entries this query added to results
+} ailsa_sql_batch_s;
+
+
+extern const char *basic_queries[];
+extern const unsigned int basic_query_total;
+extern const ailsa_sql_query_s argument_queries[];
 extern const ailsa_sql_query_s varient_queries[];
+extern const unsigned int argument_query_total;
 extern const ailsa_sql_query_s delete_queries[];
 extern const ailsa_sql_query_s update_queries[];
 extern const ailsa_sql_query_s insert_queries[];
+extern const unsigned int insert_query_total;
 
 int
 ailsa_basic_query(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *results);
@@ -411,6 +528,21 @@ ailsa_basic_query(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *results);
 int
 ailsa_argument_query(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *args, AILLIST *results);
 
+int
+ailsa_basic_query_result(ailsa_cmdb_s *cmdb, unsigned int query_no, ailsa_result_s *results);
+
+int
+ailsa_argument_query_result(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *args, ailsa_result_s *results);
+
+// Stream rows to cb without storing them. A NULL args runs basic_queries[query_no].
+// cb must not run other queries on cmdb while the rows are being read.
+int
+ailsa_query_foreach(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *args, ailsa_row_fn cb, void *ctx);
+
+// Run n independent queries in order. PostgreSQL sends them all in one pipeline
+int
+ailsa_query_batch(ailsa_cmdb_s *cmdb, ailsa_sql_batch_s *batch, size_t n);
+
 int
 ailsa_individual_query(ailsa_cmdb_s *cmdb, const ailsa_sql_query_s *query, AILLIST *args, AILLIST *results);
 
@@ -429,6 +561,112 @@ ailsa_multiple_query(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query, A
 int
 ailsa_multiple_delete(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query, AILLIST *del);
 
+int
+ailsa_bulk_insert(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query, AILLIST *insert);
+
+// Persistent connection handling. Queries open the session on first use
+
+int
+ailsa_sql_open(ailsa_cmdb_s *cmdb);
+
+void
+ailsa_sql_close(ailsa_cmdb_s *cmdb);
+
+int
+ailsa_begin(ailsa_cmdb_s *cmdb);
+
+int
+ailsa_commit(ailsa_cmdb_s *cmdb);
+
+int
+ailsa_rollback(ailsa_cmdb_s *cmdb);
+
+int
+ailsa_sql_bulk_limits(ailsa_cmdb_s *cmdb, size_t *vars, size_t *bytes);
+
+void
+ailsa_sql_stmt_cache_stats(ailsa_cmdb_s *cmdb, unsigned long int *hits, unsigned long int *misses);
+
+ailsa_sql_conn_s *
+ailsa_sql_conn(ailsa_cmdb_s *cmdb);
+
+// Share the database between threads. Each query checks a session out of
+// the pool for its duration; hold one across calls with checkout / checkin.
+
+int
+ailsa_sql_pool_init(ailsa_cmdb_s *cmdb, size_t size);
+
+int
+ailsa_sql_checkout(ailsa_cmdb_s *cmdb);
+
+void
+ailsa_sql_checkin(ailsa_cmdb_s *cmdb);
+
+void
+ailsa_sql_thread_end(void);
+
+void
+ailsa_sql_pool_stats(ailsa_cmdb_s *cmdb, ailsa_sql_pool_stats_s *stats);
+
+// Per query timings, kept when SQL_STATS or CMDB_SQL_STATS is text or json.
+// They are written out when the database is closed.
+
+void
+ailsa_sql_stats_start(ailsa_cmdb_s *cmdb, struct timespec *start);
+
+void
+ailsa_sql_stats_record(ailsa_cmdb_s *cmdb, unsigned int table, unsigned int query_no, const struct timespec *start, size_t rows, size_t bytes);
+
+int
+ailsa_sql_query_stats(ailsa_cmdb_s *cmdb, unsigned int table, unsigned int query_no, ailsa_query_stats_s *stats);
+
+void
+ailsa_sql_stats_dump(ailsa_cmdb_s *cmdb);
+
+// Columnar result sets
+
+ailsa_result_s *
+ailsa_result_init(void);
+
+void
+ailsa_result_clean(ailsa_result_s *r);
+
+void
+ailsa_result_reset(ailsa_result_s *r);
+
+int
+ailsa_result_add_row(ailsa_result_s *r, size_t cols);
+
+void
+ailsa_result_set_text(ailsa_result_s *r, size_t col, const char *text, size_t len);
+
+void
+ailsa_result_set_number(ailsa_result_s *r, size_t col, unsigned long int number);
+
+void
+ailsa_result_set_small(ailsa_result_s *r, size_t col, short int small);
+
+void
+ailsa_result_set_point(ailsa_result_s *r, size_t col, double point);
+
+unsigned int
+ailsa_result_type(ailsa_result_s *r, size_t row, size_t col);
+
+const char *
+ailsa_result_text(ailsa_result_s *r, size_t row, size_t col);
+
+unsigned long int
+ailsa_result_number(ailsa_result_s *r, size_t row, size_t col);
+
+short int
+ailsa_result_small(ailsa_result_s *r, size_t row, size_t col);
+
+double
+ailsa_result_point(ailsa_result_s *r, size_t row, size_t col);
+
+int
+ailsa_result_to_list(ailsa_result_s *r, AILLIST *list);
+
 // Some helper functions
 
 int
@@ -571,6 +809,21 @@ convert_bin_ipv4_to_text(unsigned long int ip, char *addr);
 int
 convert_text_ipv4_to_bin(unsigned long int *ip, const char *addr);
 
+int
+convert_text_ipv6_to_bin(unsigned char *ip, const char *addr);
+
+void
+convert_bin_ipv6_to_hex(const unsigned char *ip, char *hex);
+
+int
+convert_hex_ipv6_to_bin(unsigned char *ip, const char *hex);
+
+int
+cmdb_ipv6_in_range(const unsigned char *ip, const unsigned char *net, unsigned long int prefix);
+
+int
+check_ipv6_rev_zone_range(const char *range, unsigned long int prefix, unsigned char *ip);
+
 int
 get_range_search_string(const char *range, char *search, unsigned long int prefix, unsigned long int index);
 
@@ -589,6 +842,9 @@ check_for_build_domain_overlap(ailsa_cmdb_s *cbs, unsigned long int *ips);
 int
 check_for_rev_zone_overlap(ailsa_cmdb_s *cbc, unsigned long int start, unsigned long int end);
 
+int
+check_for_rev_zone_overlap_ipv6(ailsa_cmdb_s *cbc, const unsigned char *ip, unsigned long int prefix);
+
 int
 dnsa_populate_zone(ailsa_cmdb_s *cbs, char *domain, const char *type, const char *master, AILLIST *zone);
 
@@ -609,6 +865,9 @@ ailsa_get_bdom_list(ailsa_cmdb_s *cbs, AILLIST *list);
 int
 cmdb_populate_cuser_muser(AILLIST *list);
 
+int
+cmdb_add_ip_addr_to_list(const char *type, const char *dest, AILLIST *list);
+
 AILELEM *
 ailsa_clone_data_element(AILELEM *e);
 
@@ -621,7 +880,7 @@ ailsa_fill_rev_zone_list(AILLIST *l, AILLIST *z);
 // Some zone functions
 
 int
-cmdb_validate_zone(ailsa_cmdb_s *cbc, int type, char *zone, const char *ztype, unsigned long int prefix);
+cmdb_validate_zone(ailsa_cmdb_s *cbc, int type, char *zone, const char *ztype, unsigned long int prefix, short int *changed);
 
 int
 cmdb_write_fwd_zone_config(ailsa_cmdb_s *cbs);
@@ -629,6 +888,15 @@ cmdb_write_fwd_zone_config(ailsa_cmdb_s *cbs);
 int
 cmdb_write_rev_zone_config(ailsa_cmdb_s *cbs);
 
+int
+cmdb_check_zone_config(ailsa_cmdb_s *cbs, const char *conf);
+
+int
+cmdb_rev_zone_names(char *range, unsigned long int prefix, AILLIST *names);
+
+int
+cmdb_push_rrset(ailsa_cmdb_s *cbs, char *zone, const char *type, const char *host);
+
 int
 add_forward_zone(ailsa_cmdb_s *dc, char *domain, const char *type, const char *master);
 
@@ -636,10 +904,24 @@ int
 add_reverse_zone(ailsa_cmdb_s *dc, char *range, const char *type, char *master, unsigned long int prefix);
 
 # ifdef HAVE_MYSQL
-#  include <mysql.h>
 int
 ailsa_mysql_init(ailsa_cmdb_s *dc, MYSQL *cbc_mysql);
 
+int
+ailsa_mysql_session(ailsa_cmdb_s *dc, MYSQL **sql);
+
+int
+ailsa_mysql_cached_stmt(ailsa_cmdb_s *cmdb, unsigned int query_no, const char *query, MYSQL_STMT **stmt);
+
+void
+ailsa_mysql_evict_stmt(ailsa_cmdb_s *cmdb, unsigned int query_no);
+
+void
+ailsa_result_set_time(ailsa_result_s *r, size_t col, const MYSQL_TIME *time);
+
+const MYSQL_TIME *
+ailsa_result_time(ailsa_result_s *r, size_t row, size_t col);
+
 int
 ailsa_mysql_query_with_checks(MYSQL *mycmdb, const char *query);
 
@@ -670,15 +952,32 @@ ailsa_convert_mysql_time(MYSQL_TIME *time);
 # endif // HAVE_MYSQL
 
 # ifdef HAVE_SQLITE3
-#  include <sqlite3.h>
 int
-ailsa_setup_ro_sqlite(const char *query, const char *file, sqlite3 **cmdb, sqlite3_stmt **stmt);
+ailsa_sqlite_session(ailsa_cmdb_s *cmdb, int rw, sqlite3 **sql);
+
+int
+ailsa_sqlite_cached_stmt(ailsa_cmdb_s *cmdb, unsigned int query_no, const char *query, sqlite3_stmt **stmt);
+
+int
+ailsa_setup_ro_sqlite(ailsa_cmdb_s *cmdb, const char *query, sqlite3_stmt **stmt);
 
 int
-ailsa_setup_rw_sqlite(const char *query, size_t len, const char *file, sqlite3 **cmdb, sqlite3_stmt **stmt);
+ailsa_setup_rw_sqlite(ailsa_cmdb_s *cmdb, const char *query, size_t len, sqlite3_stmt **stmt);
 
 void
-ailsa_sqlite_cleanup(sqlite3 *cmdb, sqlite3_stmt *stmt);
+ailsa_sqlite_cleanup(sqlite3_stmt *stmt);
 
 # endif // HAVE_SQLITE3
+
+# ifdef HAVE_LIBPQ
+int
+ailsa_pgsql_session(ailsa_cmdb_s *cmdb, PGconn **pg);
+
+int
+ailsa_pgsql_cached_stmt(ailsa_cmdb_s *cmdb, unsigned int query_no, const char *query, char *name, size_t len);
+
+char *
+ailsa_pgsql_convert_query(const char *query);
+
+# endif // HAVE_LIBPQ
 #endif
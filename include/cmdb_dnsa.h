@@ -27,6 +27,7 @@ typedef struct dnsa_comm_line_s { /* Hold parsed command line args */
 	short int action;
 	short int type;
 	unsigned long int prefix;
+	unsigned long int workers;
 	char *rtype;
 	char *ztype;
 	char *service;
@@ -39,6 +40,7 @@ typedef struct dnsa_comm_line_s { /* Hold parsed command line args */
 	char *master;
 	char *glue_ip;
 	char *glue_ns;
+	char *import;
 } dnsa_comm_line_s;
 
 // Zone action Functions
@@ -55,6 +57,8 @@ commit_rev_zones(ailsa_cmdb_s *dc, char *name);
 int
 add_host(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm);
 int
+import_records(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm);
+int
 display_multi_a_records(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm);
 int
 mark_preferred_a_record(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm);
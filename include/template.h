@@ -0,0 +1,91 @@
+/*
+ *
+ *  cbc: Create Build Configuration
+ *  Copyright (C) 2012 - 2020  Iain M Conochie <iain-AT-thargoid.co.uk>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *  template.h
+ *
+ *  Header file for the template.c file.
+ *
+ */
+
+#ifndef __CBC_TEMPLATE_H__
+# define __CBC_TEMPLATE_H__
+
+enum {			// Types of the values a template can name
+	CBC_TMPL_TEXT = 1,	// char *
+	CBC_TMPL_NUMBER,	// unsigned long int
+	CBC_TMPL_SHORT,		// short int
+	CBC_TMPL_DATA,		// The list entry is itself an ailsa_data_s
+	CBC_TMPL_LIST,		// AILLIST *, for #each
+	CBC_TMPL_FIRST,		// First time round the innermost #each
+	CBC_TMPL_LAST		// Last time round the innermost #each
+};
+
+enum {			// Compiled template operations
+	CBC_TMPL_OP_TEXT = 1,
+	CBC_TMPL_OP_VAR,
+	CBC_TMPL_OP_IF,
+	CBC_TMPL_OP_ELSE,
+	CBC_TMPL_OP_EACH,
+	CBC_TMPL_OP_NEXT
+};
+
+enum {			// Tests an #if can make
+	CBC_TMPL_SET = 0,
+	CBC_TMPL_EQ,
+	CBC_TMPL_NE
+};
+
+enum {
+	CBC_TMPL_DEPTH = 8	// Blocks open at once
+};
+
+typedef struct cbc_tmpl_field_s {	// A name a template can use
+	const char *name;
+	size_t offset;		// Where the value is in the struct
+	short int type;
+	const struct cbc_tmpl_field_s *item;	// Names for each entry of a list
+} cbc_tmpl_field_s;
+
+typedef struct cbc_tmpl_op_s {
+	short int op;
+	short int test;
+	unsigned int level;	// 0 is the context, n the nth enclosing #each
+	const cbc_tmpl_field_s *field;
+	const char *text;	// Text to copy, or the literal an #if tests against
+	size_t len;
+	size_t jump;		// Where a block goes when it is skipped or repeated
+} cbc_tmpl_op_s;
+
+typedef struct cbc_tmpl_s {	// A template compiled against one set of names
+	char *name;
+	char *src;
+	cbc_tmpl_op_s *ops;
+	size_t total;
+} cbc_tmpl_s;
+
+cbc_tmpl_s *
+cbc_tmpl_compile(const char *file, const char *name, const cbc_tmpl_field_s *fields);
+
+int
+cbc_tmpl_render(cbc_tmpl_s *tmpl, const void *ctx, ailsa_string_s *out);
+
+void
+cbc_tmpl_clean(void *data);
+
+#endif /* __CBC_TEMPLATE_H__ */
@@ -29,6 +29,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
 #include <unistd.h>
 #include <syslog.h>
 #ifdef HAVE_GETOPT_H
@@ -60,6 +63,12 @@ parse_user_cmdb_config(ailsa_cmdb_s *cmdb);
 static void
 parse_cmdb_config_values(ailsa_cmdb_s *cmdb, FILE *conf);
 
+static void
+parse_cmdb_config_env(ailsa_cmdb_s *cmdb);
+
+static size_t
+key_base64_decode(const char *in, unsigned char *out, size_t size);
+
 void
 parse_mkvm_config(ailsa_mkvm_s *vm)
 {
@@ -84,6 +93,30 @@ parse_cmdb_config(ailsa_cmdb_s *cmdb)
 	snprintf(cmdb->pxe, CONFIG_LEN, "pxelinux.cfg");
 	parse_system_cmdb_config(cmdb);
 	parse_user_cmdb_config(cmdb);
+	parse_cmdb_config_env(cmdb);
+}
+
+// Profile a single run without editing cmdb.conf. An empty value turns it off
+static void
+parse_cmdb_config_env(ailsa_cmdb_s *cmdb)
+{
+	const char *env;
+
+	if ((env = getenv("CMDB_SQL_STATS"))) {
+		if (!(*env)) {
+			if (cmdb->sql_stats)
+				my_free(cmdb->sql_stats);
+		} else {
+			if (!(cmdb->sql_stats))
+				cmdb->sql_stats = ailsa_calloc(CONFIG_LEN, "cmdb->sql_stats in parse_cmdb_config_env");
+			snprintf(cmdb->sql_stats, CONFIG_LEN, "%s", env);
+		}
+	}
+	if ((env = getenv("CMDB_SQL_STATS_FILE")) && (*env)) {
+		if (!(cmdb->sql_stats_file))
+			cmdb->sql_stats_file = ailsa_calloc(CONFIG_LEN, "cmdb->sql_stats_file in parse_cmdb_config_env");
+		snprintf(cmdb->sql_stats_file, CONFIG_LEN, "%s", env);
+	}
 }
 
 static void
@@ -223,7 +256,6 @@ parse_cmdb_config_values(ailsa_cmdb_s *cmdb, FILE *conf)
 	GET_CONFIG_OPTION("DNSA=%s", cmdb->dnsa);
 	GET_CONFIG_OPTION("REV=%s", cmdb->rev);
 	GET_CONFIG_OPTION("RNDC=%s", cmdb->rndc);
-	GET_CONFIG_OPTION("CHKZ=%s", cmdb->chkz);
 	GET_CONFIG_OPTION("CHKC=%s", cmdb->chkc);
 	GET_CONFIG_OPTION("SOCKET=%s", cmdb->socket);
 	GET_CONFIG_OPTION("HOSTMASTER=%s", cmdb->hostmaster);
@@ -233,12 +265,29 @@ parse_cmdb_config_values(ailsa_cmdb_s *cmdb, FILE *conf)
 	GET_CONFIG_OPTION("SECDNS=%s", cmdb->secdns);
 	GET_CONFIG_OPTION("TFTPDIR=%s", cmdb->tftpdir);
 	GET_CONFIG_OPTION("DHCPCONF=%s", cmdb->dhcpconf);
+	GET_CONFIG_OPTION("SQLITE_JOURNAL=%s", cmdb->sqlite_journal);
+	GET_CONFIG_OPTION("SQLITE_SYNC=%s", cmdb->sqlite_sync);
+	GET_CONFIG_OPTION("SQL_STATS=%s", cmdb->sql_stats);
+	GET_CONFIG_OPTION("SQL_STATS_FILE=%s", cmdb->sql_stats_file);
+	GET_CONFIG_OPTION("FINAL_CHECK=%s", cmdb->final_check);
+	GET_CONFIG_OPTION("RNDC_KEY=%s", cmdb->rndc_key);
+	GET_CONFIG_OPTION("RNDC_SERVER=%s", cmdb->rndc_server);
+	GET_CONFIG_OPTION("UPDATE_KEY=%s", cmdb->update_key);
+	GET_CONFIG_OPTION("UPDATE_SERVER=%s", cmdb->update_server);
+	GET_CONFIG_OPTION("DHCP_RELOAD=%[^\t\n#]", cmdb->dhcp_reload);
 	GET_CONFIG_INT("PORT=%u", cmdb->port);
+	GET_CONFIG_INT("RNDC_PORT=%u", cmdb->rndc_port);
+	GET_CONFIG_INT("UPDATE_PORT=%u", cmdb->update_port);
 	GET_CONFIG_INT("REFRESH=%lu", cmdb->refresh);
 	GET_CONFIG_INT("RETRY=%lu", cmdb->retry);
 	GET_CONFIG_INT("EXPIRE=%lu", cmdb->expire);
 	GET_CONFIG_INT("TTL=%lu", cmdb->ttl);
 	GET_CONFIG_INT("CLIFLAG=%lu", cmdb->cliflag);
+	GET_CONFIG_INT("SQLITE_MMAP=%lu", cmdb->sqlite_mmap);
+	GET_CONFIG_INT("SQLITE_CACHE=%lu", cmdb->sqlite_cache);
+	GET_CONFIG_INT("SQLITE_TIMEOUT=%lu", cmdb->sqlite_timeout);
+	GET_CONFIG_INT("POOL_SIZE=%lu", cmdb->pool_size);
+	GET_CONFIG_INT("ZONE_WORKERS=%lu", cmdb->zone_workers);
 	if ((tmp = strchr(cmdb->hostmaster, at)))
 		*tmp = '.';
 	if (cmdb->hostmaster)
@@ -265,6 +314,12 @@ parse_cmdb_config_values(ailsa_cmdb_s *cmdb, FILE *conf)
 	if(cmdb->dhcpconf)
 		if (ailsa_add_trailing_slash(cmdb->dhcpconf) != 0)
 			ailsa_syslog(LOG_ERR, "Cannot add / to the end of DHCPCONF");
+// DHCP_RELOAD is a whole command line; drop the spaces before any comment
+	if (cmdb->dhcp_reload) {
+		tmp = cmdb->dhcp_reload + strlen(cmdb->dhcp_reload);
+		while ((tmp > cmdb->dhcp_reload) && (*(tmp - 1) == ' '))
+			*--tmp = '\0';
+	}
 }
 
 void
@@ -379,3 +434,87 @@ parse_user_cmdb_config(ailsa_cmdb_s *cmdb)
 
 #undef GET_CONFIG_OPTION
 #undef GET_CONFIG_INT
+
+// Key file, as written by rndc-confgen or tsig-keygen:
+// key "name" { algorithm hmac-sha256; secret "..."; };
+int
+ailsa_read_key_file(const char *file, char *name, size_t nsize, unsigned char *secret, size_t *len)
+{
+	int retval = 0;
+	char *buf = ailsa_calloc(FILE_LEN, "buf in ailsa_read_key_file");
+	char *p, *end;
+	size_t n;
+	FILE *key;
+
+	if (!(key = fopen(file, "r"))) {
+		ailsa_syslog(LOG_ERR, "Cannot open key file %s: %s", file, strerror(errno));
+		retval = AILSA_FILE_ERROR;
+		goto cleanup;
+	}
+	n = fread(buf, 1, FILE_LEN - 1, key);
+	fclose(key);
+	buf[n] = '\0';
+	if (name) {
+		if (!(p = strstr(buf, "key")) || !(p = strchr(p, '"')) || !(end = strchr(++p, '"')) || ((size_t)(end - p) >= nsize)) {
+			ailsa_syslog(LOG_ERR, "No key name in key file %s", file);
+			retval = AILSA_CONFIG_ERROR;
+			goto cleanup;
+		}
+		memcpy(name, p, (size_t)(end - p));
+		name[end - p] = '\0';
+	}
+	if (!(p = strstr(buf, "algorithm"))) {
+		ailsa_syslog(LOG_ERR, "No algorithm in key file %s", file);
+		retval = AILSA_CONFIG_ERROR;
+		goto cleanup;
+	}
+	p += strlen("algorithm");
+	while (isspace((unsigned char)*p))
+		p++;
+	if (strncasecmp(p, "hmac-sha256", 11) != 0) {
+		ailsa_syslog(LOG_ERR, "Key file %s does not use hmac-sha256", file);
+		retval = AILSA_CONFIG_ERROR;
+		goto cleanup;
+	}
+	if (!(p = strstr(buf, "secret")) || !(p = strchr(p, '"')) || !(end = strchr(++p, '"'))) {
+		ailsa_syslog(LOG_ERR, "No secret in key file %s", file);
+		retval = AILSA_CONFIG_ERROR;
+		goto cleanup;
+	}
+	*end = '\0';
+	if ((*len = key_base64_decode(p, secret, RNDC_SECRET_LEN)) == 0) {
+		ailsa_syslog(LOG_ERR, "Cannot decode secret in key file %s", file);
+		retval = AILSA_CONFIG_ERROR;
+	}
+	cleanup:
+		memset(buf, 0, FILE_LEN);
+		my_free(buf);
+		return retval;
+}
+
+// Returns the decoded length; 0 on error
+static size_t
+key_base64_decode(const char *in, unsigned char *out, size_t size)
+{
+	static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	const char *c;
+	unsigned long int acc = 0;
+	size_t len = 0;
+	int bits = 0;
+
+	for (; *in && (*in != '='); in++) {
+		if (isspace((unsigned char)*in))
+			continue;
+		if (!(c = strchr(b64, *in)))
+			return 0;
+		acc = (acc << 6) | (unsigned long int)(c - b64);
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			if (len >= size)
+				return 0;
+			out[len++] = (unsigned char)((acc >> bits) & 0xff);
+		}
+	}
+	return len;
+}
@@ -27,6 +27,7 @@
 #include <configmake.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
 #include <pwd.h>
@@ -216,6 +217,8 @@ ailsa_clean_cmdb(void *cmdb)
 	ailsa_cmdb_s *i;
 
 	i = cmdb;
+	if (((i->conn) || (i->pool) || (i->stats)) && (i->disconnect))
+		i->disconnect(i);
 	if (i->db)
 		my_free(i->db);
 	if (i->dbtype)
@@ -238,8 +241,6 @@ ailsa_clean_cmdb(void *cmdb)
 		my_free(i->rev);
 	if (i->rndc)
 		my_free(i->rndc);
-	if (i->chkz)
-		my_free(i->chkz);
 	if (i->chkc)
 		my_free(i->chkc);
 	if (i->socket)
@@ -264,6 +265,26 @@ ailsa_clean_cmdb(void *cmdb)
 		my_free(i->toplevelos);
 	if (i->dhcpconf)
 		my_free(i->dhcpconf);
+	if (i->sqlite_journal)
+		my_free(i->sqlite_journal);
+	if (i->sqlite_sync)
+		my_free(i->sqlite_sync);
+	if (i->sql_stats)
+		my_free(i->sql_stats);
+	if (i->sql_stats_file)
+		my_free(i->sql_stats_file);
+	if (i->final_check)
+		my_free(i->final_check);
+	if (i->rndc_key)
+		my_free(i->rndc_key);
+	if (i->rndc_server)
+		my_free(i->rndc_server);
+	if (i->update_key)
+		my_free(i->update_key);
+	if (i->update_server)
+		my_free(i->update_server);
+	if (i->dhcp_reload)
+		my_free(i->dhcp_reload);
 	free(i);
 }
 
@@ -605,13 +626,119 @@ ailsa_fill_string(ailsa_string_s *str, const char *s)
 	size_t len;
 
 	len = strlen(s);
-	if (len + str->len >= str->size)
+	while (len + str->len >= str->size)
 		ailsa_resize_string(str);
 	len++;
 	snprintf(str->string + str->len, len, "%s", s);
 	str->len = strlen(str->string);
 }
 
+// Appends to the string, growing it as needed
+void
+ailsa_printf_string(ailsa_string_s *str, const char *fmt, ...)
+{
+	int len;
+	va_list ap;
+
+	va_start(ap, fmt);
+	len = vsnprintf(str->string + str->len, str->size - str->len, fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return;
+	if ((size_t)len >= str->size - str->len) {
+		while ((size_t)len >= str->size - str->len)
+			ailsa_resize_string(str);
+		va_start(ap, fmt);
+		vsnprintf(str->string + str->len, str->size - str->len, fmt, ap);
+		va_end(ap);
+	}
+	str->len += (size_t)len;
+}
+
+// 0 if file holds exactly what is in str, 1 if it differs, -1 if it cannot be read
+int
+ailsa_cmp_string_file(const char *file, ailsa_string_s *str)
+{
+	if (!(file) || !(str))
+		return -1;
+	int fd, retval = -1;
+	char *old = NULL;
+	size_t done = 0;
+	ssize_t got;
+	struct stat st;
+
+	if ((fd = open(file, O_RDONLY)) == -1)
+		return retval;
+	if (fstat(fd, &st) != 0)
+		goto cleanup;
+	retval = 1;
+	if ((size_t)st.st_size != str->len)
+		goto cleanup;
+	old = ailsa_calloc(str->len + 1, "old in ailsa_cmp_string_file");
+	while (done < str->len) {
+		if ((got = read(fd, old + done, str->len - done)) <= 0)
+			break;
+		done += (size_t)got;
+	}
+	if ((done == str->len) && (memcmp(old, str->string, str->len) == 0))
+		retval = 0;
+	cleanup:
+		close(fd);
+		if (old)
+			my_free(old);
+		return retval;
+}
+
+// str goes to a temporary file beside file, which is synced and renamed over
+// it; a reader never sees half a file, and a crash leaves the old one whole
+int
+ailsa_write_string_file(const char *file, ailsa_string_s *str)
+{
+	if (!(file) || !(str))
+		return AILSA_NO_DATA;
+	char tmp[DOMAIN_LEN + BYTE_LEN];
+	int fd;
+	size_t done = 0;
+	ssize_t put;
+	mode_t mask = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
+
+	if ((snprintf(tmp, sizeof(tmp), "%s.XXXXXX", file)) >= (int)sizeof(tmp)) {
+		ailsa_syslog(LOG_ERR, "Path too long in ailsa_write_string_file");
+		return AILSA_FILE_ERROR;
+	}
+	if ((fd = mkstemp(tmp)) == -1) {
+		ailsa_syslog(LOG_ERR, "Cannot create a temporary file for %s: %s", file, strerror(errno));
+		return AILSA_FILE_ERROR;
+	}
+// mkstemp makes the file 0600; fchmod ignores the umask
+	if (fchmod(fd, mask) != 0)
+		goto cleanup;
+	while (done < str->len) {
+		if ((put = write(fd, str->string + done, str->len - done)) < 0) {
+			if (errno == EINTR)
+				continue;
+			goto cleanup;
+		}
+		done += (size_t)put;
+	}
+	if (fsync(fd) != 0)
+		goto cleanup;
+	if (close(fd) != 0) {
+		fd = -1;
+		goto cleanup;
+	}
+	fd = -1;
+	if (rename(tmp, file) != 0)
+		goto cleanup;
+	return 0;
+	cleanup:
+		ailsa_syslog(LOG_ERR, "Cannot write %s: %s", file, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		unlink(tmp);
+		return AILSA_FILE_ERROR;
+}
+
 int
 cbc_fill_partition_details(AILLIST *list, AILLIST *dest)
 {
@@ -693,7 +820,7 @@ ailsa_clone_data_element(AILELEM *e)
 	data->type = d->type;
 	switch (d->type) {
 	case AILSA_DB_TEXT:
-		u->text = strndup(d->data->text, CONFIG_LEN);
+		u->text = strdup(d->data->text);
 		break;
 #ifdef HAVE_MYSQL
 	case AILSA_DB_TIME:
@@ -702,7 +829,7 @@ ailsa_clone_data_element(AILELEM *e)
 		break;
 #endif
 	default:
-		memcpy(d->data, u, sizeof(ailsa_data_u));
+		memcpy(u, d->data, sizeof(ailsa_data_u));
 		break;
 	}
 	return tmp;
@@ -851,6 +978,22 @@ cmdb_populate_cuser_muser(AILLIST *list)
 	return retval;
 }
 
+// records.ip_addr holds an A record's address as a number, so reverse zone
+// ranges are an index scan. Every other record type gets 0
+int
+cmdb_add_ip_addr_to_list(const char *type, const char *dest, AILLIST *list)
+{
+	if (!(type) || !(dest) || !(list))
+		return AILSA_NO_DATA;
+	uint32_t ip = 0;
+
+	if ((strcmp(type, "A") == 0) && (inet_pton(AF_INET, dest, &ip) == 1))
+		ip = ntohl(ip);
+	else
+		ip = 0;
+	return cmdb_add_number_to_list((unsigned long int)ip, list);
+}
+
 	// The following functions should probably be moved into the ailsasql library
 void
 cmdb_add_os_name_or_alias_to_list(char *os, char *alias, AILLIST *list)
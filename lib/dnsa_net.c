@@ -26,6 +26,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
 #include <syslog.h>
 #include <time.h>
 #include <math.h>
@@ -40,10 +42,27 @@
 #include <netdb.h>
 #include <ifaddrs.h>
 #include <errno.h>
+#include <pthread.h>
 #include <ailsacmdb.h>
 #include <ailsasql.h>
 #include "cmdb_dnsa.h"
 
+// getservbyname returns static data; zone files can be written from several threads
+static pthread_mutex_t serv_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct cmdb_rev_body_s {	// PTR records of every /24 file of a reverse zone
+	ailsa_string_s *body;
+	size_t *off;			// File i is body from off[i] to off[i + 1]
+	unsigned long int index;
+	unsigned long int cur;
+	size_t nibbles;			// Nibbles in an IPv6 zone name; 0 for IPv4
+} cmdb_rev_body_s;
+
+typedef struct cmdb_rev_overlap_s {	// An IPv6 range checked against every reverse zone
+	unsigned char ip[16];
+	unsigned long int prefix;
+	int overlap;
+} cmdb_rev_overlap_s;
 
 /*
  * Temporary variables while I work out how to define these in the
@@ -59,43 +78,59 @@ const char *ubu_amd64_boot = "/main/installer-amd64/current/images/netboot/ubunt
 const char *ubu_new_amd64_boot = "/main/installer-amd64/current/legacy-images/netboot/ubuntu-installer/amd64";
 
 static int
-write_fwd_zone_file(ailsa_cmdb_s *cbc, char *zone);
+write_fwd_zone_file(ailsa_cmdb_s *cbc, char *zone, short int *changed);
 
 static int
-write_rev_zone_file(ailsa_cmdb_s *cbc, char *zone, unsigned long int prefix, unsigned long int index);
+write_rev_zone_files(ailsa_cmdb_s *cbc, char *zone, unsigned long int prefix, unsigned long int index, short int *changed);
 
 static int
-ailsa_check_for_zone_update(ailsa_cmdb_s *cbc, AILLIST *l, char *zone);
+write_rev_record(ailsa_result_s *r, void *ctx);
+
+static void
+cmdb_zone_serial_bump(ailsa_data_s *serial);
 
 static int
-ailsa_check_for_rev_zone_update(ailsa_cmdb_s *cbs, AILLIST *l, char *zone);
+cmdb_zone_serial_update(ailsa_cmdb_s *cbs, const ailsa_sql_query_s query, unsigned long int serial, const char *hash, const char *zone);
+
+static const char *
+cmdb_zone_last_hash(AILLIST *h);
 
 static void
-write_zone_file_header(int fd, AILLIST *n, AILLIST *s, char *master);
+cmdb_zone_hash_text(unsigned long long int hash, char *text);
 
 static void
-write_fwd_header_records(int fd, AILLIST *r, char *zone);
+write_zone_file_header(ailsa_string_s *zf, AILLIST *n, AILLIST *s, char *master);
 
 static void
-write_fwd_records(int fd, AILLIST *r, char *zone);
+write_fwd_header_records(ailsa_string_s *zf, AILLIST *r, char *zone);
 
 static int
-cmdb_validate_fwd_zone(ailsa_cmdb_s *cbc, char *zone, const char *ztype);
+write_fwd_record(ailsa_result_s *r, void *ctx);
 
 static int
-cmdb_validate_rev_zone(ailsa_cmdb_s *cbc, char *zone, const char *ztype, unsigned long int prefix);
+cmdb_validate_fwd_zone(ailsa_cmdb_s *cbc, char *zone, const char *ztype, short int *changed);
 
 static int
-cmdb_check_zone(ailsa_cmdb_s *cbs, char *zone);
+cmdb_validate_rev_zone(ailsa_cmdb_s *cbc, char *zone, const char *ztype, unsigned long int prefix, short int *changed);
 
 static int
-write_glue_records(ailsa_cmdb_s *cbc, int fd, AILLIST *g, const char *zone);
+cmdb_check_zone(ailsa_cmdb_s *cbs, const char *origin, const char *file);
+
+static int
+write_glue_records(ailsa_cmdb_s *cbc, ailsa_string_s *zf, AILLIST *g, const char *zone);
 
 static void
-write_rev_zone_header(int fd, AILLIST *soa, char *hostmaster);
+write_rev_zone_header(ailsa_string_s *zf, AILLIST *soa, char *hostmaster);
 
 static void
-write_rev_zone_records(int fd, AILLIST *soa);
+cmdb_ipv6_nibbles(const char *hex, size_t from, size_t to, char *out);
+
+static int
+rev_zone_overlap_ipv6_row(ailsa_result_s *r, void *ctx);
+
+static int
+get_finish_ipv6(const char *range, unsigned long int prefix, char *addr);
+
 
 static void
 fill_addrtcp(struct addrinfo *c);
@@ -112,22 +147,25 @@ get_net_range(unsigned long int prefix)
         return range;
 }
 
+// changed, if not NULL, is set when the zone content changed and got a new serial
 int
-cmdb_validate_zone(ailsa_cmdb_s *cbc, int type, char *zone, const char *ztype, unsigned long int prefix)
+cmdb_validate_zone(ailsa_cmdb_s *cbc, int type, char *zone, const char *ztype, unsigned long int prefix, short int *changed)
 {
 	if (!(cbc) || !(zone))
 		return AILSA_NO_DATA;
 	int retval;
 
+	if (changed)
+		*changed = 0;
 	switch(type) {
 	case FORWARD_ZONE:
-		if ((retval = cmdb_validate_fwd_zone(cbc, zone, ztype)) != 0) {
+		if ((retval = cmdb_validate_fwd_zone(cbc, zone, ztype, changed)) != 0) {
 			ailsa_syslog(LOG_ERR, "Cannot validate forward zone");
 			return retval;
 		}
 		break;
 	case REVERSE_ZONE:
-		if ((retval = cmdb_validate_rev_zone(cbc, zone, ztype, prefix)) != 0) {
+		if ((retval = cmdb_validate_rev_zone(cbc, zone, ztype, prefix, changed)) != 0) {
 			ailsa_syslog(LOG_ERR, "Cannot validate reverse zone");
 			return retval;
 		}
@@ -141,13 +179,13 @@ cmdb_validate_zone(ailsa_cmdb_s *cbc, int type, char *zone, const char *ztype, u
 }
 
 static int
-cmdb_validate_fwd_zone(ailsa_cmdb_s *cbc, char *zone, const char *ztype)
+cmdb_validate_fwd_zone(ailsa_cmdb_s *cbc, char *zone, const char *ztype, short int *changed)
 {
 	if (!(cbc) || !(zone))
 		return AILSA_NO_DATA;
 	AILLIST *l = ailsa_db_data_list_init();
 	char *command = ailsa_calloc(CONFIG_LEN, "command in cmdb_validate_fwd_zone");
-	int retval;
+	int retval, valid = 1;
 
 	if (ztype) {
 		if (strncmp(ztype, "slave", BYTE_LEN) == 0) {
@@ -158,12 +196,13 @@ cmdb_validate_fwd_zone(ailsa_cmdb_s *cbc, char *zone, const char *ztype)
 			goto validate;
 		}
 	}
-	if ((retval = write_fwd_zone_file(cbc, zone)) != 0) {
+	if ((retval = write_fwd_zone_file(cbc, zone, changed)) != 0) {
 		ailsa_syslog(LOG_ERR, "Cannot write zone file for domain %s", zone);
 		goto cleanup;
 	}
-	if ((retval = cmdb_check_zone(cbc, zone)) != 0) {
+	if ((retval = cmdb_check_zone(cbc, zone, zone)) != 0) {
 		ailsa_syslog(LOG_ERR, "Checking the zone failed");
+		valid = 0;
 		if ((retval = cmdb_add_string_to_list("no", l)) != 0) {
 			ailsa_syslog(LOG_ERR, "Cannot add valid to list");
 			goto cleanup;
@@ -181,6 +220,8 @@ cmdb_validate_fwd_zone(ailsa_cmdb_s *cbc, char *zone, const char *ztype)
 		}
 		if ((retval = ailsa_update_query(cbc, update_queries[FWD_ZONE_VALIDATE], l)) != 0)
 			ailsa_syslog(LOG_ERR, "FWD_ZONE_VALIDATE update query failed");
+		else if (!(valid))
+			retval = AILSA_CHKZONE_FAIL;
 	cleanup:
 		my_free(command);
 		ailsa_list_full_clean(l);
@@ -188,20 +229,25 @@ cmdb_validate_fwd_zone(ailsa_cmdb_s *cbc, char *zone, const char *ztype)
 }
 
 static int
-write_fwd_zone_file(ailsa_cmdb_s *cbc, char *zone)
+write_fwd_zone_file(ailsa_cmdb_s *cbc, char *zone, short int *changed)
 {
 	if (!(cbc) || !(zone))
 		return AILSA_NO_DATA;
 	AILLIST *a = ailsa_db_data_list_init();
 	AILLIST *g = ailsa_db_data_list_init();
+	AILLIST *h = ailsa_db_data_list_init();
 	AILLIST *n = ailsa_db_data_list_init();
 	AILLIST *s = ailsa_db_data_list_init();
 	AILLIST *hr = ailsa_db_data_list_init();
-	AILLIST *r = ailsa_db_data_list_init();
-	int retval, flags, fd;
-	mode_t um, mask;
+	ailsa_string_s *zf = ailsa_calloc(sizeof(ailsa_string_s), "zf in write_fwd_zone_file");
+	ailsa_string_s *body = NULL;
+	int retval, same, bump;
+	size_t hlen;
+	const char *last;
+	char hash[MAC_LEN];
 	char *name = ailsa_calloc(DOMAIN_LEN, "name in write_fwd_zone_file");
 
+	ailsa_init_string(zf);
 	if ((retval = cmdb_add_string_to_list(zone, a)) != 0) {
 		ailsa_syslog(LOG_ERR, "Cannot add zone name to argument list");
 		goto cleanup;
@@ -214,133 +260,134 @@ write_fwd_zone_file(ailsa_cmdb_s *cbc, char *zone)
 		ailsa_syslog(LOG_ERR, "ZONE_SOA_ON_NAME query failed");
 		goto cleanup;
 	}
-	if ((retval = ailsa_check_for_zone_update(cbc, s, zone)) != 0) {
-		ailsa_syslog(LOG_ERR, "Checking for zone updated failed");
+	if (s->total != 6) {
+		ailsa_syslog(LOG_ERR, "Cannot find SOA for zone %s", zone);
+		retval = AILSA_WRONG_LIST_LENGHT;
+		goto cleanup;
+	}
+	if ((retval = ailsa_argument_query(cbc, ZONE_HASH_ON_NAME, a, h)) != 0) {
+		ailsa_syslog(LOG_ERR, "ZONE_HASH_ON_NAME query failed");
 		goto cleanup;
 	}
 	if ((retval = ailsa_argument_query(cbc, NS_MX_SRV_RECORDS, a, hr)) != 0) {
 		ailsa_syslog(LOG_ERR, "NS_MX_SRV_RECORDS query failed");
 		goto cleanup;
 	}
-	if ((retval = ailsa_argument_query(cbc, ZONE_RECORDS_ON_NAME, a, r)) != 0) {
+	if ((retval = ailsa_argument_query(cbc, GLUE_ZONE_ON_ZONE_NAME, a, g)) != 0) {
+		ailsa_syslog(LOG_ERR, "GLUE_ZONE_ON_ZONE_NAME query failed");
+		goto cleanup;
+	}
+	write_zone_file_header(zf, n, s, cbc->hostmaster);
+	hlen = zf->len;
+	write_fwd_header_records(zf, hr, zone);
+	if ((retval = ailsa_query_foreach(cbc, ZONE_RECORDS_ON_NAME, a, write_fwd_record, zf)) != 0) {
 		ailsa_syslog(LOG_ERR, "ZONE_RECORDS_ON_NAME query failed");
 		goto cleanup;
 	}
-	if ((retval = ailsa_argument_query(cbc, GLUE_ZONE_ON_ZONE_NAME, a, g)) != 0) {
-		ailsa_syslog(LOG_ERR, "GLUE_ZONE_ON_ZONE_NAME query failed");
+	if ((retval = write_glue_records(cbc, zf, g, zone)) != 0) {
+		ailsa_syslog(LOG_ERR, "Writing glue records failed");
 		goto cleanup;
 	}
-	um = umask(0);
-	mask = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
-	flags = O_CREAT | O_WRONLY | O_TRUNC;
 	if ((snprintf(name, DOMAIN_LEN, "%s%s", cbc->dir, zone)) >= DOMAIN_LEN)
 		ailsa_syslog(LOG_INFO, "Path truncated in write_fwd_zone_file");
-	if ((fd = open(name, flags, mask)) == -1) {
-		ailsa_syslog(LOG_ERR, "%s", strerror(errno));
-		retval = AILSA_FILE_ERROR;
-		goto cleanup;
+	same = ailsa_cmp_string_file(name, zf);
+	cmdb_zone_hash_text(ailsa_hash_bytes(zf->string, zf->len, AILSA_HASH_SEED), hash);
+// With no hash stored yet, the file on disk is the only record of the last commit
+	last = cmdb_zone_last_hash(h);
+	if ((bump = (last) ? (strcmp(last, hash) != 0) : (same != 0))) {
+		cmdb_zone_serial_bump(s->head->next->data);
+		body = zf;
+		zf = ailsa_calloc(sizeof(ailsa_string_s), "zf in write_fwd_zone_file");
+		ailsa_init_string(zf);
+		write_zone_file_header(zf, n, s, cbc->hostmaster);
+		ailsa_printf_string(zf, "%s", body->string + hlen);
+		cmdb_zone_hash_text(ailsa_hash_bytes(zf->string, zf->len, AILSA_HASH_SEED), hash);
+		same = 1;
+		if (changed)
+			*changed = 1;
+	}
+	if ((bump) || !(last) || (strcmp(((ailsa_data_s *)s->tail->data)->data->text, "yes") == 0)) {
+		if ((retval = cmdb_zone_serial_update(cbc, update_queries[FWD_ZONE_SERIAL_UPDATE],
+		     ((ailsa_data_s *)s->head->next->data)->data->number, hash, zone)) != 0)
+			goto cleanup;
 	}
-	write_zone_file_header(fd, n, s, cbc->hostmaster);
-	write_fwd_header_records(fd, hr, zone);
-	write_fwd_records(fd, r, zone);
-	if ((retval = write_glue_records(cbc, fd, g, zone)) != 0)
-		ailsa_syslog(LOG_ERR, "Writing glue records failed");
-	close(fd);
-	mask = umask(um);
+	if (same != 0)
+		retval = ailsa_write_string_file(name, zf);
 	cleanup:
 		ailsa_list_full_clean(a);
 		ailsa_list_full_clean(g);
+		ailsa_list_full_clean(h);
 		ailsa_list_full_clean(n);
 		ailsa_list_full_clean(s);
 		ailsa_list_full_clean(hr);
-		ailsa_list_full_clean(r);
+		ailsa_clean_string(zf);
+		ailsa_clean_string(body);
 		my_free(name);
 		return retval;
 }
 
-static int
-ailsa_check_for_zone_update(ailsa_cmdb_s *cbs, AILLIST *l, char *zone)
+// generate_zone_serial() is the base, but the serial never goes backwards
+static void
+cmdb_zone_serial_bump(ailsa_data_s *serial)
 {
-	if (!(l) || !(cbs) || !(zone))
-		return AILSA_NO_DATA;
-	if ((l->total % 6) != 0) {
-		ailsa_syslog(LOG_ERR, "Wrong number in list. wanted 6 got %zu", l->total);
-		return AILSA_WRONG_LIST_LENGHT;
-	}
-	int retval = 0;
-	AILLIST *s = ailsa_db_data_list_init();
-	AILELEM *e;
-	unsigned long int serial;
+	unsigned long int now = generate_zone_serial();
 
-	e = l->head;
-	if (strcmp("yes", ((ailsa_data_s *)e->next->next->next->next->next->data)->data->text) == 0) {
-		serial = generate_zone_serial();
-		if (serial <= ((ailsa_data_s *)e->next->data)->data->number)
-			serial = ++((ailsa_data_s *)e->next->data)->data->number;
-		else
-			((ailsa_data_s *)e->next->data)->data->number = serial;
-		if ((retval = cmdb_add_number_to_list(serial, s)) != 0) {
-			ailsa_syslog(LOG_ERR, "Cannot add serial number to list");
-			goto cleanup;
-		}
-		if ((retval = cmdb_add_string_to_list(zone, s)) != 0) {
-			ailsa_syslog(LOG_ERR, "Cannot add zone name to list");
-			goto cleanup;
-		}
-		if ((retval = ailsa_update_query(cbs, update_queries[FWD_ZONE_SERIAL_UPDATE], s)) != 0) {
-			ailsa_syslog(LOG_ERR, "FWD_ZONE_SERIAL_UPDATE query failed");
-			goto cleanup;
-		}
-	}
-
-	cleanup:
-		ailsa_list_full_clean(s);
-		return retval;
+	if (now <= serial->data->number)
+		serial->data->number++;
+	else
+		serial->data->number = now;
 }
 
+// Stores the serial and content hash, and clears the updated flag
 static int
-ailsa_check_for_rev_zone_update(ailsa_cmdb_s *cbs, AILLIST *l, char *zone)
+cmdb_zone_serial_update(ailsa_cmdb_s *cbs, const ailsa_sql_query_s query, unsigned long int serial, const char *hash, const char *zone)
 {
-	if (!(cbs) || !(l) || !(zone))
-		return AILSA_NO_DATA;
-	if ((l->total % 8) != 0) {
-		ailsa_syslog(LOG_ERR, "Wrong number in list. wanted 8 got %zu", l->total);
-		return AILSA_WRONG_LIST_LENGHT;
-	}
-	int retval = 0;
-	AILLIST *s = ailsa_db_data_list_init();
-	AILELEM *e;
-	unsigned long int serial;
+	int retval;
+	AILLIST *l = ailsa_db_data_list_init();
 
-	e = l->head;
-	if (strcmp("yes", ((ailsa_data_s *)e->next->next->next->next->next->next->next->data)->data->text) == 0) {
-		serial = generate_zone_serial();
-		if (serial <= ((ailsa_data_s *)e->next->next->next->data)->data->number)
-			serial = ++((ailsa_data_s *)e->next->next->next->data)->data->number;
-		else
-			((ailsa_data_s *)e->next->next->next->data)->data->number = serial;
-		if ((retval = cmdb_add_number_to_list(serial, s)) != 0) {
-			ailsa_syslog(LOG_ERR, "Cannot add serial number to list");
-			goto cleanup;
-		}
-		if ((retval = cmdb_add_string_to_list(zone, s)) != 0) {
-			ailsa_syslog(LOG_ERR, "Cannot add net range to list");
-			goto cleanup;
-		}
-		if ((retval = ailsa_update_query(cbs, update_queries[REV_ZONE_SERIAL_UPDATE], s)) != 0) {
-			ailsa_syslog(LOG_ERR, "REV_ZONE_SERIAL_UPDATE query failed");
-			goto cleanup;
-		}
+	if ((retval = cmdb_add_number_to_list(serial, l)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot add serial number to list");
+		goto cleanup;
+	}
+	if ((retval = cmdb_add_string_to_list(hash, l)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot add content hash to list");
+		goto cleanup;
 	}
+	if ((retval = cmdb_add_string_to_list(zone, l)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot add zone name to list");
+		goto cleanup;
+	}
+	if ((retval = ailsa_update_query(cbs, query, l)) != 0)
+		ailsa_syslog(LOG_ERR, "Zone serial update query failed");
 	cleanup:
-		ailsa_list_full_clean(s);
+		ailsa_list_full_clean(l);
 		return retval;
 }
 
+// NULL if the zone has no hash stored yet
+static const char *
+cmdb_zone_last_hash(AILLIST *h)
+{
+	ailsa_data_s *d;
+
+	if (!(h) || (h->total != 1))
+		return NULL;
+	d = h->head->data;
+	if ((d->type != AILSA_DB_TEXT) || !(d->data->text) || (strlen(d->data->text) == 0))
+		return NULL;
+	return d->data->text;
+}
+
 static void
-write_zone_file_header(int fd, AILLIST *n, AILLIST *s, char *master)
+cmdb_zone_hash_text(unsigned long long int hash, char *text)
 {
-	if (!(n) || !(s) || !(master) || (fd == 0))
+	snprintf(text, MAC_LEN, "%016llx", hash);
+}
+
+static void
+write_zone_file_header(ailsa_string_s *zf, AILLIST *n, AILLIST *s, char *master)
+{
+	if (!(n) || !(s) || !(master) || !(zf))
 		return;
 	if (s->total != 6) {
 		ailsa_syslog(LOG_ERR, "Cannot write zone file header");
@@ -351,30 +398,30 @@ write_zone_file_header(int fd, AILLIST *n, AILLIST *s, char *master)
 	size_t plen = strlen(pri);
 	size_t slen = strlen(pri);
 	if (pri[plen - 1] != '.')
-		dprintf(fd, "$TTL %lu\n@\tIN\tSOA\t%s.\t%s\t(\n", ((ailsa_data_s *)s->head->data)->data->number, pri, master);
+		ailsa_printf_string(zf, "$TTL %lu\n@\tIN\tSOA\t%s.\t%s\t(\n", ((ailsa_data_s *)s->head->data)->data->number, pri, master);
 	else 
-		dprintf(fd, "$TTL %lu\n@\tIN\tSOA\t%s\t%s\t(\n", ((ailsa_data_s *)s->head->data)->data->number, pri, master);
-	dprintf(fd, "\t\t\t\t%lu\t; Serial\n", ((ailsa_data_s *)s->head->next->data)->data->number);
-	dprintf(fd, "\t\t\t\t%lu\t\t; Refresh\n", ((ailsa_data_s *)s->head->next->next->data)->data->number);
-	dprintf(fd, "\t\t\t\t%lu\t\t; Retry\n", ((ailsa_data_s *)s->head->next->next->next->data)->data->number);
-	dprintf(fd, "\t\t\t\t%lu\t\t; Expire\n", ((ailsa_data_s *)s->head->next->next->next->next->data)->data->number);
-	dprintf(fd, "\t\t\t\t%lu\t\t); TTL\n;\n", ((ailsa_data_s *)s->head->data)->data->number);
+		ailsa_printf_string(zf, "$TTL %lu\n@\tIN\tSOA\t%s\t%s\t(\n", ((ailsa_data_s *)s->head->data)->data->number, pri, master);
+	ailsa_printf_string(zf, "\t\t\t\t%lu\t; Serial\n", ((ailsa_data_s *)s->head->next->data)->data->number);
+	ailsa_printf_string(zf, "\t\t\t\t%lu\t\t; Refresh\n", ((ailsa_data_s *)s->head->next->next->data)->data->number);
+	ailsa_printf_string(zf, "\t\t\t\t%lu\t\t; Retry\n", ((ailsa_data_s *)s->head->next->next->next->data)->data->number);
+	ailsa_printf_string(zf, "\t\t\t\t%lu\t\t; Expire\n", ((ailsa_data_s *)s->head->next->next->next->next->data)->data->number);
+	ailsa_printf_string(zf, "\t\t\t\t%lu\t\t); TTL\n;\n", ((ailsa_data_s *)s->head->data)->data->number);
 	if (pri[plen - 1] != '.')
-		dprintf(fd, "\tIN\tNS\t%s.\n", pri);
+		ailsa_printf_string(zf, "\tIN\tNS\t%s.\n", pri);
 	else
-		dprintf(fd, "\tIN\tNS\t%s\n", pri);
+		ailsa_printf_string(zf, "\tIN\tNS\t%s\n", pri);
 	if (strncmp(sec, "none", 4) != 0) {
 		if (sec[slen - 1] != '.')
-			dprintf(fd, "\tIN\tNS\t%s.\n", sec);
+			ailsa_printf_string(zf, "\tIN\tNS\t%s.\n", sec);
 		else
-			dprintf(fd, "\tIN\tNS\t%s\n", sec);
+			ailsa_printf_string(zf, "\tIN\tNS\t%s\n", sec);
 	}
 }
 
 static void
-write_fwd_header_records(int fd, AILLIST *r, char *zone)
+write_fwd_header_records(ailsa_string_s *zf, AILLIST *r, char *zone)
 {
-	if (!(r) || !(zone) || (fd == 0))
+	if (!(r) || !(zone) || !(zf))
 		return;
 	char *dest, *proto, *service, *host;
 	size_t slen, len = 6;
@@ -391,7 +438,7 @@ write_fwd_header_records(int fd, AILLIST *r, char *zone)
 			e = ailsa_move_down_list(e, len);
 		} else {
 			e = ailsa_move_down_list(e, len - 1);
-			dprintf(fd, "\tIN\tNS\t%s\n", ((ailsa_data_s *)e->data)->data->text);
+			ailsa_printf_string(zf, "\tIN\tNS\t%s\n", ((ailsa_data_s *)e->data)->data->text);
 			e = ailsa_move_down_list(e, 1);
 		}
 	}
@@ -401,7 +448,7 @@ write_fwd_header_records(int fd, AILLIST *r, char *zone)
 			e = ailsa_move_down_list(e, len);
 		} else {
 			e = ailsa_move_down_list(e, len - 2);
-			dprintf(fd, "\tIN\tMX\t%lu\t%s\n", ((ailsa_data_s *)e->data)->data->number,
+			ailsa_printf_string(zf, "\tIN\tMX\t%lu\t%s\n", ((ailsa_data_s *)e->data)->data->number,
 			  ((ailsa_data_s *)e->next->data)->data->text);
 			e = ailsa_move_down_list(e, 2);
 		}
@@ -422,47 +469,40 @@ write_fwd_header_records(int fd, AILLIST *r, char *zone)
 			dest = ((ailsa_data_s *)e->next->next->next->next->next->data)->data->text;
 			slen = strlen(dest);
 			if (dest[slen - 1] != '.') {
-				dprintf(fd, "_%s._%s.%s.\tIN SRV %lu 0 %u\t%s.%s.\n", host, proto, zone, pri, port, dest, zone);
+				ailsa_printf_string(zf, "_%s._%s.%s.\tIN SRV %lu 0 %u\t%s.%s.\n", host, proto, zone, pri, port, dest, zone);
 			} else {
-				dprintf(fd, "_%s._%s.%s.\tIN SRV %lu 0 %u\t%s\n", host, proto, zone, pri, port, dest);
+				ailsa_printf_string(zf, "_%s._%s.%s.\tIN SRV %lu 0 %u\t%s\n", host, proto, zone, pri, port, dest);
 			}
 			e = ailsa_move_down_list(e, len);
 		}
 	}
 }
 
-static void
-write_fwd_records(int fd, AILLIST *r, char *zone)
+static int
+write_fwd_record(ailsa_result_s *r, void *ctx)
 {
-	if (!(r) || !(zone) || (fd == 0))
-		return;
-	size_t len = 3, hlen;
-	char *type, *host, *dest;
-	AILELEM *e;
+	ailsa_string_s *zf = ctx;
+	const char *type, *host, *dest;
 
-	if ((r->total % len) != 0) {
-		ailsa_syslog(LOG_ERR, "Wrong number of data objects in records list: %zu", r->total);
-		return;
-	}
-	e = r->head;
-	while (e) {
-		type = ((ailsa_data_s *)e->data)->data->text;
-		host = ((ailsa_data_s *)e->next->data)->data->text;
-		dest = ((ailsa_data_s *)e->next->next->data)->data->text;
-		hlen = strlen(host);
-		if (hlen < 8)
-			dprintf(fd, "%s\t\tIN\t%s\t%s\n", host, type, dest);
-		else 
-			dprintf(fd, "%s\tIN\t%s\t%s\n", host, type, dest);
-		e = ailsa_move_down_list(e, len);
+	if (r->cols != 3) {
+		ailsa_syslog(LOG_ERR, "Wrong number of columns in records query: %zu", r->cols);
+		return AILSA_WRONG_LIST_LENGHT;
 	}
+	if (!(type = ailsa_result_text(r, 0, 0)) || !(host = ailsa_result_text(r, 0, 1)) ||
+	    !(dest = ailsa_result_text(r, 0, 2)))
+		return 0;
+	if (strlen(host) < 8)
+		ailsa_printf_string(zf, "%s\t\tIN\t%s\t%s\n", host, type, dest);
+	else
+		ailsa_printf_string(zf, "%s\tIN\t%s\t%s\n", host, type, dest);
+	return 0;
 }
 
 static int
-write_glue_records(ailsa_cmdb_s *cbc, int fd, AILLIST *g, const char *zone)
+write_glue_records(ailsa_cmdb_s *cbc, ailsa_string_s *zf, AILLIST *g, const char *zone)
 {
 // This function could return void if we do not allow non-FQDN's in NS records
-	if (!(cbc) || (fd == 0) || !(g) || !(zone))
+	if (!(cbc) || !(zf) || !(g) || !(zone))
 		return AILSA_NO_DATA;
 	int retval = 0;
 	AILLIST *l = ailsa_db_data_list_init();
@@ -480,10 +520,10 @@ write_glue_records(ailsa_cmdb_s *cbc, int fd, AILLIST *g, const char *zone)
 		name = ((ailsa_data_s *)e->data)->data->text;
 		pri = ((ailsa_data_s *)e->next->data)->data->text;
 		sec = ((ailsa_data_s *)e->next->next->data)->data->text;
-		dprintf(fd, "%s.\tIN\tNS\t%s\n", name, pri);
+		ailsa_printf_string(zf, "%s.\tIN\tNS\t%s\n", name, pri);
 		if (sec)
 			if ((strlen(sec) > 0) && (strcmp(sec, "none") != 0))
-				dprintf(fd, "%s.\tIN\tNS\t%s\n", name, sec);
+				ailsa_printf_string(zf, "%s.\tIN\tNS\t%s\n", name, sec);
 // At this point, we should check if the NS records are FQDNs. Alternatively,
 // do not allow non FQDN records
 		e = ailsa_move_down_list(e, len);
@@ -494,31 +534,175 @@ write_glue_records(ailsa_cmdb_s *cbc, int fd, AILLIST *g, const char *zone)
 		return retval;
 }
 
+// origin is the zone name; file is the name of the zone file in DIR
 static int
-cmdb_check_zone(ailsa_cmdb_s *cbs, char *zone)
+cmdb_check_zone(ailsa_cmdb_s *cbs, const char *origin, const char *file)
+{
+	if (!(cbs) || !(origin) || !(file))
+		return AILSA_NO_DATA;
+	char path[DOMAIN_LEN + DOMAIN_LEN];
+
+	snprintf(path, sizeof(path), "%s%s", cbs->dir, file);
+	return ailsa_check_zone_file(origin, path);
+}
+
+// The names named knows a reverse zone by; one per file for split zones
+int
+cmdb_rev_zone_names(char *range, unsigned long int prefix, AILLIST *names)
 {
-	if (!(cbs) || !(zone))
+	if (!(range) || !(names))
 		return AILSA_NO_DATA;
 	int retval;
-	char command[CONFIG_LEN];
+	char net[MAC_LEN], in_addr[HOST_LEN];
+	unsigned long int index, i;
 
-	memset(command, 0, CONFIG_LEN);
-	snprintf(command, CONFIG_LEN, "%s %s %s%s", cbs->chkz, zone, cbs->dir, zone);
-	if (system(command) != 0)
-		retval = AILSA_CHKZONE_FAIL;
-	else
-		retval = 0;
+	if ((retval = get_zone_index(prefix, &index)) != 0)
+		return retval;
+	for (i = 0; i < index; i++) {
+		memset(net, 0, MAC_LEN);
+		memset(in_addr, 0, HOST_LEN);
+		if (index == 1)
+			snprintf(net, MAC_LEN, "%s", range);
+		else if ((retval = get_offset_ip(range, net, prefix, i)) != 0)
+			return retval;
+		get_in_addr_string(in_addr, net, prefix);
+		if ((retval = cmdb_add_string_to_list(in_addr, names)) != 0) {
+			ailsa_syslog(LOG_ERR, "Cannot add zone name to list");
+			return retval;
+		}
+	}
 	return retval;
 }
 
+// With UPDATE_KEY set, send the type records the database now holds for
+// host in zone to the master as one dynamic update, with a new serial.
+// Returns 0 only if the name server took it; otherwise the caller marks
+// the zone updated so the next commit writes it out
+int
+cmdb_push_rrset(ailsa_cmdb_s *cbs, char *zone, const char *type, const char *host)
+{
+	if (!(cbs) || !(zone) || !(type) || !(host) || !(cbs->update_key))
+		return AILSA_NO_DATA;
+	int retval;
+	char line[DOMAIN_LEN], soa[FILE_LEN];
+	char *pri, *dest;
+	const char *owner = host;
+	size_t len = 3, plen;
+	unsigned long int serial, ttl;
+	AILLIST *a = ailsa_db_data_list_init();
+	AILLIST *n = ailsa_db_data_list_init();
+	AILLIST *s = ailsa_db_data_list_init();
+	AILLIST *r = ailsa_db_data_list_init();
+	AILLIST *rdata = ailsa_db_data_list_init();
+	AILELEM *e;
+
+// The zone file puts every MX record on the apex
+	if (strcmp(type, "MX") == 0)
+		owner = "@";
+	if ((retval = cmdb_add_string_to_list(zone, a)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot add zone name to argument list");
+		goto cleanup;
+	}
+	if ((retval = ailsa_argument_query(cbs, NAME_SERVERS_ON_NAME, a, n)) != 0) {
+		ailsa_syslog(LOG_ERR, "NAME_SERVERS_ON_NAME query failed");
+		goto cleanup;
+	}
+	if ((retval = ailsa_argument_query(cbs, ZONE_SOA_ON_NAME, a, s)) != 0) {
+		ailsa_syslog(LOG_ERR, "ZONE_SOA_ON_NAME query failed");
+		goto cleanup;
+	}
+	if ((n->total != 2) || (s->total != 6) || !(cbs->hostmaster)) {
+		ailsa_syslog(LOG_ERR, "Cannot find SOA for zone %s", zone);
+		retval = AILSA_WRONG_LIST_LENGHT;
+		goto cleanup;
+	}
+	if ((retval = cmdb_add_string_to_list(type, a)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot add record type to argument list");
+		goto cleanup;
+	}
+	if ((retval = ailsa_argument_query(cbs, RECORDS_ON_ZONE_TYPE, a, r)) != 0) {
+		ailsa_syslog(LOG_ERR, "RECORDS_ON_ZONE_TYPE query failed");
+		goto cleanup;
+	}
+	for (e = r->head; e; e = ailsa_move_down_list(e, len)) {
+		if ((owner == host) && (strcasecmp(((ailsa_data_s *)e->data)->data->text, host) != 0))
+			continue;
+		dest = ((ailsa_data_s *)e->next->data)->data->text;
+		if (owner == host)
+			snprintf(line, DOMAIN_LEN, "%s", dest);
+		else
+			snprintf(line, DOMAIN_LEN, "%lu %s", ((ailsa_data_s *)e->next->next->data)->data->number, dest);
+		if ((retval = cmdb_add_string_to_list(line, rdata)) != 0) {
+			ailsa_syslog(LOG_ERR, "Cannot add record to update list");
+			goto cleanup;
+		}
+	}
+	cmdb_zone_serial_bump(s->head->next->data);
+	ttl = ((ailsa_data_s *)s->head->data)->data->number;
+	serial = ((ailsa_data_s *)s->head->next->data)->data->number;
+	pri = ((ailsa_data_s *)n->head->data)->data->text;
+	plen = strlen(pri);
+	snprintf(soa, FILE_LEN, "%s%s %s %lu %lu %lu %lu %lu", pri, ((plen > 0) && (pri[plen - 1] == '.')) ? "" : ".",
+	  cbs->hostmaster, serial, ((ailsa_data_s *)s->head->next->next->data)->data->number,
+	  ((ailsa_data_s *)s->head->next->next->next->data)->data->number,
+	  ((ailsa_data_s *)s->head->next->next->next->next->data)->data->number, ttl);
+	if ((retval = ailsa_dns_update(cbs, zone, soa, owner, type, ttl, rdata)) != 0) {
+		if (retval != AILSA_WRONG_TYPE)
+			ailsa_syslog(LOG_INFO, "Zone %s will be sent to the name server on the next commit", zone);
+		goto cleanup;
+	}
+	ailsa_list_full_clean(a);
+	a = ailsa_db_data_list_init();
+	if ((retval = cmdb_add_number_to_list(serial, a)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot add serial number to list");
+		goto cleanup;
+	}
+	if ((retval = cmdb_add_string_to_list(zone, a)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot add zone name to list");
+		goto cleanup;
+	}
+	if ((retval = ailsa_update_query(cbs, update_queries[FWD_ZONE_SERIAL_SET], a)) != 0) {
+		ailsa_syslog(LOG_ERR, "FWD_ZONE_SERIAL_SET query failed");
+		goto cleanup;
+	}
+	ailsa_syslog(LOG_INFO, "Zone %s: %s records for %s sent to the name server; serial %lu", zone, type, owner, serial);
+	cleanup:
+		ailsa_list_full_clean(a);
+		ailsa_list_full_clean(n);
+		ailsa_list_full_clean(s);
+		ailsa_list_full_clean(r);
+		ailsa_list_full_clean(rdata);
+		return retval;
+}
+
+// With FINAL_CHECK=yes, CHKC loads every zone in conf in one run
+int
+cmdb_check_zone_config(ailsa_cmdb_s *cbs, const char *conf)
+{
+	if (!(cbs) || !(conf))
+		return AILSA_NO_DATA;
+	char command[FILE_LEN];
+
+	if (!(cbs->final_check) || (strncmp(cbs->final_check, "yes", BYTE_LEN) != 0))
+		return 0;
+	if (!(cbs->chkc) || !(cbs->bind)) {
+		ailsa_syslog(LOG_ERR, "FINAL_CHECK needs CHKC and BIND set");
+		return AILSA_CONFIG_ERROR;
+	}
+	snprintf(command, FILE_LEN, "%s -z %s%s", cbs->chkc, cbs->bind, conf);
+	if (system(command) != 0)
+		return AILSA_CHKZONE_FAIL;
+	return 0;
+}
+
 static int
-cmdb_validate_rev_zone(ailsa_cmdb_s *cbc, char *zone, const char *ztype, unsigned long int prefix)
+cmdb_validate_rev_zone(ailsa_cmdb_s *cbc, char *zone, const char *ztype, unsigned long int prefix, short int *changed)
 {
 	if (!(cbc) || !(zone))
 		return AILSA_NO_DATA;
 	AILLIST *l = ailsa_db_data_list_init();
-	char addr[MAC_LEN];
-	int retval;
+	char addr[MAC_LEN], in_addr[HOST_LEN];
+	int retval, valid = 1;
 	unsigned long int index, i;
 	if (ztype) {
 		if (strncmp(ztype, "slave", BYTE_LEN) == 0) {
@@ -531,13 +715,16 @@ cmdb_validate_rev_zone(ailsa_cmdb_s *cbc, char *zone, const char *ztype, unsigne
 	}
 	if ((retval = get_zone_index(prefix, &index)) != 0)
 		goto cleanup;
+	if ((retval = write_rev_zone_files(cbc, zone, prefix, index, changed)) != 0)
+		goto cleanup;
 	for (i = 0; i < index; i++) {
 		memset(addr, 0, MAC_LEN);
 		if ((retval = get_offset_ip(zone, addr, prefix, i)) != 0)
 			goto cleanup;
-		if ((retval = write_rev_zone_file(cbc, zone, prefix, i)) != 0)
-			goto cleanup;
-		if ((retval = cmdb_check_zone(cbc, addr)) != 0) {
+		memset(in_addr, 0, HOST_LEN);
+		get_in_addr_string(in_addr, addr, prefix);
+		if ((retval = cmdb_check_zone(cbc, in_addr, addr)) != 0) {
+			valid = 0;
 			if ((retval = cmdb_add_string_to_list("no", l)) != 0)
 				goto cleanup;
 			goto validate;
@@ -553,24 +740,45 @@ cmdb_validate_rev_zone(ailsa_cmdb_s *cbc, char *zone, const char *ztype, unsigne
 		}
 		if ((retval = ailsa_update_query(cbc, update_queries[REV_ZONE_VALIDATE], l)) != 0)
 			ailsa_syslog(LOG_ERR, "REV_ZONE_VALIDATE update query failed");
+		else if (!(valid))
+			retval = AILSA_CHKZONE_FAIL;
 	cleanup:
 		ailsa_list_full_clean(l);
 		return retval;
 }
 
+// Every file of a reverse zone shares its serial and content hash, so all of
+// them are rendered before the serial is settled. Only files that differ
+// from what is on disk are written.
 static int
-write_rev_zone_file(ailsa_cmdb_s *cbc, char *zone, unsigned long int prefix, unsigned long int index)
+write_rev_zone_files(ailsa_cmdb_s *cbc, char *zone, unsigned long int prefix, unsigned long int index, short int *changed)
 {
-	if (!(cbc) || !(zone))
+	if (!(cbc) || !(zone) || (index == 0))
 		return AILSA_NO_DATA;
-	char *name = ailsa_calloc(DOMAIN_LEN, "name in write_rev_zone_file");
-	char *ip = ailsa_calloc(MAC_LEN, "ip in write_rev_zone_file");
-	int retval, flags, fd;
-	mode_t um, mask;
+	char *name = ailsa_calloc(DOMAIN_LEN, "name in write_rev_zone_files");
+	char *ip = ailsa_calloc(MAC_LEN, "ip in write_rev_zone_files");
+	char *differ = ailsa_calloc(index, "differ in write_rev_zone_files");
+	char hash[MAC_LEN];
+	const char *last;
+	int retval, same = 0, bump;
+	unsigned long int i;
+	unsigned long long int sum;
 	AILLIST *a = ailsa_db_data_list_init();
-	AILLIST *r = ailsa_db_data_list_init();
+	AILLIST *h = ailsa_db_data_list_init();
 	AILLIST *s = ailsa_db_data_list_init();
-
+	ailsa_string_s *head = ailsa_calloc(sizeof(ailsa_string_s), "head in write_rev_zone_files");
+	ailsa_string_s *zf = ailsa_calloc(sizeof(ailsa_string_s), "zf in write_rev_zone_files");
+	cmdb_rev_body_s rb;
+
+	memset(&rb, 0, sizeof(cmdb_rev_body_s));
+	rb.body = ailsa_calloc(sizeof(ailsa_string_s), "rb.body in write_rev_zone_files");
+	rb.off = ailsa_calloc(sizeof(size_t) * (index + 1), "rb.off in write_rev_zone_files");
+	rb.index = index;
+	if (strchr(zone, ':'))
+		rb.nibbles = prefix / 4;
+	ailsa_init_string(rb.body);
+	ailsa_init_string(head);
+	ailsa_init_string(zf);
 	if ((retval = cmdb_add_string_to_list(zone, a)) != 0) {
 		ailsa_syslog(LOG_ERR, "Cannot add zone name to argument list");
 		goto cleanup;
@@ -579,36 +787,72 @@ write_rev_zone_file(ailsa_cmdb_s *cbc, char *zone, unsigned long int prefix, uns
 		ailsa_syslog(LOG_ERR, "REV_SOA_ON_NET_RANGE query failed");
 		goto cleanup;
 	}
-	if ((retval = ailsa_check_for_rev_zone_update(cbc, s, zone)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot check or set zone updated");
+	if (s->total != 8) {
+		ailsa_syslog(LOG_ERR, "Cannot find SOA for reverse zone %s", zone);
+		retval = AILSA_WRONG_LIST_LENGHT;
 		goto cleanup;
 	}
-	if ((retval = cmdb_add_number_to_list(index, a)) != 0)
-		goto cleanup;
-	if ((retval = ailsa_argument_query(cbc, REV_RECORDS_ON_NET_RANGE, a, r)) != 0) {
-		ailsa_syslog(LOG_ERR, "REV_RECORDS_ON_NET_RANGE query failed");
+	if ((retval = ailsa_argument_query(cbc, REV_ZONE_HASH_ON_NET_RANGE, a, h)) != 0) {
+		ailsa_syslog(LOG_ERR, "REV_ZONE_HASH_ON_NET_RANGE query failed");
 		goto cleanup;
 	}
-	if ((retval = get_offset_ip(zone, ip, prefix, index)) != 0)
-		goto cleanup;
-	um = umask(0);
-	mask = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
-	flags = O_CREAT | O_WRONLY | O_TRUNC;
-	if ((snprintf(name, DOMAIN_LEN, "%s%s", cbc->dir, ip)) >= DOMAIN_LEN)
-		ailsa_syslog(LOG_INFO, "path truncated in write_rev_zone_file");
-	if ((fd = open(name, flags, mask)) == -1) {
-		ailsa_syslog(LOG_ERR, "Cannot open zone file for writing: %s", strerror(errno));
-		retval = AILSA_FILE_ERROR;
+	if ((retval = ailsa_query_foreach(cbc, REV_RECORDS_ALL_ON_NET_RANGE, a, write_rev_record, &rb)) != 0) {
+		ailsa_syslog(LOG_ERR, "REV_RECORDS_ALL_ON_NET_RANGE query failed");
 		goto cleanup;
 	}
-	write_rev_zone_header(fd, s, cbc->hostmaster);
-	write_rev_zone_records(fd, r);
-	close(fd);
-	mask = umask(um);
+	while (rb.cur < index)
+		rb.off[++rb.cur] = rb.body->len;
+	write_rev_zone_header(head, s, cbc->hostmaster);
+	sum = AILSA_HASH_SEED;
+	for (i = 0; i < index; i++) {
+		memset(ip, 0, MAC_LEN);
+		if ((retval = get_offset_ip(zone, ip, prefix, i)) != 0)
+			goto cleanup;
+		if ((snprintf(name, DOMAIN_LEN, "%s%s", cbc->dir, ip)) >= DOMAIN_LEN)
+			ailsa_syslog(LOG_INFO, "path truncated in write_rev_zone_files");
+		zf->len = 0;
+		ailsa_printf_string(zf, "%s%.*s", head->string, (int)(rb.off[i + 1] - rb.off[i]), rb.body->string + rb.off[i]);
+		if ((differ[i] = (ailsa_cmp_string_file(name, zf) != 0)))
+			same = 1;
+		sum = ailsa_hash_bytes(zf->string, zf->len, sum);
+	}
+	cmdb_zone_hash_text(sum, hash);
+	last = cmdb_zone_last_hash(h);
+	if ((bump = (last) ? (strcmp(last, hash) != 0) : same)) {
+		cmdb_zone_serial_bump(s->head->next->next->next->data);
+		head->len = 0;
+		write_rev_zone_header(head, s, cbc->hostmaster);
+		memset(differ, 1, index);
+		if (changed)
+			*changed = 1;
+	}
+	sum = AILSA_HASH_SEED;
+	for (i = 0; i < index; i++) {
+		zf->len = 0;
+		ailsa_printf_string(zf, "%s%.*s", head->string, (int)(rb.off[i + 1] - rb.off[i]), rb.body->string + rb.off[i]);
+		sum = ailsa_hash_bytes(zf->string, zf->len, sum);
+		if (!(differ[i]))
+			continue;
+		memset(ip, 0, MAC_LEN);
+		if ((retval = get_offset_ip(zone, ip, prefix, i)) != 0)
+			goto cleanup;
+		snprintf(name, DOMAIN_LEN, "%s%s", cbc->dir, ip);
+		if ((retval = ailsa_write_string_file(name, zf)) != 0)
+			goto cleanup;
+	}
+	cmdb_zone_hash_text(sum, hash);
+	if ((bump) || !(last) || (strcmp(((ailsa_data_s *)s->tail->data)->data->text, "yes") == 0))
+		retval = cmdb_zone_serial_update(cbc, update_queries[REV_ZONE_SERIAL_UPDATE],
+		  ((ailsa_data_s *)s->head->next->next->next->data)->data->number, hash, zone);
 	cleanup:
 		ailsa_list_full_clean(a);
-		ailsa_list_full_clean(r);
+		ailsa_list_full_clean(h);
 		ailsa_list_full_clean(s);
+		ailsa_clean_string(head);
+		ailsa_clean_string(zf);
+		ailsa_clean_string(rb.body);
+		my_free(rb.off);
+		my_free(differ);
 		my_free(name);
 		my_free(ip);
 		return retval;
@@ -638,18 +882,27 @@ dnsa_populate_rev_zone(ailsa_cmdb_s *cbc, char *range, char *master, unsigned lo
 		ailsa_syslog(LOG_ERR, "Cannot add net_start to list");
 		goto cleanup;
 	}
-	if ((retval = get_start_finsh_ips(range, prefix, &start, &end)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot get start and end IP's");
-		goto cleanup;
+// start_ip and finish_ip only hold IPv4 addresses; IPv6 zones leave them 0
+	if (strchr(range, ':')) {
+		start = end = 0;
+		if ((retval = get_finish_ipv6(range, prefix, buff)) != 0) {
+			ailsa_syslog(LOG_ERR, "Cannot get end IP for %s", range);
+			goto cleanup;
+		}
+	} else {
+		if ((retval = get_start_finsh_ips(range, prefix, &start, &end)) != 0) {
+			ailsa_syslog(LOG_ERR, "Cannot get start and end IP's");
+			goto cleanup;
+		}
+		if ((retval = convert_bin_ipv4_to_text(end, buff)) != 0) {
+			ailsa_syslog(LOG_ERR, "Cannot convert end IP to text");
+			goto cleanup;
+		}
 	}
 	if ((retval = cmdb_add_number_to_list(start, list)) != 0) {
 		ailsa_syslog(LOG_ERR, "Cannot add start_ip to list");
 		goto cleanup;
 	}
-	if ((retval = convert_bin_ipv4_to_text(end, buff)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot convert end IP to text");
-		goto cleanup;
-	}
 	if ((retval = cmdb_add_string_to_list(buff, list)) != 0) {
 		ailsa_syslog(LOG_ERR, "Cannot add net_finish to list");
 		goto cleanup;
@@ -723,9 +976,9 @@ dnsa_populate_rev_zone(ailsa_cmdb_s *cbc, char *range, char *master, unsigned lo
 }
 
 static void
-write_rev_zone_header(int fd, AILLIST *soa, char *hostmaster)
+write_rev_zone_header(ailsa_string_s *zf, AILLIST *soa, char *hostmaster)
 {
-	if (!(soa) || !(hostmaster) || (fd == 0))
+	if (!(soa) || !(hostmaster) || !(zf))
 		return;
 	if (soa->total != 8) {
 		ailsa_syslog(LOG_ERR, "Wrong number in soa list in write_rev_zone_header: %zu", soa->total);
@@ -736,57 +989,61 @@ write_rev_zone_header(int fd, AILLIST *soa, char *hostmaster)
 	size_t plen = strlen(pri);
 	size_t slen = strlen(sec);
 
-	dprintf(fd, "$TTL %lu\n", ((ailsa_data_s *)soa->head->data)->data->number);
+	ailsa_printf_string(zf, "$TTL %lu\n", ((ailsa_data_s *)soa->head->data)->data->number);
 	if (pri[plen - 1] != '.')
-		dprintf(fd, "@\tIN\tSOA\t%s.\t%s (\n", pri, hostmaster);
+		ailsa_printf_string(zf, "@\tIN\tSOA\t%s.\t%s (\n", pri, hostmaster);
 	else
-		dprintf(fd, "@\tIN\tSOA\t%s\t%s (\n", pri, hostmaster);
-	dprintf(fd, "\t\t\t\t%lu\t; Serial\n", ((ailsa_data_s *)soa->head->next->next->next->data)->data->number);
-	dprintf(fd, "\t\t\t\t%lu\t; Refresh\n",
+		ailsa_printf_string(zf, "@\tIN\tSOA\t%s\t%s (\n", pri, hostmaster);
+	ailsa_printf_string(zf, "\t\t\t\t%lu\t; Serial\n", ((ailsa_data_s *)soa->head->next->next->next->data)->data->number);
+	ailsa_printf_string(zf, "\t\t\t\t%lu\t; Refresh\n",
 		((ailsa_data_s *)soa->head->next->next->next->next->data)->data->number);
-	dprintf(fd, "\t\t\t\t%lu\t; Retry\n",
+	ailsa_printf_string(zf, "\t\t\t\t%lu\t; Retry\n",
 		((ailsa_data_s *)soa->head->next->next->next->next->next->data)->data->number);
-	dprintf(fd, "\t\t\t\t%lu\t; Expire\n",
+	ailsa_printf_string(zf, "\t\t\t\t%lu\t; Expire\n",
 		((ailsa_data_s *)soa->head->next->next->next->next->next->next->data)->data->number);
-	dprintf(fd, "\t\t\t\t%lu\t); Cache TTL\n",
+	ailsa_printf_string(zf, "\t\t\t\t%lu\t); Cache TTL\n",
 		((ailsa_data_s *)soa->head->data)->data->number);
-	dprintf(fd, ";\n");
+	ailsa_printf_string(zf, ";\n");
 	if (pri[plen - 1] != '.')
-		dprintf(fd, "\t\tIN\tNS\t%s.\n", pri);
+		ailsa_printf_string(zf, "\t\tIN\tNS\t%s.\n", pri);
 	else
-		dprintf(fd, "\t\tIN\tNS\t%s\n", pri);
+		ailsa_printf_string(zf, "\t\tIN\tNS\t%s\n", pri);
 	if (sec) {
 		if (sec[slen - 1] != '.')
-			dprintf(fd, "\t\tIN\tNS\t%s.\n", sec);
+			ailsa_printf_string(zf, "\t\tIN\tNS\t%s.\n", sec);
 		else
-			dprintf(fd, "\t\tIN\tNS\t%s\n", sec);
+			ailsa_printf_string(zf, "\t\tIN\tNS\t%s\n", sec);
 	}
 }
 
-static void
-write_rev_zone_records(int fd, AILLIST *soa)
+// Rows come ordered by zone_index; each index starts a new file in the body.
+// IPv6 hosts are the packed address in hex and become nibbles below the zone
+static int
+write_rev_record(ailsa_result_s *r, void *ctx)
 {
-	if (!(soa) || (fd == 0))
-		return;
-	char *host;
-	char *dest;
-	AILELEM *e;
-	ailsa_data_s *d;
+	cmdb_rev_body_s *rb = ctx;
+	const char *host, *dest;
+	char owner[HOST_LEN];
+	unsigned long int i;
 
-	if ((soa->total % 2) != 0) {
-		ailsa_syslog(LOG_ERR, "Wrong number of elements in list: %zu", soa->total);
-		return;
-	}
-	e = soa->head;
-	while (e) {
-		d = e->data;
-		host = d->data->text;
-		e = e->next;
-		d = e->data;
-		dest = d->data->text;
-		dprintf(fd, "%s\tPTR\t%s\n", host, dest);
-		e = e->next;
+	if (r->cols != 3) {
+		ailsa_syslog(LOG_ERR, "Wrong number of columns in reverse records query: %zu", r->cols);
+		return AILSA_WRONG_LIST_LENGHT;
 	}
+	i = ailsa_result_number(r, 0, 0);
+	if (!(host = ailsa_result_text(r, 0, 1)) || !(dest = ailsa_result_text(r, 0, 2)) ||
+	    (i >= rb->index) || (i < rb->cur))
+		return 0;
+	if (rb->nibbles > 0) {
+		if (strlen(host) != 32)
+			return 0;
+		cmdb_ipv6_nibbles(host, rb->nibbles, 32, owner);
+		host = owner;
+	}
+	while (rb->cur < i)
+		rb->off[++rb->cur] = rb->body->len;
+	ailsa_printf_string(rb->body, "%s\tPTR\t%s\n", host, dest);
+	return 0;
 }
 
 int
@@ -795,14 +1052,16 @@ cmdb_get_port_number(char *proto, char *service, unsigned int *port)
 	if (!(proto) || !(service) || !(port))
 		return AILSA_NO_DATA;
 	int retval = 0;
-	struct servent *res = getservbyname(service, proto);
+	struct servent *res;
 
-	if (!(res)) {
+	pthread_mutex_lock(&serv_lock);
+	if (!(res = getservbyname(service, proto))) {
 		ailsa_syslog(LOG_ERR, "%s", strerror(errno));
 		retval = -1;
 	} else {
 		*port = ntohs((uint16_t)res->s_port);
 	}
+	pthread_mutex_unlock(&serv_lock);
 	return retval;
 }
 
@@ -810,12 +1069,12 @@ unsigned long int
 generate_zone_serial(void)
 {
         time_t now;
-        struct tm *lctime;
+        struct tm tm, *lctime;
         char sday[SERVICE_LEN], smonth[SERVICE_LEN], syear[SERVICE_LEN], sserial[HOST_LEN];
         unsigned long int serial;
 
         now = time(0);
-        if (!(lctime = localtime(&now))) {
+        if (!(lctime = localtime_r(&now, &tm))) {
 		ailsa_syslog(LOG_ERR, "Get time failed");
 		return 0;
 	}
@@ -1173,8 +1432,18 @@ get_in_addr_string(char *in_addr, char range[], unsigned long int prefix)
 	size_t len;
 	char *tmp, *line, *classless;
 	char louisa[] = ".in-addr.arpa";
+	char hex[MAC_LEN + 1];
+	unsigned char ip[16];
 	int c, i;
 
+	if (strchr(range, ':')) {
+		if (convert_text_ipv6_to_bin(ip, range) != 0)
+			return;
+		convert_bin_ipv6_to_hex(ip, hex);
+		cmdb_ipv6_nibbles(hex, 0, prefix / 4, in_addr);
+		strcat(in_addr, ".ip6.arpa");
+		return;
+	}
 	c = '.';
 	i = 0;
 	tmp = 0;
@@ -1303,7 +1572,6 @@ add_forward_zone(ailsa_cmdb_s *dc, char *domain, const char *type, const char *m
 {
 	if (!(dc) || !(domain))
 		return AILSA_NO_DATA;
-	char *command = ailsa_calloc(CONFIG_LEN, "command in add_forward_zone");
 	int retval;
 	unsigned int query = INSERT_FORWARD_ZONE;
 	AILLIST *l = ailsa_db_data_list_init();
@@ -1331,7 +1599,7 @@ add_forward_zone(ailsa_cmdb_s *dc, char *domain, const char *type, const char *m
 			ailsa_syslog(LOG_ERR, "INSERT_FORWARD_ZONE query failed");
 			goto cleanup;
 		}
-		if ((retval = cmdb_validate_zone(dc, FORWARD_ZONE, domain, type, 0)) != 0) {
+		if ((retval = cmdb_validate_zone(dc, FORWARD_ZONE, domain, type, 0, NULL)) != 0) {
 			ailsa_syslog(LOG_ERR, "Cannot validate zone %s", domain);
 			goto cleanup;
 		}
@@ -1339,13 +1607,10 @@ add_forward_zone(ailsa_cmdb_s *dc, char *domain, const char *type, const char *m
 			ailsa_syslog(LOG_ERR, "Cannot write forward zones config");
 			goto cleanup;
 		}
-		snprintf(command, CONFIG_LEN, "%s reload", dc->rndc);
-		if ((retval = system(command)) != 0)
-			ailsa_syslog(LOG_ERR, "Reload of nameserver failed");
+		retval = ailsa_rndc_reload(dc, NULL, 1);
 	}
 	cleanup:
 		ailsa_list_full_clean(l);
-		my_free(command);
 		return retval;
 }
 
@@ -1356,17 +1621,26 @@ add_reverse_zone(ailsa_cmdb_s *dc, char *range, const char *type, char *master,
 	if (!(dc) || !(range) || (prefix == 0))
 		return AILSA_NO_DATA;
 
-	char *command = ailsa_calloc(CONFIG_LEN, "command in add_reverse_zone");
 	int retval;
 	AILLIST *rev = ailsa_db_data_list_init();
 	AILLIST *rid = ailsa_db_data_list_init();
 	unsigned long int start, end;
+	unsigned char ip[16];
 
-	if ((retval = get_start_finsh_ips(range, prefix, &start, &end)) != 0)
-		goto cleanup;
-	if ((retval = check_for_rev_zone_overlap(dc, start, end)) != 0) {
-		ailsa_syslog(LOG_ERR, "Reverse zone %s overlaps", range);
-		goto cleanup;
+	if (strchr(range, ':')) {
+		if ((retval = check_ipv6_rev_zone_range(range, prefix, ip)) != 0)
+			goto cleanup;
+		if ((retval = check_for_rev_zone_overlap_ipv6(dc, ip, prefix)) != 0) {
+			ailsa_syslog(LOG_ERR, "Reverse zone %s overlaps", range);
+			goto cleanup;
+		}
+	} else {
+		if ((retval = get_start_finsh_ips(range, prefix, &start, &end)) != 0)
+			goto cleanup;
+		if ((retval = check_for_rev_zone_overlap(dc, start, end)) != 0) {
+			ailsa_syslog(LOG_ERR, "Reverse zone %s overlaps", range);
+			goto cleanup;
+		}
 	}
 	if ((retval = dnsa_populate_rev_zone(dc, range, master, prefix, rev)) != 0) {
 		ailsa_syslog(LOG_ERR, "Cannot create list for DB insert");
@@ -1376,7 +1650,7 @@ add_reverse_zone(ailsa_cmdb_s *dc, char *range, const char *type, char *master,
 		ailsa_syslog(LOG_ERR, "INSERT_REVERSE_ZONE query failed");
 		goto cleanup;
 	}
-	if ((retval = cmdb_validate_zone(dc, REVERSE_ZONE, range, type, prefix)) != 0) {
+	if ((retval = cmdb_validate_zone(dc, REVERSE_ZONE, range, type, prefix, NULL)) != 0) {
 		ailsa_syslog(LOG_ERR, "Unable to validate new zone %s", range);
 		goto cleanup;
 	}
@@ -1384,12 +1658,9 @@ add_reverse_zone(ailsa_cmdb_s *dc, char *range, const char *type, char *master,
 		ailsa_syslog(LOG_ERR, "Cannot write reverse zones configuration");
 		goto cleanup;
 	}
-	snprintf(command, CONFIG_LEN, "%s reload", dc->rndc);
-	if ((retval = system(command)) != 0)
-		ailsa_syslog(LOG_ERR, "Reload of nameserver failed!");
+	retval = ailsa_rndc_reload(dc, NULL, 1);
 
 	cleanup:
-		my_free(command);
 		ailsa_list_full_clean(rev);
 		ailsa_list_full_clean(rid);
 		return retval;
@@ -1853,7 +2124,15 @@ get_offset_ip(const char *range, char *addr, unsigned long int prefix, unsigned
         unsigned long int ip;
         unsigned long int third = 256;
         unsigned long int second = 256 * 256;
+        unsigned long int first = 256 * 256 * 256;
 
+// An IPv6 reverse zone is always one file, named for its range
+        if (strchr(range, ':')) {
+                if (index > 0)
+                        return AILSA_IP_CONVERT_FAILED;
+                snprintf(addr, MAC_LEN, "%s", range);
+                return 0;
+        }
         if ((retval = convert_text_ipv4_to_bin(&ip, range)) != 0)
                 return retval;
         if ((prefix > 16) && (prefix <= 24)) {
@@ -1863,7 +2142,8 @@ get_offset_ip(const char *range, char *addr, unsigned long int prefix, unsigned
                 if (index > 0)
                         ip += (second * index);
         } else if ((prefix == 8)) {
-                ;
+                if (index > 0)
+                        ip += (first * index);
         } else {
                 return AILSA_IP_CONVERT_FAILED;
         }
@@ -1901,3 +2181,169 @@ get_start_finsh_ips(const char *range, unsigned long int prefix, unsigned long i
                 my_free(ip);
                 return retval;
 }
+
+int
+convert_text_ipv6_to_bin(unsigned char *ip, const char *addr)
+{
+	if (!(ip) || !(addr))
+		return AILSA_NO_DATA;
+
+	if (inet_pton(AF_INET6, addr, ip) != 1) {
+		ailsa_syslog(LOG_ERR, "IPv6 address to binary conversion failed");
+		return AILSA_IP_CONVERT_FAILED;
+	}
+	return 0;
+}
+
+// The packed address as 32 lower case hex digits. hex needs 33 bytes
+void
+convert_bin_ipv6_to_hex(const unsigned char *ip, char *hex)
+{
+	const char digits[] = "0123456789abcdef";
+	size_t i;
+
+	for (i = 0; i < 16; i++) {
+		hex[i * 2] = digits[ip[i] >> 4];
+		hex[(i * 2) + 1] = digits[ip[i] & 0x0f];
+	}
+	hex[32] = '\0';
+}
+
+int
+convert_hex_ipv6_to_bin(unsigned char *ip, const char *hex)
+{
+	if (!(ip) || !(hex))
+		return AILSA_NO_DATA;
+	const char digits[] = "0123456789abcdef";
+	const char *hi, *lo;
+	size_t i;
+
+	if (strlen(hex) != 32)
+		return AILSA_IP_CONVERT_FAILED;
+	for (i = 0; i < 16; i++) {
+		if (!(hi = strchr(digits, tolower(hex[i * 2]))) ||
+		    !(lo = strchr(digits, tolower(hex[(i * 2) + 1]))))
+			return AILSA_IP_CONVERT_FAILED;
+		ip[i] = (unsigned char)(((hi - digits) << 4) | (lo - digits));
+	}
+	return 0;
+}
+
+// 1 if the first prefix bits of ip and net are the same
+int
+cmdb_ipv6_in_range(const unsigned char *ip, const unsigned char *net, unsigned long int prefix)
+{
+	size_t bytes = prefix / 8;
+	unsigned char mask;
+
+	if (prefix > 128)
+		return 0;
+	if (memcmp(ip, net, bytes) != 0)
+		return 0;
+	if ((prefix % 8) == 0)
+		return 1;
+	mask = (unsigned char)(0xff << (8 - (prefix % 8)));
+	return (ip[bytes] & mask) == (net[bytes] & mask);
+}
+
+// IPv6 reverse zones are cut on a nibble boundary, from /32 to /64
+int
+check_ipv6_rev_zone_range(const char *range, unsigned long int prefix, unsigned char *ip)
+{
+	if (!(range) || !(ip))
+		return AILSA_NO_DATA;
+	unsigned char net[16];
+	int retval;
+
+	if ((prefix < 32) || (prefix > 64) || ((prefix % 4) != 0))
+		return AILSA_PREFIX_OUT_OF_RANGE;
+	if ((retval = convert_text_ipv6_to_bin(ip, range)) != 0)
+		return retval;
+	memset(net, 0, sizeof(net));
+	memcpy(net, ip, prefix / 8);
+	if ((prefix % 8) != 0)
+		net[prefix / 8] = ip[prefix / 8] & 0xf0;
+	if (memcmp(net, ip, sizeof(net)) != 0) {
+		ailsa_syslog(LOG_ERR, "Range %s has bits set past /%lu", range, prefix);
+		return AILSA_INPUT_INVALID;
+	}
+	return 0;
+}
+
+int
+check_for_rev_zone_overlap_ipv6(ailsa_cmdb_s *cbc, const unsigned char *ip, unsigned long int prefix)
+{
+	if (!(cbc) || !(ip))
+		return AILSA_NO_DATA;
+	int retval;
+	cmdb_rev_overlap_s ov;
+
+	memset(&ov, 0, sizeof(cmdb_rev_overlap_s));
+	memcpy(ov.ip, ip, sizeof(ov.ip));
+	ov.prefix = prefix;
+	if ((retval = ailsa_query_foreach(cbc, REV_ZONE_RANGES, NULL, rev_zone_overlap_ipv6_row, &ov)) != 0) {
+		ailsa_syslog(LOG_ERR, "REV_ZONE_RANGES query failed");
+		return retval;
+	}
+	if (ov.overlap)
+		retval = AILSA_REV_ZONE_OVERLAP;
+	return retval;
+}
+
+// Two ranges overlap when they match on the shorter of their prefixes
+static int
+rev_zone_overlap_ipv6_row(ailsa_result_s *r, void *ctx)
+{
+	cmdb_rev_overlap_s *ov = ctx;
+	const char *range, *text;
+	unsigned char ip[16];
+	unsigned long int prefix;
+
+	if (!(range = ailsa_result_text(r, 0, 0)) || !(strchr(range, ':')))
+		return 0;
+	if (inet_pton(AF_INET6, range, ip) != 1)
+		return 0;
+	if ((text = ailsa_result_text(r, 0, 1)))
+		prefix = strtoul(text, NULL, 10);
+	else
+		prefix = ailsa_result_number(r, 0, 1);
+	if (prefix > ov->prefix)
+		prefix = ov->prefix;
+	if (cmdb_ipv6_in_range(ip, ov->ip, prefix))
+		ov->overlap = 1;
+	return 0;
+}
+
+static int
+get_finish_ipv6(const char *range, unsigned long int prefix, char *addr)
+{
+	unsigned char ip[16];
+	unsigned long int i;
+	int retval;
+
+	if ((retval = convert_text_ipv6_to_bin(ip, range)) != 0)
+		return retval;
+	for (i = prefix; i < 128; i++)
+		ip[i / 8] |= (unsigned char)(0x80 >> (i % 8));
+	if (!(inet_ntop(AF_INET6, ip, addr, CONFIG_LEN))) {
+		ailsa_syslog(LOG_ERR, "IP address to text conversion failed");
+		return AILSA_IP_CONVERT_FAILED;
+	}
+	return 0;
+}
+
+// Nibbles from hex[to - 1] back to hex[from], dot separated. out needs 64 bytes
+static void
+cmdb_ipv6_nibbles(const char *hex, size_t from, size_t to, char *out)
+{
+	char *p = out;
+	size_t i;
+
+	for (i = to; i > from; i--) {
+		*p++ = hex[i - 1];
+		*p++ = '.';
+	}
+	if (p > out)
+		p--;
+	*p = '\0';
+}
@@ -0,0 +1,732 @@
+/*
+ *
+ *  alisacmdb: Alisatech Configuration Management Database library
+ *  Copyright (C) 2015 Iain M Conochie <iain-AT-thargoid.co.uk>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *  dnsupdate.c
+ *
+ *  RFC 2136 dynamic update client, signed with TSIG (RFC 8945)
+ *
+ *  Each update replaces one RRset on the master: it deletes the RRset and
+ *  adds back every record cmdb holds for it, so the name server ends up
+ *  with what is in the database whether a record was added or removed.
+ *  An SOA with the serial cmdb will store goes in the same message, which
+ *  stops named picking its own. named applies all of it or none of it.
+ *
+ */
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <ailsacmdb.h>
+
+enum {			// DNS wire format
+	DNS_HEADER_LEN = 12,
+	DNS_OPCODE_UPDATE = 5,
+	DNS_CLASS_IN = 1,
+	DNS_CLASS_ANY = 255,
+	DNS_TYPE_A = 1,
+	DNS_TYPE_NS = 2,
+	DNS_TYPE_CNAME = 5,
+	DNS_TYPE_SOA = 6,
+	DNS_TYPE_MX = 15,
+	DNS_TYPE_TXT = 16,
+	DNS_TYPE_AAAA = 28,
+	DNS_TYPE_TSIG = 250,
+	DNS_NAME_LEN = 255,
+	DNS_LABEL_LEN = 63,
+	DNS_STRING_LEN = 255,
+	DNS_UDP_LEN = 512,
+	DNS_MAX_MESSAGE = 65535,
+	DNS_FUDGE = 300,
+	DNS_TRIES = 3,
+	DNS_TIMEOUT = 5
+};
+
+typedef struct dns_buf_s {	// Message being built
+	unsigned char data[DNS_MAX_MESSAGE];
+	size_t len;
+	int error;
+} dns_buf_s;
+
+typedef struct dns_key_s {	// TSIG key from UPDATE_KEY
+	char name[DOMAIN_LEN];
+	unsigned char secret[RNDC_SECRET_LEN];
+	size_t slen;
+} dns_key_s;
+
+static const char *tsig_alg = "hmac-sha256.";
+
+static const char *dns_rcodes[] = {
+	"NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED",
+	"YXDOMAIN", "YXRRSET", "NXRRSET", "NOTAUTH", "NOTZONE"
+};
+
+static unsigned int
+dns_type(const char *type);
+
+static const char *
+dns_rcode(unsigned int rcode);
+
+static void
+dns_put(dns_buf_s *b, const void *data, size_t len);
+
+static void
+dns_put_byte(dns_buf_s *b, size_t c);
+
+static void
+dns_put_uint16(dns_buf_s *b, unsigned int n);
+
+static void
+dns_put_uint32(dns_buf_s *b, unsigned long int n);
+
+static void
+dns_set_uint16(unsigned char *p, size_t n);
+
+static unsigned int
+dns_get_uint16(const unsigned char *p);
+
+static int
+dns_put_name(dns_buf_s *b, const char *name, const char *origin);
+
+static int
+dns_put_rdata(dns_buf_s *b, unsigned int type, const char *text, const char *origin);
+
+static int
+dns_put_txt(dns_buf_s *b, const char *text);
+
+static void
+dns_put_tsig_vars(dns_buf_s *b, dns_key_s *k, unsigned long long int now, unsigned int fudge);
+
+static int
+dns_tsig_sign(dns_buf_s *b, dns_key_s *k, unsigned char *mac);
+
+static int
+dns_check_reply(dns_key_s *k, const unsigned char *query, const unsigned char *mac, const unsigned char *reply, size_t len);
+
+static size_t
+dns_skip_name(const unsigned char *m, size_t len, size_t off);
+
+static int
+dns_exchange(ailsa_cmdb_s *cbs, dns_buf_s *b, unsigned char *reply, size_t *len);
+
+static int
+dns_exchange_tcp(const struct addrinfo *a, dns_buf_s *b, unsigned char *reply, size_t *len);
+
+static int
+dns_write(int fd, const unsigned char *data, size_t len);
+
+static int
+dns_read(int fd, unsigned char *data, size_t len);
+
+// Replace the owner/type RRset in zone with rdata, in presentation format
+// ("10 mail" for MX). An empty list deletes the RRset. soa, if not NULL,
+// is the new SOA rdata. Returns AILSA_WRONG_TYPE for types not sent this way
+int
+ailsa_dns_update(ailsa_cmdb_s *cbs, const char *zone, const char *soa, const char *owner, const char *type, unsigned long int ttl, AILLIST *rdata)
+{
+	if (!(cbs) || !(zone) || !(owner) || !(type) || !(cbs->update_key))
+		return AILSA_NO_DATA;
+	int retval = 0;
+	unsigned int rtype, count = 1;
+	unsigned char mac[AILSA_SHA256_LEN];
+	unsigned char *reply = NULL;
+	const char *text;
+	size_t i, len;
+	struct timespec ts;
+	AILELEM *e;
+	dns_buf_s *b = NULL;
+	dns_key_s *k = NULL;
+
+	if ((rtype = dns_type(type)) == 0)
+		return AILSA_WRONG_TYPE;
+	k = ailsa_calloc(sizeof(dns_key_s), "k in ailsa_dns_update");
+	if ((retval = ailsa_read_key_file(cbs->update_key, k->name, DOMAIN_LEN, k->secret, &(k->slen))) != 0)
+		goto cleanup;
+	for (i = 0; k->name[i]; i++)
+		k->name[i] = (char)tolower((unsigned char)k->name[i]);
+	b = ailsa_calloc(sizeof(dns_buf_s), "b in ailsa_dns_update");
+	clock_gettime(CLOCK_REALTIME, &ts);
+	dns_put_uint16(b, (unsigned int)(ts.tv_nsec ^ getpid()) & 0xffff);
+	dns_put_uint16(b, DNS_OPCODE_UPDATE << 11);
+	dns_put_uint16(b, 1);
+	dns_put_uint16(b, 0);
+	dns_put_uint16(b, 0);
+	dns_put_uint16(b, 0);
+// Zone section
+	dns_put_name(b, zone, NULL);
+	dns_put_uint16(b, DNS_TYPE_SOA);
+	dns_put_uint16(b, DNS_CLASS_IN);
+	if (soa) {
+		dns_put_name(b, zone, NULL);
+		dns_put_uint16(b, DNS_TYPE_SOA);
+		dns_put_uint16(b, DNS_CLASS_IN);
+		dns_put_uint32(b, ttl);
+		if (dns_put_rdata(b, DNS_TYPE_SOA, soa, zone) != 0) {
+			ailsa_syslog(LOG_ERR, "Cannot encode SOA %s for zone %s", soa, zone);
+			retval = AILSA_STRING_FAIL;
+			goto cleanup;
+		}
+		count++;
+	}
+// Delete the RRset, then add back what the database has
+	if (dns_put_name(b, owner, zone) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot encode name %s in zone %s", owner, zone);
+		retval = AILSA_STRING_FAIL;
+		goto cleanup;
+	}
+	dns_put_uint16(b, rtype);
+	dns_put_uint16(b, DNS_CLASS_ANY);
+	dns_put_uint32(b, 0);
+	dns_put_uint16(b, 0);
+	for (e = (rdata) ? rdata->head : NULL; e; e = e->next) {
+		text = ((ailsa_data_s *)e->data)->data->text;
+		dns_put_name(b, owner, zone);
+		dns_put_uint16(b, rtype);
+		dns_put_uint16(b, DNS_CLASS_IN);
+		dns_put_uint32(b, ttl);
+		if (dns_put_rdata(b, rtype, text, zone) != 0) {
+			ailsa_syslog(LOG_ERR, "Cannot encode %s record %s for %s", type, text, owner);
+			retval = AILSA_STRING_FAIL;
+			goto cleanup;
+		}
+		count++;
+	}
+	dns_set_uint16(b->data + 8, count);
+	if ((retval = dns_tsig_sign(b, k, mac)) != 0)
+		goto cleanup;
+	if (b->error != 0) {
+		ailsa_syslog(LOG_ERR, "Update for %s %s in zone %s is too large", owner, type, zone);
+		retval = AILSA_BUFFER_TOO_SMALL;
+		goto cleanup;
+	}
+	reply = ailsa_calloc(DNS_MAX_MESSAGE, "reply in ailsa_dns_update");
+	if ((retval = dns_exchange(cbs, b, reply, &len)) != 0)
+		goto cleanup;
+	if ((retval = dns_check_reply(k, b->data, mac, reply, len)) != 0)
+		ailsa_syslog(LOG_ERR, "Update for %s %s in zone %s failed", owner, type, zone);
+	cleanup:
+		if (k)
+			memset(k, 0, sizeof(dns_key_s));
+		my_free(k);
+		my_free(b);
+		my_free(reply);
+		return retval;
+}
+
+static unsigned int
+dns_type(const char *type)
+{
+	if (strcmp(type, "A") == 0)
+		return DNS_TYPE_A;
+	else if (strcmp(type, "AAAA") == 0)
+		return DNS_TYPE_AAAA;
+	else if (strcmp(type, "CNAME") == 0)
+		return DNS_TYPE_CNAME;
+	else if (strcmp(type, "MX") == 0)
+		return DNS_TYPE_MX;
+	else if (strcmp(type, "TXT") == 0)
+		return DNS_TYPE_TXT;
+	return 0;
+}
+
+static const char *
+dns_rcode(unsigned int rcode)
+{
+	if (rcode < sizeof(dns_rcodes) / sizeof(dns_rcodes[0]))
+		return dns_rcodes[rcode];
+	return "unknown rcode";
+}
+
+// Message building. b->error is set, rather than overrunning the buffer
+
+static void
+dns_put(dns_buf_s *b, const void *data, size_t len)
+{
+	if (b->len + len > DNS_MAX_MESSAGE) {
+		b->error = 1;
+		return;
+	}
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+}
+
+static void
+dns_put_byte(dns_buf_s *b, size_t c)
+{
+	unsigned char p = (unsigned char)(c & 0xff);
+
+	dns_put(b, &p, 1);
+}
+
+static void
+dns_put_uint16(dns_buf_s *b, unsigned int n)
+{
+	unsigned char p[2];
+
+	p[0] = (unsigned char)((n >> 8) & 0xff);
+	p[1] = (unsigned char)(n & 0xff);
+	dns_put(b, p, 2);
+}
+
+static void
+dns_put_uint32(dns_buf_s *b, unsigned long int n)
+{
+	dns_put_uint16(b, (unsigned int)((n >> 16) & 0xffff));
+	dns_put_uint16(b, (unsigned int)(n & 0xffff));
+}
+
+static void
+dns_set_uint16(unsigned char *p, size_t n)
+{
+	p[0] = (unsigned char)((n >> 8) & 0xff);
+	p[1] = (unsigned char)(n & 0xff);
+}
+
+static unsigned int
+dns_get_uint16(const unsigned char *p)
+{
+	return ((unsigned int)p[0] << 8) | (unsigned int)p[1];
+}
+
+// "@" is the origin; a name ending in . is absolute; anything else is
+// relative to origin. With origin NULL, name is taken as absolute
+static int
+dns_put_name(dns_buf_s *b, const char *name, const char *origin)
+{
+	char full[DOMAIN_LEN * 2];
+	const char *p, *end;
+	size_t len, total = 1;
+
+	if (!(origin) || ((*name) && (name[strlen(name) - 1] == '.')))
+		snprintf(full, sizeof(full), "%s", name);
+	else if ((strcmp(name, "@") == 0) || (*name == '\0'))
+		snprintf(full, sizeof(full), "%s", origin);
+	else
+		snprintf(full, sizeof(full), "%s.%s", name, origin);
+	for (p = full; *p; p = (*end) ? end + 1 : end) {
+		end = strchr(p, '.');
+		if (!(end))
+			end = p + strlen(p);
+		len = (size_t)(end - p);
+		if ((len == 0) || (len > DNS_LABEL_LEN) || ((total += len + 1) > DNS_NAME_LEN)) {
+			b->error = 1;
+			return AILSA_STRING_FAIL;
+		}
+		dns_put_byte(b, len);
+		dns_put(b, p, len);
+	}
+	dns_put_byte(b, 0);
+	return 0;
+}
+
+// Returns non zero if text cannot be encoded as type
+static int
+dns_put_rdata(dns_buf_s *b, unsigned int type, const char *text, const char *origin)
+{
+	int retval = 0;
+	unsigned char addr[sizeof(struct in6_addr)];
+	char one[DOMAIN_LEN], two[DOMAIN_LEN];
+	unsigned long int n[5];
+	size_t i, start = b->len;
+
+	dns_put_uint16(b, 0);
+	switch (type) {
+	case DNS_TYPE_A:
+		if ((retval = (inet_pton(AF_INET, text, addr) != 1)) == 0)
+			dns_put(b, addr, 4);
+		break;
+	case DNS_TYPE_AAAA:
+		if ((retval = (inet_pton(AF_INET6, text, addr) != 1)) == 0)
+			dns_put(b, addr, 16);
+		break;
+	case DNS_TYPE_NS:
+	case DNS_TYPE_CNAME:
+		retval = dns_put_name(b, text, origin);
+		break;
+	case DNS_TYPE_MX:
+		if ((retval = ((sscanf(text, "%lu %255s", n, one) != 2) || (n[0] > 65535))) == 0) {
+			dns_put_uint16(b, (unsigned int)n[0]);
+			retval = dns_put_name(b, one, origin);
+		}
+		break;
+	case DNS_TYPE_TXT:
+		retval = dns_put_txt(b, text);
+		break;
+	case DNS_TYPE_SOA:
+		if ((retval = (sscanf(text, "%255s %255s %lu %lu %lu %lu %lu", one, two, n, n + 1, n + 2, n + 3, n + 4) != 7)) == 0) {
+			if ((retval = dns_put_name(b, one, origin)) == 0)
+				retval = dns_put_name(b, two, origin);
+			for (i = 0; i < 5; i++)
+				dns_put_uint32(b, n[i]);
+		}
+		break;
+	default:
+		retval = 1;
+		break;
+	}
+	dns_set_uint16(b->data + start, b->len - start - 2);
+	return retval;
+}
+
+// Quoted strings as in a zone file; otherwise each word is one string
+static int
+dns_put_txt(dns_buf_s *b, const char *text)
+{
+	unsigned char s[DNS_STRING_LEN];
+	size_t len;
+	int count = 0;
+
+	while (*text) {
+		if (isspace((unsigned char)*text)) {
+			text++;
+			continue;
+		}
+		len = 0;
+		if (*text == '"') {
+			for (text++; (*text) && (*text != '"'); text++) {
+				if ((*text == '\\') && (text[1]))
+					text++;
+				if (len == DNS_STRING_LEN)
+					return 1;
+				s[len++] = (unsigned char)*text;
+			}
+			if (*text++ != '"')
+				return 1;
+		} else {
+			for (; (*text) && !(isspace((unsigned char)*text)); text++) {
+				if (len == DNS_STRING_LEN)
+					return 1;
+				s[len++] = (unsigned char)*text;
+			}
+		}
+		dns_put_byte(b, len);
+		dns_put(b, s, len);
+		count++;
+	}
+	return count == 0;
+}
+
+// TSIG variables: the parts of the TSIG record covered by the MAC
+static void
+dns_put_tsig_vars(dns_buf_s *b, dns_key_s *k, unsigned long long int now, unsigned int fudge)
+{
+	dns_put_name(b, k->name, NULL);
+	dns_put_uint16(b, DNS_CLASS_ANY);
+	dns_put_uint32(b, 0);
+	dns_put_name(b, tsig_alg, NULL);
+	dns_put_uint16(b, (unsigned int)((now >> 32) & 0xffff));
+	dns_put_uint32(b, (unsigned long int)(now & 0xffffffff));
+	dns_put_uint16(b, fudge);
+	dns_put_uint16(b, 0);
+	dns_put_uint16(b, 0);
+}
+
+// Appends the TSIG record; mac is kept to check the reply
+static int
+dns_tsig_sign(dns_buf_s *b, dns_key_s *k, unsigned char *mac)
+{
+	unsigned long long int now = (unsigned long long int)time(NULL);
+	size_t start;
+	dns_buf_s *d = ailsa_calloc(sizeof(dns_buf_s), "d in dns_tsig_sign");
+
+	dns_put(d, b->data, b->len);
+	dns_put_tsig_vars(d, k, now, DNS_FUDGE);
+	ailsa_hmac_sha256(k->secret, k->slen, d->data, d->len, mac);
+	my_free(d);
+	if (dns_put_name(b, k->name, NULL) != 0) {
+		ailsa_syslog(LOG_ERR, "Bad TSIG key name %s", k->name);
+		return AILSA_CONFIG_ERROR;
+	}
+	dns_put_uint16(b, DNS_TYPE_TSIG);
+	dns_put_uint16(b, DNS_CLASS_ANY);
+	dns_put_uint32(b, 0);
+	start = b->len;
+	dns_put_uint16(b, 0);
+	dns_put_name(b, tsig_alg, NULL);
+	dns_put_uint16(b, (unsigned int)((now >> 32) & 0xffff));
+	dns_put_uint32(b, (unsigned long int)(now & 0xffffffff));
+	dns_put_uint16(b, DNS_FUDGE);
+	dns_put_uint16(b, AILSA_SHA256_LEN);
+	dns_put(b, mac, AILSA_SHA256_LEN);
+	dns_put(b, b->data, 2);
+	dns_put_uint16(b, 0);
+	dns_put_uint16(b, 0);
+	if (b->error == 0) {
+		dns_set_uint16(b->data + start, b->len - start - 2);
+		dns_set_uint16(b->data + 10, 1);
+	}
+	return 0;
+}
+
+// The reply must be signed with our key, over our MAC and the reply
+// without its TSIG record, before its rcode is believed
+static int
+dns_check_reply(dns_key_s *k, const unsigned char *query, const unsigned char *mac, const unsigned char *reply, size_t len)
+{
+	int retval = AILSA_DNS_UPDATE_FAIL;
+	unsigned int i, count, rcode, error, fudge, msize;
+	unsigned long long int signed_at, now = (unsigned long long int)time(NULL);
+	unsigned char check[AILSA_SHA256_LEN];
+	size_t off = DNS_HEADER_LEN, tsig = 0, rr, rdata;
+	dns_buf_s *d = NULL;
+
+	if ((len < DNS_HEADER_LEN) || (memcmp(reply, query, 2) != 0) || !(reply[2] & 0x80)) {
+		ailsa_syslog(LOG_ERR, "Malformed reply from name server");
+		return retval;
+	}
+	rcode = reply[3] & 0x0f;
+	count = dns_get_uint16(reply + 4);
+	for (i = 0; (i < count) && (off > 0); i++)
+		if ((off = dns_skip_name(reply, len, off)) > 0)
+			off = (off + 4 <= len) ? off + 4 : 0;
+	count = dns_get_uint16(reply + 6) + dns_get_uint16(reply + 8) + dns_get_uint16(reply + 10);
+	for (i = 0; (i < count) && (off > 0); i++) {
+		rr = off;
+		if (((off = dns_skip_name(reply, len, off)) == 0) || (off + 10 > len)) {
+			off = 0;
+			break;
+		}
+		rdata = off + 10;
+		if ((i + 1 == count) && (dns_get_uint16(reply + off) == DNS_TYPE_TSIG) && (dns_get_uint16(reply + 10) > 0))
+			tsig = rr;
+		off = rdata + dns_get_uint16(reply + off + 8);
+		if (off > len)
+			off = 0;
+	}
+	if (off == 0) {
+		ailsa_syslog(LOG_ERR, "Malformed reply from name server");
+		return retval;
+	}
+	if (tsig == 0) {
+		ailsa_syslog(LOG_ERR, "Unsigned reply from name server: %s", dns_rcode(rcode));
+		return retval;
+	}
+// TSIG rdata: algorithm, time signed, fudge, MAC, original id, error, other
+	off = dns_skip_name(reply, len, tsig) + 10;
+	if (((off = dns_skip_name(reply, len, off)) == 0) || (off + 10 > len)) {
+		ailsa_syslog(LOG_ERR, "Malformed TSIG in reply from name server");
+		return retval;
+	}
+	signed_at = ((unsigned long long int)dns_get_uint16(reply + off) << 32) |
+	  ((unsigned long long int)dns_get_uint16(reply + off + 2) << 16) | dns_get_uint16(reply + off + 4);
+	fudge = dns_get_uint16(reply + off + 6);
+	msize = dns_get_uint16(reply + off + 8);
+	off += 10;
+	if (off + msize + 6 > len) {
+		ailsa_syslog(LOG_ERR, "Malformed TSIG in reply from name server");
+		return retval;
+	}
+	if ((error = dns_get_uint16(reply + off + msize + 2)) != 0) {
+		ailsa_syslog(LOG_ERR, "Name server rejected our TSIG: error %u", error);
+		return retval;
+	}
+	if (msize != AILSA_SHA256_LEN) {
+		ailsa_syslog(LOG_ERR, "Reply is not signed with hmac-sha256");
+		return retval;
+	}
+	d = ailsa_calloc(sizeof(dns_buf_s), "d in dns_check_reply");
+	dns_put_uint16(d, AILSA_SHA256_LEN);
+	dns_put(d, mac, AILSA_SHA256_LEN);
+	dns_put(d, reply, tsig);
+	dns_set_uint16(d->data + AILSA_SHA256_LEN + 2 + 10, dns_get_uint16(reply + 10) - 1);
+	dns_put_tsig_vars(d, k, signed_at, fudge);
+	ailsa_hmac_sha256(k->secret, k->slen, d->data, d->len, check);
+	if (memcmp(check, reply + off, AILSA_SHA256_LEN) != 0) {
+		ailsa_syslog(LOG_ERR, "Reply from name server has a bad TSIG signature");
+	} else if (((now > signed_at) ? now - signed_at : signed_at - now) > fudge) {
+		ailsa_syslog(LOG_ERR, "Reply from name server was signed outside the time window");
+	} else if (rcode != 0) {
+		ailsa_syslog(LOG_ERR, "Name server refused the update: %s", dns_rcode(rcode));
+	} else {
+		retval = 0;
+	}
+	my_free(d);
+	return retval;
+}
+
+// Returns the offset after the name; 0 if it runs off the message
+static size_t
+dns_skip_name(const unsigned char *m, size_t len, size_t off)
+{
+	while (off < len) {
+		if (m[off] == 0)
+			return off + 1;
+		if ((m[off] & 0xc0) == 0xc0)
+			return (off + 2 <= len) ? off + 2 : 0;
+		off += (size_t)m[off] + 1;
+	}
+	return 0;
+}
+
+// UDP to UPDATE_SERVER, or PRIDNS; TCP if the message or the reply is too
+// big for a datagram
+static int
+dns_exchange(ailsa_cmdb_s *cbs, dns_buf_s *b, unsigned char *reply, size_t *len)
+{
+	int retval = 0, fd = -1, tries;
+	char port[SERVICE_LEN];
+	const char *server = (cbs->update_server) ? cbs->update_server : cbs->pridns;
+	ssize_t n = -1;
+	struct addrinfo hints, *res = NULL, *p;
+	struct timeval tv;
+
+	if (!(server) || (*server == '\0')) {
+		ailsa_syslog(LOG_ERR, "No UPDATE_SERVER or PRIDNS to send updates to");
+		return AILSA_NO_DATA;
+	}
+	snprintf(port, SERVICE_LEN, "%u", (cbs->update_port > 0) ? cbs->update_port : 53);
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	if ((retval = getaddrinfo(server, port, &hints, &res)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot resolve name server %s: %s", server, gai_strerror(retval));
+		return AILSA_GETADDR_FAIL;
+	}
+	if (b->len > DNS_UDP_LEN) {
+		retval = dns_exchange_tcp(res, b, reply, len);
+		goto cleanup;
+	}
+	tv.tv_sec = DNS_TIMEOUT;
+	tv.tv_usec = 0;
+	for (p = res; p; p = p->ai_next) {
+		if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0)
+			continue;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		if (connect(fd, p->ai_addr, p->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	if (fd < 0) {
+		ailsa_syslog(LOG_ERR, "Cannot connect to name server %s port %s: %s", server, port, strerror(errno));
+		retval = AILSA_NO_CONNECT;
+		goto cleanup;
+	}
+// Anything that is not the reply to this message is ignored
+	for (tries = 0; tries < DNS_TRIES; tries++) {
+		if (send(fd, b->data, b->len, 0) < 0)
+			break;
+		while ((n = recv(fd, reply, DNS_MAX_MESSAGE, 0)) >= 0)
+			if ((n >= DNS_HEADER_LEN) && (memcmp(reply, b->data, 2) == 0))
+				break;
+		if (n >= 0)
+			break;
+		if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+			break;
+	}
+	if (n < 0) {
+		ailsa_syslog(LOG_ERR, "No reply from name server %s port %s: %s", server, port, strerror(errno));
+		retval = AILSA_NO_CONNECT;
+		goto cleanup;
+	}
+	*len = (size_t)n;
+	if (reply[2] & 0x02)
+		retval = dns_exchange_tcp(res, b, reply, len);
+	cleanup:
+		if (fd >= 0)
+			close(fd);
+		freeaddrinfo(res);
+		return retval;
+}
+
+static int
+dns_exchange_tcp(const struct addrinfo *a, dns_buf_s *b, unsigned char *reply, size_t *len)
+{
+	int retval, fd = -1;
+	unsigned char head[2];
+	struct timeval tv;
+	const struct addrinfo *p;
+
+	tv.tv_sec = DNS_TIMEOUT;
+	tv.tv_usec = 0;
+	for (p = a; p; p = p->ai_next) {
+		if ((fd = socket(p->ai_family, SOCK_STREAM, IPPROTO_TCP)) < 0)
+			continue;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		if (connect(fd, p->ai_addr, p->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	if (fd < 0) {
+		ailsa_syslog(LOG_ERR, "Cannot connect to name server over TCP: %s", strerror(errno));
+		return AILSA_NO_CONNECT;
+	}
+	dns_set_uint16(head, b->len);
+	if (((retval = dns_write(fd, head, 2)) != 0) || ((retval = dns_write(fd, b->data, b->len)) != 0))
+		goto cleanup;
+	if ((retval = dns_read(fd, head, 2)) != 0)
+		goto cleanup;
+	*len = dns_get_uint16(head);
+	retval = dns_read(fd, reply, *len);
+	cleanup:
+		close(fd);
+		return retval;
+}
+
+static int
+dns_write(int fd, const unsigned char *data, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, data, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			ailsa_syslog(LOG_ERR, "Cannot write to name server: %s", strerror(errno));
+			return AILSA_NO_CONNECT;
+		}
+		data += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+static int
+dns_read(int fd, unsigned char *data, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = read(fd, data, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			ailsa_syslog(LOG_ERR, "Cannot read from name server: %s", strerror(errno));
+			return AILSA_NO_CONNECT;
+		} else if (n == 0) {
+			ailsa_syslog(LOG_ERR, "Name server closed the connection");
+			return AILSA_NO_CONNECT;
+		}
+		data += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
@@ -154,7 +154,7 @@ If you wish to remove all services (for a server or customer) add the -f option\
 	else if (retval == AILSA_NO_OPTION)
 		ailsa_syslog(LOG_ERR, "Partition option specified but no option supplied");
 	else if (retval == AILSA_PREFIX_OUT_OF_RANGE)
-		ailsa_syslog(LOG_ERR, "Prefix provided out of range. Allow ranges: 8, 16, 24 and above");
+		ailsa_syslog(LOG_ERR, "Prefix provided out of range. Allow ranges: 8, 16, 24 and above; IPv6 /32 to /64 in steps of 4");
 	else if (retval == AILSA_VERSION)
 		ailsa_syslog(LOG_ERR, "%s: %s", program, VERSION);
 	else if (retval == AILSA_NO_URI)
@@ -351,7 +351,9 @@ display_cbc_usage(void)
 	printf("-r: remove build for server\n-u: show defaults\n");
 	printf("-w: write build files\n\n");
 	printf("Display and write options:\n");
-	printf("cbc ( -d | -w ) -n <server name>\n\n");
+	printf("cbc ( -d | -w ) -n <server name>\n");
+	printf("cbc -w ( -n <server name>[,<server name>...] | -A )\n");
+	printf("With -w, names may be globs (quote them); -A writes every build\n\n");
 	printf("Remove options:\n");
 	printf("cbc -r [ -g ] -n <server name>\n");
 	printf("-g will remove the build IP from DB. Dangerous if server is still online\n\n");
@@ -460,10 +462,11 @@ display_dnsa_usage(void)
 	printf("\n\t-h -n -i\n");
 	printf("-g: remove preferred A record\n\t -i\n");
 	printf("-l: list zones\n\t( -F | -R )\n");
+	printf("-f: import records from a zone file or CSV\n\t-f file -n\n");
 	printf("-m: add CNAME to root domain\n\t-h -n [ -j top-level domain ]\n");
 	printf("-r: remove record\n\t-h -n -t\n");
-	printf("-u: display IP's with multiple A records\n\t( -n domain | -i ip-address )\n");
-	printf("-w: commit valid zones on nameserver\n\t( -F | -R )\n");
+	printf("-u: display IP's with multiple A records\n\t[ -n range[,range...] | -i ip-address ]\n");
+	printf("-w: commit valid zones on nameserver\n\t( -F | -R ) [ -W workers ]\n");
 	printf("-x: remove zone\n\t( -F |-R ) -n\n");
 	printf("-z: add zone\n\t( -F | -R [-p] | -G -N [ -I ] ) [ -S -M ] -n\n\n");
 	printf("Zone details:\n");
@@ -631,6 +634,24 @@ ailsa_strerror(int type)
 	case AILSA_NO_FIELDS:
 		message = "No feilds to select in MySQL query";
 		break;
+	case AILSA_TRANSACTION_FAIL:
+		message = "Cannot begin, commit or roll back transaction";
+		break;
+	case AILSA_PG_CONN_FAIL:
+		message = "Cannot connect to PostgreSQL server";
+		break;
+	case AILSA_POOL_FAIL:
+		message = "Cannot set up database connection pool";
+		break;
+	case AILSA_RNDC_FAIL:
+		message = "Name server control channel command failed";
+		break;
+	case AILSA_DNS_UPDATE_FAIL:
+		message = "Dynamic DNS update refused by the name server";
+		break;
+	case AILSA_IMPORT_INVALID:
+		message = "Cannot parse the import file";
+		break;
 	default:
 		message = "Unknown type error";
 		break;
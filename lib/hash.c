@@ -35,6 +35,36 @@
 #include <fcntl.h>
 #include <ailsacmdb.h>
 
+typedef struct ailsa_sha256_s {
+	unsigned int h[8];
+	unsigned char block[AILSA_SHA256_BLOCK];
+	size_t used;
+	unsigned long long int total;
+} ailsa_sha256_s;
+
+static const unsigned int sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void
+sha256_init(ailsa_sha256_s *s);
+
+static void
+sha256_block(ailsa_sha256_s *s, const unsigned char *p);
+
+static void
+sha256_update(ailsa_sha256_s *s, const unsigned char *data, size_t len);
+
+static void
+sha256_final(ailsa_sha256_s *s, unsigned char *out);
+
 // Hash tables functions
 
 // Hash a character string key
@@ -57,6 +87,20 @@ ailsa_hash(const void *key)
 	return val;
 }
 
+// 64 bit FNV-1a. Start with AILSA_HASH_SEED; pass the last result to carry on
+unsigned long long int
+ailsa_hash_bytes(const void *data, size_t len, unsigned long long int hash)
+{
+	const unsigned char *ptr = data;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= ptr[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
 int
 ailsa_hash_init(AILHASH *htbl, unsigned int buckets,
 		unsigned int (*h)(const void *key),
@@ -96,7 +140,7 @@ ailsa_hash_insert(AILHASH *htbl, void *data, const char *key)
 	if (ailsa_hash_lookup(htbl, &data, key) == 0)
 		return 1;
 	bucket = htbl->h(key) % htbl->buckets;
-	if ((retval = ailsa_list_ins_next(&htbl->table[bucket], NULL, data)) == 0)
+	if ((retval = ailsa_list_ins_prev(&htbl->table[bucket], htbl->table[bucket].head, data)) == 0)
 		htbl->size++;
 	return retval;
 }
@@ -104,21 +148,19 @@ ailsa_hash_insert(AILHASH *htbl, void *data, const char *key)
 int
 ailsa_hash_remove(AILHASH *htbl, void **data, const char *key)
 {
-	AILELEM 	*em, *prev;
+	AILELEM 	*em;
 	unsigned int	bucket;
 
 	bucket = htbl->h(key) % htbl->buckets;
-	prev = NULL;
 	for (em = htbl->table[bucket].head; em != NULL; em = em->next) {
 		if (htbl->match(*data, em->data)) {
-			if (ailsa_list_remove(&htbl->table[bucket], prev, data) == 0) {
+			if (ailsa_list_remove(&htbl->table[bucket], em, data) == 0) {
 				htbl->size--;
 				return 0;
 			} else {
 				return 1;
 			}
 		}
-		prev = em;
 	}
 	return -1;
 }
@@ -139,3 +181,138 @@ ailsa_hash_lookup(AILHASH *htbl, void **data, const char *key)
 	return -1;
 }
 
+// SHA-256 (FIPS 180-4) and HMAC-SHA256 (RFC 2104), for TSIG and rndc keys
+
+void
+ailsa_hmac_sha256(const unsigned char *key, size_t klen, const unsigned char *data, size_t len, unsigned char *mac)
+{
+	unsigned char k[AILSA_SHA256_BLOCK], pad[AILSA_SHA256_BLOCK];
+	size_t i;
+	ailsa_sha256_s s;
+
+	memset(k, 0, AILSA_SHA256_BLOCK);
+	if (klen > AILSA_SHA256_BLOCK) {
+		sha256_init(&s);
+		sha256_update(&s, key, klen);
+		sha256_final(&s, k);
+	} else {
+		memcpy(k, key, klen);
+	}
+	for (i = 0; i < AILSA_SHA256_BLOCK; i++)
+		pad[i] = k[i] ^ 0x36;
+	sha256_init(&s);
+	sha256_update(&s, pad, AILSA_SHA256_BLOCK);
+	sha256_update(&s, data, len);
+	sha256_final(&s, mac);
+	for (i = 0; i < AILSA_SHA256_BLOCK; i++)
+		pad[i] = k[i] ^ 0x5c;
+	sha256_init(&s);
+	sha256_update(&s, pad, AILSA_SHA256_BLOCK);
+	sha256_update(&s, mac, AILSA_SHA256_LEN);
+	sha256_final(&s, mac);
+	memset(k, 0, AILSA_SHA256_BLOCK);
+	memset(pad, 0, AILSA_SHA256_BLOCK);
+}
+
+# define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void
+sha256_init(ailsa_sha256_s *s)
+{
+	static const unsigned int h[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	memcpy(s->h, h, sizeof(h));
+	s->used = 0;
+	s->total = 0;
+}
+
+static void
+sha256_block(ailsa_sha256_s *s, const unsigned char *p)
+{
+	unsigned int w[64], a, b, c, d, e, f, g, h, t1, t2;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = ((unsigned int)p[i * 4] << 24) | ((unsigned int)p[i * 4 + 1] << 16) |
+		  ((unsigned int)p[i * 4 + 2] << 8) | (unsigned int)p[i * 4 + 3];
+	for (i = 16; i < 64; i++)
+		w[i] = (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7] +
+		  (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+	a = s->h[0];
+	b = s->h[1];
+	c = s->h[2];
+	d = s->h[3];
+	e = s->h[4];
+	f = s->h[5];
+	g = s->h[6];
+	h = s->h[7];
+	for (i = 0; i < 64; i++) {
+		t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+	s->h[0] += a;
+	s->h[1] += b;
+	s->h[2] += c;
+	s->h[3] += d;
+	s->h[4] += e;
+	s->h[5] += f;
+	s->h[6] += g;
+	s->h[7] += h;
+}
+
+# undef ROR
+
+static void
+sha256_update(ailsa_sha256_s *s, const unsigned char *data, size_t len)
+{
+	size_t n;
+
+	s->total += len;
+	while (len > 0) {
+		n = AILSA_SHA256_BLOCK - s->used;
+		if (n > len)
+			n = len;
+		memcpy(s->block + s->used, data, n);
+		s->used += n;
+		data += n;
+		len -= n;
+		if (s->used == AILSA_SHA256_BLOCK) {
+			sha256_block(s, s->block);
+			s->used = 0;
+		}
+	}
+}
+
+static void
+sha256_final(ailsa_sha256_s *s, unsigned char *out)
+{
+	unsigned long long int bits = s->total * 8;
+	unsigned char pad = 0x80;
+	unsigned char len[8];
+	int i;
+
+	sha256_update(s, &pad, 1);
+	pad = 0;
+	while (s->used != AILSA_SHA256_BLOCK - 8)
+		sha256_update(s, &pad, 1);
+	for (i = 0; i < 8; i++)
+		len[i] = (unsigned char)((bits >> (56 - (i * 8))) & 0xff);
+	sha256_update(s, len, 8);
+	for (i = 0; i < 8; i++) {
+		out[i * 4] = (unsigned char)((s->h[i] >> 24) & 0xff);
+		out[i * 4 + 1] = (unsigned char)((s->h[i] >> 16) & 0xff);
+		out[i * 4 + 2] = (unsigned char)((s->h[i] >> 8) & 0xff);
+		out[i * 4 + 3] = (unsigned char)(s->h[i] & 0xff);
+	}
+}
@@ -40,6 +40,9 @@
 #ifdef HAVE_SQLITE3
 # include <sqlite3.h>
 #endif /* HAVE_SQLITE3 */
+#ifdef HAVE_LIBPQ
+# include <libpq-fe.h>
+#endif /* HAVE_LIBPQ */
 
 #include <ailsacmdb.h>
 #include <ailsasql.h>
@@ -93,8 +96,56 @@ const char *basic_queries[] = {
 "SELECT s.name, i.username, i.cuser, i.muser, i.ctime, i.mtime FROM server s \
   LEFT JOIN identity i WHERE s.server_id = i.server_id", // IDENTITIES
 "SELECT server_id, username, cuser, muser, ctime, mtime from identity", // IDENTITIES_NO_SERVER_NAME
+"SELECT z.name, z.updated, z.type, COUNT(r.id), MAX(r.mtime) FROM zones z \
+  LEFT JOIN records r ON r.zone = z.id GROUP BY z.id, z.name, z.updated, z.type", // FWD_ZONE_COMMIT_STATE
+"SELECT z.net_range, z.updated, z.type, z.prefix, COUNT(r.rev_record_id), MAX(r.mtime) FROM rev_zones z \
+  LEFT JOIN rev_records r ON r.rev_zone = z.rev_zone_id \
+  GROUP BY z.rev_zone_id, z.net_range, z.updated, z.type, z.prefix", // REV_ZONE_COMMIT_STATE
+"SELECT net_range, prefix, start_ip, finish_ip FROM rev_zones", // REV_ZONE_RANGES
+"SELECT d.destination, d.c, p.fqdn FROM (SELECT destination, COUNT(*) AS c FROM records \
+  WHERE type = 'A' GROUP BY destination HAVING COUNT(*) > 1) d \
+  LEFT JOIN preferred_a p ON p.ip = d.destination ORDER BY d.destination", // DUP_IP_PREF_A
+"SELECT destination, r.id, host, name FROM records r LEFT JOIN zones z ON z.id = r.zone \
+  WHERE r.type = 'AAAA'", // AAAA_RECORDS
+"SELECT COUNT(*) FROM build", // BUILD_COUNT
+"SELECT DISTINCT s.name, s.server_id FROM build b JOIN server s ON s.server_id = b.server_id \
+  ORDER BY s.name", // SERVER_IDS_WITH_BUILD
+"SELECT server_id, domainname, ip FROM build_ip", // IP_NET_ON_ALL_BUILDS
+"SELECT b.server_id, alias, os_version, arch FROM build b \
+  JOIN build_os bo ON bo.os_id = b.os_id", // BUILD_OS_DETAILS_ON_ALL_BUILDS
+"SELECT b.server_id, country, locale, keymap, timezone FROM build b \
+  JOIN locale l ON l.locale_id = b.locale_id", // FULL_LOCALE_DETAILS_ON_ALL_BUILDS
+"SELECT b.server_id, boot_line, net_inst_int, arg, url, build_type FROM build b \
+  LEFT JOIN build_os bo on b.os_id = bo.os_id LEFT JOIN build_type bt on bt.bt_id = bo.bt_id", // TFTP_DETAILS_ON_ALL_BUILDS
+"SELECT b.server_id, build_type FROM build b JOIN build_os bo ON bo.os_id = b.os_id \
+  JOIN build_type bt ON bt.bt_id = bo.bt_id", // BUILD_TYPE_ON_ALL_BUILDS
+"SELECT b.server_id, locale, language, keymap, country, net_inst_int, ip, ns, netmask, gateway, config_ntp, ntp_server, hostname, domain, mirror, bt.alias, ver_alias, os_version, arch, url \
+ FROM build b LEFT JOIN build_ip bi ON b.ip_id = bi.ip_id \
+ LEFT JOIN build_os bo ON b.os_id = bo.os_id \
+ LEFT JOIN build_domain bd ON bd.bd_id = bi.bd_id \
+ LEFT JOIN locale l ON b.locale_id = l.locale_id \
+ LEFT JOIN build_type bt ON bt.bt_id = bo.bt_id", // BUILD_DETAILS_ON_ALL_BUILDS
+"SELECT s.name, username, pass, hash, identity_id FROM identity i \
+  JOIN server s ON s.server_id = i.server_id ORDER BY identity_id", // IDENTITIES_ON_ALL_BUILDS
+"SELECT server_id, device, lvm FROM disk_dev", // DISK_DEV_DETAILS_ON_ALL_BUILDS
+"SELECT b.server_id, minimum, maximum, priority, mount_point, filesystem, logical_volume FROM build b \
+  JOIN default_part dp ON dp.def_scheme_id = b.def_scheme_id ORDER BY dp.def_part_id", // BUILD_PARTITIONS_ON_ALL_BUILDS
+"SELECT b.server_id, package FROM packages p \
+  JOIN build b ON p.varient_id = b.varient_id AND p.os_id = b.os_id ORDER BY p.pack_id", // BUILD_PACKAGES_ON_ALL_BUILDS
+"SELECT bd.server_id, sp.name, spa.field, spa.type, spc.arg FROM system_package_args spa \
+  LEFT JOIN system_package_conf spc ON spa.syspack_arg_id = spc.syspack_arg_id \
+  LEFT JOIN system_packages sp ON sp.syspack_id = spc.syspack_id \
+  LEFT JOIN build_ip bd ON spc.bd_id = bd.bd_id \
+  WHERE bd.server_id IS NOT NULL ORDER BY sp.name, spa.field", // SYSTEM_PACKAGES_ON_ALL_BUILDS
+"SELECT b.server_id, domain, bt.alias, bt.url FROM build_domain bd \
+  JOIN build_ip bi ON bd.bd_id = bi.bd_id \
+  JOIN build b ON b.ip_id = bi.ip_id \
+  JOIN build_os bo ON bo.os_id = b.os_id \
+  JOIN build_type bt ON bo.bt_id = bt.bt_id", // DOMAIN_BUILD_ALIAS_ON_ALL_BUILDS
 };
 
+const unsigned int basic_query_total = sizeof(basic_queries) / sizeof(basic_queries[0]);
+
 const struct ailsa_sql_query_s argument_queries[] = {
 	{ // CONTACT_DETAILS_ON_COID
 "SELECT co.name, co.phone, co.email FROM customer cu INNER JOIN contacts co ON co.cust_id = cu.cust_id WHERE cu.coid = ?",
@@ -480,9 +531,9 @@ const struct ailsa_sql_query_s argument_queries[] = {
 	{ AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_TEXT }
 	},
 	{ // DUP_IP_NET_RANGE
-"SELECT destination, count(*) c FROM records WHERE type = 'A' AND destination LIKE ? GROUP BY destination HAVING c > 1",
-	1,
-	{ AILSA_DB_TEXT }
+"SELECT destination, count(*) c FROM records WHERE ip_addr BETWEEN ? AND ? AND type = 'A' GROUP BY destination HAVING c > 1",
+	2,
+	{ AILSA_DB_LINT, AILSA_DB_LINT }
 	},
 	{ // DUP_IP_A_RECORD
 "SELECT destination, count(*) c FROM records WHERE type = 'A' AND destination = ? GROUP BY destination HAVING c > 1",
@@ -510,14 +561,14 @@ const struct ailsa_sql_query_s argument_queries[] = {
 	{ AILSA_DB_TEXT }
 	},
 	{ // PREFER_A_INFO_ON_RANGE
-"SELECT ip, fqdn, record_id FROM preferred_a WHERE ip LIKE ?",
-	1,
-	{ AILSA_DB_TEXT }
+"SELECT ip, fqdn, record_id FROM preferred_a WHERE ip_addr BETWEEN ? AND ?",
+	2,
+	{ AILSA_DB_LINT, AILSA_DB_LINT }
 	},
 	{ // RECORDS_ON_NET_RANGE
-"SELECT destination, r.id, host, name FROM records r LEFT JOIN zones z ON z.id = r.zone WHERE destination LIKE ?",
-	1,
-	{ AILSA_DB_TEXT }
+"SELECT destination, r.id, host, name FROM records r LEFT JOIN zones z ON z.id = r.zone WHERE r.ip_addr BETWEEN ? AND ?",
+	2,
+	{ AILSA_DB_LINT, AILSA_DB_LINT }
 	},
 	{ // REV_RECORD_ID_ON_ZONE_HOST
 "SELECT rev_record_id FROM rev_records WHERE rev_zone = ? AND host = ?",
@@ -658,14 +709,14 @@ const struct ailsa_sql_query_s argument_queries[] = {
 	},
 	{ // BUILD_PARTITIONS_ON_SERVER_ID
 "SELECT minimum, maximum, priority, mount_point, filesystem, logical_volume FROM default_part\
- WHERE def_scheme_id = (SELECT def_scheme_id FROM build WHERE server_id = ?)",
+ WHERE def_scheme_id = (SELECT def_scheme_id FROM build WHERE server_id = ?) ORDER BY def_part_id",
 	1,
 	{ AILSA_DB_LINT }
 	},
 	{ // BUILD_PACKAGES_ON_SERVER_ID
 "SELECT package FROM packages p \
   LEFT JOIN build b ON p.varient_id = b.varient_id AND p.os_id = b.os_id \
-  WHERE server_id = ?",
+  WHERE server_id = ? ORDER BY p.pack_id",
 	1,
 	{ AILSA_DB_LINT }
 	},
@@ -755,8 +806,43 @@ const struct ailsa_sql_query_s argument_queries[] = {
 	1,
 	{ AILSA_DB_LINT }
 	},
+	{ // ZONE_HASH_ON_NAME
+"SELECT content_hash FROM zones WHERE name = ?",
+	1,
+	{ AILSA_DB_TEXT }
+	},
+	{ // REV_ZONE_HASH_ON_NET_RANGE
+"SELECT content_hash FROM rev_zones WHERE net_range = ?",
+	1,
+	{ AILSA_DB_TEXT }
+	},
+	{ // REV_RECORDS_ALL_ON_NET_RANGE
+"SELECT zone_index, host, destination FROM rev_records WHERE rev_zone = (SELECT rev_zone_id FROM rev_zones WHERE net_range = ?) ORDER BY zone_index, rev_record_id",
+	1,
+	{ AILSA_DB_TEXT }
+	},
+	{ // RECORDS_ON_ZONE_TYPE
+"SELECT host, destination, pri FROM records WHERE zone = (SELECT id FROM zones WHERE name = ?) AND type = ? ORDER BY id",
+	2,
+	{ AILSA_DB_TEXT, AILSA_DB_TEXT }
+	},
+	{ // RECORDS_ALL_ON_ZONE
+"SELECT type, host, destination, pri, protocol, service FROM records WHERE zone = (SELECT id FROM zones WHERE name = ?)",
+	1,
+	{ AILSA_DB_TEXT }
+	},
+	{ // DHCP_INFORMATION_ON_SERVER_ID
+"SELECT s.name, b.mac_addr, ip.ip, db.domain FROM build b \
+ LEFT JOIN server s ON s.server_id = b.server_id \
+ LEFT JOIN build_ip ip ON ip.ip_id = b.ip_id \
+ LEFT JOIN build_domain db ON db.bd_id = ip.bd_id WHERE b.server_id = ?",
+	1,
+	{ AILSA_DB_LINT }
+	},
 };
 
+const unsigned int argument_query_total = sizeof(argument_queries) / sizeof(argument_queries[0]);
+
 const struct ailsa_sql_query_s insert_queries[] = {
 	{ // INSERT_CONTACT
 "INSERT INTO contacts (name, phone, email, cust_id, cuser, muser) VALUES (?, ?, ?, ?, ?, ?)",
@@ -884,19 +970,19 @@ const struct ailsa_sql_query_s insert_queries[] = {
 	{ AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_LINT, AILSA_DB_LINT, AILSA_DB_LINT, AILSA_DB_LINT, AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_LINT, AILSA_DB_LINT }
 	},
 	{ // INSERT_RECORD_BASE
-"INSERT INTO records (zone, type, host, destination, cuser, muser) VALUES (?, ?, ?, ?, ?, ?)",
-	6,
-	{ AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_LINT, AILSA_DB_LINT }
-	},
-	{ // INSERT_RECORD_MX
-"INSERT INTO records (zone, type, host, destination, pri, cuser, muser) VALUES (?, ?, ?, ?, ?, ?, ?)",
+"INSERT INTO records (zone, type, host, destination, cuser, muser, ip_addr) VALUES (?, ?, ?, ?, ?, ?, ?)",
 	7,
 	{ AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_LINT, AILSA_DB_LINT, AILSA_DB_LINT }
 	},
+	{ // INSERT_RECORD_MX
+"INSERT INTO records (zone, type, host, destination, pri, cuser, muser, ip_addr) VALUES (?, ?, ?, ?, ?, ?, ?, ?)",
+	8,
+	{ AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_LINT, AILSA_DB_LINT, AILSA_DB_LINT, AILSA_DB_LINT }
+	},
 	{ // INSERT_RECORD_SRV
-"INSERT INTO records (zone, type, host, destination, pri, protocol, service, cuser, muser) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)",
-	9,
-	{ AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_LINT, AILSA_DB_LINT },
+"INSERT INTO records (zone, type, host, destination, pri, protocol, service, cuser, muser, ip_addr) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)",
+	10,
+	{ AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_TEXT, AILSA_DB_LINT, AILSA_DB_LINT, AILSA_DB_LINT },
 	},
 	{ // INSERT_REVERSE_RECORD
 "INSERT INTO rev_records (rev_zone, zone_index, host, destination, cuser, muser) VALUES (?, ?, ?, ?, ?, ?)",
@@ -960,6 +1046,8 @@ const struct ailsa_sql_query_s insert_queries[] = {
 	},
 };
 
+const unsigned int insert_query_total = sizeof(insert_queries) / sizeof(insert_queries[0]);
+
 const struct ailsa_sql_query_s delete_queries[] = {
 	{ // DELETE_BUILD_OS
 "DELETE FROM build_os WHERE os_id = ?",
@@ -1115,9 +1203,9 @@ const struct ailsa_sql_query_s update_queries[] = {
 	{ AILSA_DB_TEXT, AILSA_DB_TEXT }
 	},
 	{ // FWD_ZONE_SERIAL_UPDATE
-"UPDATE zones SET serial = ?, updated = 'no' WHERE name = ?",
-	2,
-	{ AILSA_DB_LINT, AILSA_DB_TEXT }
+"UPDATE zones SET serial = ?, content_hash = ?, updated = 'no' WHERE name = ?",
+	3,
+	{ AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_TEXT }
 	},
 	{ // REV_ZONE_VALIDATE
 "UPDATE rev_zones SET valid = ? WHERE net_range = ?",
@@ -1125,7 +1213,12 @@ const struct ailsa_sql_query_s update_queries[] = {
 	{ AILSA_DB_TEXT, AILSA_DB_TEXT }
 	},
 	{ // REV_ZONE_SERIAL_UPDATE
-"UPDATE rev_zones SET serial = ?, updated = 'no' WHERE net_range = ?",
+"UPDATE rev_zones SET serial = ?, content_hash = ?, updated = 'no' WHERE net_range = ?",
+	3,
+	{ AILSA_DB_LINT, AILSA_DB_TEXT, AILSA_DB_TEXT }
+	},
+	{ // FWD_ZONE_SERIAL_SET
+"UPDATE zones SET serial = ? WHERE name = ?",
 	2,
 	{ AILSA_DB_LINT, AILSA_DB_TEXT }
 	},
@@ -1205,14 +1298,26 @@ cmdb_create_value_string(const struct ailsa_sql_query_s query);
 static unsigned int *
 cmdb_insert_fields_array(unsigned int n, size_t tot, const unsigned int *f);
 
+static size_t
+ailsa_bulk_data_len(ailsa_data_s *data);
+
 #ifdef HAVE_MYSQL
 
 static int
-ailsa_basic_query_mysql(ailsa_cmdb_s *cmdb, const char *query, AILLIST *results);
+ailsa_basic_query_mysql(ailsa_cmdb_s *cmdb, const char *query, ailsa_result_s *results, ailsa_row_fn cb, void *ctx);
 
 int
 ailsa_argument_query_mysql(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s argument, AILLIST *args, AILLIST *results);
 
+static int
+ailsa_cached_argument_query_mysql(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *args, ailsa_result_s *results, ailsa_row_fn cb, void *ctx);
+
+static int
+ailsa_run_argument_stmt_mysql(MYSQL_STMT *stmt, const struct ailsa_sql_query_s argument, AILLIST *args, ailsa_result_s *results, ailsa_row_fn cb, void *ctx);
+
+static int
+ailsa_fetch_results_mysql(MYSQL_STMT *stmt, ailsa_result_s *results, ailsa_row_fn cb, void *ctx);
+
 int
 ailsa_delete_query_mysql(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query, AILLIST *delete);
 
@@ -1220,21 +1325,27 @@ int
 ailsa_insert_query_mysql(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query, AILLIST *insert);
 
 static void
-ailsa_store_mysql_row(MYSQL_ROW row, AILLIST *results, unsigned int *fields);
+ailsa_store_mysql_row(MYSQL_ROW row, unsigned long *lengths, ailsa_result_s *results, unsigned int *fields);
 
 int
 ailsa_multiple_query_mysql(ailsa_cmdb_s *cmdb, ailsa_sql_multi_s *sql, AILLIST *insert);
 
+static unsigned int
+ailsa_set_my_type(unsigned int type);
+
 #endif
 
 #ifdef HAVE_SQLITE3
 
 static int
-ailsa_basic_query_sqlite(ailsa_cmdb_s *cmdb, const char *query, AILLIST *results);
+ailsa_basic_query_sqlite(ailsa_cmdb_s *cmdb, const char *query, ailsa_result_s *results, ailsa_row_fn cb, void *ctx);
 
 int
 ailsa_argument_query_sqlite(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s argument, AILLIST *args, AILLIST *results);
 
+static int
+ailsa_cached_argument_query_sqlite(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *args, ailsa_result_s *results, ailsa_row_fn cb, void *ctx);
+
 int
 ailsa_delete_query_sqlite(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query, AILLIST *delete);
 
@@ -1245,66 +1356,238 @@ int
 ailsa_multiple_query_sqlite(ailsa_cmdb_s *cmdb, ailsa_sql_multi_s *sql, AILLIST *insert);
 
 static void
-ailsa_store_basic_sqlite(sqlite3_stmt *state, AILLIST *results);
+ailsa_store_basic_sqlite(sqlite3_stmt *state, ailsa_result_s *results);
 
 static int
 ailsa_bind_arguments_sqlite(sqlite3_stmt *state, AILLIST *args, unsigned int t, const unsigned int *f);
 
-static unsigned int
-ailsa_set_my_type(unsigned int type);
+#endif
+
+#ifdef HAVE_LIBPQ
+
+// Type OIDs from the server's pg_type catalogue; libpq does not export them
+enum {
+	AILSA_PG_INT8 = 20,
+	AILSA_PG_INT2 = 21,
+	AILSA_PG_INT4 = 23,
+	AILSA_PG_OID = 26,
+	AILSA_PG_FLOAT4 = 700,
+	AILSA_PG_FLOAT8 = 701,
+	AILSA_PG_NUMERIC = 1700
+};
+
+static int
+ailsa_basic_query_pgsql(ailsa_cmdb_s *cmdb, const char *query, ailsa_result_s *results, ailsa_row_fn cb, void *ctx);
+
+static int
+ailsa_argument_query_pgsql(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s argument, AILLIST *args, AILLIST *results);
+
+static int
+ailsa_cached_argument_query_pgsql(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *args, ailsa_result_s *results, ailsa_row_fn cb, void *ctx);
+
+static int
+ailsa_write_query_pgsql(ailsa_cmdb_s *cmdb, const char *query, AILLIST *args, unsigned int t, const unsigned int *f);
+
+static int
+ailsa_query_batch_pgsql(ailsa_cmdb_s *cmdb, ailsa_sql_batch_s *batch, size_t n);
+
+static int
+ailsa_get_results_pgsql(PGconn *pg, ailsa_result_s *results, ailsa_row_fn cb, void *ctx);
 
 static void
-ailsa_remove_empty_results_mysql(MYSQL_STMT *stmt, AILLIST *results);
+ailsa_store_pgsql_row(PGresult *res, int row, ailsa_result_s *results);
 
-#endif
+static int
+ailsa_bind_arguments_pgsql(AILLIST *args, unsigned int t, const unsigned int *f, char ***values);
+
+static void
+ailsa_free_arguments_pgsql(char **values, unsigned int t);
+
+#endif // HAVE_LIBPQ
 
 int
 ailsa_basic_query(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *results)
 {
-	int retval = AILSA_WRONG_DBTYPE;
-	const char *query = basic_queries[query_no];
+	if (!(results))
+		return AILSA_NO_DATA;
+	int retval;
+	ailsa_result_s *r = ailsa_result_init();
 
+	if ((retval = ailsa_basic_query_result(cmdb, query_no, r)) == 0)
+		retval = ailsa_result_to_list(r, results);
+	ailsa_result_clean(r);
+	return retval;
+}
+
+int
+ailsa_basic_query_result(ailsa_cmdb_s *cmdb, unsigned int query_no, ailsa_result_s *results)
+{
+	int retval = AILSA_WRONG_DBTYPE;
+	const char *query;
+	size_t rows = results->fetched, bytes = results->copied;
+	struct timespec start;
+
+	if (query_no >= basic_query_total)
+		return AILSA_NO_QUERY;
+	query = basic_queries[query_no];
+	ailsa_sql_stats_start(cmdb, &start);
+	ailsa_sql_checkout(cmdb);
 	if ((strncmp(cmdb->dbtype, "none", SERVICE_LEN) == 0))
 		ailsa_syslog(LOG_ERR, "no dbtype set");
 #ifdef HAVE_MYSQL
 	else if ((strncmp(cmdb->dbtype, "mysql", SERVICE_LEN) == 0))
-		retval = ailsa_basic_query_mysql(cmdb, query, results);
+		retval = ailsa_basic_query_mysql(cmdb, query, results, NULL, NULL);
 #endif // HAVE_MYSQL
 #ifdef HAVE_SQLITE3
 	else if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0))
-		retval = ailsa_basic_query_sqlite(cmdb, query, results);
+		retval = ailsa_basic_query_sqlite(cmdb, query, results, NULL, NULL);
 #endif
+#ifdef HAVE_LIBPQ
+	else if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0))
+		retval = ailsa_basic_query_pgsql(cmdb, query, results, NULL, NULL);
+#endif // HAVE_LIBPQ
 	else
 		ailsa_syslog(LOG_ERR, "dbtype unavailable: %s", cmdb->dbtype);
+	ailsa_sql_checkin(cmdb);
+	ailsa_sql_stats_record(cmdb, AILSA_STATS_BASIC, query_no, &start, results->fetched - rows, results->copied - bytes);
 	return retval;
 }
 
 int
 ailsa_argument_query(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *args, AILLIST *results)
+{
+	if (!(results))
+		return AILSA_NO_DATA;
+	int retval;
+	ailsa_result_s *r = ailsa_result_init();
+
+	if ((retval = ailsa_argument_query_result(cmdb, query_no, args, r)) == 0)
+		retval = ailsa_result_to_list(r, results);
+	ailsa_result_clean(r);
+	return retval;
+}
+
+int
+ailsa_argument_query_result(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *args, ailsa_result_s *results)
 {
 	int retval = AILSA_WRONG_DBTYPE;
-	const struct ailsa_sql_query_s argument = argument_queries[query_no];
+	size_t rows = results->fetched, bytes = results->copied;
+	struct timespec start;
 
+	if (query_no >= argument_query_total)
+		return AILSA_NO_QUERY_NO;
+	ailsa_sql_stats_start(cmdb, &start);
+	ailsa_sql_checkout(cmdb);
 	if ((strncmp(cmdb->dbtype, "none", SERVICE_LEN) == 0))
 		ailsa_syslog(LOG_ERR, "no dbtype set");
 #ifdef HAVE_MYSQL
 	else if ((strncmp(cmdb->dbtype, "mysql", SERVICE_LEN) == 0))
-		retval = ailsa_argument_query_mysql(cmdb, argument, args, results);
+		retval = ailsa_cached_argument_query_mysql(cmdb, query_no, args, results, NULL, NULL);
 #endif // HAVE_MYSQL
 #ifdef HAVE_SQLITE3
 	else if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0))
-		retval = ailsa_argument_query_sqlite(cmdb, argument, args, results);
+		retval = ailsa_cached_argument_query_sqlite(cmdb, query_no, args, results, NULL, NULL);
 #endif
+#ifdef HAVE_LIBPQ
+	else if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0))
+		retval = ailsa_cached_argument_query_pgsql(cmdb, query_no, args, results, NULL, NULL);
+#endif // HAVE_LIBPQ
 	else
 		ailsa_syslog(LOG_ERR, "dbtype unavailable: %s", cmdb->dbtype);
+	ailsa_sql_checkin(cmdb);
+	ailsa_sql_stats_record(cmdb, AILSA_STATS_ARGUMENT, query_no, &start, results->fetched - rows, results->copied - bytes);
 	return retval;	
 }
 
+int
+ailsa_query_foreach(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *args, ailsa_row_fn cb, void *ctx)
+{
+	if (!(cmdb) || !(cb))
+		return AILSA_NO_DATA;
+	int retval = AILSA_WRONG_DBTYPE;
+	ailsa_result_s *row;
+	struct timespec start;
+
+	if ((args) && (query_no >= argument_query_total))
+		return AILSA_NO_QUERY_NO;
+	if (!(args) && (query_no >= basic_query_total))
+		return AILSA_NO_QUERY;
+	row = ailsa_result_init();
+	ailsa_sql_stats_start(cmdb, &start);
+	ailsa_sql_checkout(cmdb);
+	if ((strncmp(cmdb->dbtype, "none", SERVICE_LEN) == 0))
+		ailsa_syslog(LOG_ERR, "no dbtype set");
+#ifdef HAVE_MYSQL
+	else if ((strncmp(cmdb->dbtype, "mysql", SERVICE_LEN) == 0) && (args))
+		retval = ailsa_cached_argument_query_mysql(cmdb, query_no, args, row, cb, ctx);
+	else if ((strncmp(cmdb->dbtype, "mysql", SERVICE_LEN) == 0))
+		retval = ailsa_basic_query_mysql(cmdb, basic_queries[query_no], row, cb, ctx);
+#endif // HAVE_MYSQL
+#ifdef HAVE_SQLITE3
+	else if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0) && (args))
+		retval = ailsa_cached_argument_query_sqlite(cmdb, query_no, args, row, cb, ctx);
+	else if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0))
+		retval = ailsa_basic_query_sqlite(cmdb, basic_queries[query_no], row, cb, ctx);
+#endif
+#ifdef HAVE_LIBPQ
+	else if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0) && (args))
+		retval = ailsa_cached_argument_query_pgsql(cmdb, query_no, args, row, cb, ctx);
+	else if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0))
+		retval = ailsa_basic_query_pgsql(cmdb, basic_queries[query_no], row, cb, ctx);
+#endif // HAVE_LIBPQ
+	else
+		ailsa_syslog(LOG_ERR, "dbtype unavailable: %s", cmdb->dbtype);
+	ailsa_sql_checkin(cmdb);
+	ailsa_sql_stats_record(cmdb, args ? AILSA_STATS_ARGUMENT : AILSA_STATS_BASIC, query_no, &start, row->fetched, row->copied);
+	ailsa_result_clean(row);
+	return retval;
+}
+
+int
+ailsa_query_batch(ailsa_cmdb_s *cmdb, ailsa_sql_batch_s *batch, size_t n)
+{
+	if (!(cmdb) || !(batch))
+		return AILSA_NO_DATA;
+	int retval;
+	size_t i, total;
+
+	for (i = 0; i < n; i++) {
+		if (!(batch[i].results))
+			return AILSA_NO_DATA;
+		if ((batch[i].args) && (batch[i].query_no >= argument_query_total))
+			return AILSA_NO_QUERY_NO;
+		batch[i].total = 0;
+	}
+// One session for the whole batch
+	ailsa_sql_checkout(cmdb);
+#ifdef HAVE_LIBPQ
+	if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0)) {
+		retval = ailsa_query_batch_pgsql(cmdb, batch, n);
+		goto cleanup;
+	}
+#endif // HAVE_LIBPQ
+	for (i = 0; i < n; i++) {
+		total = batch[i].results->total;
+		if (batch[i].args)
+			retval = ailsa_argument_query(cmdb, batch[i].query_no, batch[i].args, batch[i].results);
+		else
+			retval = ailsa_basic_query(cmdb, batch[i].query_no, batch[i].results);
+		if (retval != 0)
+			goto cleanup;
+		batch[i].total = batch[i].results->total - total;
+	}
+	retval = 0;
+	cleanup:
+		ailsa_sql_checkin(cmdb);
+		return retval;
+}
+
 int
 ailsa_individual_query(ailsa_cmdb_s *cmdb, const ailsa_sql_query_s *query, AILLIST *args, AILLIST *results)
 {
 	int retval = AILSA_WRONG_DBTYPE;
 
+	ailsa_sql_checkout(cmdb);
 	if ((strncmp(cmdb->dbtype, "none", SERVICE_LEN) == 0))
 		ailsa_syslog(LOG_ERR, "no dbtype set");
 #ifdef HAVE_MYSQL
@@ -1315,8 +1598,13 @@ ailsa_individual_query(ailsa_cmdb_s *cmdb, const ailsa_sql_query_s *query, AILLI
 	else if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0))
 		retval = ailsa_argument_query_sqlite(cmdb, *query, args, results);
 #endif
+#ifdef HAVE_LIBPQ
+	else if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0))
+		retval = ailsa_argument_query_pgsql(cmdb, *query, args, results);
+#endif // HAVE_LIBPQ
 	else
 		ailsa_syslog(LOG_ERR, "dbtype unavailable: %s", cmdb->dbtype);
+	ailsa_sql_checkin(cmdb);
 	return retval;
 }
 
@@ -1325,6 +1613,7 @@ ailsa_delete_query(ailsa_cmdb_s *cmdb, const ailsa_sql_query_s query, AILLIST *d
 {
 	int retval = AILSA_WRONG_DBTYPE;
 
+	ailsa_sql_checkout(cmdb);
 	if ((strncmp(cmdb->dbtype, "none", SERVICE_LEN) == 0))
 		ailsa_syslog(LOG_ERR, "no dbtype set");
 #ifdef HAVE_MYSQL
@@ -1335,8 +1624,13 @@ ailsa_delete_query(ailsa_cmdb_s *cmdb, const ailsa_sql_query_s query, AILLIST *d
 	else if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0))
 		retval = ailsa_delete_query_sqlite(cmdb, query, delete);
 #endif
+#ifdef HAVE_LIBPQ
+	else if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0))
+		retval = ailsa_write_query_pgsql(cmdb, query.query, delete, query.number, query.fields);
+#endif // HAVE_LIBPQ
 	else
 		ailsa_syslog(LOG_ERR, "dbtype unavailable: %s", cmdb->dbtype);
+	ailsa_sql_checkin(cmdb);
 	return retval;
 }
 
@@ -1345,6 +1639,7 @@ ailsa_update_query(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query, AIL
 {
 	int retval = AILSA_WRONG_DBTYPE;
 
+	ailsa_sql_checkout(cmdb);
 	if ((strncmp(cmdb->dbtype, "none", SERVICE_LEN) == 0))
 		ailsa_syslog(LOG_ERR, "no dbtype set");
 #ifdef HAVE_MYSQL
@@ -1355,8 +1650,13 @@ ailsa_update_query(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query, AIL
 	else if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0))
 		retval = ailsa_delete_query_sqlite(cmdb, query, update);
 #endif
+#ifdef HAVE_LIBPQ
+	else if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0))
+		retval = ailsa_write_query_pgsql(cmdb, query.query, update, query.number, query.fields);
+#endif // HAVE_LIBPQ
 	else
 		ailsa_syslog(LOG_ERR, "dbtype unavailable: %s", cmdb->dbtype);
+	ailsa_sql_checkin(cmdb);
 	return retval;
 }
 
@@ -1365,7 +1665,10 @@ ailsa_insert_query(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *insert)
 {
 	int retval = AILSA_WRONG_DBTYPE;
 	const struct ailsa_sql_query_s query = insert_queries[query_no];
+	struct timespec start;
 
+	ailsa_sql_stats_start(cmdb, &start);
+	ailsa_sql_checkout(cmdb);
 	if ((strncmp(cmdb->dbtype, "none", SERVICE_LEN) == 0))
 		ailsa_syslog(LOG_ERR, "no dbtype set");
 #ifdef HAVE_MYSQL
@@ -1376,8 +1679,14 @@ ailsa_insert_query(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *insert)
 	else if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0))
 		retval = ailsa_insert_query_sqlite(cmdb, query, insert);
 #endif
+#ifdef HAVE_LIBPQ
+	else if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0))
+		retval = ailsa_write_query_pgsql(cmdb, query.query, insert, query.number, query.fields);
+#endif // HAVE_LIBPQ
 	else
 		ailsa_syslog(LOG_ERR, "dbtype unavailable: %s", cmdb->dbtype);
+	ailsa_sql_checkin(cmdb);
+	ailsa_sql_stats_record(cmdb, AILSA_STATS_INSERT, query_no, &start, query.number > 0 ? insert->total / query.number : 0, 0);
 	return retval;
 }
 
@@ -1392,6 +1701,7 @@ ailsa_multiple_query(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query, A
 		goto cleanup;
 	}
 	retval = AILSA_WRONG_DBTYPE;
+	ailsa_sql_checkout(cmdb);
 	if ((strncmp(cmdb->dbtype, "none", SERVICE_LEN) == 0))
 		ailsa_syslog(LOG_ERR, "no dbtype set");
 #ifdef HAVE_MYSQL
@@ -1402,14 +1712,85 @@ ailsa_multiple_query(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query, A
 	else if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0))
 		retval = ailsa_multiple_query_sqlite(cmdb, sql, insert);
 #endif
+#ifdef HAVE_LIBPQ
+	else if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0))
+		retval = ailsa_write_query_pgsql(cmdb, sql->query, insert, sql->total, sql->fields);
+#endif // HAVE_LIBPQ
 	else
 		ailsa_syslog(LOG_ERR, "dbtype unavailable: %s", cmdb->dbtype);
+	ailsa_sql_checkin(cmdb);
 
 	cleanup:
 		cmdb_clean_ailsa_sql_multi(sql);
 		return retval;
 }
 
+/*
+ * Insert any number of rows with multi row INSERTs. The rows are split into
+ * statements that stay under the backend's bound variable and packet size
+ * limits, and all of them run in one transaction.
+ */
+int
+ailsa_bulk_insert(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query, AILLIST *insert)
+{
+	if (!(cmdb) || !(insert) || (query.number == 0))
+		return AILSA_NO_DATA;
+	int retval;
+	size_t vars, bytes, row_len, chunk_len, row_vars, rows;
+	size_t values = (size_t)query.number * 3 + 4;
+	AILLIST *chunk = NULL;
+	AILELEM *e, *r;
+
+	if ((insert->total % query.number) != 0) {
+		ailsa_syslog(LOG_ERR, "List has %zu entries; not a multiple of %u", insert->total, query.number);
+		return AILSA_WRONG_LIST_LENGHT;
+	}
+	if (insert->total == 0)
+		return 0;
+	if ((retval = ailsa_sql_bulk_limits(cmdb, &vars, &bytes)) != 0)
+		return retval;
+	if ((retval = ailsa_begin(cmdb)) != 0)
+		goto cleanup;
+	chunk = ailsa_calloc(sizeof(AILLIST), "chunk in ailsa_bulk_insert");
+	ailsa_list_init(chunk, NULL);
+	e = insert->head;
+	while (e) {
+		chunk_len = strlen(query.query);
+		rows = 0;
+		while (e) {
+			row_len = values;
+			row_vars = 0;
+			for (r = e; (r) && (row_vars < query.number); r = r->next, row_vars++)
+				row_len += ailsa_bulk_data_len(r->data);
+			if ((rows > 0) && (((rows + 1) * query.number > vars) || (chunk_len + row_len > bytes)))
+				break;
+			for (row_vars = 0; row_vars < query.number; row_vars++, e = e->next)
+				if ((retval = ailsa_list_insert(chunk, e->data)) != 0)
+					goto cleanup;
+			chunk_len += row_len;
+			rows++;
+		}
+		if ((retval = ailsa_multiple_query(cmdb, query, chunk)) != 0)
+			goto cleanup;
+		ailsa_list_clean(chunk);
+	}
+	retval = ailsa_commit(cmdb);
+	cleanup:
+		if (retval != 0)
+			ailsa_rollback(cmdb);
+		ailsa_list_full_clean(chunk);
+		return retval;
+}
+
+// Rough wire size of one bound value
+static size_t
+ailsa_bulk_data_len(ailsa_data_s *data)
+{
+	if ((data) && (data->type == AILSA_DB_TEXT) && (data->data->text))
+		return strlen(data->data->text) + 9;
+	return 9;
+}
+
 int
 ailsa_multiple_delete(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query, AILLIST *del)
 {
@@ -1422,6 +1803,7 @@ ailsa_multiple_delete(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query,
 	}
 	retval = AILSA_WRONG_DBTYPE;
 
+	ailsa_sql_checkout(cmdb);
 	if ((strncmp(cmdb->dbtype, "none", SERVICE_LEN) == 0))
 		ailsa_syslog(LOG_ERR, "no dbtype set");
 #ifdef HAVE_MYSQL
@@ -1432,8 +1814,13 @@ ailsa_multiple_delete(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s query,
 	else if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0))
 		retval = ailsa_multiple_query_sqlite(cmdb, sql, del);
 #endif
+#ifdef HAVE_LIBPQ
+	else if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0))
+		retval = ailsa_write_query_pgsql(cmdb, sql->query, del, sql->total, sql->fields);
+#endif // HAVE_LIBPQ
 	else
 		ailsa_syslog(LOG_ERR, "dbtype unavailable: %s", cmdb->dbtype);
+	ailsa_sql_checkin(cmdb);
 
 	cmdb_clean_ailsa_sql_multi(sql);
 	return retval;
@@ -1554,7 +1941,7 @@ cmdb_insert_fields_array(unsigned int n, size_t tot, const unsigned int *f)
 #ifdef HAVE_MYSQL
 
 static int
-ailsa_basic_query_mysql(ailsa_cmdb_s *cmdb, const char *query, AILLIST *results)
+ailsa_basic_query_mysql(ailsa_cmdb_s *cmdb, const char *query, ailsa_result_s *results, ailsa_row_fn cb, void *ctx)
 {
 	if (!(cmdb) || !(query) || !(results))
 		return AILSA_NO_DATA;
@@ -1562,22 +1949,25 @@ ailsa_basic_query_mysql(ailsa_cmdb_s *cmdb, const char *query, AILLIST *results)
 	int retval = 0;
 	unsigned int total, i, *fields;
 	size_t size;
-	MYSQL sql;
+	MYSQL *sql = NULL;
 	MYSQL_RES *sql_res;
 	MYSQL_ROW sql_row;
 	MYSQL_FIELD *field;
-	my_ulonglong sql_rows;
 
-	if ((retval = ailsa_mysql_init(cmdb, &sql)) != 0)
+	if ((retval = ailsa_mysql_session(cmdb, &sql)) != 0)
 		return retval;
 
-	if ((retval = ailsa_mysql_query_with_checks(&sql, query)) != 0) {
-		ailsa_syslog(LOG_ERR, "MySQL query failed: %s", mysql_error(&sql));
+	if ((retval = ailsa_mysql_query_with_checks(sql, query)) != 0) {
+		ailsa_syslog(LOG_ERR, "MySQL query failed: %s", mysql_error(sql));
 		return AILSA_QUERY_FAIL;
 	}
-	if (!(sql_res = mysql_store_result(&sql))) {
-		ailsa_mysql_cleanup(&sql);
-		ailsa_syslog(LOG_ERR, "MySQL store result failed: %s", mysql_error(&sql));
+// With a callback, rows are handed over as the server sends them
+	if (cb)
+		sql_res = mysql_use_result(sql);
+	else
+		sql_res = mysql_store_result(sql);
+	if (!(sql_res)) {
+		ailsa_syslog(LOG_ERR, "MySQL store result failed: %s", mysql_error(sql));
 		return AILSA_STORE_FAIL;
 	}
 
@@ -1589,11 +1979,18 @@ ailsa_basic_query_mysql(ailsa_cmdb_s *cmdb, const char *query, AILLIST *results)
 		fields[i + 1] = field->type;
 	}
 	*fields = i;
-	if (((sql_rows = mysql_num_rows(sql_res)) != 0)) {
-		while ((sql_row = mysql_fetch_row(sql_res)))
-			ailsa_store_mysql_row(sql_row, results, fields);
+	while ((sql_row = mysql_fetch_row(sql_res))) {
+		if (cb)
+			ailsa_result_reset(results);
+		ailsa_store_mysql_row(sql_row, mysql_fetch_lengths(sql_res), results, fields);
+		if ((cb) && ((retval = cb(results, ctx)) != 0))
+			break;
+	}
+	if ((retval == 0) && (mysql_errno(sql) != 0)) {
+		ailsa_syslog(LOG_ERR, "MySQL fetch row failed: %s", mysql_error(sql));
+		retval = AILSA_QUERY_FAIL;
 	}
-	ailsa_mysql_cleanup_full(&sql, sql_res);
+	mysql_free_result(sql_res);
 	my_free(fields);
 	return retval;
 }
@@ -1606,56 +2003,138 @@ ailsa_argument_query_mysql(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s ar
 
 	int retval = 0;
 	const char *query = argument.query;
-	MYSQL sql;
+	MYSQL *sql = NULL;
 	MYSQL_STMT *stmt = NULL;
-	MYSQL_BIND *params = NULL;
-	MYSQL_BIND *res = NULL;
+	ailsa_result_s *r;
 
-	if ((retval = ailsa_mysql_init(cmdb, &sql)) != 0)
+	if ((retval = ailsa_mysql_session(cmdb, &sql)) != 0)
 		return retval;
-	if (!(stmt = mysql_stmt_init(&sql))) {
-		ailsa_syslog(LOG_ERR, "Error from mysql: %s", mysql_error(&sql));
-		retval = AILSA_STATEMENT_FAIL;
-		goto cleanup;
-	}
-	if ((retval = mysql_stmt_prepare(stmt, query, strlen(query))) != 0) {
-		ailsa_syslog(LOG_ERR, "Error from mysql: %s", mysql_error(&sql));
-		goto cleanup;
+	if (!(stmt = mysql_stmt_init(sql))) {
+		ailsa_syslog(LOG_ERR, "Error from mysql: %s", mysql_error(sql));
+		return AILSA_STATEMENT_FAIL;
 	}
+	r = ailsa_result_init();
+	if ((retval = mysql_stmt_prepare(stmt, query, strlen(query))) != 0)
+		ailsa_syslog(LOG_ERR, "Error from mysql: %s", mysql_error(sql));
+	else if ((retval = ailsa_run_argument_stmt_mysql(stmt, argument, args, r, NULL, NULL)) == 0)
+		retval = ailsa_result_to_list(r, results);
+	mysql_stmt_close(stmt);
+	ailsa_result_clean(r);
+	return retval;
+}
+
+static int
+ailsa_cached_argument_query_mysql(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *args, ailsa_result_s *results, ailsa_row_fn cb, void *ctx)
+{
+	if (!(cmdb) || !(args) || !(results))
+		return AILSA_NO_DATA;
+
+	int retval = 0;
+	const struct ailsa_sql_query_s argument = argument_queries[query_no];
+	MYSQL_STMT *stmt = NULL;
+
+	if ((retval = ailsa_mysql_cached_stmt(cmdb, query_no, argument.query, &stmt)) != 0)
+		return retval;
+	if ((retval = ailsa_run_argument_stmt_mysql(stmt, argument, args, results, cb, ctx)) != 0)
+		ailsa_mysql_evict_stmt(cmdb, query_no);
+	return retval;
+}
+
+static int
+ailsa_run_argument_stmt_mysql(MYSQL_STMT *stmt, const struct ailsa_sql_query_s argument, AILLIST *args, ailsa_result_s *results, ailsa_row_fn cb, void *ctx)
+{
+	int retval = 0;
+	MYSQL_BIND *params = NULL;
+
 	if ((retval = ailsa_bind_params_mysql(stmt, &params, argument, args)) != 0)
 		goto cleanup;
-	if ((retval = ailsa_bind_results_mysql(stmt, &res, results)) != 0)
-		goto cleanup;
 	if ((retval = mysql_stmt_execute(stmt)) != 0) {
 		ailsa_syslog(LOG_ERR, "Cannot execute MySQL statement. %s", mysql_stmt_error(stmt));
 		goto cleanup;
 	}
-	if ((retval = mysql_stmt_store_result(stmt)) != 0) {
+	if (!(cb) && ((retval = mysql_stmt_store_result(stmt)) != 0)) {
 		ailsa_syslog(LOG_ERR, "Cannot store result of MySQL statement: %s", mysql_stmt_error(stmt));
 		goto cleanup;
 	}
+	retval = ailsa_fetch_results_mysql(stmt, results, cb, ctx);
+	cleanup:
+		if (cb)
+			mysql_stmt_reset(stmt);
+		mysql_stmt_free_result(stmt);
+		if (params)
+			my_free(params);
+		return retval;
+}
+
+// Bind one row of buffers and copy each fetched row into the result set
+static int
+ailsa_fetch_results_mysql(MYSQL_STMT *stmt, ailsa_result_s *results, ailsa_row_fn cb, void *ctx)
+{
+	int retval = 0;
+	unsigned int fields = mysql_stmt_field_count(stmt), i;
+	MYSQL_BIND *bind = NULL;
+	MYSQL_RES *res = NULL;
+	MYSQL_FIELD *field = NULL;
+	ailsa_data_s *row = NULL;
+
+	if (fields == 0)
+		return AILSA_NO_FIELDS;
+	if (!(res = mysql_stmt_result_metadata(stmt)))
+		return 0;
+	bind = ailsa_calloc(sizeof(MYSQL_BIND) * (size_t)fields, "bind in ailsa_fetch_results_mysql");
+	row = ailsa_calloc(sizeof(ailsa_data_s) * (size_t)fields, "row in ailsa_fetch_results_mysql");
+	for (i = 0; i < fields; i++) {
+		ailsa_init_data(&(row[i]));
+		field = mysql_fetch_field_direct(res, i);
+		if ((retval = ailsa_set_bind_mysql(&(bind[i]), &(row[i]), ailsa_set_my_type(field->type))) != 0)
+			goto cleanup;
+	}
+	if ((retval = mysql_stmt_bind_result(stmt, bind)) != 0) {
+		ailsa_syslog(LOG_ERR, "Unable to bind MySQL results: %s", mysql_stmt_error(stmt));
+		goto cleanup;
+	}
 	while ((retval = mysql_stmt_fetch(stmt)) == 0) {
-		if (res)
-			my_free(res);
-		if ((retval = ailsa_bind_results_mysql(stmt, &res, results)) != 0)
+		if (cb)
+			ailsa_result_reset(results);
+		if ((retval = ailsa_result_add_row(results, fields)) != 0)
+			goto cleanup;
+		for (i = 0; i < fields; i++) {
+			switch(row[i].type) {
+			case AILSA_DB_TEXT:
+				ailsa_result_set_text(results, i, row[i].data->text, strnlen(row[i].data->text, CONFIG_LEN));
+				memset(row[i].data->text, 0, CONFIG_LEN);
+				break;
+			case AILSA_DB_LINT:
+				ailsa_result_set_number(results, i, row[i].data->number);
+				row[i].data->number = 0;
+				break;
+			case AILSA_DB_SINT:
+				ailsa_result_set_small(results, i, row[i].data->small);
+				row[i].data->small = 0;
+				break;
+			case AILSA_DB_TIME:
+				ailsa_result_set_time(results, i, row[i].data->time);
+				break;
+			}
+		}
+		if ((cb) && ((retval = cb(results, ctx)) != 0))
 			goto cleanup;
 	}
-	if (retval != MYSQL_NO_DATA) {
+	if (retval != MYSQL_NO_DATA)
 		ailsa_syslog(LOG_ERR, "Cannot fetch data from mysql result set: %s", mysql_stmt_error(stmt));
-	} else {
+	else
 		retval = 0;
-		ailsa_remove_empty_results_mysql(stmt, results);
-	}
 	cleanup:
-		if (stmt) {
-			mysql_stmt_free_result(stmt);
-			mysql_stmt_close(stmt);
+		for (i = 0; i < fields; i++) {
+			if (row[i].type == AILSA_DB_TEXT)
+				my_free(row[i].data->text);
+			else if (row[i].type == AILSA_DB_TIME)
+				my_free(row[i].data->time);
+			my_free(row[i].data);
 		}
-		if (params)
-			my_free(params);
-		if (res)
-			my_free(res);
-		ailsa_mysql_cleanup(&sql);
+		my_free(row);
+		my_free(bind);
+		mysql_free_result(res);
 		return retval;
 }
 
@@ -1665,17 +2144,16 @@ ailsa_delete_query_mysql(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s dele
 	if (!(cmdb) || !(list))
 		return AILSA_NO_DATA;
 	int retval;
-	MYSQL sql;
+	MYSQL *sql = NULL;
 	MYSQL_BIND *bind = NULL;
 	const char *query = delete.query;
 
-	if ((retval = ailsa_mysql_init(cmdb, &sql)) != 0)
+	if ((retval = ailsa_mysql_session(cmdb, &sql)) != 0)
 		return retval;
-	if ((retval = ailsa_run_mysql_stmt(&sql, bind, delete, list)) < 0)
+	if ((retval = ailsa_run_mysql_stmt(sql, bind, delete, list)) < 0)
 		ailsa_syslog(LOG_ERR, "Statement failed: %s", query);
 	else
 		retval = 0;
-	ailsa_mysql_cleanup(&sql);
 	return retval;
 }
 
@@ -1685,17 +2163,16 @@ ailsa_insert_query_mysql(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s inse
 	if (!(cmdb) || !(list))
 		return AILSA_NO_DATA;
 	int retval;
-	MYSQL sql;
+	MYSQL *sql = NULL;
 	MYSQL_BIND *bind = NULL;
 	const char *query = insert.query;
 
-	if ((retval = ailsa_mysql_init(cmdb, &sql)) != 0)
+	if ((retval = ailsa_mysql_session(cmdb, &sql)) != 0)
 		return retval;
-	if ((retval = ailsa_run_mysql_stmt(&sql, bind, insert, list)) == 0)
+	if ((retval = ailsa_run_mysql_stmt(sql, bind, insert, list)) == 0)
 		ailsa_syslog(LOG_INFO, "No affected rows for %s", query);
 	else if (retval < 0)
 		ailsa_syslog(LOG_ERR, "Statement failed: %s", query);
-	ailsa_mysql_cleanup(&sql);
 	return 0;
 }
 
@@ -1709,14 +2186,14 @@ ailsa_multiple_query_mysql(ailsa_cmdb_s *cmdb, ailsa_sql_multi_s *insert, AILLIS
 	unsigned int t = insert->total;
 	unsigned int *f = insert->fields;
 	unsigned int rows;
-	MYSQL sql;
+	MYSQL *sql = NULL;
 	MYSQL_STMT *stmt;
 	MYSQL_BIND *bind = NULL;
 
-	if ((retval = ailsa_mysql_init(cmdb, &sql)) != 0)
+	if ((retval = ailsa_mysql_session(cmdb, &sql)) != 0)
 		return retval;
-	if (!(stmt = mysql_stmt_init(&sql))) {
-		ailsa_syslog(LOG_ERR, "MySQL stmt failed: %s", mysql_error(&sql));
+	if (!(stmt = mysql_stmt_init(sql))) {
+		ailsa_syslog(LOG_ERR, "MySQL stmt failed: %s", mysql_error(sql));
 		goto cleanup;
 	}
 	if ((retval = mysql_stmt_prepare(stmt, query, strlen(query))) != 0) {
@@ -1741,53 +2218,40 @@ ailsa_multiple_query_mysql(ailsa_cmdb_s *cmdb, ailsa_sql_multi_s *insert, AILLIS
 			my_free(bind);
 		if (stmt)
 			mysql_stmt_close(stmt);
-		ailsa_mysql_cleanup(&sql);
 		return retval;
 }
 
 static void
-ailsa_store_mysql_row(MYSQL_ROW row, AILLIST *results, unsigned int *fields)
+ailsa_store_mysql_row(MYSQL_ROW row, unsigned long *lengths, ailsa_result_s *results, unsigned int *fields)
 {
-	if (!(row) || !(results) || (fields == 0))
+	if (!(row) || !(lengths) || !(results) || (fields == 0))
 		return;
 	unsigned int i, n, *p;
-	int retval = 0;
-	ailsa_data_s *tmp;
 
 	p = fields;
 	n = fields[0];
+	if (ailsa_result_add_row(results, n) != 0)
+		return;
 	for (i = 1; i <= n; i++) {
-		tmp = ailsa_calloc(sizeof(ailsa_data_s), "tmp in ailsa_store_mysql_row");
-		ailsa_init_data(tmp);
+		if (!(row[i - 1]))
+			continue;
 		switch(p[i]) {
 		case MYSQL_TYPE_VAR_STRING:
 		case MYSQL_TYPE_VARCHAR:
-			if (row[i - 1]) {
-				tmp->data->text = strndup(row[i - 1], SQL_TEXT_MAX);
-				tmp->type = AILSA_DB_TEXT;
-			} else {
-				tmp->type = AILSA_DB_NULL;
-			}
+		case MYSQL_TYPE_TIMESTAMP:
+			ailsa_result_set_text(results, i - 1, row[i - 1], lengths[i - 1]);
 			break;
 		case MYSQL_TYPE_LONG:
 		case MYSQL_TYPE_LONGLONG:
-			tmp->data->number = strtoul(row[i - 1], NULL, 10);
-			tmp->type = AILSA_DB_LINT;
+			ailsa_result_set_number(results, i - 1, strtoul(row[i - 1], NULL, 10));
 			break;
 		case MYSQL_TYPE_SHORT:
-			tmp->data->small = (short int)strtoul(row[i - 1], NULL, 10);
-			tmp->type = AILSA_DB_SINT;
-			break;
-		case MYSQL_TYPE_TIMESTAMP:
-			tmp->data->text = strndup(row[i - 1], SQL_TEXT_MAX);
-			tmp->type = AILSA_DB_TEXT;
+			ailsa_result_set_small(results, i - 1, (short int)strtoul(row[i - 1], NULL, 10));
 			break;
 		default:
 			ailsa_syslog(LOG_ERR, "Unknown mysql type %u", p[i]);
 			break;
 		}
-		if ((retval = ailsa_list_insert(results, tmp) != 0))
-			ailsa_syslog(LOG_ERR, "Cannot insert data into list in store_mysql_row");
 	}
 }
 
@@ -1939,41 +2403,27 @@ ailsa_set_my_type(unsigned int type)
 	return retval;
 }
 
-static void
-ailsa_remove_empty_results_mysql(MYSQL_STMT *stmt, AILLIST *results)
-{
-	if (!(stmt) || !(results))
-		return;
-
-	unsigned int fields = mysql_stmt_field_count(stmt), i;
-	void *data = NULL;
-	AILELEM *tail = NULL;
-
-	for (i = 0; i < fields; i++) {
-		tail = results->tail;
-		ailsa_list_remove(results, tail, &data);
-		ailsa_clean_data(data);
-	}
-}
-
 #endif // HAVE_MYSQL
 
 #ifdef HAVE_SQLITE3
 static int
-ailsa_basic_query_sqlite(ailsa_cmdb_s *cmdb, const char *query, AILLIST *results)
+ailsa_basic_query_sqlite(ailsa_cmdb_s *cmdb, const char *query, ailsa_result_s *results, ailsa_row_fn cb, void *ctx)
 {
 	if (!(cmdb) || !(query) || !(results))
 		return AILSA_NO_DATA;
 	int retval = 0;
-	const char *file = cmdb->file;
-	sqlite3 *sql = NULL;
 	sqlite3_stmt *state = NULL;
 
-	if ((retval = ailsa_setup_ro_sqlite(query, file, &sql, &state)) != 0)
+	if ((retval = ailsa_setup_ro_sqlite(cmdb, query, &state)) != 0)
 		return retval;
-	while ((retval = sqlite3_step(state)) == SQLITE_ROW)
+	while ((retval = sqlite3_step(state)) == SQLITE_ROW) {
+		if (cb)
+			ailsa_result_reset(results);
 		ailsa_store_basic_sqlite(state, results);
-	ailsa_sqlite_cleanup(sql, state);
+		if ((cb) && ((retval = cb(results, ctx)) != 0))
+			break;
+	}
+	ailsa_sqlite_cleanup(state);
 	if (retval == SQLITE_DONE)
 		retval = 0;
 	return retval;
@@ -1985,25 +2435,59 @@ ailsa_argument_query_sqlite(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s a
 	if (!(cmdb) || !(args) || !(results))
 		return AILSA_NO_DATA;
 	int retval = 0;
-	sqlite3 *sql = NULL;
 	sqlite3_stmt *state = NULL;
 	const char *query = argument.query;
-	const char *file = cmdb->file;
 	unsigned int t = argument.number;
 	const unsigned int *f = argument.fields;
+	ailsa_result_s *r;
 
-	if ((retval = ailsa_setup_ro_sqlite(query, file, &sql, &state)) != 0)
+	if ((retval = ailsa_setup_ro_sqlite(cmdb, query, &state)) != 0)
 		return retval;
 	if ((retval = ailsa_bind_arguments_sqlite(state, args, t, f)) != 0) {
 		ailsa_syslog(LOG_ERR, "Unable to bind sqlite arguments: got error %d", retval);
+		ailsa_sqlite_cleanup(state);
 		return retval;
 	}
+	r = ailsa_result_init();
 	while ((retval = sqlite3_step(state)) == SQLITE_ROW)
+		ailsa_store_basic_sqlite(state, r);
+	ailsa_sqlite_cleanup(state);
+	if (retval == SQLITE_DONE)
+		retval = ailsa_result_to_list(r, results);
+	ailsa_result_clean(r);
+	return retval;
+}
+
+static int
+ailsa_cached_argument_query_sqlite(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *args, ailsa_result_s *results, ailsa_row_fn cb, void *ctx)
+{
+	if (!(cmdb) || !(args) || !(results))
+		return AILSA_NO_DATA;
+	int retval = 0;
+	sqlite3_stmt *state = NULL;
+	const struct ailsa_sql_query_s argument = argument_queries[query_no];
+	unsigned int t = argument.number;
+	const unsigned int *f = argument.fields;
+
+	if ((retval = ailsa_sqlite_cached_stmt(cmdb, query_no, argument.query, &state)) != 0)
+		return retval;
+	if ((retval = ailsa_bind_arguments_sqlite(state, args, t, f)) != 0) {
+		ailsa_syslog(LOG_ERR, "Unable to bind sqlite arguments: got error %d", retval);
+		goto cleanup;
+	}
+	while ((retval = sqlite3_step(state)) == SQLITE_ROW) {
+		if (cb)
+			ailsa_result_reset(results);
 		ailsa_store_basic_sqlite(state, results);
-	ailsa_sqlite_cleanup(sql, state);
+		if ((cb) && ((retval = cb(results, ctx)) != 0))
+			break;
+	}
 	if (retval == SQLITE_DONE)
 		retval = 0;
-	return retval;
+	cleanup:
+		sqlite3_reset(state);
+		sqlite3_clear_bindings(state);
+		return retval;
 }
 
 int
@@ -2012,14 +2496,12 @@ ailsa_delete_query_sqlite(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s que
 	if (!(cmdb) || !(delete))
 		return AILSA_NO_DATA;
 	int retval = 0;
-	sqlite3 *sql = NULL;
 	sqlite3_stmt *state = NULL;
 	const char *sql_query = query.query;
-	const char *file = cmdb->file;
 	unsigned int t = query.number;
 	const unsigned int *f = query.fields;
 
-	if ((retval = ailsa_setup_rw_sqlite(sql_query, strlen(sql_query), file, &sql, &state)) != 0)
+	if ((retval = ailsa_setup_rw_sqlite(cmdb, sql_query, strlen(sql_query), &state)) != 0)
 		return retval;
 	if ((retval = ailsa_bind_arguments_sqlite(state, delete, t, f)) != 0) {
 		ailsa_syslog(LOG_ERR, "Unable to bind sqlite arguments: got error %d", retval);
@@ -2033,7 +2515,7 @@ ailsa_delete_query_sqlite(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s que
 	cleanup:
 		if (retval == SQLITE_DONE)
 			retval = 0;
-		ailsa_sqlite_cleanup(sql, state);
+		ailsa_sqlite_cleanup(state);
 		return retval;
 }
 
@@ -2043,14 +2525,12 @@ ailsa_insert_query_sqlite(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s que
 	if (!(cmdb) || !(insert))
 		return AILSA_NO_DATA;
 	int retval = 0;
-	sqlite3 *sql = NULL;
 	sqlite3_stmt *state = NULL;
 	const char *sql_query = query.query;
-	const char *file = cmdb->file;
 	unsigned int t = query.number;
 	const unsigned int *f = query.fields;
 
-	if ((retval = ailsa_setup_rw_sqlite(sql_query, strlen(sql_query), file, &sql, &state)) != 0)
+	if ((retval = ailsa_setup_rw_sqlite(cmdb, sql_query, strlen(sql_query), &state)) != 0)
 		return retval;
 	if ((retval = ailsa_bind_arguments_sqlite(state, insert, t, f)) != 0) {
 		ailsa_syslog(LOG_ERR, "Unable to bind sqlite arguments: got error %d", retval);
@@ -2064,7 +2544,7 @@ ailsa_insert_query_sqlite(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s que
 	cleanup:
 		if (retval == SQLITE_DONE)
 			retval = 0;
-		ailsa_sqlite_cleanup(sql, state);
+		ailsa_sqlite_cleanup(state);
 		return retval;
 }
 
@@ -2074,12 +2554,10 @@ ailsa_multiple_query_sqlite(ailsa_cmdb_s *cmdb, ailsa_sql_multi_s *sql, AILLIST
 	if (!(cmdb) || !(sql) || !(insert))
 		return AILSA_NO_DATA;
 	int retval = 0;
-	sqlite3 *lite = NULL;
 	sqlite3_stmt *state = NULL;
 	const char *sql_query = sql->query;
-	const char *file = cmdb->file;
 
-	if ((retval = ailsa_setup_rw_sqlite(sql_query, strlen(sql_query), file, &lite, &state)) != 0)
+	if ((retval = ailsa_setup_rw_sqlite(cmdb, sql_query, strlen(sql_query), &state)) != 0)
 		return retval;
 	if ((retval = ailsa_bind_arguments_sqlite(state, insert, sql->total, sql->fields)) != 0) {
 		ailsa_syslog(LOG_ERR, "Unable to bind sqlite arguments: error %d", retval);
@@ -2093,47 +2571,40 @@ ailsa_multiple_query_sqlite(ailsa_cmdb_s *cmdb, ailsa_sql_multi_s *sql, AILLIST
 	cleanup:
 		if (retval == SQLITE_DONE)
 			retval = 0;
-		ailsa_sqlite_cleanup(lite, state);
+		ailsa_sqlite_cleanup(state);
 		return retval;
 }
 
 static void
-ailsa_store_basic_sqlite(sqlite3_stmt *state, AILLIST *results)
+ailsa_store_basic_sqlite(sqlite3_stmt *state, ailsa_result_s *results)
 {
-	ailsa_data_s *tmp;
 	if (!(state) || !(results))
 		return;
-	short int fields, i;
-	int type, retval;
+	int fields, i, type;
+	const char *text;
 
-	fields = (short int)sqlite3_column_count(state);
-	retval = 0;
-	for (i=0; i<fields; i++) {
-		tmp = ailsa_calloc(sizeof(ailsa_data_s), "tmp in ailsa_store_basic_sqlite");
-		ailsa_init_data(tmp);
-		type = sqlite3_column_type(state, (int)i);
+	fields = sqlite3_column_count(state);
+	if (ailsa_result_add_row(results, (size_t)fields) != 0)
+		return;
+	for (i = 0; i < fields; i++) {
+		type = sqlite3_column_type(state, i);
 		switch(type) {
 		case SQLITE_INTEGER:
-			tmp->data->number = (unsigned long int)sqlite3_column_int64(state, (int)i);
-			tmp->type = AILSA_DB_LINT;
+			ailsa_result_set_number(results, (size_t)i, (unsigned long int)sqlite3_column_int64(state, i));
 			break;
-	 	case SQLITE_TEXT:  // Can use sqlite3_column_bytes() to get size
-			tmp->data->text = strndup((const char *)sqlite3_column_text(state, (int)i), SQL_TEXT_MAX);
-			tmp->type = AILSA_DB_TEXT;
+		case SQLITE_TEXT:
+			text = (const char *)sqlite3_column_text(state, i);
+			ailsa_result_set_text(results, (size_t)i, text, (size_t)sqlite3_column_bytes(state, i));
 			break;
 		case SQLITE_FLOAT:
-			tmp->data->point = sqlite3_column_double(state, (int)i);
-			tmp->type = AILSA_DB_FLOAT;
+			ailsa_result_set_point(results, (size_t)i, sqlite3_column_double(state, i));
 			break;
 		case SQLITE_NULL:
-			tmp->type = AILSA_DB_NULL;
 			break;
 		default:
 			ailsa_syslog(LOG_ERR, "Unknown sqlite type %d", type);
 			break;
 		}
-		if ((retval = ailsa_list_insert(results, tmp) != 0))
-			ailsa_syslog(LOG_ERR, "Cannot insert data %hi into list in ailsa_store_basic_sqlite", i);
 	}
 }
 
@@ -2194,3 +2665,374 @@ ailsa_bind_arguments_sqlite(sqlite3_stmt *state, AILLIST *args, unsigned int t,
 }
 
 #endif
+
+#ifdef HAVE_LIBPQ
+static int
+ailsa_basic_query_pgsql(ailsa_cmdb_s *cmdb, const char *query, ailsa_result_s *results, ailsa_row_fn cb, void *ctx)
+{
+	if (!(cmdb) || !(query) || !(results))
+		return AILSA_NO_DATA;
+	int retval;
+	PGconn *pg = NULL;
+
+	if ((retval = ailsa_pgsql_session(cmdb, &pg)) != 0)
+		return retval;
+	if (PQsendQueryParams(pg, query, 0, NULL, NULL, NULL, NULL, 0) == 0) {
+		ailsa_syslog(LOG_ERR, "PostgreSQL query failed: %s", PQerrorMessage(pg));
+		return AILSA_QUERY_FAIL;
+	}
+	if (cb)
+		PQsetSingleRowMode(pg);
+	return ailsa_get_results_pgsql(pg, results, cb, ctx);
+}
+
+static int
+ailsa_argument_query_pgsql(ailsa_cmdb_s *cmdb, const struct ailsa_sql_query_s argument, AILLIST *args, AILLIST *results)
+{
+	if (!(cmdb) || !(args) || !(results))
+		return AILSA_NO_DATA;
+	int retval;
+	char *query = NULL;
+	char **values = NULL;
+	PGconn *pg = NULL;
+	ailsa_result_s *r;
+
+	if ((retval = ailsa_pgsql_session(cmdb, &pg)) != 0)
+		return retval;
+	if ((retval = ailsa_bind_arguments_pgsql(args, argument.number, argument.fields, &values)) != 0) {
+		ailsa_syslog(LOG_ERR, "Unable to bind PostgreSQL arguments: got error %d", retval);
+		return retval;
+	}
+	query = ailsa_pgsql_convert_query(argument.query);
+	r = ailsa_result_init();
+	if (PQsendQueryParams(pg, query, (int)argument.number, NULL, (const char * const *)values, NULL, NULL, 0) == 0) {
+		ailsa_syslog(LOG_ERR, "PostgreSQL query failed: %s", PQerrorMessage(pg));
+		retval = AILSA_QUERY_FAIL;
+		goto cleanup;
+	}
+	if ((retval = ailsa_get_results_pgsql(pg, r, NULL, NULL)) == 0)
+		retval = ailsa_result_to_list(r, results);
+	cleanup:
+		ailsa_result_clean(r);
+		ailsa_free_arguments_pgsql(values, argument.number);
+		my_free(query);
+		return retval;
+}
+
+static int
+ailsa_cached_argument_query_pgsql(ailsa_cmdb_s *cmdb, unsigned int query_no, AILLIST *args, ailsa_result_s *results, ailsa_row_fn cb, void *ctx)
+{
+	if (!(cmdb) || !(args) || !(results))
+		return AILSA_NO_DATA;
+	int retval;
+	char name[MAC_LEN];
+	char **values = NULL;
+	PGconn *pg;
+	const struct ailsa_sql_query_s argument = argument_queries[query_no];
+
+	if ((retval = ailsa_pgsql_cached_stmt(cmdb, query_no, argument.query, name, MAC_LEN)) != 0)
+		return retval;
+	pg = ailsa_sql_conn(cmdb)->pg;
+	if ((retval = ailsa_bind_arguments_pgsql(args, argument.number, argument.fields, &values)) != 0) {
+		ailsa_syslog(LOG_ERR, "Unable to bind PostgreSQL arguments: got error %d", retval);
+		return retval;
+	}
+	if (PQsendQueryPrepared(pg, name, (int)argument.number, (const char * const *)values, NULL, NULL, 0) == 0) {
+		ailsa_syslog(LOG_ERR, "PostgreSQL query failed: %s", PQerrorMessage(pg));
+		retval = AILSA_QUERY_FAIL;
+	} else {
+		if (cb)
+			PQsetSingleRowMode(pg);
+		retval = ailsa_get_results_pgsql(pg, results, cb, ctx);
+	}
+	ailsa_free_arguments_pgsql(values, argument.number);
+	return retval;
+}
+
+// Inserts, updates and deletes; none of them return rows
+static int
+ailsa_write_query_pgsql(ailsa_cmdb_s *cmdb, const char *query, AILLIST *args, unsigned int t, const unsigned int *f)
+{
+	if (!(cmdb) || !(query) || !(args))
+		return AILSA_NO_DATA;
+	int retval;
+	char *pg_query;
+	char **values = NULL;
+	PGconn *pg = NULL;
+	PGresult *res;
+
+	if ((retval = ailsa_pgsql_session(cmdb, &pg)) != 0)
+		return retval;
+	if ((retval = ailsa_bind_arguments_pgsql(args, t, f, &values)) != 0) {
+		ailsa_syslog(LOG_ERR, "Unable to bind PostgreSQL arguments: got error %d", retval);
+		return retval;
+	}
+	pg_query = ailsa_pgsql_convert_query(query);
+	res = PQexecParams(pg, pg_query, (int)t, NULL, (const char * const *)values, NULL, NULL, 0);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+		ailsa_syslog(LOG_ERR, "PostgreSQL query failed: %s", PQresultErrorMessage(res));
+		retval = AILSA_STATEMENT_FAIL;
+	}
+	PQclear(res);
+	ailsa_free_arguments_pgsql(values, t);
+	my_free(pg_query);
+	return retval;
+}
+
+/*
+ * Send every query (and a Parse for any statement this session has not
+ * prepared yet) before reading the first result, so the whole batch costs
+ * one round trip. An error aborts the rest of the pipeline; we still read
+ * it all back so the connection is usable afterwards.
+ */
+static int
+ailsa_query_batch_pgsql(ailsa_cmdb_s *cmdb, ailsa_sql_batch_s *batch, size_t n)
+{
+	int retval, status;
+	char name[MAC_LEN];
+	char *query;
+	char ***values;
+	unsigned char *parse;
+	unsigned int q;
+	size_t i, sent, total;
+	PGconn *pg = NULL;
+	PGresult *res;
+	ailsa_result_s *r;
+	ailsa_sql_conn_s *conn;
+	struct timespec start;
+
+	if ((retval = ailsa_pgsql_session(cmdb, &pg)) != 0)
+		return retval;
+	conn = ailsa_sql_conn(cmdb);
+	if (!(conn->pg_stmt))
+		conn->pg_stmt = ailsa_calloc(argument_query_total, "conn->pg_stmt in ailsa_query_batch_pgsql");
+	values = ailsa_calloc(sizeof(char **) * n, "values in ailsa_query_batch_pgsql");
+	parse = ailsa_calloc(n, "parse in ailsa_query_batch_pgsql");
+// Bind everything first so a bad list does not leave half a pipeline on the wire
+	for (i = 0; i < n; i++) {
+		if (!(batch[i].args))
+			continue;
+		q = batch[i].query_no;
+		if ((retval = ailsa_bind_arguments_pgsql(batch[i].args, argument_queries[q].number, argument_queries[q].fields, &values[i])) != 0) {
+			ailsa_syslog(LOG_ERR, "Unable to bind PostgreSQL arguments for query %u: got error %d", q, retval);
+			goto cleanup;
+		}
+	}
+	if (PQenterPipelineMode(pg) == 0) {
+		ailsa_syslog(LOG_ERR, "Cannot enter PostgreSQL pipeline mode: %s", PQerrorMessage(pg));
+		retval = AILSA_QUERY_FAIL;
+		goto cleanup;
+	}
+	for (sent = 0; sent < n; sent++) {
+		q = batch[sent].query_no;
+		if (!(batch[sent].args)) {
+			if (PQsendQueryParams(pg, basic_queries[q], 0, NULL, NULL, NULL, NULL, 0) == 0)
+				break;
+			continue;
+		}
+		snprintf(name, MAC_LEN, "ailsa_%u", q);
+		if (conn->pg_stmt[q] == 0) {
+			conn->misses++;
+			query = ailsa_pgsql_convert_query(argument_queries[q].query);
+			status = PQsendPrepare(pg, name, query, 0, NULL);
+			my_free(query);
+			if (status == 0)
+				break;
+			conn->pg_stmt[q] = 1;
+			parse[sent] = 1;
+		} else {
+			conn->hits++;
+		}
+		if (PQsendQueryPrepared(pg, name, (int)argument_queries[q].number, (const char * const *)values[sent], NULL, NULL, 0) == 0)
+			break;
+	}
+	if (sent < n) {
+		ailsa_syslog(LOG_ERR, "Cannot send PostgreSQL query %zu of %zu: %s", sent + 1, n, PQerrorMessage(pg));
+		retval = AILSA_QUERY_FAIL;
+	}
+	if (PQpipelineSync(pg) == 0) {
+		ailsa_syslog(LOG_ERR, "Cannot sync PostgreSQL pipeline: %s", PQerrorMessage(pg));
+		retval = AILSA_QUERY_FAIL;
+		goto cleanup;
+	}
+// Each query is timed from when the one before it finished arriving
+	ailsa_sql_stats_start(cmdb, &start);
+	for (i = 0; (i < n) && ((i < sent) || (parse[i])); i++) {
+		if (parse[i]) {
+			if ((status = ailsa_get_results_pgsql(pg, NULL, NULL, NULL)) != 0) {
+				conn->pg_stmt[batch[i].query_no] = 0;
+				if (retval == 0)
+					retval = status;
+			}
+		}
+		if (i >= sent)
+			break;
+		r = ailsa_result_init();
+		status = ailsa_get_results_pgsql(pg, r, NULL, NULL);
+		if ((status == 0) && (retval == 0)) {
+			total = batch[i].results->total;
+			status = ailsa_result_to_list(r, batch[i].results);
+			batch[i].total = batch[i].results->total - total;
+		}
+		if ((status != 0) && (retval == 0))
+			retval = status;
+		ailsa_sql_stats_record(cmdb, batch[i].args ? AILSA_STATS_ARGUMENT : AILSA_STATS_BASIC, batch[i].query_no, &start, r->fetched, r->copied);
+		ailsa_sql_stats_start(cmdb, &start);
+		ailsa_result_clean(r);
+	}
+	if ((res = PQgetResult(pg))) {
+		if (PQresultStatus(res) != PGRES_PIPELINE_SYNC)
+			ailsa_syslog(LOG_ERR, "Expected end of PostgreSQL pipeline; got %s", PQresStatus(PQresultStatus(res)));
+		PQclear(res);
+	}
+	if (PQexitPipelineMode(pg) == 0) {
+		ailsa_syslog(LOG_ERR, "Cannot leave PostgreSQL pipeline mode: %s", PQerrorMessage(pg));
+		if (retval == 0)
+			retval = AILSA_QUERY_FAIL;
+	}
+	cleanup:
+		for (i = 0; i < n; i++)
+			if (batch[i].args)
+				ailsa_free_arguments_pgsql(values[i], argument_queries[batch[i].query_no].number);
+		my_free(values);
+		my_free(parse);
+		return retval;
+}
+
+// Read everything the last query sent back. Rows stop being stored once cb returns non zero
+static int
+ailsa_get_results_pgsql(PGconn *pg, ailsa_result_s *results, ailsa_row_fn cb, void *ctx)
+{
+	int retval = 0;
+	int i, rows;
+	PGresult *res;
+
+	while ((res = PQgetResult(pg))) {
+		switch (PQresultStatus(res)) {
+		case PGRES_SINGLE_TUPLE:
+		case PGRES_TUPLES_OK:
+			rows = PQntuples(res);
+			for (i = 0; (i < rows) && (results) && (retval == 0); i++) {
+				if (cb)
+					ailsa_result_reset(results);
+				ailsa_store_pgsql_row(res, i, results);
+				if (cb)
+					retval = cb(results, ctx);
+			}
+			break;
+		case PGRES_COMMAND_OK:
+			break;
+		case PGRES_PIPELINE_ABORTED:
+			if (retval == 0)
+				retval = AILSA_QUERY_FAIL;
+			break;
+		default:
+			if (retval == 0) {
+				ailsa_syslog(LOG_ERR, "PostgreSQL query failed: %s", PQresultErrorMessage(res));
+				retval = AILSA_QUERY_FAIL;
+			}
+			break;
+		}
+		PQclear(res);
+	}
+	return retval;
+}
+
+static void
+ailsa_store_pgsql_row(PGresult *res, int row, ailsa_result_s *results)
+{
+	int fields, i;
+	const char *value;
+
+	fields = PQnfields(res);
+	if (ailsa_result_add_row(results, (size_t)fields) != 0)
+		return;
+	for (i = 0; i < fields; i++) {
+		if (PQgetisnull(res, row, i))
+			continue;
+		value = PQgetvalue(res, row, i);
+		switch (PQftype(res, i)) {
+		case AILSA_PG_INT8:
+		case AILSA_PG_INT4:
+		case AILSA_PG_OID:
+			ailsa_result_set_number(results, (size_t)i, (unsigned long int)strtoll(value, NULL, 10));
+			break;
+		case AILSA_PG_INT2:
+			ailsa_result_set_small(results, (size_t)i, (short int)strtol(value, NULL, 10));
+			break;
+		case AILSA_PG_FLOAT4:
+		case AILSA_PG_FLOAT8:
+		case AILSA_PG_NUMERIC:
+			ailsa_result_set_point(results, (size_t)i, strtod(value, NULL));
+			break;
+		default:
+			ailsa_result_set_text(results, (size_t)i, value, (size_t)PQgetlength(res, row, i));
+			break;
+		}
+	}
+}
+
+// Parameters all go over as text; the server casts them to the column types
+static int
+ailsa_bind_arguments_pgsql(AILLIST *args, unsigned int t, const unsigned int *f, char ***values)
+{
+	if (!(args) || !(values))
+		return AILSA_NO_DATA;
+	char **v = ailsa_calloc(sizeof(char *) * (t + 1), "v in ailsa_bind_arguments_pgsql");
+	int retval = 0;
+	unsigned int i;
+	ailsa_data_s *data;
+	AILELEM *tmp = args->head;
+
+	for (i = 0; i < t; i++) {
+		if (!(tmp)) {
+			ailsa_syslog(LOG_ERR, "List stopped with %u of %u arguments bound for PostgreSQL", i, t);
+			retval = AILSA_WRONG_LIST_LENGHT;
+			goto cleanup;
+		}
+		data = tmp->data;
+		switch (f[i]) {
+		case AILSA_DB_TEXT:
+			if (data->data->text)
+				v[i] = strdup(data->data->text);
+			break;
+		case AILSA_DB_LINT:
+			v[i] = ailsa_calloc(MAC_LEN, "v[i] in ailsa_bind_arguments_pgsql");
+			snprintf(v[i], MAC_LEN, "%lu", data->data->number);
+			break;
+		case AILSA_DB_SINT:
+			v[i] = ailsa_calloc(MAC_LEN, "v[i] in ailsa_bind_arguments_pgsql");
+			snprintf(v[i], MAC_LEN, "%hd", data->data->small);
+			break;
+		case AILSA_DB_FLOAT:
+			v[i] = ailsa_calloc(MAC_LEN, "v[i] in ailsa_bind_arguments_pgsql");
+			snprintf(v[i], MAC_LEN, "%.17g", data->data->point);
+			break;
+		default:
+			ailsa_syslog(LOG_ERR, "Unknown SQL type %u", f[i]);
+			retval = AILSA_INVALID_DBTYPE;
+			goto cleanup;
+		}
+		tmp = tmp->next;
+	}
+	cleanup:
+		if (retval != 0)
+			ailsa_free_arguments_pgsql(v, t);
+		else
+			*values = v;
+		return retval;
+}
+
+static void
+ailsa_free_arguments_pgsql(char **values, unsigned int t)
+{
+	unsigned int i;
+
+	if (!(values))
+		return;
+	for (i = 0; i < t; i++)
+		my_free(values[i]);
+	free(values);
+}
+
+#endif // HAVE_LIBPQ
@@ -0,0 +1,552 @@
+/*
+ *
+ *  alisacmdb: Alisatech Configuration Management Database library
+ *  Copyright (C) 2015 Iain M Conochie <iain-AT-thargoid.co.uk>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *  rndc.c
+ *
+ *  Client for the BIND control channel, in place of running rndc
+ *
+ *  Messages are tables of named values, each preceded by its length and
+ *  signed with HMAC-SHA256 using the secret from RNDC_KEY. The first
+ *  message on a connection fetches a nonce from named; every command
+ *  after that carries it, so one connection can send a batch of
+ *  reload <zone> commands.
+ *
+ */
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <ailsacmdb.h>
+
+enum {			// Control channel wire format
+	RNDC_VERSION = 1,
+	RNDC_TYPE_BINARY = 1,
+	RNDC_TYPE_TABLE = 2,
+	RNDC_ALG_SHA256 = 163,	// Algorithm number named uses for hmac-sha256
+	RNDC_SIG_LEN = 88,	// Base64 signature, padded with zeros
+	RNDC_EXPIRE = 60,
+	RNDC_TIMEOUT = 30,
+	RNDC_MAX_MESSAGE = 65536
+};
+
+typedef struct rndc_buf_s {	// Message being built
+	unsigned char data[BUFFER_LEN];
+	size_t len;
+	int error;
+} rndc_buf_s;
+
+static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void
+rndc_sign(const unsigned char *key, size_t klen, const unsigned char *data, size_t len, unsigned char *sig);
+
+static void
+rndc_put(rndc_buf_s *b, const void *data, size_t len);
+
+static void
+rndc_put_byte(rndc_buf_s *b, unsigned char c);
+
+static void
+rndc_put_uint32(rndc_buf_s *b, unsigned long int n);
+
+static void
+rndc_put_key(rndc_buf_s *b, const char *key);
+
+static void
+rndc_put_string(rndc_buf_s *b, const char *key, const char *value);
+
+static void
+rndc_put_number(rndc_buf_s *b, const char *key, unsigned long int n);
+
+static size_t
+rndc_table_start(rndc_buf_s *b, const char *key);
+
+static void
+rndc_table_end(rndc_buf_s *b, size_t start);
+
+static unsigned long int
+rndc_get_uint32(const unsigned char *p);
+
+static int
+rndc_find(const unsigned char *table, size_t len, const char *key, int type, const unsigned char **value, size_t *vlen);
+
+static int
+rndc_find_string(const unsigned char *table, size_t len, const char *key, char *str, size_t size);
+
+static int
+rndc_send(ailsa_rndc_s *r, const char *command, unsigned char **reply, size_t *len);
+
+static int
+rndc_write(int fd, const unsigned char *data, size_t len);
+
+static int
+rndc_read(int fd, unsigned char *data, size_t len);
+
+int
+ailsa_rndc_open(ailsa_cmdb_s *cbs, ailsa_rndc_s **rndc)
+{
+	if (!(cbs) || !(rndc) || !(cbs->rndc_key))
+		return AILSA_NO_DATA;
+	int retval = 0, fd = -1;
+	char port[SERVICE_LEN];
+	const char *server = (cbs->rndc_server) ? cbs->rndc_server : "127.0.0.1";
+	unsigned char *reply = NULL;
+	size_t len;
+	struct addrinfo hints, *res = NULL, *p;
+	struct timeval tv;
+	struct timespec ts;
+	ailsa_rndc_s *r = ailsa_calloc(sizeof(ailsa_rndc_s), "r in ailsa_rndc_open");
+
+	r->fd = -1;
+	if ((retval = ailsa_read_key_file(cbs->rndc_key, NULL, 0, r->secret, &(r->slen))) != 0)
+		goto cleanup;
+	snprintf(port, SERVICE_LEN, "%u", (cbs->rndc_port > 0) ? cbs->rndc_port : 953);
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if ((retval = getaddrinfo(server, port, &hints, &res)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot resolve control channel %s: %s", server, gai_strerror(retval));
+		retval = AILSA_GETADDR_FAIL;
+		goto cleanup;
+	}
+	tv.tv_sec = RNDC_TIMEOUT;
+	tv.tv_usec = 0;
+	for (p = res; p; p = p->ai_next) {
+		if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0)
+			continue;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		if (connect(fd, p->ai_addr, p->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	if (fd < 0) {
+		ailsa_syslog(LOG_ERR, "Cannot connect to control channel %s port %s: %s", server, port, strerror(errno));
+		retval = AILSA_NO_CONNECT;
+		goto cleanup;
+	}
+	r->fd = fd;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	r->serial = (unsigned long int)(ts.tv_nsec ^ getpid()) & 0x7fffffff;
+// named answers the null command with the nonce for this connection
+	if ((retval = rndc_send(r, "null", &reply, &len)) != 0)
+		goto cleanup;
+	if (r->nonce == 0) {
+		ailsa_syslog(LOG_ERR, "No nonce from control channel %s", server);
+		retval = AILSA_RNDC_FAIL;
+	}
+	cleanup:
+		if (res)
+			freeaddrinfo(res);
+		my_free(reply);
+		if (retval != 0)
+			ailsa_rndc_close(r);
+		else
+			*rndc = r;
+		return retval;
+}
+
+// The text named sends back, if any, is copied into text
+int
+ailsa_rndc_command(ailsa_rndc_s *r, const char *command, char *text, size_t size)
+{
+	if (!(r) || !(command))
+		return AILSA_NO_DATA;
+	int retval;
+	char result[MAC_LEN], err[BUFFER_LEN];
+	const unsigned char *data;
+	unsigned char *reply = NULL;
+	size_t len, dlen;
+
+	if (text)
+		memset(text, 0, size);
+	if ((retval = rndc_send(r, command, &reply, &len)) != 0)
+		goto cleanup;
+	if (rndc_find(reply + 4, len - 4, "_data", RNDC_TYPE_TABLE, &data, &dlen) != 0) {
+		ailsa_syslog(LOG_ERR, "No data in control channel reply to %s", command);
+		retval = AILSA_RNDC_FAIL;
+		goto cleanup;
+	}
+	if (text)
+		rndc_find_string(data, dlen, "text", text, size);
+	if ((rndc_find_string(data, dlen, "result", result, MAC_LEN) == 0) && (strcmp(result, "0") != 0)) {
+		if (rndc_find_string(data, dlen, "err", err, BUFFER_LEN) != 0)
+			snprintf(err, BUFFER_LEN, "result %s", result);
+		ailsa_syslog(LOG_ERR, "%s: %s", command, err);
+		retval = AILSA_RNDC_FAIL;
+	}
+	cleanup:
+		my_free(reply);
+		return retval;
+}
+
+void
+ailsa_rndc_close(ailsa_rndc_s *r)
+{
+	if (!(r))
+		return;
+	if (r->fd >= 0)
+		close(r->fd);
+	memset(r->secret, 0, sizeof(r->secret));
+	my_free(r);
+}
+
+// Without RNDC_KEY, fall back to RNDC reload. Otherwise reconfig if the zone
+// configuration changed, then reload each zone in zones; every zone is tried
+int
+ailsa_rndc_reload(ailsa_cmdb_s *cbs, AILLIST *zones, short int reconfig)
+{
+	if (!(cbs))
+		return AILSA_NO_DATA;
+	int retval = 0, ret;
+	char command[CONFIG_LEN], text[BUFFER_LEN];
+	const char *zone;
+	AILELEM *e;
+	ailsa_rndc_s *r = NULL;
+
+	if (!(cbs->rndc_key)) {
+		snprintf(command, CONFIG_LEN, "%s reload", cbs->rndc);
+		if ((retval = system(command)) != 0)
+			ailsa_syslog(LOG_ERR, "Reload of nameserver failed");
+		return retval;
+	}
+	if ((reconfig == 0) && (!(zones) || (zones->total == 0)))
+		return 0;
+	if ((retval = ailsa_rndc_open(cbs, &r)) != 0) {
+		ailsa_syslog(LOG_ERR, "Reload of nameserver failed");
+		return retval;
+	}
+	if (reconfig > 0) {
+		if ((retval = ailsa_rndc_command(r, "reconfig", NULL, 0)) != 0)
+			goto cleanup;
+		ailsa_syslog(LOG_INFO, "Name server configuration reloaded");
+	}
+	for (e = (zones) ? zones->head : NULL; e; e = e->next) {
+		zone = ((ailsa_data_s *)e->data)->data->text;
+		snprintf(command, CONFIG_LEN, "reload %s", zone);
+		if ((ret = ailsa_rndc_command(r, command, text, BUFFER_LEN)) != 0)
+			retval = ret;
+		else
+			ailsa_syslog(LOG_INFO, "Zone %s: %s", zone, (*text) ? text : "reloaded");
+	}
+	cleanup:
+		ailsa_rndc_close(r);
+		return retval;
+}
+
+// Send one command and read the reply; *reply is freed by the caller
+static int
+rndc_send(ailsa_rndc_s *r, const char *command, unsigned char **reply, size_t *len)
+{
+	int retval = 0;
+	unsigned char head[4];
+	unsigned char sig[RNDC_SIG_LEN];
+	const unsigned char *auth, *ctrl, *hsha;
+	char nonce[MAC_LEN];
+	size_t auth_start, ctrl_start, data_start, sign_start, sig_off, alen, clen, hlen, i, total;
+	unsigned long int now = (unsigned long int)time(NULL);
+	rndc_buf_s *b = ailsa_calloc(sizeof(rndc_buf_s), "b in rndc_send");
+
+	*reply = NULL;
+	*len = 0;
+	rndc_put_uint32(b, 0);
+	rndc_put_uint32(b, RNDC_VERSION);
+// _auth comes first; the signature covers everything after it
+	auth_start = rndc_table_start(b, "_auth");
+	rndc_put_key(b, "hsha");
+	rndc_put_byte(b, RNDC_TYPE_BINARY);
+	rndc_put_uint32(b, RNDC_SIG_LEN + 1);
+	rndc_put_byte(b, RNDC_ALG_SHA256);
+	sig_off = b->len;
+	memset(sig, 0, RNDC_SIG_LEN);
+	rndc_put(b, sig, RNDC_SIG_LEN);
+	rndc_table_end(b, auth_start);
+	sign_start = b->len;
+	ctrl_start = rndc_table_start(b, "_ctrl");
+	rndc_put_number(b, "_ser", ++r->serial);
+	rndc_put_number(b, "_tim", now);
+	rndc_put_number(b, "_exp", now + RNDC_EXPIRE);
+	if (r->nonce != 0)
+		rndc_put_number(b, "_nonce", r->nonce);
+	rndc_table_end(b, ctrl_start);
+	data_start = rndc_table_start(b, "_data");
+	rndc_put_string(b, "type", command);
+	rndc_table_end(b, data_start);
+	if (b->error != 0) {
+		ailsa_syslog(LOG_ERR, "Control channel command too long: %s", command);
+		retval = AILSA_BUFFER_TOO_SMALL;
+		goto cleanup;
+	}
+	rndc_sign(r->secret, r->slen, b->data + sign_start, b->len - sign_start, sig);
+	memcpy(b->data + sig_off, sig, RNDC_SIG_LEN);
+	total = b->len - 4;
+	for (i = 0; i < 4; i++)
+		b->data[i] = (unsigned char)((total >> (24 - (i * 8))) & 0xff);
+	if ((retval = rndc_write(r->fd, b->data, b->len)) != 0)
+		goto cleanup;
+	if ((retval = rndc_read(r->fd, head, 4)) != 0)
+		goto cleanup;
+	total = rndc_get_uint32(head);
+	if ((total < 4) || (total > RNDC_MAX_MESSAGE)) {
+		ailsa_syslog(LOG_ERR, "Bad control channel message length %zu", total);
+		retval = AILSA_RNDC_FAIL;
+		goto cleanup;
+	}
+	*reply = ailsa_calloc(total, "reply in rndc_send");
+	if ((retval = rndc_read(r->fd, *reply, total)) != 0)
+		goto cleanup;
+	*len = total;
+	if (rndc_get_uint32(*reply) != RNDC_VERSION) {
+		ailsa_syslog(LOG_ERR, "Unknown control channel version %lu", rndc_get_uint32(*reply));
+		retval = AILSA_RNDC_FAIL;
+		goto cleanup;
+	}
+// Check the reply is signed with our key: _auth is its first entry
+	if ((total < 10) || ((*reply)[4] != 5) || (memcmp(*reply + 5, "_auth", 5) != 0) ||
+	    (rndc_find(*reply + 4, total - 4, "_auth", RNDC_TYPE_TABLE, &auth, &alen) != 0) ||
+	    (rndc_find(auth, alen, "hsha", RNDC_TYPE_BINARY, &hsha, &hlen) != 0) ||
+	    (hlen != RNDC_SIG_LEN + 1) || (hsha[0] != RNDC_ALG_SHA256)) {
+		ailsa_syslog(LOG_ERR, "Control channel reply is not signed with hmac-sha256");
+		retval = AILSA_RNDC_FAIL;
+		goto cleanup;
+	}
+	sign_start = (size_t)(auth - *reply) + alen;
+	rndc_sign(r->secret, r->slen, *reply + sign_start, total - sign_start, sig);
+	if (memcmp(sig, hsha + 1, RNDC_SIG_LEN) != 0) {
+		ailsa_syslog(LOG_ERR, "Control channel reply has a bad signature");
+		retval = AILSA_RNDC_FAIL;
+		goto cleanup;
+	}
+	if ((rndc_find(*reply + 4, total - 4, "_ctrl", RNDC_TYPE_TABLE, &ctrl, &clen) == 0) &&
+	    (rndc_find_string(ctrl, clen, "_nonce", nonce, MAC_LEN) == 0))
+		r->nonce = strtoul(nonce, NULL, 10);
+	cleanup:
+		my_free(b);
+		if (retval != 0) {
+			my_free(*reply);
+			*len = 0;
+		}
+		return retval;
+}
+
+static int
+rndc_write(int fd, const unsigned char *data, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = write(fd, data, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			ailsa_syslog(LOG_ERR, "Cannot write to control channel: %s", strerror(errno));
+			return AILSA_RNDC_FAIL;
+		}
+		data += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+static int
+rndc_read(int fd, unsigned char *data, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		if ((n = read(fd, data, len)) < 0) {
+			if (errno == EINTR)
+				continue;
+			ailsa_syslog(LOG_ERR, "Cannot read from control channel: %s", strerror(errno));
+			return AILSA_RNDC_FAIL;
+		} else if (n == 0) {
+			ailsa_syslog(LOG_ERR, "Control channel closed the connection");
+			return AILSA_RNDC_FAIL;
+		}
+		data += n;
+		len -= (size_t)n;
+	}
+	return 0;
+}
+
+// Message building. b->error is set, rather than overrunning the buffer
+
+static void
+rndc_put(rndc_buf_s *b, const void *data, size_t len)
+{
+	if (b->len + len > BUFFER_LEN) {
+		b->error = 1;
+		return;
+	}
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+}
+
+static void
+rndc_put_byte(rndc_buf_s *b, unsigned char c)
+{
+	rndc_put(b, &c, 1);
+}
+
+static void
+rndc_put_uint32(rndc_buf_s *b, unsigned long int n)
+{
+	unsigned char p[4];
+
+	p[0] = (unsigned char)((n >> 24) & 0xff);
+	p[1] = (unsigned char)((n >> 16) & 0xff);
+	p[2] = (unsigned char)((n >> 8) & 0xff);
+	p[3] = (unsigned char)(n & 0xff);
+	rndc_put(b, p, 4);
+}
+
+static void
+rndc_put_key(rndc_buf_s *b, const char *key)
+{
+	unsigned char len = (unsigned char)strlen(key);
+
+	rndc_put(b, &len, 1);
+	rndc_put(b, key, len);
+}
+
+static void
+rndc_put_string(rndc_buf_s *b, const char *key, const char *value)
+{
+	size_t len = strlen(value);
+
+	rndc_put_key(b, key);
+	rndc_put_byte(b, RNDC_TYPE_BINARY);
+	rndc_put_uint32(b, len);
+	rndc_put(b, value, len);
+}
+
+// Numbers are sent as decimal strings
+static void
+rndc_put_number(rndc_buf_s *b, const char *key, unsigned long int n)
+{
+	char str[MAC_LEN];
+
+	snprintf(str, MAC_LEN, "%lu", n & 0xffffffff);
+	rndc_put_string(b, key, str);
+}
+
+// Returns where the table length goes, for rndc_table_end
+static size_t
+rndc_table_start(rndc_buf_s *b, const char *key)
+{
+	size_t start;
+
+	rndc_put_key(b, key);
+	rndc_put_byte(b, RNDC_TYPE_TABLE);
+	start = b->len;
+	rndc_put_uint32(b, 0);
+	return start;
+}
+
+static void
+rndc_table_end(rndc_buf_s *b, size_t start)
+{
+	size_t len, i;
+
+	if ((b->error != 0) || (start + 4 > b->len))
+		return;
+	len = b->len - start - 4;
+	for (i = 0; i < 4; i++)
+		b->data[start + i] = (unsigned char)((len >> (24 - (i * 8))) & 0xff);
+}
+
+// Message parsing
+
+static unsigned long int
+rndc_get_uint32(const unsigned char *p)
+{
+	return ((unsigned long int)p[0] << 24) | ((unsigned long int)p[1] << 16) |
+	  ((unsigned long int)p[2] << 8) | (unsigned long int)p[3];
+}
+
+// Look for key in one level of a table; value points into the message
+static int
+rndc_find(const unsigned char *table, size_t len, const char *key, int type, const unsigned char **value, size_t *vlen)
+{
+	size_t klen = strlen(key), pos = 0, n, size;
+
+	while (pos < len) {
+		n = table[pos++];
+		if (pos + n + 5 > len)
+			break;
+		size = rndc_get_uint32(table + pos + n + 1);
+		if (size > len - (pos + n + 5))
+			break;
+		if ((n == klen) && (memcmp(table + pos, key, n) == 0) && (table[pos + n] == type)) {
+			*value = table + pos + n + 5;
+			*vlen = size;
+			return 0;
+		}
+		pos += n + 5 + size;
+	}
+	return AILSA_NO_DATA;
+}
+
+static int
+rndc_find_string(const unsigned char *table, size_t len, const char *key, char *str, size_t size)
+{
+	const unsigned char *value;
+	size_t vlen;
+
+	if (rndc_find(table, len, key, RNDC_TYPE_BINARY, &value, &vlen) != 0)
+		return AILSA_NO_DATA;
+	if (vlen >= size)
+		vlen = size - 1;
+	memcpy(str, value, vlen);
+	str[vlen] = '\0';
+	return 0;
+}
+
+// HMAC-SHA256 of data, written as base64 and padded out with zeros
+static void
+rndc_sign(const unsigned char *key, size_t klen, const unsigned char *data, size_t len, unsigned char *sig)
+{
+	unsigned char digest[AILSA_SHA256_LEN];
+	unsigned long int v;
+	size_t i, j;
+
+	ailsa_hmac_sha256(key, klen, data, len, digest);
+	memset(sig, 0, RNDC_SIG_LEN);
+	for (i = 0, j = 0; i < AILSA_SHA256_LEN; i += 3) {
+		v = (unsigned long int)digest[i] << 16;
+		if (i + 1 < AILSA_SHA256_LEN)
+			v |= (unsigned long int)digest[i + 1] << 8;
+		if (i + 2 < AILSA_SHA256_LEN)
+			v |= digest[i + 2];
+		sig[j++] = (unsigned char)b64[(v >> 18) & 0x3f];
+		sig[j++] = (unsigned char)b64[(v >> 12) & 0x3f];
+		sig[j++] = (i + 1 < AILSA_SHA256_LEN) ? (unsigned char)b64[(v >> 6) & 0x3f] : '=';
+		sig[j++] = (i + 2 < AILSA_SHA256_LEN) ? (unsigned char)b64[v & 0x3f] : '=';
+	}
+}
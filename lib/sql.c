@@ -28,7 +28,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <syslog.h>
+#include <time.h>
+#include <pthread.h>
 #ifdef HAVE_STDBOOL_H
 # include <stdbool.h>
 #endif // HAVE_STDBOOL_H
@@ -38,9 +41,711 @@
 #ifdef HAVE_SQLITE3
 # include <sqlite3.h>
 #endif /*HAVE_SQLITE3 */
+#ifdef HAVE_LIBPQ
+# include <libpq-fe.h>
+#endif /*HAVE_LIBPQ */
 #include <ailsacmdb.h>
 #include <ailsasql.h>
 
+/*
+ * Sessions shared between threads. Each thread holds at most one session
+ * from one pool at a time; the thread locals below track it.
+ */
+typedef struct ailsa_sql_pool_s {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	ailsa_sql_conn_s **conns;	// Every session opened, for shutdown
+	ailsa_sql_conn_s **idle;	// Sessions not checked out
+	size_t size;
+	size_t open;
+	size_t nidle;
+	unsigned long int checkouts;
+	unsigned long int waits;
+	unsigned long int reconnects;
+	unsigned long long int wait_total;
+	unsigned long long int wait_max;
+} ailsa_sql_pool_s;
+
+enum {
+	AILSA_POOL_SIZE = 4,		// Sessions when neither caller nor config say
+	AILSA_POOL_IDLE = 30,		// Seconds idle before a session is checked
+	AILSA_POOL_SQLITE_WAIT = 10000	// Lock wait in ms when SQLITE_TIMEOUT is not set
+};
+
+static __thread ailsa_sql_conn_s *thread_conn;
+static __thread unsigned int thread_hold;
+#ifdef HAVE_MYSQL
+static __thread short int thread_mysql;		// mysql_thread_init() done here
+static pthread_key_t mysql_thread_key;
+static pthread_once_t mysql_thread_once = PTHREAD_ONCE_INIT;
+#endif // HAVE_MYSQL
+
+static ailsa_sql_conn_s *
+ailsa_sql_current(ailsa_cmdb_s *cmdb);
+
+static void
+ailsa_sql_free_conn(ailsa_sql_conn_s *conn);
+
+static void
+ailsa_sql_pool_destroy(ailsa_cmdb_s *cmdb);
+
+static void
+ailsa_sql_pool_ping(ailsa_sql_pool_s *pool, ailsa_sql_conn_s *conn);
+
+static void
+ailsa_sql_flush_stmt_cache(ailsa_sql_conn_s *conn);
+
+static int
+ailsa_sql_transaction(ailsa_cmdb_s *cmdb, const char *query);
+
+#ifdef HAVE_MYSQL
+static int
+ailsa_mysql_thread_init(void);
+
+static void
+ailsa_mysql_thread_key(void);
+
+static void
+ailsa_mysql_thread_exit(void *data);
+#endif // HAVE_MYSQL
+
+#ifdef HAVE_SQLITE3
+static void
+ailsa_sqlite_pragmas(ailsa_cmdb_s *cmdb, sqlite3 *sql, int rw);
+
+static int
+ailsa_sqlite_pragma(sqlite3 *sql, const char *name, const char *value, const char **allowed);
+#endif // HAVE_SQLITE3
+
+int
+ailsa_sql_open(ailsa_cmdb_s *cmdb)
+{
+	if (!(cmdb) || !(cmdb->dbtype))
+		return AILSA_NO_DBTYPE;
+	int retval = AILSA_WRONG_DBTYPE;
+
+	ailsa_sql_checkout(cmdb);
+	if ((strncmp(cmdb->dbtype, "none", SERVICE_LEN) == 0)) {
+		ailsa_syslog(LOG_ERR, "no dbtype set");
+#ifdef HAVE_MYSQL
+	} else if ((strncmp(cmdb->dbtype, "mysql", SERVICE_LEN) == 0)) {
+		MYSQL *sql = NULL;
+		retval = ailsa_mysql_session(cmdb, &sql);
+#endif // HAVE_MYSQL
+#ifdef HAVE_SQLITE3
+	} else if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0)) {
+		sqlite3 *sql = NULL;
+		retval = ailsa_sqlite_session(cmdb, 0, &sql);
+#endif // HAVE_SQLITE3
+#ifdef HAVE_LIBPQ
+	} else if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0)) {
+		PGconn *sql = NULL;
+		retval = ailsa_pgsql_session(cmdb, &sql);
+#endif // HAVE_LIBPQ
+	} else {
+		ailsa_syslog(LOG_ERR, "dbtype unavailable: %s", cmdb->dbtype);
+	}
+	ailsa_sql_checkin(cmdb);
+	return retval;
+}
+
+void
+ailsa_sql_close(ailsa_cmdb_s *cmdb)
+{
+	if (!(cmdb))
+		return;
+	ailsa_sql_conn_s *conn = cmdb->conn;
+
+	ailsa_sql_stats_dump(cmdb);
+	if (cmdb->pool) {
+		ailsa_sql_pool_destroy(cmdb);
+	} else if (conn) {
+#ifdef DEBUG
+		ailsa_syslog(LOG_DEBUG, "statement cache: %lu hits, %lu misses", conn->hits, conn->misses);
+#endif // DEBUG
+		if (conn->txn > 0) {
+			conn->txn = 1;
+			ailsa_syslog(LOG_ERR, "Closing database with open transaction; rolling back");
+			ailsa_rollback(cmdb);
+		}
+		ailsa_sql_free_conn(conn);
+		cmdb->conn = NULL;
+	} else {
+		return;
+	}
+#ifdef HAVE_MYSQL
+	if ((cmdb->dbtype) && (strncmp(cmdb->dbtype, "mysql", SERVICE_LEN) == 0))
+		mysql_library_end();
+#endif // HAVE_MYSQL
+	cmdb->disconnect = NULL;
+}
+
+static void
+ailsa_sql_free_conn(ailsa_sql_conn_s *conn)
+{
+	ailsa_sql_flush_stmt_cache(conn);
+#ifdef HAVE_MYSQL
+	if (conn->mysql) {
+		mysql_close(conn->mysql);
+		my_free(conn->mysql);
+	}
+#endif // HAVE_MYSQL
+#ifdef HAVE_SQLITE3
+	if (conn->sqlite)
+		sqlite3_close_v2(conn->sqlite);
+#endif // HAVE_SQLITE3
+#ifdef HAVE_LIBPQ
+	if (conn->pg)
+		PQfinish(conn->pg);
+#endif // HAVE_LIBPQ
+	my_free(conn);
+}
+
+/*
+ * Group writes into one transaction. Calls nest: only the outermost
+ * ailsa_begin / ailsa_commit pair touches the database. A rollback at any
+ * depth abandons the whole transaction at once; every enclosing ailsa_begin
+ * or ailsa_commit then fails with AILSA_TRANSACTION_FAIL, so no caller
+ * reports the lost work as done. A failed begin or commit leaves its level
+ * open: each level ends with a successful commit or with ailsa_rollback.
+ * With a pool, the thread keeps its session until the outermost level ends.
+ */
+int
+ailsa_begin(ailsa_cmdb_s *cmdb)
+{
+	if (!(cmdb) || !(cmdb->dbtype))
+		return AILSA_NO_DBTYPE;
+	int retval;
+	const char *query = "START TRANSACTION";
+	ailsa_sql_conn_s *conn;
+
+	ailsa_sql_checkout(cmdb);
+	conn = ailsa_sql_conn(cmdb);
+	if (conn->txn > 0) {
+		conn->txn++;
+		ailsa_sql_checkin(cmdb);
+		if (conn->aborted) {
+			ailsa_syslog(LOG_ERR, "Transaction already rolled back; cannot begin inside it");
+			return AILSA_TRANSACTION_FAIL;
+		}
+		return 0;
+	}
+// Take the write lock up front so we do not deadlock upgrading from a read
+	if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0))
+		query = "BEGIN IMMEDIATE";
+	if ((retval = ailsa_sql_transaction(cmdb, query)) != 0) {
+		ailsa_sql_checkin(cmdb);
+		return retval;
+	}
+	conn->txn = 1;
+	return 0;
+}
+
+int
+ailsa_commit(ailsa_cmdb_s *cmdb)
+{
+	if (!(cmdb))
+		return 0;
+	int retval;
+	ailsa_sql_conn_s *conn = ailsa_sql_current(cmdb);
+
+	if (!(conn) || (conn->txn == 0))
+		return 0;
+	if (conn->aborted) {
+		ailsa_syslog(LOG_ERR, "Transaction was rolled back; nothing committed");
+		return AILSA_TRANSACTION_FAIL;
+	}
+	if (conn->txn > 1) {
+		conn->txn--;
+		return 0;
+	}
+	if ((retval = ailsa_sql_transaction(cmdb, "COMMIT")) != 0) {
+		ailsa_syslog(LOG_ERR, "Commit failed; rolling back");
+		ailsa_sql_transaction(cmdb, "ROLLBACK");
+		conn->aborted = 1;
+		return retval;
+	}
+	conn->txn = 0;
+	ailsa_sql_checkin(cmdb);
+	return 0;
+}
+
+int
+ailsa_rollback(ailsa_cmdb_s *cmdb)
+{
+	if (!(cmdb))
+		return 0;
+	int retval = 0;
+	ailsa_sql_conn_s *conn = ailsa_sql_current(cmdb);
+
+	if (!(conn) || (conn->txn == 0))
+		return 0;
+	if (!(conn->aborted)) {
+		retval = ailsa_sql_transaction(cmdb, "ROLLBACK");
+		conn->aborted = 1;
+	}
+	if (--conn->txn > 0)
+		return retval;
+	conn->aborted = 0;
+	ailsa_sql_checkin(cmdb);
+	return retval;
+}
+
+static int
+ailsa_sql_transaction(ailsa_cmdb_s *cmdb, const char *query)
+{
+	int retval = AILSA_WRONG_DBTYPE;
+
+	if ((strncmp(cmdb->dbtype, "none", SERVICE_LEN) == 0)) {
+		ailsa_syslog(LOG_ERR, "no dbtype set");
+#ifdef HAVE_MYSQL
+	} else if ((strncmp(cmdb->dbtype, "mysql", SERVICE_LEN) == 0)) {
+		MYSQL *sql = NULL;
+		if ((retval = ailsa_mysql_session(cmdb, &sql)) != 0)
+			return retval;
+		if ((retval = mysql_query(sql, query)) != 0) {
+			ailsa_syslog(LOG_ERR, "%s failed: %s", query, mysql_error(sql));
+			retval = AILSA_TRANSACTION_FAIL;
+		}
+#endif // HAVE_MYSQL
+#ifdef HAVE_SQLITE3
+	} else if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0)) {
+		sqlite3 *sql = NULL;
+		char *errmsg = NULL;
+		if ((retval = ailsa_sqlite_session(cmdb, 1, &sql)) != 0)
+			return retval;
+		if ((retval = sqlite3_exec(sql, query, NULL, NULL, &errmsg)) != SQLITE_OK) {
+			ailsa_syslog(LOG_ERR, "%s failed: %s", query, errmsg ? errmsg : sqlite3_errstr(retval));
+			sqlite3_free(errmsg);
+			retval = AILSA_TRANSACTION_FAIL;
+		}
+#endif // HAVE_SQLITE3
+#ifdef HAVE_LIBPQ
+	} else if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0)) {
+		PGconn *sql = NULL;
+		PGresult *res;
+		if ((retval = ailsa_pgsql_session(cmdb, &sql)) != 0)
+			return retval;
+		res = PQexec(sql, query);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			ailsa_syslog(LOG_ERR, "%s failed: %s", query, PQerrorMessage(sql));
+			retval = AILSA_TRANSACTION_FAIL;
+		}
+		PQclear(res);
+#endif // HAVE_LIBPQ
+	} else {
+		ailsa_syslog(LOG_ERR, "dbtype unavailable: %s", cmdb->dbtype);
+	}
+	return retval;
+}
+
+// How many bound variables and bytes a single statement may carry
+int
+ailsa_sql_bulk_limits(ailsa_cmdb_s *cmdb, size_t *vars, size_t *bytes)
+{
+	if (!(cmdb) || !(cmdb->dbtype) || !(vars) || !(bytes))
+		return AILSA_NO_DATA;
+	int retval = AILSA_WRONG_DBTYPE;
+
+	ailsa_sql_checkout(cmdb);
+	if ((strncmp(cmdb->dbtype, "none", SERVICE_LEN) == 0)) {
+		ailsa_syslog(LOG_ERR, "no dbtype set");
+#ifdef HAVE_MYSQL
+	} else if ((strncmp(cmdb->dbtype, "mysql", SERVICE_LEN) == 0)) {
+		MYSQL *sql = NULL;
+		MYSQL_RES *res;
+		MYSQL_ROW row;
+		ailsa_sql_conn_s *conn;
+
+		if ((retval = ailsa_mysql_session(cmdb, &sql)) != 0)
+			goto cleanup;
+		conn = ailsa_sql_conn(cmdb);
+		if (conn->max_packet == 0) {
+			conn->max_packet = 1048576;	// 1MiB; the oldest server default
+			if ((mysql_query(sql, "SELECT @@max_allowed_packet") == 0) && (res = mysql_store_result(sql))) {
+				if ((row = mysql_fetch_row(res)) && (row[0]))
+					conn->max_packet = strtoul(row[0], NULL, 10);
+				mysql_free_result(res);
+			}
+		}
+		*vars = 65535;			// Placeholders per prepared statement
+		*bytes = conn->max_packet > FILE_LEN ? conn->max_packet - FILE_LEN : conn->max_packet;
+#endif // HAVE_MYSQL
+#ifdef HAVE_SQLITE3
+	} else if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0)) {
+		sqlite3 *sql = NULL;
+
+		if ((retval = ailsa_sqlite_session(cmdb, 1, &sql)) != 0)
+			goto cleanup;
+		*vars = (size_t)sqlite3_limit(sql, SQLITE_LIMIT_VARIABLE_NUMBER, -1);
+		*bytes = (size_t)sqlite3_limit(sql, SQLITE_LIMIT_SQL_LENGTH, -1);
+#endif // HAVE_SQLITE3
+#ifdef HAVE_LIBPQ
+	} else if ((strncmp(cmdb->dbtype, "postgresql", SERVICE_LEN) == 0)) {
+		*vars = 65535;			// Parameter count is an int16 on the wire
+		*bytes = 0x3fffffff;		// 1GiB; the largest query string the server takes
+		retval = 0;
+#endif // HAVE_LIBPQ
+	} else {
+		ailsa_syslog(LOG_ERR, "dbtype unavailable: %s", cmdb->dbtype);
+	}
+#if defined HAVE_MYSQL || defined HAVE_SQLITE3
+	cleanup:
+#endif // HAVE_MYSQL || HAVE_SQLITE3
+		ailsa_sql_checkin(cmdb);
+		return retval;
+}
+
+void
+ailsa_sql_stmt_cache_stats(ailsa_cmdb_s *cmdb, unsigned long int *hits, unsigned long int *misses)
+{
+	if (!(hits) || !(misses))
+		return;
+	size_t i;
+	ailsa_sql_pool_s *pool;
+
+	*hits = *misses = 0;
+	if (!(cmdb))
+		return;
+	if ((pool = cmdb->pool)) {
+		pthread_mutex_lock(&pool->lock);
+		for (i = 0; i < pool->open; i++) {
+			*hits += pool->conns[i]->hits;
+			*misses += pool->conns[i]->misses;
+		}
+		pthread_mutex_unlock(&pool->lock);
+	} else if (cmdb->conn) {
+		*hits = cmdb->conn->hits;
+		*misses = cmdb->conn->misses;
+	}
+}
+
+/*
+ * Share the database between threads. Up to size sessions are opened as
+ * they are needed (size 0 takes POOL_SIZE from cmdb.conf). Any session
+ * already open becomes the first one in the pool. sqlite sessions each
+ * open the file, so writers queue on its lock for SQLITE_TIMEOUT ms, or
+ * AILSA_POOL_SQLITE_WAIT if that is not set.
+ */
+int
+ailsa_sql_pool_init(ailsa_cmdb_s *cmdb, size_t size)
+{
+	if (!(cmdb) || !(cmdb->dbtype))
+		return AILSA_NO_DBTYPE;
+	ailsa_sql_pool_s *pool;
+
+	if (cmdb->pool)
+		return 0;
+	if (size == 0)
+		size = cmdb->pool_size > 0 ? (size_t)cmdb->pool_size : AILSA_POOL_SIZE;
+	if ((cmdb->conn) && (cmdb->conn->txn > 0)) {
+		ailsa_syslog(LOG_ERR, "Cannot pool a session with an open transaction");
+		return AILSA_POOL_FAIL;
+	}
+#ifdef HAVE_MYSQL
+	if ((strncmp(cmdb->dbtype, "mysql", SERVICE_LEN) == 0) && (mysql_library_init(0, NULL, NULL) != 0)) {
+		ailsa_syslog(LOG_ERR, "Cannot initialise mysql library");
+		return AILSA_POOL_FAIL;
+	}
+#endif // HAVE_MYSQL
+#ifdef HAVE_SQLITE3
+	if ((strncmp(cmdb->dbtype, "sqlite", SERVICE_LEN) == 0)) {
+		if (sqlite3_threadsafe() == 0) {
+			ailsa_syslog(LOG_ERR, "sqlite library built without thread support");
+			return AILSA_POOL_FAIL;
+		}
+		if (cmdb->sqlite_timeout == 0) {
+			cmdb->sqlite_timeout = AILSA_POOL_SQLITE_WAIT;
+			if ((cmdb->conn) && (cmdb->conn->sqlite))
+				sqlite3_busy_timeout(cmdb->conn->sqlite, (int)cmdb->sqlite_timeout);
+		}
+	}
+#endif // HAVE_SQLITE3
+	pool = ailsa_calloc(sizeof(ailsa_sql_pool_s), "pool in ailsa_sql_pool_init");
+	if ((pthread_mutex_init(&pool->lock, NULL) != 0) || (pthread_cond_init(&pool->cond, NULL) != 0)) {
+		ailsa_syslog(LOG_ERR, "Cannot initialise connection pool lock");
+		my_free(pool);
+		return AILSA_POOL_FAIL;
+	}
+	pool->size = size;
+	pool->conns = ailsa_calloc(sizeof(ailsa_sql_conn_s *) * size, "pool->conns in ailsa_sql_pool_init");
+	pool->idle = ailsa_calloc(sizeof(ailsa_sql_conn_s *) * size, "pool->idle in ailsa_sql_pool_init");
+	if (cmdb->conn) {
+		cmdb->conn->pool = pool;
+		pool->conns[pool->open++] = cmdb->conn;
+		pool->idle[pool->nidle++] = cmdb->conn;
+		cmdb->conn = NULL;
+	}
+	cmdb->pool = pool;
+	cmdb->disconnect = ailsa_sql_close;
+	return 0;
+}
+
+/*
+ * Give the calling thread a session until the matching checkin. Calls
+ * nest, and without a pool they do nothing. When every session is in use
+ * the thread waits for one to come back. Sessions open in whichever
+ * thread first uses them, so libmysqlclient is set up for each thread
+ * here, and torn down by ailsa_sql_thread_end() or when the thread exits.
+ */
+int
+ailsa_sql_checkout(ailsa_cmdb_s *cmdb)
+{
+	if (!(cmdb))
+		return AILSA_NO_DATA;
+	ailsa_sql_pool_s *pool = cmdb->pool;
+	ailsa_sql_conn_s *conn;
+	struct timespec start, end;
+	unsigned long long int waited;
+
+	if (!(pool))
+		return 0;
+	if (thread_conn) {
+		thread_hold++;
+		return 0;
+	}
+#ifdef HAVE_MYSQL
+	if ((thread_mysql == 0) && (strncmp(cmdb->dbtype, "mysql", SERVICE_LEN) == 0) && (ailsa_mysql_thread_init() != 0))
+		return AILSA_POOL_FAIL;
+#endif // HAVE_MYSQL
+	pthread_mutex_lock(&pool->lock);
+	pool->checkouts++;
+	if ((pool->nidle == 0) && (pool->open >= pool->size)) {
+		pool->waits++;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		while (pool->nidle == 0)
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		waited = (unsigned long long int)(end.tv_sec - start.tv_sec) * 1000000000ULL;
+		waited += (unsigned long long int)end.tv_nsec;
+		waited -= (unsigned long long int)start.tv_nsec;
+		pool->wait_total += waited;
+		if (waited > pool->wait_max)
+			pool->wait_max = waited;
+	}
+	if (pool->nidle > 0) {
+		conn = pool->idle[--pool->nidle];
+	} else {
+		conn = ailsa_calloc(sizeof(ailsa_sql_conn_s), "conn in ailsa_sql_checkout");
+		conn->pool = pool;
+		pool->conns[pool->open++] = conn;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	ailsa_sql_pool_ping(pool, conn);
+	thread_conn = conn;
+	thread_hold = 1;
+	return 0;
+}
+
+void
+ailsa_sql_checkin(ailsa_cmdb_s *cmdb)
+{
+	if (!(cmdb) || !(cmdb->pool) || !(thread_conn))
+		return;
+	ailsa_sql_pool_s *pool = cmdb->pool;
+	ailsa_sql_conn_s *conn = thread_conn;
+
+	if (--thread_hold > 0)
+		return;
+	thread_conn = NULL;
+	conn->used = time(NULL);
+	pthread_mutex_lock(&pool->lock);
+	pool->idle[pool->nidle++] = conn;
+	pthread_cond_signal(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// A thread that used the pool calls this before it returns. The thread
+// that opened the database must not; closing it cleans that thread up
+void
+ailsa_sql_thread_end(void)
+{
+#ifdef HAVE_MYSQL
+	if (thread_mysql == 0)
+		return;
+	pthread_setspecific(mysql_thread_key, NULL);
+	mysql_thread_end();
+	thread_mysql = 0;
+#endif // HAVE_MYSQL
+}
+
+#ifdef HAVE_MYSQL
+static int
+ailsa_mysql_thread_init(void)
+{
+	pthread_once(&mysql_thread_once, ailsa_mysql_thread_key);
+	if (mysql_thread_init() != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot initialise mysql library for this thread");
+		return AILSA_POOL_FAIL;
+	}
+// Any non NULL value makes the key run its destructor at thread exit
+	pthread_setspecific(mysql_thread_key, &mysql_thread_key);
+	thread_mysql = 1;
+	return 0;
+}
+
+static void
+ailsa_mysql_thread_key(void)
+{
+	pthread_key_create(&mysql_thread_key, ailsa_mysql_thread_exit);
+}
+
+// For threads that exit without calling ailsa_sql_thread_end()
+static void
+ailsa_mysql_thread_exit(void *data)
+{
+	if (data)
+		mysql_thread_end();
+}
+#endif // HAVE_MYSQL
+
+void
+ailsa_sql_pool_stats(ailsa_cmdb_s *cmdb, ailsa_sql_pool_stats_s *stats)
+{
+	if (!(stats))
+		return;
+	ailsa_sql_pool_s *pool;
+
+	memset(stats, 0, sizeof(ailsa_sql_pool_stats_s));
+	if (!(cmdb) || !(pool = cmdb->pool))
+		return;
+	pthread_mutex_lock(&pool->lock);
+	stats->size = pool->size;
+	stats->open = pool->open;
+	stats->checkouts = pool->checkouts;
+	stats->waits = pool->waits;
+	stats->reconnects = pool->reconnects;
+	stats->wait_total = pool->wait_total;
+	stats->wait_max = pool->wait_max;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// Every other thread must have checked its session back in by now
+static void
+ailsa_sql_pool_destroy(ailsa_cmdb_s *cmdb)
+{
+	size_t i;
+	ailsa_sql_pool_s *pool = cmdb->pool;
+
+	if ((thread_conn) && (thread_conn->pool == pool)) {
+		thread_hold = 1;
+		if (thread_conn->txn > 0) {
+			thread_conn->txn = 1;
+			ailsa_syslog(LOG_ERR, "Closing database with open transaction; rolling back");
+			ailsa_rollback(cmdb);
+		} else {
+			ailsa_sql_checkin(cmdb);
+		}
+	}
+	if (pool->nidle < pool->open)
+		ailsa_syslog(LOG_ERR, "Closing pool with %zu sessions checked out", pool->open - pool->nidle);
+#ifdef DEBUG
+	ailsa_syslog(LOG_DEBUG, "pool: %zu open, %lu checkouts, %lu waits, %llu ns waiting",
+	 pool->open, pool->checkouts, pool->waits, pool->wait_total);
+#endif // DEBUG
+	for (i = 0; i < pool->open; i++)
+		ailsa_sql_free_conn(pool->conns[i]);
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	my_free(pool->conns);
+	my_free(pool->idle);
+	my_free(cmdb->pool);
+}
+
+// Drop a session the server has closed; the next query opens a new one
+static void
+ailsa_sql_pool_ping(ailsa_sql_pool_s *pool, ailsa_sql_conn_s *conn)
+{
+	short int lost = 0;
+
+	if ((conn->used == 0) || (time(NULL) - conn->used < AILSA_POOL_IDLE))
+		return;
+#ifdef HAVE_MYSQL
+	if ((conn->mysql) && (mysql_ping(conn->mysql) != 0)) {
+		ailsa_syslog(LOG_ERR, "Lost mysql connection: %s", mysql_error(conn->mysql));
+		ailsa_sql_flush_stmt_cache(conn);
+		mysql_close(conn->mysql);
+		my_free(conn->mysql);
+		lost = 1;
+	}
+#endif // HAVE_MYSQL
+#ifdef HAVE_LIBPQ
+	if (conn->pg) {
+		PGresult *res = PQexec(conn->pg, "");
+
+		if (PQresultStatus(res) != PGRES_EMPTY_QUERY) {
+			ailsa_syslog(LOG_ERR, "Lost PostgreSQL connection: %s", PQerrorMessage(conn->pg));
+			ailsa_sql_flush_stmt_cache(conn);
+			PQfinish(conn->pg);
+			conn->pg = NULL;
+			lost = 1;
+		}
+		PQclear(res);
+	}
+#endif // HAVE_LIBPQ
+	if (lost > 0) {
+		pthread_mutex_lock(&pool->lock);
+		pool->reconnects++;
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+static void
+ailsa_sql_flush_stmt_cache(ailsa_sql_conn_s *conn)
+{
+	unsigned int i;
+
+#ifdef HAVE_MYSQL
+	if (conn->my_stmt) {
+		for (i = 0; i < argument_query_total; i++)
+			if (conn->my_stmt[i])
+				mysql_stmt_close(conn->my_stmt[i]);
+		my_free(conn->my_stmt);
+	}
+#endif // HAVE_MYSQL
+#ifdef HAVE_SQLITE3
+	if (conn->lite_stmt) {
+		for (i = 0; i < argument_query_total; i++)
+			if (conn->lite_stmt[i])
+				sqlite3_finalize(conn->lite_stmt[i]);
+		my_free(conn->lite_stmt);
+	}
+#endif // HAVE_SQLITE3
+#ifdef HAVE_LIBPQ
+	if (conn->pg_stmt)
+		my_free(conn->pg_stmt);
+#endif // HAVE_LIBPQ
+}
+
+/*
+ * The session queries run on. With a pool this is the calling thread's
+ * session; a thread without one checks one out and keeps it until it
+ * calls ailsa_sql_checkin.
+ */
+ailsa_sql_conn_s *
+ailsa_sql_conn(ailsa_cmdb_s *cmdb)
+{
+	if (cmdb->pool) {
+		if (!(thread_conn))
+			ailsa_sql_checkout(cmdb);
+		return thread_conn;
+	}
+	if (!(cmdb->conn)) {
+		cmdb->conn = ailsa_calloc(sizeof(ailsa_sql_conn_s), "cmdb->conn in ailsa_sql_conn");
+		cmdb->disconnect = ailsa_sql_close;
+	}
+	return cmdb->conn;
+}
+
+// As above, but never opens a session
+static ailsa_sql_conn_s *
+ailsa_sql_current(ailsa_cmdb_s *cmdb)
+{
+	if (cmdb->pool)
+		return thread_conn;
+	return cmdb->conn;
+}
+
 #ifdef HAVE_MYSQL
 
 char mysql_time[MAC_LEN];
@@ -64,6 +769,77 @@ ailsa_mysql_init(ailsa_cmdb_s *dc, MYSQL *cbc_mysql)
 	return 0;
 }
 
+int
+ailsa_mysql_session(ailsa_cmdb_s *dc, MYSQL **sql)
+{
+	if (!(dc) || !(sql))
+		return AILSA_NO_DATA;
+	int retval;
+	ailsa_sql_conn_s *conn = ailsa_sql_conn(dc);
+
+	if (!(conn->mysql)) {
+		conn->mysql = ailsa_calloc(sizeof(MYSQL), "conn->mysql in ailsa_mysql_session");
+		if ((retval = ailsa_mysql_init(dc, conn->mysql)) != 0) {
+			if (retval == AILSA_MY_CONN_FAIL)
+				mysql_close(conn->mysql);
+			my_free(conn->mysql);
+			return retval;
+		}
+	}
+	*sql = conn->mysql;
+	return 0;
+}
+
+int
+ailsa_mysql_cached_stmt(ailsa_cmdb_s *cmdb, unsigned int query_no, const char *query, MYSQL_STMT **stmt)
+{
+	if (!(cmdb) || !(query) || !(stmt))
+		return AILSA_NO_DATA;
+	int retval;
+	MYSQL *sql = NULL;
+	MYSQL_STMT *tmp = NULL;
+	ailsa_sql_conn_s *conn;
+
+	if (query_no >= argument_query_total)
+		return AILSA_NO_QUERY_NO;
+	if ((retval = ailsa_mysql_session(cmdb, &sql)) != 0)
+		return retval;
+	conn = ailsa_sql_conn(cmdb);
+	if (!(conn->my_stmt))
+		conn->my_stmt = ailsa_calloc(sizeof(MYSQL_STMT *) * argument_query_total, "conn->my_stmt in ailsa_mysql_cached_stmt");
+	if ((tmp = conn->my_stmt[query_no])) {
+		conn->hits++;
+		*stmt = tmp;
+		return 0;
+	}
+	conn->misses++;
+	if (!(tmp = mysql_stmt_init(sql))) {
+		ailsa_syslog(LOG_ERR, "Error from mysql: %s", mysql_error(sql));
+		return AILSA_STATEMENT_FAIL;
+	}
+	if ((retval = mysql_stmt_prepare(tmp, query, strlen(query))) != 0) {
+		ailsa_syslog(LOG_ERR, "Error from mysql: %s", mysql_stmt_error(tmp));
+		mysql_stmt_close(tmp);
+		return AILSA_STATEMENT_FAIL;
+	}
+	conn->my_stmt[query_no] = tmp;
+	*stmt = tmp;
+	return 0;
+}
+
+void
+ailsa_mysql_evict_stmt(ailsa_cmdb_s *cmdb, unsigned int query_no)
+{
+	if (!(cmdb) || (query_no >= argument_query_total))
+		return;
+	ailsa_sql_conn_s *conn = ailsa_sql_current(cmdb);
+
+	if ((conn) && (conn->my_stmt) && (conn->my_stmt[query_no])) {
+		mysql_stmt_close(conn->my_stmt[query_no]);
+		conn->my_stmt[query_no] = NULL;
+	}
+}
+
 int
 ailsa_mysql_query_with_checks(MYSQL *mycmdb, const char *query)
 {
@@ -172,47 +948,273 @@ ailsa_convert_mysql_time(MYSQL_TIME *time)
 #ifdef HAVE_SQLITE3
 
 int
-ailsa_setup_ro_sqlite(const char *query, const char *file, sqlite3 **cmdb, sqlite3_stmt **stmt)
+ailsa_sqlite_session(ailsa_cmdb_s *cmdb, int rw, sqlite3 **sql)
+{
+	if (!(cmdb) || !(sql))
+		return AILSA_NO_DATA;
+	int retval, flags, sqlret = 0;
+	const char *file = cmdb->file;
+	ailsa_sql_conn_s *conn = ailsa_sql_conn(cmdb);
+
+	if ((conn->sqlite) && (rw > 0) && (conn->rw == 0)) {
+		ailsa_sql_flush_stmt_cache(conn);
+		sqlite3_close_v2(conn->sqlite);
+		conn->sqlite = NULL;
+	}
+	if (!(conn->sqlite)) {
+		if (rw > 0)
+			flags = SQLITE_OPEN_READWRITE;
+		else
+			flags = SQLITE_OPEN_READONLY;
+		if ((retval = sqlite3_open_v2(file, &(conn->sqlite), flags, NULL)) > 0) {
+			ailsa_syslog(LOG_ERR, "Cannot open SQL file %s", file);
+			sqlite3_close(conn->sqlite);
+			conn->sqlite = NULL;
+			return AILSA_SQL_FILE_INIT_FAIL;
+		}
+		conn->rw = (short int)rw;
+		if (rw > 0) {
+			if ((retval = sqlite3_db_config(conn->sqlite, SQLITE_DBCONFIG_ENABLE_FKEY, 1, &sqlret)) != SQLITE_OK)
+				ailsa_syslog(LOG_ERR, "Cannot enable foreign key support in sqlite");
+			if (sqlret == 0)
+				ailsa_syslog(LOG_ERR, "Did not enable foreign key support");
+		}
+		ailsa_sqlite_pragmas(cmdb, conn->sqlite, rw);
+	}
+	*sql = conn->sqlite;
+	return 0;
+}
+
+int
+ailsa_sqlite_cached_stmt(ailsa_cmdb_s *cmdb, unsigned int query_no, const char *query, sqlite3_stmt **stmt)
 {
+	if (!(cmdb) || !(query) || !(stmt))
+		return AILSA_NO_DATA;
 	int retval;
-	if ((retval = sqlite3_open_v2(file, cmdb, SQLITE_OPEN_READONLY, NULL)) > 0) {
-		ailsa_syslog(LOG_ERR, "Cannot open SQL file %s", file);
-		return AILSA_SQL_FILE_INIT_FAIL;
+	sqlite3 *sql = NULL;
+	sqlite3_stmt *tmp = NULL;
+	ailsa_sql_conn_s *conn;
+
+	if (query_no >= argument_query_total)
+		return AILSA_NO_QUERY_NO;
+	if ((retval = ailsa_sqlite_session(cmdb, 0, &sql)) != 0)
+		return retval;
+	conn = ailsa_sql_conn(cmdb);
+	if (!(conn->lite_stmt))
+		conn->lite_stmt = ailsa_calloc(sizeof(sqlite3_stmt *) * argument_query_total, "conn->lite_stmt in ailsa_sqlite_cached_stmt");
+	if ((tmp = conn->lite_stmt[query_no])) {
+		conn->hits++;
+		*stmt = tmp;
+		return 0;
 	}
-	if ((retval = sqlite3_prepare_v2(*cmdb, query, BUFFER_LEN, stmt, NULL)) > 0) {
+	conn->misses++;
+	if ((retval = sqlite3_prepare_v2(sql, query, -1, &tmp, NULL)) != SQLITE_OK) {
 		ailsa_syslog(LOG_ERR, "Cannot prepare statement for sqlite: %s", sqlite3_errstr(retval));
-		retval = sqlite3_close(*cmdb);
 		return AILSA_STATEMENT_FAIL;
 	}
-	return retval;
+	conn->lite_stmt[query_no] = tmp;
+	*stmt = tmp;
+	return 0;
 }
 
 int
-ailsa_setup_rw_sqlite(const char *query, size_t len, const char *file, sqlite3 **cmdb, sqlite3_stmt **stmt)
+ailsa_setup_ro_sqlite(ailsa_cmdb_s *cmdb, const char *query, sqlite3_stmt **stmt)
 {
-	int retval, sqlret = 0;
-	if ((retval = sqlite3_open_v2(file, cmdb, SQLITE_OPEN_READWRITE, NULL)) > 0) {
-		ailsa_syslog(LOG_ERR, "Cannot open SQL file %s", file);
-		return AILSA_SQL_FILE_INIT_FAIL;
+	int retval;
+	sqlite3 *sql = NULL;
+
+	if ((retval = ailsa_sqlite_session(cmdb, 0, &sql)) != 0)
+		return retval;
+	if ((retval = sqlite3_prepare_v2(sql, query, -1, stmt, NULL)) > 0) {
+		ailsa_syslog(LOG_ERR, "Cannot prepare statement for sqlite: %s", sqlite3_errstr(retval));
+		return AILSA_STATEMENT_FAIL;
 	}
-	if ((retval = sqlite3_db_config(*cmdb, SQLITE_DBCONFIG_ENABLE_FKEY, 1, &sqlret)) != SQLITE_OK)
-		ailsa_syslog(LOG_ERR, "Cannot enable foreign key support in sqlite");
-	if (sqlret == 0)
-		ailsa_syslog(LOG_ERR, "Did not enable foreign key support");
-	if ((retval = sqlite3_prepare_v2(*cmdb, query, (int)len, stmt, NULL)) > 0) {
+	return retval;
+}
+
+int
+ailsa_setup_rw_sqlite(ailsa_cmdb_s *cmdb, const char *query, size_t len, sqlite3_stmt **stmt)
+{
+	int retval;
+	sqlite3 *sql = NULL;
+
+	if ((retval = ailsa_sqlite_session(cmdb, 1, &sql)) != 0)
+		return retval;
+	if ((retval = sqlite3_prepare_v2(sql, query, (int)len, stmt, NULL)) > 0) {
 		ailsa_syslog(LOG_ERR, "Cannot prepare statement for sqlite: %s", sqlite3_errstr(retval));
-		retval = sqlite3_close(*cmdb);
 		return AILSA_STATEMENT_FAIL;
 	}
 	return retval;
 }
 
 void
-ailsa_sqlite_cleanup(sqlite3 *cmdb, sqlite3_stmt *stmt)
+ailsa_sqlite_cleanup(sqlite3_stmt *stmt)
 {
 	sqlite3_finalize(stmt);
-	sqlite3_close(cmdb);
+}
+
+/*
+ * Apply the SQLITE_* settings from cmdb.conf. With SQLITE_JOURNAL=wal,
+ * readers keep working while a writer holds its transaction open.
+ * The journal mode is stored in the database file, so only a read-write
+ * open sets it. The other settings last for one connection, so every open
+ * applies them.
+ */
+static void
+ailsa_sqlite_pragmas(ailsa_cmdb_s *cmdb, sqlite3 *sql, int rw)
+{
+	const char *journal[] = { "delete", "truncate", "persist", "memory", "wal", "off", NULL };
+	const char *sync[] = { "off", "normal", "full", "extra", NULL };
+	char value[MAC_LEN];
+
+	if (cmdb->sqlite_timeout > 0)
+		sqlite3_busy_timeout(sql, (int)cmdb->sqlite_timeout);
+	if ((rw > 0) && (cmdb->sqlite_journal))
+		ailsa_sqlite_pragma(sql, "journal_mode", cmdb->sqlite_journal, journal);
+	if (cmdb->sqlite_sync)
+		ailsa_sqlite_pragma(sql, "synchronous", cmdb->sqlite_sync, sync);
+	if (cmdb->sqlite_mmap > 0) {
+		snprintf(value, MAC_LEN, "%lu", cmdb->sqlite_mmap);
+		ailsa_sqlite_pragma(sql, "mmap_size", value, NULL);
+	}
+// A negative cache_size is in KiB rather than pages
+	if (cmdb->sqlite_cache > 0) {
+		snprintf(value, MAC_LEN, "-%lu", cmdb->sqlite_cache);
+		ailsa_sqlite_pragma(sql, "cache_size", value, NULL);
+	}
+}
+
+static int
+ailsa_sqlite_pragma(sqlite3 *sql, const char *name, const char *value, const char **allowed)
+{
+	int retval;
+	char pragma[CONFIG_LEN];
+	char *errmsg = NULL;
+
+	if (allowed) {
+		while ((*allowed) && (strcasecmp(*allowed, value) != 0))
+			allowed++;
+		if (!(*allowed)) {
+			ailsa_syslog(LOG_ERR, "Invalid sqlite %s: %s", name, value);
+			return AILSA_INVALID_DBTYPE;
+		}
+	}
+	snprintf(pragma, CONFIG_LEN, "PRAGMA %s = %s", name, value);
+	if ((retval = sqlite3_exec(sql, pragma, NULL, NULL, &errmsg)) != SQLITE_OK) {
+		ailsa_syslog(LOG_ERR, "%s failed: %s", pragma, errmsg ? errmsg : sqlite3_errstr(retval));
+		sqlite3_free(errmsg);
+		return AILSA_STATEMENT_FAIL;
+	}
+	return 0;
 }
 
 #endif /*HAVE_SQLITE3*/
 
+#ifdef HAVE_LIBPQ
+
+int
+ailsa_pgsql_session(ailsa_cmdb_s *cmdb, PGconn **pg)
+{
+	if (!(cmdb) || !(pg))
+		return AILSA_NO_DATA;
+	char port[SERVICE_LEN];
+	const char *keys[] = { "host", "port", "dbname", "user", "password", NULL };
+	const char *values[6];
+	ailsa_sql_conn_s *conn = ailsa_sql_conn(cmdb);
+
+	if ((conn->pg) && (PQstatus(conn->pg) == CONNECTION_BAD)) {
+		ailsa_syslog(LOG_ERR, "Lost PostgreSQL connection: %s", PQerrorMessage(conn->pg));
+		ailsa_sql_flush_stmt_cache(conn);
+		PQfinish(conn->pg);
+		conn->pg = NULL;
+	}
+	if (!(conn->pg)) {
+// A socket directory wins over the host name, as it does for mysql
+		values[0] = cmdb->socket ? cmdb->socket : cmdb->host;
+		values[1] = NULL;
+		if (cmdb->port > 0) {
+			snprintf(port, SERVICE_LEN, "%u", cmdb->port);
+			values[1] = port;
+		}
+		values[2] = cmdb->db;
+		values[3] = cmdb->user;
+		values[4] = cmdb->pass;
+		values[5] = NULL;
+		conn->pg = PQconnectdbParams(keys, values, 0);
+		if (PQstatus(conn->pg) != CONNECTION_OK) {
+			ailsa_syslog(LOG_ERR, "PostgreSQL connection failed: %s", PQerrorMessage(conn->pg));
+			PQfinish(conn->pg);
+			conn->pg = NULL;
+			return AILSA_PG_CONN_FAIL;
+		}
+	}
+	*pg = conn->pg;
+	return 0;
+}
+
+// Prepare argument query query_no once per session and return its name
+int
+ailsa_pgsql_cached_stmt(ailsa_cmdb_s *cmdb, unsigned int query_no, const char *query, char *name, size_t len)
+{
+	if (!(cmdb) || !(query) || !(name) || (len == 0))
+		return AILSA_NO_DATA;
+	int retval;
+	char *pg_query;
+	PGconn *pg = NULL;
+	PGresult *res;
+	ailsa_sql_conn_s *conn;
+
+	if (query_no >= argument_query_total)
+		return AILSA_NO_QUERY_NO;
+	if ((retval = ailsa_pgsql_session(cmdb, &pg)) != 0)
+		return retval;
+	conn = ailsa_sql_conn(cmdb);
+	if (!(conn->pg_stmt))
+		conn->pg_stmt = ailsa_calloc(argument_query_total, "conn->pg_stmt in ailsa_pgsql_cached_stmt");
+	snprintf(name, len, "ailsa_%u", query_no);
+	if (conn->pg_stmt[query_no]) {
+		conn->hits++;
+		return 0;
+	}
+	conn->misses++;
+	pg_query = ailsa_pgsql_convert_query(query);
+	res = PQprepare(pg, name, pg_query, 0, NULL);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+		ailsa_syslog(LOG_ERR, "Cannot prepare statement for PostgreSQL: %s", PQerrorMessage(pg));
+		retval = AILSA_STATEMENT_FAIL;
+	} else {
+		conn->pg_stmt[query_no] = 1;
+	}
+	PQclear(res);
+	my_free(pg_query);
+	return retval;
+}
+
+// Rewrite the ? placeholders our queries use as $1, $2 ... for the server
+char *
+ailsa_pgsql_convert_query(const char *query)
+{
+	if (!(query))
+		return NULL;
+	char *pg_query, *p;
+	const char *q;
+	short int quoted = 0;
+	unsigned int n = 0;
+	size_t len = strlen(query) + 1;
+
+	for (q = query; *q; q++)
+		if (*q == '?')
+			len += 5;	// $65535 at the most
+	pg_query = ailsa_calloc(len, "pg_query in ailsa_pgsql_convert_query");
+	for (p = pg_query, q = query; *q; q++) {
+		if (*q == '\'')
+			quoted = !quoted;
+		if ((*q == '?') && (quoted == 0))
+			p += sprintf(p, "$%u", ++n);
+		else
+			*p++ = *q;
+	}
+	return pg_query;
+}
+
+#endif // HAVE_LIBPQ
@@ -0,0 +1,313 @@
+/*
+ *
+ *  cmdb: Configuration Management Database
+ *  Copyright (C) 2020  Iain M Conochie <iain-AT-thargoid.co.uk>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *  sql_result.c
+ *
+ *
+ *  Columnar result sets for libailsasql
+ *
+ *  Each column is a pair of arrays (cell type and value) indexed by row.
+ *  Text and time values are copied into one arena owned by the result set
+ *  and the cell holds the offset, so a query costs a handful of
+ *  allocations no matter how many rows come back.
+ *
+ */
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#endif // HAVE_STDBOOL_H
+#ifdef HAVE_MYSQL
+# include <mysql.h>
+#endif /*HAVE_MYSQL */
+#include <ailsacmdb.h>
+#include <ailsasql.h>
+
+static void
+ailsa_result_grow(ailsa_result_s *r);
+
+static size_t
+ailsa_result_store(ailsa_result_s *r, const void *data, size_t len);
+
+static const ailsa_data_u *
+ailsa_result_cell(ailsa_result_s *r, size_t row, size_t col, unsigned int type);
+
+ailsa_result_s *
+ailsa_result_init(void)
+{
+	return ailsa_calloc(sizeof(ailsa_result_s), "r in ailsa_result_init");
+}
+
+void
+ailsa_result_clean(ailsa_result_s *r)
+{
+	size_t i;
+
+	if (!(r))
+		return;
+	if (r->col) {
+		for (i = 0; i < r->cols; i++) {
+			my_free(r->col[i].type);
+			my_free(r->col[i].data);
+		}
+		my_free(r->col);
+	}
+	if (r->arena)
+		my_free(r->arena);
+	my_free(r);
+}
+
+// Empty the result but keep its buffers, so it can be refilled row by row
+void
+ailsa_result_reset(ailsa_result_s *r)
+{
+	if (!(r))
+		return;
+	r->rows = 0;
+	r->arena_len = 0;
+}
+
+int
+ailsa_result_add_row(ailsa_result_s *r, size_t cols)
+{
+	if (!(r) || (cols == 0))
+		return AILSA_NO_DATA;
+	size_t i;
+
+	if (!(r->col)) {
+		r->cols = cols;
+		r->col = ailsa_calloc(sizeof(ailsa_result_col_s) * cols, "r->col in ailsa_result_add_row");
+	} else if (cols != r->cols) {
+		ailsa_syslog(LOG_ERR, "Row has %zu columns; result set has %zu", cols, r->cols);
+		return AILSA_WRONG_LIST_LENGHT;
+	}
+	if (r->rows == r->size)
+		ailsa_result_grow(r);
+	for (i = 0; i < cols; i++) {
+		r->col[i].type[r->rows] = AILSA_DB_NULL;
+		memset(&(r->col[i].data[r->rows]), 0, sizeof(ailsa_data_u));
+	}
+	r->rows++;
+	r->fetched++;
+	r->copied += sizeof(ailsa_data_u) * cols;
+	return 0;
+}
+
+void
+ailsa_result_set_text(ailsa_result_s *r, size_t col, const char *text, size_t len)
+{
+	if (!(r) || (r->rows == 0) || (col >= r->cols) || !(text))
+		return;
+	size_t row = r->rows - 1;
+
+	if (len > SQL_TEXT_MAX)
+		len = SQL_TEXT_MAX;
+	r->col[col].data[row].number = ailsa_result_store(r, text, len);
+	r->arena[r->arena_len++] = '\0';
+	r->col[col].type[row] = AILSA_DB_TEXT;
+}
+
+void
+ailsa_result_set_number(ailsa_result_s *r, size_t col, unsigned long int number)
+{
+	if (!(r) || (r->rows == 0) || (col >= r->cols))
+		return;
+
+	r->col[col].data[r->rows - 1].number = number;
+	r->col[col].type[r->rows - 1] = AILSA_DB_LINT;
+}
+
+void
+ailsa_result_set_small(ailsa_result_s *r, size_t col, short int small)
+{
+	if (!(r) || (r->rows == 0) || (col >= r->cols))
+		return;
+
+	r->col[col].data[r->rows - 1].small = small;
+	r->col[col].type[r->rows - 1] = AILSA_DB_SINT;
+}
+
+void
+ailsa_result_set_point(ailsa_result_s *r, size_t col, double point)
+{
+	if (!(r) || (r->rows == 0) || (col >= r->cols))
+		return;
+
+	r->col[col].data[r->rows - 1].point = point;
+	r->col[col].type[r->rows - 1] = AILSA_DB_FLOAT;
+}
+
+#ifdef HAVE_MYSQL
+void
+ailsa_result_set_time(ailsa_result_s *r, size_t col, const MYSQL_TIME *time)
+{
+	if (!(r) || (r->rows == 0) || (col >= r->cols) || !(time))
+		return;
+
+	r->arena_len = (r->arena_len + sizeof(double) - 1) & ~(sizeof(double) - 1);
+	r->col[col].data[r->rows - 1].number = ailsa_result_store(r, time, sizeof(MYSQL_TIME));
+	r->col[col].type[r->rows - 1] = AILSA_DB_TIME;
+}
+
+const MYSQL_TIME *
+ailsa_result_time(ailsa_result_s *r, size_t row, size_t col)
+{
+	const ailsa_data_u *cell;
+
+	if (!(cell = ailsa_result_cell(r, row, col, AILSA_DB_TIME)))
+		return NULL;
+	return (const MYSQL_TIME *)(r->arena + cell->number);
+}
+#endif // HAVE_MYSQL
+
+unsigned int
+ailsa_result_type(ailsa_result_s *r, size_t row, size_t col)
+{
+	if (!(r) || (row >= r->rows) || (col >= r->cols))
+		return AILSA_DB_NULL;
+	return r->col[col].type[row];
+}
+
+const char *
+ailsa_result_text(ailsa_result_s *r, size_t row, size_t col)
+{
+	const ailsa_data_u *cell;
+
+	if (!(cell = ailsa_result_cell(r, row, col, AILSA_DB_TEXT)))
+		return NULL;
+	return r->arena + cell->number;
+}
+
+unsigned long int
+ailsa_result_number(ailsa_result_s *r, size_t row, size_t col)
+{
+	const ailsa_data_u *cell;
+
+	if (!(cell = ailsa_result_cell(r, row, col, AILSA_DB_LINT)))
+		return 0;
+	return cell->number;
+}
+
+short int
+ailsa_result_small(ailsa_result_s *r, size_t row, size_t col)
+{
+	const ailsa_data_u *cell;
+
+	if (!(cell = ailsa_result_cell(r, row, col, AILSA_DB_SINT)))
+		return 0;
+	return cell->small;
+}
+
+double
+ailsa_result_point(ailsa_result_s *r, size_t row, size_t col)
+{
+	const ailsa_data_u *cell;
+
+	if (!(cell = ailsa_result_cell(r, row, col, AILSA_DB_FLOAT)))
+		return 0;
+	return cell->point;
+}
+
+// Build the old one-node-per-cell list for callers that walk AILLISTs
+int
+ailsa_result_to_list(ailsa_result_s *r, AILLIST *list)
+{
+	if (!(r) || !(list))
+		return AILSA_NO_DATA;
+	int retval;
+	size_t i, j;
+	unsigned int type;
+	ailsa_data_s *data;
+
+	for (i = 0; i < r->rows; i++) {
+		for (j = 0; j < r->cols; j++) {
+			data = ailsa_calloc(sizeof(ailsa_data_s), "data in ailsa_result_to_list");
+			ailsa_init_data(data);
+			type = r->col[j].type[i];
+			switch(type) {
+			case AILSA_DB_TEXT:
+				data->data->text = strdup(r->arena + r->col[j].data[i].number);
+				break;
+#ifdef HAVE_MYSQL
+			case AILSA_DB_TIME:
+				data->data->time = ailsa_calloc(sizeof(MYSQL_TIME), "time in ailsa_result_to_list");
+				memcpy(data->data->time, r->arena + r->col[j].data[i].number, sizeof(MYSQL_TIME));
+				break;
+#endif // HAVE_MYSQL
+			default:
+				*(data->data) = r->col[j].data[i];
+				break;
+			}
+			data->type = type;
+			if ((retval = ailsa_list_insert(list, data)) != 0) {
+				ailsa_syslog(LOG_ERR, "Cannot insert data into list in ailsa_result_to_list");
+				ailsa_clean_data(data);
+				return retval;
+			}
+		}
+	}
+	return 0;
+}
+
+static void
+ailsa_result_grow(ailsa_result_s *r)
+{
+	size_t i;
+
+	if (r->size == 0)
+		r->size = 64;
+	else
+		r->size *= 2;
+	for (i = 0; i < r->cols; i++) {
+		r->col[i].type = ailsa_realloc(r->col[i].type, sizeof(unsigned int) * r->size, "type in ailsa_result_grow");
+		r->col[i].data = ailsa_realloc(r->col[i].data, sizeof(ailsa_data_u) * r->size, "data in ailsa_result_grow");
+	}
+}
+
+// Copy len bytes into the arena, leaving room for a trailing NUL
+static size_t
+ailsa_result_store(ailsa_result_s *r, const void *data, size_t len)
+{
+	size_t offset = r->arena_len;
+
+	if (r->arena_len + len + 1 > r->arena_size) {
+		if (r->arena_size == 0)
+			r->arena_size = FILE_LEN;
+		while (r->arena_len + len + 1 > r->arena_size)
+			r->arena_size *= 2;
+		r->arena = ailsa_realloc(r->arena, r->arena_size, "r->arena in ailsa_result_store");
+	}
+	memcpy(r->arena + offset, data, len);
+	r->arena_len += len;
+	r->copied += len;
+	return offset;
+}
+
+static const ailsa_data_u *
+ailsa_result_cell(ailsa_result_s *r, size_t row, size_t col, unsigned int type)
+{
+	if (!(r) || (row >= r->rows) || (col >= r->cols))
+		return NULL;
+	if (r->col[col].type[row] != type)
+		return NULL;
+	return &(r->col[col].data[row]);
+}
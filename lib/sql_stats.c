@@ -0,0 +1,288 @@
+/*
+ *
+ *  cmdb: Configuration Management Database
+ *  Copyright (C) 2020  Iain M Conochie <iain-AT-thargoid.co.uk>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *  sql_stats.c
+ *
+ *
+ *  Per query statistics for libailsasql
+ *
+ *  With SQL_STATS set to text or json, every query run through the
+ *  dispatchers in queries.c records its time, rows and bytes against its
+ *  query number. The totals are written to SQL_STATS_FILE (stderr if it
+ *  is not set) when the database is closed, busiest query first.
+ *
+ */
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <syslog.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef HAVE_STDBOOL_H
+# include <stdbool.h>
+#endif // HAVE_STDBOOL_H
+#include <ailsacmdb.h>
+#include <ailsasql.h>
+
+typedef struct ailsa_sql_stats_s {
+	ailsa_query_stats_s *query[AILSA_STATS_TABLES];
+	unsigned int total[AILSA_STATS_TABLES];
+	short int json;
+} ailsa_sql_stats_s;
+
+typedef struct ailsa_stats_entry_s {	// One line of the report
+	unsigned int table;
+	unsigned int query_no;
+	const ailsa_query_stats_s *stats;
+} ailsa_stats_entry_s;
+
+static const char *stats_tables[] = { "basic", "argument", "insert" };
+
+// Guards every cmdb's statistics; pooled threads record concurrently
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static ailsa_sql_stats_s *
+ailsa_sql_stats_init(ailsa_cmdb_s *cmdb);
+
+static const char *
+ailsa_sql_stats_query(unsigned int table, unsigned int query_no);
+
+static int
+ailsa_sql_stats_cmp(const void *one, const void *two);
+
+static void
+ailsa_sql_stats_text(FILE *out, ailsa_stats_entry_s *entry, size_t n);
+
+static void
+ailsa_sql_stats_json(FILE *out, ailsa_stats_entry_s *entry, size_t n);
+
+static void
+ailsa_sql_stats_json_string(FILE *out, const char *str);
+
+// start stays zero when statistics are off; ailsa_sql_stats_record checks that
+void
+ailsa_sql_stats_start(ailsa_cmdb_s *cmdb, struct timespec *start)
+{
+	if (!(start))
+		return;
+	start->tv_sec = 0;
+	start->tv_nsec = 0;
+	if (!(cmdb) || !(cmdb->sql_stats))
+		return;
+	if (!(cmdb->stats) && !(ailsa_sql_stats_init(cmdb)))
+		return;
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+void
+ailsa_sql_stats_record(ailsa_cmdb_s *cmdb, unsigned int table, unsigned int query_no, const struct timespec *start, size_t rows, size_t bytes)
+{
+	if (!(cmdb) || !(cmdb->stats) || !(start) || ((start->tv_sec == 0) && (start->tv_nsec == 0)))
+		return;
+	struct timespec end;
+	unsigned long long int taken;
+	ailsa_query_stats_s *q;
+
+	if ((table >= AILSA_STATS_TABLES) || (query_no >= cmdb->stats->total[table]))
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	taken = (unsigned long long int)(end.tv_sec - start->tv_sec) * 1000000000ULL;
+	taken += (unsigned long long int)end.tv_nsec;
+	taken -= (unsigned long long int)start->tv_nsec;
+	pthread_mutex_lock(&stats_lock);
+	q = &(cmdb->stats->query[table][query_no]);
+	if ((q->calls == 0) || (taken < q->min))
+		q->min = taken;
+	if (taken > q->max)
+		q->max = taken;
+	q->calls++;
+	q->total += taken;
+	q->rows += rows;
+	q->bytes += bytes;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+int
+ailsa_sql_query_stats(ailsa_cmdb_s *cmdb, unsigned int table, unsigned int query_no, ailsa_query_stats_s *stats)
+{
+	if (!(cmdb) || !(stats))
+		return AILSA_NO_DATA;
+	int retval = 0;
+
+	memset(stats, 0, sizeof(ailsa_query_stats_s));
+	pthread_mutex_lock(&stats_lock);
+	if (!(cmdb->stats))
+		retval = AILSA_NO_DATA;
+	else if ((table >= AILSA_STATS_TABLES) || (query_no >= cmdb->stats->total[table]))
+		retval = AILSA_NO_QUERY_NO;
+	else
+		memcpy(stats, &(cmdb->stats->query[table][query_no]), sizeof(ailsa_query_stats_s));
+	pthread_mutex_unlock(&stats_lock);
+	return retval;
+}
+
+// Write the report and free the statistics
+void
+ailsa_sql_stats_dump(ailsa_cmdb_s *cmdb)
+{
+	if (!(cmdb) || !(cmdb->stats))
+		return;
+	unsigned int i, j;
+	size_t n = 0;
+	FILE *out = stderr;
+	ailsa_sql_stats_s *s = cmdb->stats;
+	ailsa_stats_entry_s *entry;
+
+	for (i = 0; i < AILSA_STATS_TABLES; i++)
+		n += s->total[i];
+	entry = ailsa_calloc(sizeof(ailsa_stats_entry_s) * n, "entry in ailsa_sql_stats_dump");
+	for (i = 0, n = 0; i < AILSA_STATS_TABLES; i++) {
+		for (j = 0; j < s->total[i]; j++) {
+			if (s->query[i][j].calls == 0)
+				continue;
+			entry[n].table = i;
+			entry[n].query_no = j;
+			entry[n].stats = &(s->query[i][j]);
+			n++;
+		}
+	}
+	qsort(entry, n, sizeof(ailsa_stats_entry_s), ailsa_sql_stats_cmp);
+// Append, so several runs can share one file
+	if ((cmdb->sql_stats_file) && (*cmdb->sql_stats_file)) {
+		if (!(out = fopen(cmdb->sql_stats_file, "a"))) {
+			ailsa_syslog(LOG_ERR, "Cannot open SQL statistics file %s", cmdb->sql_stats_file);
+			out = stderr;
+		}
+	}
+	if (s->json > 0)
+		ailsa_sql_stats_json(out, entry, n);
+	else
+		ailsa_sql_stats_text(out, entry, n);
+	if (out != stderr)
+		fclose(out);
+	my_free(entry);
+	for (i = 0; i < AILSA_STATS_TABLES; i++)
+		my_free(s->query[i]);
+	my_free(cmdb->stats);
+}
+
+static ailsa_sql_stats_s *
+ailsa_sql_stats_init(ailsa_cmdb_s *cmdb)
+{
+	ailsa_sql_stats_s *s;
+
+	pthread_mutex_lock(&stats_lock);
+	if ((s = cmdb->stats))
+		goto cleanup;
+	s = ailsa_calloc(sizeof(ailsa_sql_stats_s), "s in ailsa_sql_stats_init");
+	if (strcasecmp(cmdb->sql_stats, "json") == 0)
+		s->json = 1;
+	else if (strcasecmp(cmdb->sql_stats, "text") != 0)
+		ailsa_syslog(LOG_ERR, "Unknown SQL_STATS format %s; using text", cmdb->sql_stats);
+	s->total[AILSA_STATS_BASIC] = basic_query_total;
+	s->total[AILSA_STATS_ARGUMENT] = argument_query_total;
+	s->total[AILSA_STATS_INSERT] = insert_query_total;
+	s->query[AILSA_STATS_BASIC] = ailsa_calloc(sizeof(ailsa_query_stats_s) * basic_query_total, "basic in ailsa_sql_stats_init");
+	s->query[AILSA_STATS_ARGUMENT] = ailsa_calloc(sizeof(ailsa_query_stats_s) * argument_query_total, "argument in ailsa_sql_stats_init");
+	s->query[AILSA_STATS_INSERT] = ailsa_calloc(sizeof(ailsa_query_stats_s) * insert_query_total, "insert in ailsa_sql_stats_init");
+	cmdb->stats = s;
+	cleanup:
+		pthread_mutex_unlock(&stats_lock);
+		return s;
+}
+
+static const char *
+ailsa_sql_stats_query(unsigned int table, unsigned int query_no)
+{
+	switch (table) {
+	case AILSA_STATS_BASIC:
+		return basic_queries[query_no];
+	case AILSA_STATS_ARGUMENT:
+		return argument_queries[query_no].query;
+	case AILSA_STATS_INSERT:
+		return insert_queries[query_no].query;
+	}
+	return "";
+}
+
+// Most total time first
+static int
+ailsa_sql_stats_cmp(const void *one, const void *two)
+{
+	const ailsa_stats_entry_s *a = one, *b = two;
+
+	if (a->stats->total > b->stats->total)
+		return -1;
+	if (a->stats->total < b->stats->total)
+		return 1;
+	return 0;
+}
+
+static void
+ailsa_sql_stats_text(FILE *out, ailsa_stats_entry_s *entry, size_t n)
+{
+	size_t i;
+	const ailsa_query_stats_s *q;
+
+	fprintf(out, "%-8s %5s %8s %12s %10s %10s %10s %10s %12s  %s\n", "table", "query",
+	 "calls", "total ms", "mean us", "min us", "max us", "rows", "bytes", "sql");
+	for (i = 0; i < n; i++) {
+		q = entry[i].stats;
+		fprintf(out, "%-8s %5u %8lu %12.3f %10.1f %10.1f %10.1f %10llu %12llu  %.60s\n",
+		 stats_tables[entry[i].table], entry[i].query_no, q->calls, (double)q->total / 1e6,
+		 (double)q->total / q->calls / 1e3, (double)q->min / 1e3, (double)q->max / 1e3,
+		 q->rows, q->bytes, ailsa_sql_stats_query(entry[i].table, entry[i].query_no));
+	}
+}
+
+// One object per line, so appended runs can be read as JSON lines
+static void
+ailsa_sql_stats_json(FILE *out, ailsa_stats_entry_s *entry, size_t n)
+{
+	size_t i;
+	const ailsa_query_stats_s *q;
+
+	fputs("{\"queries\":[", out);
+	for (i = 0; i < n; i++) {
+		q = entry[i].stats;
+		fprintf(out, "%s{\"table\":\"%s\",\"query\":%u,\"calls\":%lu,\"total_ns\":%llu,\"min_ns\":%llu,\"max_ns\":%llu,\"rows\":%llu,\"bytes\":%llu,\"sql\":",
+		 i > 0 ? "," : "", stats_tables[entry[i].table], entry[i].query_no, q->calls,
+		 q->total, q->min, q->max, q->rows, q->bytes);
+		ailsa_sql_stats_json_string(out, ailsa_sql_stats_query(entry[i].table, entry[i].query_no));
+		fputc('}', out);
+	}
+	fputs("]}\n", out);
+}
+
+static void
+ailsa_sql_stats_json_string(FILE *out, const char *str)
+{
+	fputc('"', out);
+	for (; *str; str++) {
+		if ((*str == '"') || (*str == '\\'))
+			fprintf(out, "\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			fprintf(out, "\\u%04x", (unsigned char)*str);
+		else
+			fputc(*str, out);
+	}
+	fputc('"', out);
+}
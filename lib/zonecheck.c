@@ -0,0 +1,740 @@
+/*
+ *
+ *  alisacmdb: Alisatech Configuration Management Database library
+ *  Copyright (C) 2015 Iain M Conochie <iain-AT-thargoid.co.uk>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *  zonecheck.c
+ *
+ *  Checks a zone file in process, in place of forking named-checkzone
+ *
+ *  Reads the master file format (comments, parentheses, blank owners,
+ *  $TTL and $ORIGIN) and checks for:
+ *  - one SOA, first and at the zone apex, and NS records at the apex
+ *  - a CNAME alongside other data
+ *  - records outside the zone
+ *  - in zone NS, MX and SRV targets without address records (glue)
+ *  - TTLs and SOA timers out of range, and bad names or addresses
+ *
+ */
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <ailsacmdb.h>
+
+enum {			// Record types seen at an owner name
+	ZC_SOA = 1,
+	ZC_NS = 2,
+	ZC_A = 4,
+	ZC_AAAA = 8,
+	ZC_CNAME = 16,
+	ZC_OTHER = 32,
+	ZC_ADDRESS = ZC_A | ZC_AAAA
+};
+
+enum {
+	ZC_MAX_TTL = 2147483647,	// RFC 2181
+	ZC_MAX_NAME = 255,
+	ZC_MAX_LABEL = 63,
+	ZC_MIN_BUCKETS = 61,
+	ZC_LINE_BYTES = 24		// Rough size of a record, to size the hash
+};
+
+typedef struct zc_name_s {	// Record types at one owner
+	char *name;
+	unsigned int types;
+} zc_name_s;
+
+typedef struct zc_target_s {	// NS, MX or SRV target, checked once all is read
+	char *owner;
+	char *target;
+	const char *type;
+	unsigned long int line;
+} zc_target_s;
+
+typedef struct zc_state_s {
+	const char *file;
+	char apex[DOMAIN_LEN];
+	char origin[DOMAIN_LEN];
+	char owner[DOMAIN_LEN];
+	ailsa_zone_tokens_s t;
+	unsigned long int line;
+	unsigned long int records;
+	unsigned int errors;
+	short int have_ttl;
+	AILHASH names;
+	AILLIST targets;
+} zc_state_s;
+
+static int
+zc_read(zc_state_s *z, FILE *f);
+
+static void
+zc_add_token(ailsa_zone_tokens_s *t, const char *start, size_t len);
+
+static void
+zc_record(zc_state_s *z, int blank);
+
+static void
+zc_directive(zc_state_s *z);
+
+static void
+zc_rdata(zc_state_s *z, const char *owner, const char *type, size_t i);
+
+static void
+zc_soa(zc_state_s *z, const char *owner, size_t i);
+
+static void
+zc_target(zc_state_s *z, const char *owner, const char *type, const char *name);
+
+static void
+zc_finish(zc_state_s *z);
+
+static int
+zc_fqdn(zc_state_s *z, const char *name, char *fqdn);
+
+static int
+zc_in_zone(const char *name, const char *apex);
+
+static int
+zc_ttl(const char *str, unsigned long int *ttl);
+
+static int
+zc_number(const char *str, unsigned long int max);
+
+static int
+zc_is_class(const char *str);
+
+static void
+zc_add_type(zc_state_s *z, const char *owner, unsigned int type);
+
+static zc_name_s *
+zc_find(zc_state_s *z, const char *name);
+
+static void
+zc_error(zc_state_s *z, const char *msg, ...);
+
+static void
+zc_warning(zc_state_s *z, const char *msg, ...);
+
+static void
+zc_log(zc_state_s *z, int priority, const char *msg, va_list ap);
+
+static int
+zc_name_match(const void *one, const void *two);
+
+static void
+zc_name_clean(void *data);
+
+static void
+zc_target_clean(void *data);
+
+// Returns 0 if the zone is good, AILSA_CHKZONE_FAIL if not
+int
+ailsa_check_zone_file(const char *zone, const char *file)
+{
+	if (!(zone) || !(file))
+		return AILSA_NO_DATA;
+	int retval;
+	unsigned int buckets = ZC_MIN_BUCKETS;
+	FILE *f;
+	struct stat st;
+	zc_state_s *z;
+
+	if (!(f = fopen(file, "r"))) {
+		ailsa_syslog(LOG_ERR, "Cannot open zone file %s", file);
+		return AILSA_FILE_ERROR;
+	}
+	z = ailsa_calloc(sizeof(zc_state_s), "z in ailsa_check_zone_file");
+	z->file = file;
+	if ((fstat(fileno(f), &st) == 0) && ((st.st_size / ZC_LINE_BYTES) > buckets))
+		buckets = (unsigned int)(st.st_size / ZC_LINE_BYTES) | 1;
+	ailsa_hash_init(&(z->names), buckets, ailsa_hash, zc_name_match, zc_name_clean);
+	ailsa_list_init(&(z->targets), zc_target_clean);
+	if (zc_fqdn(z, zone, z->apex) != 0) {
+		ailsa_syslog(LOG_ERR, "Invalid zone name %s", zone);
+		retval = AILSA_CHKZONE_FAIL;
+		goto cleanup;
+	}
+	snprintf(z->origin, DOMAIN_LEN, "%s", z->apex);
+	if ((retval = zc_read(z, f)) != 0)
+		goto cleanup;
+	zc_finish(z);
+	if (z->errors > 0) {
+		ailsa_syslog(LOG_ERR, "Zone %s has %u errors", zone, z->errors);
+		retval = AILSA_CHKZONE_FAIL;
+	}
+	cleanup:
+		fclose(f);
+		ailsa_zone_tokens_free(&(z->t));
+		ailsa_hash_destroy(&(z->names));
+		ailsa_list_destroy(&(z->targets));
+		my_free(z);
+		return retval;
+}
+
+static int
+zc_read(zc_state_s *z, FILE *f)
+{
+	char *line = NULL;
+	size_t len = 0;
+	unsigned long int lineno = 0;
+	int blank = 0;
+
+	while (getline(&line, &len, f) != -1) {
+		lineno++;
+		if (z->t.depth == 0) {
+			z->line = lineno;
+			blank = ((line[0] == ' ') || (line[0] == '\t'));
+		}
+		if (ailsa_zone_tokenise(&(z->t), line) != 0) {
+			zc_error(z, "%s", z->t.error);
+			ailsa_zone_tokens_clear(&(z->t));
+			continue;
+		}
+		if ((z->t.depth == 0) && (z->t.total > 0)) {
+			zc_record(z, blank);
+			ailsa_zone_tokens_clear(&(z->t));
+		}
+	}
+	my_free(line);
+	if (z->t.depth > 0) {
+		zc_error(z, "unbalanced parentheses");
+		ailsa_zone_tokens_clear(&(z->t));
+	}
+	if (ferror(f)) {
+		ailsa_syslog(LOG_ERR, "Cannot read zone file %s", z->file);
+		return AILSA_FILE_ERROR;
+	}
+	return 0;
+}
+
+/*
+ * Splits one line of a master file (RFC 1035 section 5) into t, dropping
+ * comments and parentheses. Quoted strings keep their quotes, and a
+ * backslash escapes the next character. An entry inside ( ) goes on over
+ * the following lines until t->depth is back to 0. The importer uses this
+ * too, so both read zone files the same way.
+ */
+int
+ailsa_zone_tokenise(ailsa_zone_tokens_s *t, const char *line)
+{
+	if (!(t) || !(line))
+		return AILSA_NO_DATA;
+	const char *p = line, *start;
+
+	while (*p) {
+		if (isspace((unsigned char)*p)) {
+			p++;
+		} else if (*p == ';') {
+			break;
+		} else if (*p == '(') {
+			t->depth++;
+			p++;
+		} else if (*p == ')') {
+			if (t->depth == 0) {
+				t->error = "unbalanced parentheses";
+				return AILSA_STRING_FAIL;
+			}
+			t->depth--;
+			p++;
+		} else if (*p == '"') {
+			start = p++;
+			while ((*p) && (*p != '"') && (*p != '\n')) {
+				if ((*p == '\\') && (*(p + 1)))
+					p++;
+				p++;
+			}
+			if (*p != '"') {
+				t->error = "unterminated quoted string";
+				return AILSA_STRING_FAIL;
+			}
+			p++;
+			zc_add_token(t, start, (size_t)(p - start));
+		} else {
+			start = p;
+			while ((*p) && !(isspace((unsigned char)*p)) && (*p != ';') && (*p != '(') &&
+			       (*p != ')') && (*p != '"')) {
+				if ((*p == '\\') && (*(p + 1)))
+					p++;
+				p++;
+			}
+			zc_add_token(t, start, (size_t)(p - start));
+		}
+	}
+	return 0;
+}
+
+// Frees the tokens and starts a new entry; the array is kept for reuse
+void
+ailsa_zone_tokens_clear(ailsa_zone_tokens_s *t)
+{
+	size_t i;
+
+	if (!(t))
+		return;
+	for (i = 0; i < t->total; i++)
+		my_free(t->tok[i]);
+	t->total = 0;
+	t->depth = 0;
+}
+
+void
+ailsa_zone_tokens_free(ailsa_zone_tokens_s *t)
+{
+	if (!(t))
+		return;
+	ailsa_zone_tokens_clear(t);
+	my_free(t->tok);
+	t->size = 0;
+}
+
+static void
+zc_add_token(ailsa_zone_tokens_s *t, const char *start, size_t len)
+{
+	if (t->total == t->size) {
+		t->size = t->size ? t->size * 2 : 8;
+		t->tok = ailsa_realloc(t->tok, t->size * sizeof(char *), "t->tok in zc_add_token");
+	}
+	t->tok[t->total++] = strndup(start, len);
+}
+
+static void
+zc_record(zc_state_s *z, int blank)
+{
+	char owner[DOMAIN_LEN], *type;
+	size_t i = 0, n = 0;
+	unsigned long int ttl;
+
+	if (z->t.tok[0][0] == '$') {
+		zc_directive(z);
+		return;
+	}
+	if (blank) {
+		if (!(z->owner[0])) {
+			zc_error(z, "no owner name before the first record");
+			return;
+		}
+		snprintf(owner, DOMAIN_LEN, "%s", z->owner);
+	} else {
+		if (zc_fqdn(z, z->t.tok[i++], owner) != 0)
+			return;
+		snprintf(z->owner, DOMAIN_LEN, "%s", owner);
+	}
+// A TTL and a class may come in either order before the type
+	for (n = 0; (n < 2) && (i < z->t.total); n++) {
+		if (isdigit((unsigned char)z->t.tok[i][0])) {
+			if (zc_ttl(z->t.tok[i], &ttl) != 0)
+				zc_error(z, "bad TTL %s", z->t.tok[i]);
+			i++;
+		} else if (zc_is_class(z->t.tok[i])) {
+			if (strcasecmp(z->t.tok[i], "IN") != 0)
+				zc_error(z, "class %s is not IN", z->t.tok[i]);
+			i++;
+		} else {
+			break;
+		}
+	}
+	if (i >= z->t.total) {
+		zc_error(z, "no record type for %s", owner);
+		return;
+	}
+	type = z->t.tok[i++];
+	if (!(zc_in_zone(owner, z->apex))) {
+		zc_error(z, "%s %s is outside the zone %s", owner, type, z->apex);
+		return;
+	}
+	if ((!(z->have_ttl)) && (z->records == 0))
+		ailsa_syslog(LOG_INFO, "%s:%lu: no $TTL; the SOA minimum is used", z->file, z->line);
+	zc_rdata(z, owner, type, i);
+	z->records++;
+}
+
+static void
+zc_directive(zc_state_s *z)
+{
+	unsigned long int ttl;
+
+	if (strcasecmp(z->t.tok[0], "$TTL") == 0) {
+		if ((z->t.total != 2) || (zc_ttl(z->t.tok[1], &ttl) != 0))
+			zc_error(z, "bad $TTL");
+		else
+			z->have_ttl = 1;
+	} else if (strcasecmp(z->t.tok[0], "$ORIGIN") == 0) {
+		if (z->t.total != 2)
+			zc_error(z, "bad $ORIGIN");
+		else
+			zc_fqdn(z, z->t.tok[1], z->origin);
+	} else {
+		zc_error(z, "unsupported directive %s", z->t.tok[0]);
+	}
+}
+
+static void
+zc_rdata(zc_state_s *z, const char *owner, const char *type, size_t i)
+{
+	char name[DOMAIN_LEN];
+	size_t n = z->t.total - i;
+	unsigned char addr[sizeof(struct in6_addr)];
+
+	if (strcasecmp(type, "SOA") == 0) {
+		zc_soa(z, owner, i);
+	} else if (strcasecmp(type, "A") == 0) {
+		if ((n != 1) || (inet_pton(AF_INET, z->t.tok[i], addr) != 1))
+			zc_error(z, "bad A record for %s", owner);
+		zc_add_type(z, owner, ZC_A);
+	} else if (strcasecmp(type, "AAAA") == 0) {
+		if ((n != 1) || (inet_pton(AF_INET6, z->t.tok[i], addr) != 1))
+			zc_error(z, "bad AAAA record for %s", owner);
+		zc_add_type(z, owner, ZC_AAAA);
+	} else if ((strcasecmp(type, "NS") == 0) || (strcasecmp(type, "CNAME") == 0) ||
+		   (strcasecmp(type, "PTR") == 0)) {
+		if (n != 1)
+			zc_error(z, "bad %s record for %s", type, owner);
+		else if ((zc_fqdn(z, z->t.tok[i], name) == 0) && (strcasecmp(type, "NS") == 0))
+			zc_target(z, owner, "NS", name);
+		if (strcasecmp(type, "NS") == 0)
+			zc_add_type(z, owner, ZC_NS);
+		else if (strcasecmp(type, "CNAME") == 0)
+			zc_add_type(z, owner, ZC_CNAME);
+		else
+			zc_add_type(z, owner, ZC_OTHER);
+	} else if (strcasecmp(type, "MX") == 0) {
+		if ((n != 2) || (zc_number(z->t.tok[i], 65535) != 0))
+			zc_error(z, "bad MX record for %s", owner);
+		else if (zc_fqdn(z, z->t.tok[i + 1], name) == 0)
+			zc_target(z, owner, "MX", name);
+		zc_add_type(z, owner, ZC_OTHER);
+	} else if (strcasecmp(type, "SRV") == 0) {
+		if ((n != 4) || (zc_number(z->t.tok[i], 65535) != 0) ||
+		    (zc_number(z->t.tok[i + 1], 65535) != 0) || (zc_number(z->t.tok[i + 2], 65535) != 0))
+			zc_error(z, "bad SRV record for %s", owner);
+		else if ((strcmp(z->t.tok[i + 3], ".") != 0) && (zc_fqdn(z, z->t.tok[i + 3], name) == 0))
+			zc_target(z, owner, "SRV", name);
+		zc_add_type(z, owner, ZC_OTHER);
+	} else if ((strcasecmp(type, "RRSIG") == 0) || (strcasecmp(type, "NSEC") == 0)) {
+// These may sit beside a CNAME
+		if (n == 0)
+			zc_error(z, "no data in %s record for %s", type, owner);
+	} else {
+		if (n == 0)
+			zc_error(z, "no data in %s record for %s", type, owner);
+		zc_add_type(z, owner, ZC_OTHER);
+	}
+}
+
+static void
+zc_soa(zc_state_s *z, const char *owner, size_t i)
+{
+	char name[DOMAIN_LEN];
+	unsigned long int refresh, retry, expire, minimum;
+
+	if (strcmp(owner, z->apex) != 0)
+		zc_error(z, "SOA record at %s, not the zone apex %s", owner, z->apex);
+	else if (z->records != 0)
+		zc_error(z, "SOA is not the first record");
+	zc_add_type(z, owner, ZC_SOA);
+	if (z->t.total - i != 7) {
+		zc_error(z, "SOA record has %zu fields, not 7", z->t.total - i);
+		return;
+	}
+	zc_fqdn(z, z->t.tok[i], name);
+	zc_fqdn(z, z->t.tok[i + 1], name);
+	if (zc_number(z->t.tok[i + 2], 4294967295UL) != 0)
+		zc_error(z, "bad SOA serial %s", z->t.tok[i + 2]);
+	if ((zc_ttl(z->t.tok[i + 3], &refresh) != 0) || (zc_ttl(z->t.tok[i + 4], &retry) != 0) ||
+	    (zc_ttl(z->t.tok[i + 5], &expire) != 0) || (zc_ttl(z->t.tok[i + 6], &minimum) != 0)) {
+		zc_error(z, "bad SOA timer value");
+		return;
+	}
+	if (retry >= refresh)
+		ailsa_syslog(LOG_INFO, "%s:%lu: SOA retry %lu is not less than refresh %lu",
+		 z->file, z->line, retry, refresh);
+	if (expire < refresh + retry)
+		ailsa_syslog(LOG_INFO, "%s:%lu: SOA expire %lu is less than refresh plus retry",
+		 z->file, z->line, expire);
+}
+
+// Only names inside this zone can be checked
+static void
+zc_target(zc_state_s *z, const char *owner, const char *type, const char *name)
+{
+	zc_target_s *t;
+
+	if (!(zc_in_zone(name, z->apex)))
+		return;
+	t = ailsa_calloc(sizeof(zc_target_s), "t in zc_target");
+	t->owner = strndup(owner, DOMAIN_LEN);
+	t->target = strndup(name, DOMAIN_LEN);
+	t->type = type;
+	t->line = z->line;
+	if (ailsa_list_insert(&(z->targets), t) != 0)
+		zc_target_clean(t);
+}
+
+static void
+zc_finish(zc_state_s *z)
+{
+	AILELEM *e;
+	zc_name_s *n;
+	zc_target_s *t;
+	const char *problem;
+
+	z->line = 0;
+	if (!(n = zc_find(z, z->apex)) || !(n->types & ZC_SOA))
+		zc_error(z, "no SOA record at %s", z->apex);
+	if (!(n) || !(n->types & ZC_NS))
+		zc_error(z, "no NS records at %s", z->apex);
+	for (e = z->targets.head; e; e = e->next) {
+		t = e->data;
+		z->line = t->line;
+		if ((n = zc_find(z, t->target)) && (n->types & ZC_CNAME))
+			problem = "is a CNAME";
+		else if (!(n) || !(n->types & ZC_ADDRESS))
+			problem = "has no address records";
+		else
+			continue;
+// Only a lame NS breaks the zone; a bad MX or SRV target loses just that service
+		if (strcmp(t->type, "NS") == 0)
+			zc_error(z, "%s %s %s %s", t->owner, t->type, t->target, problem);
+		else
+			zc_warning(z, "%s %s %s %s", t->owner, t->type, t->target, problem);
+	}
+}
+
+// Makes name absolute and lower case in fqdn; fqdn must hold DOMAIN_LEN
+static int
+zc_fqdn(zc_state_s *z, const char *name, char *fqdn)
+{
+	size_t len, label = 0;
+	char *p;
+
+	if (strcmp(name, "@") == 0)
+		len = (size_t)snprintf(fqdn, DOMAIN_LEN, "%s", z->origin);
+	else if (name[strlen(name) - 1] == '.')
+		len = (size_t)snprintf(fqdn, DOMAIN_LEN, "%s", name);
+	else if (strcmp(z->origin, ".") == 0)
+		len = (size_t)snprintf(fqdn, DOMAIN_LEN, "%s.", name);
+	else
+		len = (size_t)snprintf(fqdn, DOMAIN_LEN, "%s.%s", name, z->origin);
+	if (len > ZC_MAX_NAME) {
+		zc_error(z, "name %s is too long", name);
+		return -1;
+	}
+	if (strcmp(fqdn, ".") == 0)
+		return 0;
+	for (p = fqdn; *p; p++) {
+		*p = (char)tolower((unsigned char)*p);
+		if (*p != '.') {
+			label++;
+		} else if ((label == 0) || (label > ZC_MAX_LABEL)) {
+			zc_error(z, "bad label in name %s", name);
+			return -1;
+		} else {
+			label = 0;
+		}
+	}
+	return 0;
+}
+
+static int
+zc_in_zone(const char *name, const char *apex)
+{
+	size_t nlen = strlen(name), alen = strlen(apex);
+
+	if (strcmp(apex, ".") == 0)
+		return 1;
+	if (nlen == alen)
+		return (strcmp(name, apex) == 0);
+	if (nlen < alen)
+		return 0;
+	return ((strcmp(name + nlen - alen, apex) == 0) && (name[nlen - alen - 1] == '.'));
+}
+
+// Seconds, or BIND style 1w2d3h4m5s
+static int
+zc_ttl(const char *str, unsigned long int *ttl)
+{
+	unsigned long long int total = 0, part;
+	char *end;
+
+	if (!(isdigit((unsigned char)*str)))
+		return -1;
+	while (*str) {
+		if (!(isdigit((unsigned char)*str)))
+			return -1;
+		part = strtoull(str, &end, 10);
+		switch (tolower((unsigned char)*end)) {
+		case 'w':
+			part *= 7;
+			// fall through
+		case 'd':
+			part *= 24;
+			// fall through
+		case 'h':
+			part *= 60;
+			// fall through
+		case 'm':
+			part *= 60;
+			// fall through
+		case 's':
+			end++;
+			break;
+		case '\0':
+			break;
+		default:
+			return -1;
+		}
+		total += part;
+		if (total > ZC_MAX_TTL)
+			return -1;
+		str = end;
+	}
+	*ttl = (unsigned long int)total;
+	return 0;
+}
+
+static int
+zc_number(const char *str, unsigned long int max)
+{
+	unsigned long long int n;
+	char *end;
+
+	if (!(isdigit((unsigned char)*str)))
+		return -1;
+	n = strtoull(str, &end, 10);
+	if ((*end) || (n > max))
+		return -1;
+	return 0;
+}
+
+static int
+zc_is_class(const char *str)
+{
+	return ((strcasecmp(str, "IN") == 0) || (strcasecmp(str, "CH") == 0) ||
+		(strcasecmp(str, "HS") == 0) || (strncasecmp(str, "CLASS", 5) == 0));
+}
+
+static void
+zc_add_type(zc_state_s *z, const char *owner, unsigned int type)
+{
+	zc_name_s *n;
+
+	if (!(n = zc_find(z, owner))) {
+		n = ailsa_calloc(sizeof(zc_name_s), "n in zc_add_type");
+		n->name = strndup(owner, DOMAIN_LEN);
+		if (ailsa_hash_insert(&(z->names), n, n->name) != 0) {
+			zc_name_clean(n);
+			return;
+		}
+	}
+	if ((type == ZC_SOA) && (n->types & ZC_SOA))
+		zc_error(z, "more than one SOA record");
+	if ((type == ZC_CNAME) && (n->types != 0))
+		zc_error(z, "CNAME and other data at %s", owner);
+	else if ((type != ZC_CNAME) && (n->types & ZC_CNAME))
+		zc_error(z, "CNAME and other data at %s", owner);
+	n->types |= type;
+}
+
+static zc_name_s *
+zc_find(zc_state_s *z, const char *name)
+{
+	char key[DOMAIN_LEN];
+	zc_name_s probe;
+	void *data = &probe;
+
+	snprintf(key, DOMAIN_LEN, "%s", name);
+	probe.name = key;
+	if (ailsa_hash_lookup(&(z->names), &data, key) != 0)
+		return NULL;
+	return data;
+}
+
+static void
+zc_error(zc_state_s *z, const char *msg, ...)
+{
+	va_list ap;
+
+	va_start(ap, msg);
+	zc_log(z, LOG_ERR, msg, ap);
+	va_end(ap);
+	z->errors++;
+}
+
+// Reported, but the zone still loads
+static void
+zc_warning(zc_state_s *z, const char *msg, ...)
+{
+	va_list ap;
+
+	va_start(ap, msg);
+	zc_log(z, LOG_WARNING, msg, ap);
+	va_end(ap);
+}
+
+static void
+zc_log(zc_state_s *z, int priority, const char *msg, va_list ap)
+{
+	char error[BUFFER_LEN];
+
+	vsnprintf(error, BUFFER_LEN, msg, ap);
+	if (z->line > 0)
+		ailsa_syslog(priority, "%s:%lu: %s", z->file, z->line, error);
+	else
+		ailsa_syslog(priority, "%s: %s", z->file, error);
+}
+
+static int
+zc_name_match(const void *one, const void *two)
+{
+	const zc_name_s *a = one, *b = two;
+
+	return (strcmp(a->name, b->name) == 0);
+}
+
+static void
+zc_name_clean(void *data)
+{
+	zc_name_s *n = data;
+
+	if (!(n))
+		return;
+	my_free(n->name);
+	my_free(n);
+}
+
+static void
+zc_target_clean(void *data)
+{
+	zc_target_s *t = data;
+
+	if (!(t))
+		return;
+	my_free(t->owner);
+	my_free(t->target);
+	my_free(t);
+}
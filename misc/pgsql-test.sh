@@ -0,0 +1,249 @@
+#!/bin/sh
+#
+#  pgsql-test.sh: check the libpq backend against a PostgreSQL server
+#
+#  Runs only when PGHOST or PGDATABASE is set; the server, database and
+#  login all come from the usual PG* variables, for psql and for the
+#  library alike. The tables are made in a scratch schema that is dropped
+#  again at the end, so any database the login can create a schema in
+#  will do.
+#
+#  A small program built against the libraries in the build tree checks
+#  that argument queries are prepared once per session, that a batch goes
+#  down one pipeline with a Parse for each statement not yet prepared, and
+#  that a failed batch leaves the session usable. It then checks nested
+#  ailsa_begin / ailsa_commit / ailsa_rollback, and ailsa_bulk_insert with
+#  more rows than one statement can bind, on its own and inside a
+#  transaction that is rolled back. psql checks from a second session
+#  that only the committed rows reached the server.
+#
+#  Usage: pgsql-test.sh [-b builddir] [-s schema]
+
+SRCDIR=$(cd $(dirname $0)/.. && pwd)
+BUILD=$SRCDIR
+SCHEMA=$SRCDIR/sql/postgresql/all-tables.sql
+
+while getopts "b:s:" opt; do
+  case $opt in
+    b) BUILD=$OPTARG ;;
+    s) SCHEMA=$OPTARG ;;
+    *) echo "Usage: $0 [-b builddir] [-s schema]"; exit 1 ;;
+  esac
+done
+
+if [ -z "$PGHOST" ] && [ -z "$PGDATABASE" ]; then
+  echo "PGHOST and PGDATABASE are not set; skipping"
+  exit 0
+fi
+if ! grep -q "define HAVE_LIBPQ 1" $BUILD/include/config.h 2>/dev/null; then
+  echo "$BUILD was not configured with libpq; use -b"
+  exit 1
+fi
+if [ ! -f "$SCHEMA" ]; then
+  echo "Cannot find postgresql schema $SCHEMA; use -s"
+  exit 1
+fi
+
+TMP=$(mktemp -d)
+NS=ailsa_test_$$
+PSQL="psql -X -q -t -A -v ON_ERROR_STOP=1"
+trap '$PSQL -c "DROP SCHEMA IF EXISTS $NS CASCADE" >/dev/null 2>&1; rm -rf $TMP' EXIT
+$PSQL -c "CREATE SCHEMA $NS" || exit 1
+# Sent in the startup packet of every connection, the library's included
+PGOPTIONS="-c search_path=$NS"
+export PGOPTIONS
+$PSQL -f $SCHEMA >/dev/null || exit 1
+# vm_server_hosts goes so that VM_SERVERS fails inside a batch
+$PSQL >/dev/null <<EOF || exit 1
+INSERT INTO customer (cust_id, name, coid) VALUES (1, 'Test', 'TEST01');
+INSERT INTO server (server_id, cust_id, name) VALUES (1, 1, 's1'), (2, 1, 's2'), (3, 1, 's3');
+CREATE TABLE pgtest (id integer PRIMARY KEY, name varchar(63) NOT NULL);
+DROP TABLE vm_server_hosts;
+EOF
+
+cat > $TMP/pgtest.c <<'EOF'
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ailsacmdb.h>
+#include <ailsasql.h>
+
+static const ailsa_sql_query_s add = { "INSERT INTO pgtest (id, name) VALUES (?, ?)", 2, { AILSA_DB_LINT, AILSA_DB_TEXT } };
+static const ailsa_sql_query_s count = { "SELECT COUNT(*) FROM pgtest WHERE id >= ? AND id < ?", 2, { AILSA_DB_LINT, AILSA_DB_LINT } };
+static int failed;
+
+static void
+check(const char *name, int ok)
+{
+	printf("%s %s\n", ok ? "ok  " : "FAIL", name);
+	if (!(ok))
+		failed++;
+}
+
+static unsigned long int
+number(AILLIST *l, size_t i)
+{
+	AILELEM *e = l->head;
+
+	while ((e) && (i-- > 0))
+		e = e->next;
+	return e ? ((ailsa_data_s *)e->data)->data->number : 0;
+}
+
+static AILLIST *
+text_args(const char *text)
+{
+	AILLIST *l = ailsa_db_data_list_init();
+
+	cmdb_add_string_to_list(text, l);
+	return l;
+}
+
+static int
+insert(ailsa_cmdb_s *c, unsigned long int first, unsigned long int total, int bulk)
+{
+	char name[HOST_LEN];
+	int retval;
+	unsigned long int i;
+	AILLIST *l = ailsa_db_data_list_init();
+
+	for (i = first; i < first + total; i++) {
+		snprintf(name, HOST_LEN, "row%lu", i);
+		cmdb_add_number_to_list(i, l);
+		cmdb_add_string_to_list(name, l);
+	}
+	retval = bulk ? ailsa_bulk_insert(c, add, l) : ailsa_multiple_query(c, add, l);
+	ailsa_list_full_clean(l);
+	return retval;
+}
+
+static unsigned long int
+rows(ailsa_cmdb_s *c, unsigned long int first, unsigned long int last)
+{
+	unsigned long int n = ~0UL;
+	AILLIST *args = ailsa_db_data_list_init();
+	AILLIST *r = ailsa_db_data_list_init();
+
+	cmdb_add_number_to_list(first, args);
+	cmdb_add_number_to_list(last, args);
+	if ((ailsa_individual_query(c, &count, args, r) == 0) && (r->total == 1))
+		n = number(r, 0);
+	ailsa_list_full_clean(args);
+	ailsa_list_full_clean(r);
+	return n;
+}
+
+int
+main(void)
+{
+	int i, ok;
+	unsigned long int hits, misses;
+	ailsa_cmdb_s c;
+	ailsa_sql_batch_s b[4];
+	AILLIST *r = ailsa_db_data_list_init();
+
+	memset(&c, 0, sizeof(c));
+	c.dbtype = strdup("postgresql");
+
+	ok = 1;
+	for (i = 0; i < 3; i++) {
+		AILLIST *a = text_args(i == 2 ? "s2" : "s1");
+		ok = ok && (ailsa_argument_query(&c, SERVER_ID_ON_NAME, a, r) == 0) && (r->total == 1) &&
+		     (number(r, 0) == (i == 2 ? 2UL : 1UL));
+		ailsa_list_full_clean(a);
+		ailsa_list_full_clean(r);
+		r = ailsa_db_data_list_init();
+	}
+	ailsa_sql_stmt_cache_stats(&c, &hits, &misses);
+	check("prepared statement runs again", ok);
+	check("statement prepared once per session", (misses == 1) && (hits == 2));
+
+	memset(b, 0, sizeof(b));
+	b[0].query_no = SERVER_NAME_COID;
+	b[1].query_no = SERVER_ID_ON_NAME;
+	b[1].args = text_args("s3");
+	b[2].query_no = CUST_ID_ON_COID;
+	b[2].args = text_args("TEST01");
+	b[3].query_no = SERVER_ID_ON_NAME;
+	b[3].args = text_args("nosuch");
+	for (i = 0; i < 4; i++)
+		b[i].results = ailsa_db_data_list_init();
+	ok = (ailsa_query_batch(&c, b, 4) == 0);
+	check("pipelined batch", ok);
+	check("batch results in order", ok && (b[0].total == 6) && (b[1].total == 1) && (number(b[1].results, 0) == 3) &&
+	      (b[2].total == 1) && (number(b[2].results, 0) == 1) && (b[3].total == 0));
+	ailsa_sql_stmt_cache_stats(&c, &hits, &misses);
+	check("batch prepares only new statements", (misses == 2) && (hits == 4));
+	for (i = 0; i < 4; i++) {
+		ailsa_list_full_clean(b[i].args);
+		ailsa_list_full_clean(b[i].results);
+	}
+
+	memset(b, 0, sizeof(b));
+	b[0].query_no = SERVER_ID_ON_NAME;
+	b[0].args = text_args("s1");
+	b[1].query_no = VM_SERVERS;
+	b[2].query_no = SERVER_ID_ON_NAME;
+	b[2].args = text_args("s2");
+	for (i = 0; i < 3; i++)
+		b[i].results = ailsa_db_data_list_init();
+	check("failed query fails the batch", ailsa_query_batch(&c, b, 3) != 0);
+	for (i = 0; i < 3; i++) {
+		ailsa_list_full_clean(b[i].args);
+		ailsa_list_full_clean(b[i].results);
+	}
+	{
+		AILLIST *a = text_args("s3");
+		check("session usable after failed batch", (ailsa_argument_query(&c, SERVER_ID_ON_NAME, a, r) == 0) &&
+		      (r->total == 1) && (number(r, 0) == 3));
+		ailsa_list_full_clean(a);
+	}
+
+	ok = (ailsa_begin(&c) == 0) && (ailsa_begin(&c) == 0) && (insert(&c, 1, 1, 0) == 0) &&
+	     (ailsa_commit(&c) == 0) && (ailsa_commit(&c) == 0);
+	check("nested commit", ok && (rows(&c, 1, 2) == 1));
+
+	ok = (ailsa_begin(&c) == 0) && (insert(&c, 2, 1, 0) == 0) && (ailsa_begin(&c) == 0) &&
+	     (insert(&c, 3, 1, 0) == 0) && (ailsa_rollback(&c) == 0);
+	ok = ok && (ailsa_begin(&c) == AILSA_TRANSACTION_FAIL);
+	ailsa_rollback(&c);
+	ok = ok && (ailsa_commit(&c) == AILSA_TRANSACTION_FAIL);
+	ailsa_rollback(&c);
+	check("inner rollback abandons the outer transaction", ok && (rows(&c, 2, 4) == 0));
+
+	check("bulk insert", (insert(&c, 1000, 40000, 1) == 0) && (rows(&c, 1000, 41000) == 40000));
+	ok = (ailsa_begin(&c) == 0) && (insert(&c, 100000, 40000, 1) == 0);
+	ailsa_rollback(&c);
+	check("bulk insert rolled back with its transaction", ok && (rows(&c, 100000, 140000) == 0));
+	check("transaction after rollback", (ailsa_begin(&c) == 0) && (insert(&c, 5, 1, 0) == 0) &&
+	      (ailsa_commit(&c) == 0) && (rows(&c, 5, 6) == 1));
+
+	ailsa_list_full_clean(r);
+	ailsa_sql_close(&c);
+	my_free(c.dbtype);
+	return failed;
+}
+EOF
+
+${CC:-cc} -DHAVE_CONFIG_H -I$BUILD/include -I$SRCDIR/include $(pkg-config --cflags libpq) \
+  -c -o $TMP/pgtest.o $TMP/pgtest.c || exit 1
+$BUILD/libtool --quiet --mode=link ${CC:-cc} -o $TMP/pgtest $TMP/pgtest.o \
+  $BUILD/lib/libailsasql.la $BUILD/lib/libailsacmdb.la -lpthread || exit 1
+
+$TMP/pgtest
+FAILED=$?
+# A second session sees only what was committed: rows 1 and 5 and the bulk insert
+GOT=$($PSQL -c "SELECT COUNT(*) FROM pgtest")
+if [ "$GOT" = 40002 ]; then
+  echo "ok   committed rows seen by another session"
+else
+  echo "FAIL committed rows seen by another session: $GOT, not 40002"
+  FAILED=$((FAILED + 1))
+fi
+
+if [ $FAILED -ne 0 ]; then
+  echo "$FAILED checks failed"
+  exit 1
+fi
+echo "All checks passed"
@@ -0,0 +1,80 @@
+#!/bin/sh
+#
+#  range-bench.sh: compare finding the A records in a reverse zone range by
+#  text pattern and by the numeric ip_addr column
+#
+#  Builds a scratch sqlite database with COUNT records in one forward zone,
+#  nine in ten of them A records scattered over 10.0.0.0/8. Then, for a /24
+#  and a /16 in that range, shows the query plan and times RUNS of each
+#  query: the LIKE '10.1.%' pattern dnsa used to build, and the ip_addr
+#  BETWEEN range it builds with now.
+#
+#  Usage: range-bench.sh [-c count] [-r runs] [-s schema]
+
+COUNT=500000
+RUNS=20
+SCHEMA=$(dirname $0)/../sql/sqlite/all-tables-sqlite.sql
+
+while getopts "c:r:s:" opt; do
+  case $opt in
+    c) COUNT=$OPTARG ;;
+    r) RUNS=$OPTARG ;;
+    s) SCHEMA=$OPTARG ;;
+    *) echo "Usage: $0 [-c count] [-r runs] [-s schema]"; exit 1 ;;
+  esac
+done
+
+if [ ! -f "$SCHEMA" ]; then
+  echo "Cannot find sqlite schema $SCHEMA; use -s"
+  exit 1
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+DB=$TMP/cmdb.sql
+sqlite3 $DB < $SCHEMA
+sqlite3 $DB "INSERT INTO zones (name) VALUES ('bench.example')"
+
+# An odd multiplier visits every address in 2^24 once, so no two records
+# share an IP. Every tenth record is a CNAME, with ip_addr left at 0
+awk -v count=$COUNT 'BEGIN {
+  print "BEGIN;"
+  for (k = 0; k < count; k++) {
+    if (k % 10 == 0) {
+      printf "INSERT INTO records (zone, host, type, destination) VALUES (1, \"c%d\", \"CNAME\", \"h%d.bench.example.\");\n", k, k + 1
+      continue
+    }
+    n = (k * 40503) % 16777216
+    ip = sprintf("10.%d.%d.%d", int(n / 65536), int(n / 256) % 256, n % 256)
+    printf "INSERT INTO records (zone, host, type, destination, ip_addr) VALUES (1, \"h%d\", \"A\", \"%s\", %d);\n", k, ip, 167772160 + n
+  }
+  print "COMMIT;"
+  print "ANALYZE;"
+}' | sqlite3 $DB
+
+run() {
+  I=0
+  : > $TMP/q.sql
+  while [ $I -lt $RUNS ]; do
+    echo "$2;" >> $TMP/q.sql
+    I=$((I + 1))
+  done
+  ROWS=$(sqlite3 $DB "$2" | wc -l)
+  START=$(date +%s.%N)
+  sqlite3 $DB < $TMP/q.sql > /dev/null
+  END=$(date +%s.%N)
+  echo "$1 $START $END $RUNS $ROWS" | awk '{
+    printf "  %-8s %8.2fms a query, %d rows\n", $1, ($3 - $2) * 1000 / $4, $5
+  }'
+  sqlite3 $DB "EXPLAIN QUERY PLAN $2" | grep -v '^QUERY PLAN' | sed 's/^/           /'
+}
+
+SELECT="SELECT r.destination, r.id, r.host, z.name FROM records r LEFT JOIN zones z ON z.id = r.zone"
+echo "$COUNT records"
+for R in "10.1.1.0 24 10.1.1.% 167837952 167838207" \
+         "10.1.0.0 16 10.1.% 167837696 167903231"; do
+  set -- $R
+  echo "$1/$2"
+  run like "$SELECT WHERE r.destination LIKE '$3' AND r.type = 'A'"
+  run between "$SELECT WHERE r.ip_addr BETWEEN $4 AND $5"
+done
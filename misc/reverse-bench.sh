@@ -0,0 +1,110 @@
+#!/bin/sh
+#
+#  reverse-bench.sh: time dnsa -b against a synthetic reverse zone
+#
+#  Builds a scratch sqlite database with one forward zone holding COUNT
+#  A records spread over a /16 or a /8, plus a master reverse zone for the
+#  range. Then times three reverse zone builds: the first one, which adds
+#  every record; a rebuild with nothing changed; and a rebuild after a
+#  tenth of the forward records are deleted. After each build it checks
+#  how many reverse records there are.
+#
+#  Everything lives in a scratch directory, and rndc is replaced with
+#  true. The forward zone is loaded straight into the database with an
+#  address for its name server outside the range, so the zones pass the
+#  zone check. The system cmdb.conf must still exist; the scratch
+#  ~/.cmdb.conf overrides it.
+#
+#  Usage: reverse-bench.sh [-p 16|8] [-c count] [-b bindir] [-s schema]
+
+PREFIX=16
+COUNT=30000
+BINDIR=
+SCHEMA=$(dirname $0)/../sql/sqlite/all-tables-sqlite.sql
+
+while getopts "p:c:b:s:" opt; do
+  case $opt in
+    p) PREFIX=$OPTARG ;;
+    c) COUNT=$OPTARG ;;
+    b) BINDIR=$OPTARG/ ;;
+    s) SCHEMA=$OPTARG ;;
+    *) echo "Usage: $0 [-p 16|8] [-c count] [-b bindir] [-s schema]"; exit 1 ;;
+  esac
+done
+
+case $PREFIX in
+  16) RANGE=10.20.0.0; MAX=65024 ;;
+  8) RANGE=10.0.0.0; MAX=16777216 ;;
+  *) echo "Prefix must be 16 or 8"; exit 1 ;;
+esac
+if [ $COUNT -gt $MAX ]; then
+  echo "At most $MAX records fit in a /$PREFIX"
+  exit 1
+fi
+if [ ! -f "$SCHEMA" ]; then
+  echo "Cannot find sqlite schema $SCHEMA; use -s"
+  exit 1
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+mkdir -p $TMP/db
+sqlite3 $TMP/cmdb.sql < $SCHEMA
+cat > $TMP/.cmdb.conf <<EOF
+DBTYPE=sqlite
+FILE=$TMP/cmdb.sql
+DIR=$TMP/db/
+BIND=$TMP/
+DNSA=dnsa.conf
+REV=dnsa-rev.conf
+RNDC=/bin/true
+CHKC=/bin/true
+REFRESH=28800
+RETRY=7200
+EXPIRE=1209600
+TTL=86400
+PRIDNS=192.0.2.1
+PRINS=ns1.bench.example
+HOSTMASTER=hostmaster.bench.example
+EOF
+
+export HOME=$TMP
+${BINDIR}dnsa -z -R -p $PREFIX -n $RANGE >/dev/null
+
+# /16: fill the /24s in order. /8: scatter with an odd multiplier, which
+# visits every address in 2^24 once, so no two records share an IP
+awk -v count=$COUNT -v prefix=$PREFIX 'BEGIN {
+  print "BEGIN;"
+  print "INSERT INTO zones (name, pri_dns, sec_dns, serial, refresh, retry, expire, ttl) VALUES (\"bench.example\", \"ns1.bench.example\", \"none\", 0, 28800, 7200, 1209600, 86400);"
+  print "INSERT INTO records (zone, host, type, destination, ip_addr) SELECT id, \"ns1\", \"A\", \"192.0.2.1\", 3221225985 FROM zones WHERE name = \"bench.example\";"
+  for (k = 0; k < count; k++) {
+    if (prefix == 16) {
+      n = 20 * 65536 + int(k / 254) * 256 + k % 254 + 1
+    } else {
+      n = (k * 40503) % 16777216
+    }
+    ip = sprintf("10.%d.%d.%d", int(n / 65536) % 256, int(n / 256) % 256, n % 256)
+    printf "INSERT INTO records (zone, host, type, destination, ip_addr) SELECT id, \"h%d\", \"A\", \"%s\", %d FROM zones WHERE name = \"bench.example\";\n", k, ip, 167772160 + n
+  }
+  print "COMMIT;"
+}' | sqlite3 $TMP/cmdb.sql
+
+build() {
+  START=$(date +%s.%N)
+  ${BINDIR}dnsa -b -n $RANGE >/dev/null 2>$TMP/err
+  END=$(date +%s.%N)
+  REV=$(sqlite3 $TMP/cmdb.sql "SELECT COUNT(*) FROM rev_records")
+  echo "$1 $START $END $REV $2" | awk '{
+    printf "%-10s %8.2fs  %d reverse records (expected %d)\n", $1, $3 - $2, $4, $5
+  }'
+  if [ -s $TMP/err ]; then
+    sed 's/^/  /' $TMP/err
+  fi
+}
+
+echo "/$PREFIX with $COUNT A records"
+build first $COUNT
+build unchanged $COUNT
+sqlite3 $TMP/cmdb.sql "DELETE FROM records WHERE id % 10 = 0"
+LEFT=$(sqlite3 $TMP/cmdb.sql "SELECT COUNT(*) FROM records WHERE type = 'A' AND host <> 'ns1'")
+build removed $LEFT
@@ -0,0 +1,189 @@
+#!/bin/sh
+#
+#  rndc-test.sh: check dnsa against a mock BIND control channel
+#
+#  Starts a small python3 server that speaks the rndc control channel
+#  protocol. It checks the HMAC-SHA256 signature on every message, that
+#  the first message on a connection is a null command that gets a nonce,
+#  and that every command after it carries that nonce and a current
+#  _tim and _exp. It logs each connection and the commands it accepts.
+#
+#  The script then commits zones with dnsa and checks the log: the
+#  reconfig and the batch of reload <zone> commands must arrive on one
+#  connection, an unchanged commit must not connect at all, a wrong key
+#  must be refused, a reply signed with the wrong key must make dnsa
+#  fail, and the next commit must reload what the failed one did not.
+#  The system cmdb.conf must still exist; the scratch ~/.cmdb.conf
+#  overrides it.
+#
+#  Usage: rndc-test.sh [-p port] [-b bindir] [-s schema]
+
+PORT=$((20000 + $$ % 10000))
+BINDIR=
+SCHEMA=$(dirname $0)/../sql/sqlite/all-tables-sqlite.sql
+
+while getopts "p:b:s:" opt; do
+  case $opt in
+    p) PORT=$OPTARG ;;
+    b) BINDIR=$OPTARG/ ;;
+    s) SCHEMA=$OPTARG ;;
+    *) echo "Usage: $0 [-p port] [-b bindir] [-s schema]"; exit 1 ;;
+  esac
+done
+
+if [ ! -f "$SCHEMA" ]; then
+  echo "Cannot find sqlite schema $SCHEMA; use -s"
+  exit 1
+fi
+
+TMP=$(mktemp -d)
+MOCK=
+trap 'kill $MOCK 2>/dev/null; rm -rf $TMP' EXIT
+mkdir -p $TMP/db
+sqlite3 $TMP/cmdb.sql < $SCHEMA
+SECRET=$(head -c 32 /dev/urandom | base64)
+key() {
+  printf 'key "rndc-key" {\n\talgorithm hmac-sha256;\n\tsecret "%s";\n};\n' "$1" > $TMP/rndc.key
+}
+key $SECRET
+cat > $TMP/.cmdb.conf <<EOF
+DBTYPE=sqlite
+FILE=$TMP/cmdb.sql
+DIR=$TMP/db/
+BIND=$TMP/
+DNSA=dnsa.conf
+REV=dnsa-rev.conf
+RNDC=/bin/false
+RNDC_KEY=$TMP/rndc.key
+RNDC_SERVER=127.0.0.1
+RNDC_PORT=$PORT
+CHKC=/bin/true
+PRIDNS=10.20.0.1
+PRINS=ns1.z0.example
+HOSTMASTER=hostmaster.z0.example
+EOF
+
+# Messages are a length, version 1, then the _auth, _ctrl and _data tables.
+# hsha in _auth is 163 and the base64 HMAC of everything after _auth.
+# If $TMP/badreply exists the replies are signed with the wrong secret
+cat > $TMP/mock.py <<'EOF'
+import socket, struct, hmac, hashlib, base64, sys, random, time, os
+port = int(sys.argv[1]); secret = base64.b64decode(sys.argv[2])
+log = open(sys.argv[3], 'a', buffering=1); badreply = sys.argv[4]
+
+def parse(b):
+    d = {}; p = 0
+    while p < len(b):
+        n = b[p]; k = b[p + 1:p + 1 + n].decode(); p += 1 + n
+        t = b[p]; l = struct.unpack('>I', b[p + 1:p + 5])[0]; p += 5
+        d[k] = parse(b[p:p + l]) if t == 2 else b[p:p + l]; p += l
+    return d
+
+def name(k): return bytes([len(k)]) + k.encode()
+def binary(k, v): return name(k) + b'\x01' + struct.pack('>I', len(v)) + v
+def table(k, v): return name(k) + b'\x02' + struct.pack('>I', len(v)) + v
+
+def sign(key, data):
+    s = base64.b64encode(hmac.new(key, data, hashlib.sha256).digest())
+    return s + b'\0' * (88 - len(s))
+
+def serve(c):
+    nonce = 0
+    while True:
+        h = c.recv(4, socket.MSG_WAITALL)
+        if len(h) < 4:
+            return
+        m = c.recv(struct.unpack('>I', h)[0], socket.MSG_WAITALL)
+        if struct.unpack('>I', m[:4])[0] != 1 or m[4:10] != b'\x05_auth':
+            log.write('BADFORMAT\n'); return
+        alen = struct.unpack('>I', m[11:15])[0]
+        msg = parse(m[4:]); hsha = msg['_auth'].get('hsha', b'')
+        if hsha[:1] != b'\xa3' or hsha[1:] != sign(secret, m[15 + alen:]):
+            log.write('BADAUTH\n'); return
+        ctrl = msg['_ctrl']; cmd = msg['_data']['type'].decode()
+        now = time.time()
+        if abs(int(ctrl['_tim']) - now) > 60 or int(ctrl['_exp']) < now:
+            log.write('BADTIME\n'); return
+        if not nonce:
+            if cmd != 'null' or '_nonce' in ctrl:
+                log.write('NONULL %s\n' % cmd); return
+            nonce = random.randint(1, 2 ** 32 - 1)
+            data = binary('type', b'null') + binary('result', b'0')
+        else:
+            if int(ctrl.get('_nonce', b'0')) != nonce:
+                log.write('BADNONCE\n'); return
+            log.write(cmd + '\n')
+            data = binary('type', cmd.encode()) + binary('result', b'0')
+        rest = table('_ctrl', binary('_ser', ctrl['_ser']) + binary('_tim', ctrl['_tim']) +
+            binary('_rpl', b'1') + binary('_nonce', str(nonce).encode())) + table('_data', data)
+        key = b'wrong' if os.path.exists(badreply) else secret
+        auth = table('_auth', binary('hsha', b'\xa3' + sign(key, rest)))
+        out = struct.pack('>I', 1) + auth + rest
+        c.sendall(struct.pack('>I', len(out)) + out)
+
+s = socket.socket()
+s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+s.bind(('127.0.0.1', port)); s.listen(5)
+while True:
+    c, _ = s.accept()
+    log.write('connect\n')
+    serve(c)
+    c.close()
+EOF
+
+python3 $TMP/mock.py $PORT $SECRET $TMP/log $TMP/badreply &
+MOCK=$!
+sleep 1
+
+export HOME=$TMP
+FAILED=0
+# check name rc expected-rc expected-log...: the log must hold exactly these lines
+check() {
+  NAME=$1; RC=$2; WANT=$3; shift 3
+  printf '%s\n' "$@" | sed '/^$/d' > $TMP/want
+  if [ $RC -ne $WANT ] && [ $WANT -eq 0 -o $RC -eq 0 ]; then
+    echo "FAIL $NAME: dnsa returned $RC"
+    FAILED=$((FAILED + 1))
+  elif ! cmp -s $TMP/want $TMP/log; then
+    echo "FAIL $NAME: control channel saw"
+    sed 's/^/  /' $TMP/log
+    echo "  expected"
+    sed 's/^/  /' $TMP/want
+    FAILED=$((FAILED + 1))
+  else
+    echo "ok   $NAME"
+  fi
+  : > $TMP/log
+}
+
+for z in z0 z1; do
+  ${BINDIR}dnsa -z -F -n $z.example >/dev/null 2>&1
+  ${BINDIR}dnsa -a -t A -h ns1 -i 10.20.0.1 -n $z.example >/dev/null 2>&1
+done
+: > $TMP/log
+${BINDIR}dnsa -w -F >/dev/null 2>&1
+check "batched reload" $? 0 connect reconfig "reload z0.example" "reload z1.example"
+${BINDIR}dnsa -w -F >/dev/null 2>&1
+check "unchanged commit" $? 0 ""
+${BINDIR}dnsa -a -t A -h www -i 10.20.0.5 -n z1.example >/dev/null 2>&1
+: > $TMP/log
+${BINDIR}dnsa -w -F >/dev/null 2>&1
+check "one zone changed" $? 0 connect "reload z1.example"
+${BINDIR}dnsa -a -t A -h www -i 10.20.0.5 -n z0.example >/dev/null 2>&1
+: > $TMP/log
+key $(head -c 32 /dev/urandom | base64)
+${BINDIR}dnsa -w -F >/dev/null 2>&1
+check "wrong key" $? 1 connect BADAUTH
+key $SECRET
+touch $TMP/badreply
+${BINDIR}dnsa -w -F >/dev/null 2>&1
+check "badly signed reply" $? 1 connect
+rm -f $TMP/badreply
+${BINDIR}dnsa -w -F >/dev/null 2>&1
+check "retry after failure" $? 0 connect "reload z0.example"
+
+if [ $FAILED -ne 0 ]; then
+  echo "$FAILED checks failed"
+  exit 1
+fi
+echo "All checks passed"
@@ -0,0 +1,93 @@
+#!/bin/sh
+#
+#  sqlite-bench.sh: time concurrent readers against one writer
+#
+#  Runs READERS copies of "dnsa -d", each LOOPS times, while one writer
+#  keeps adding and removing a host record and rebuilding the reverse zone
+#  for it. Prints the elapsed time and how many runs failed; a failed run
+#  is one that logged a failed query, usually "database is locked".
+#
+#  Run it once with the SQLITE_* settings in cmdb.conf and once without
+#  them to compare.
+#
+#  Usage: sqlite-bench.sh -z <reverse range> -d <forward zone> -i <ip>
+#                         [-r readers] [-l loops] [-b bindir]
+#
+#  <ip> must be free and inside <reverse range>.
+
+READERS=4
+LOOPS=50
+BINDIR=
+RANGE=
+ZONE=
+IP=
+
+while getopts "r:l:b:z:d:i:" opt; do
+  case $opt in
+    r) READERS=$OPTARG ;;
+    l) LOOPS=$OPTARG ;;
+    b) BINDIR=$OPTARG/ ;;
+    z) RANGE=$OPTARG ;;
+    d) ZONE=$OPTARG ;;
+    i) IP=$OPTARG ;;
+    *) echo "Usage: $0 -z <range> -d <zone> -i <ip> [-r readers] [-l loops] [-b bindir]"; exit 1 ;;
+  esac
+done
+
+if [ -z "$RANGE" ] || [ -z "$ZONE" ] || [ -z "$IP" ]; then
+  echo "Need a reverse range (-z), a forward zone (-d) and a free IP (-i)"
+  exit 1
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+# dnsa exits 0 even when a query fails, so look for the error it logs
+run() {
+  out=$1
+  shift
+  if "$@" 2>&1 >/dev/null | grep -q -e "failed" -e "locked"; then
+    echo x >> $out
+  fi
+}
+
+writer() {
+  while [ ! -f $TMP/done ]; do
+    run $TMP/writer ${BINDIR}dnsa -a -t A -h sqlite-bench -i $IP -n $ZONE
+    run $TMP/writer ${BINDIR}dnsa -b -n $RANGE
+    run $TMP/writer ${BINDIR}dnsa -r -t A -h sqlite-bench -n $ZONE
+    run $TMP/writer ${BINDIR}dnsa -b -n $RANGE
+  done
+}
+
+reader() {
+  i=0
+  while [ $i -lt $LOOPS ]; do
+    run $TMP/reader.$1 ${BINDIR}dnsa -d -F -n $ZONE
+    i=$((i + 1))
+  done
+}
+
+writer &
+WPID=$!
+START=$(date +%s.%N)
+PIDS=
+n=0
+while [ $n -lt $READERS ]; do
+  reader $n &
+  PIDS="$PIDS $!"
+  n=$((n + 1))
+done
+wait $PIDS
+END=$(date +%s.%N)
+touch $TMP/done
+wait $WPID
+
+FAILS=$(cat $TMP/reader.* 2>/dev/null | wc -l)
+WFAILS=$(cat $TMP/writer 2>/dev/null | wc -l)
+RUNS=$((READERS * LOOPS))
+echo "$END $START $RUNS $FAILS $WFAILS" | awk '{
+  t = $1 - $2
+  printf "%d reader runs in %.2fs (%.1f/s); %d reader and %d writer failures\n",
+    $3, t, $3 / t, $4, $5
+}'
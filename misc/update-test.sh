@@ -0,0 +1,334 @@
+#!/bin/sh
+#
+#  update-test.sh: check dnsa dynamic updates against a stub name server
+#
+#  Starts a small python3 server on UDP and TCP that takes RFC 2136
+#  updates. It checks the TSIG on each one: the key name, hmac-sha256,
+#  the time and the MAC over the message. It then checks the update is
+#  the RRset replace dnsa sends: an SOA for the zone apex first, one
+#  delete of the whole RRset (class ANY, TTL 0, no rdata) and then adds
+#  of that RRset in class IN. It logs what it saw and sends back a reply
+#  signed over the request MAC, as named does.
+#
+#  The script adds and removes records with dnsa and checks the log and
+#  the zone: the serial in the SOA sent must be the one stored, and a
+#  zone whose update failed must be flagged for the next commit. It also
+#  checks an update too big for UDP, a truncated UDP reply, a REFUSED
+#  reply, a wrong key and a reply signed with the wrong key. The system
+#  cmdb.conf must still exist; the scratch ~/.cmdb.conf overrides it.
+#
+#  Usage: update-test.sh [-p port] [-b bindir] [-s schema]
+
+PORT=$((20000 + $$ % 10000))
+BINDIR=
+SCHEMA=$(dirname $0)/../sql/sqlite/all-tables-sqlite.sql
+
+while getopts "p:b:s:" opt; do
+  case $opt in
+    p) PORT=$OPTARG ;;
+    b) BINDIR=$OPTARG/ ;;
+    s) SCHEMA=$OPTARG ;;
+    *) echo "Usage: $0 [-p port] [-b bindir] [-s schema]"; exit 1 ;;
+  esac
+done
+
+if [ ! -f "$SCHEMA" ]; then
+  echo "Cannot find sqlite schema $SCHEMA; use -s"
+  exit 1
+fi
+
+TMP=$(mktemp -d)
+STUB=
+trap 'kill $STUB 2>/dev/null; rm -rf $TMP' EXIT
+mkdir -p $TMP/db
+sqlite3 $TMP/cmdb.sql < $SCHEMA
+SECRET=$(head -c 32 /dev/urandom | base64)
+# dnsa lowercases the key name, as named does
+key() {
+  printf 'key "cmdb-Update" {\n\talgorithm hmac-sha256;\n\tsecret "%s";\n};\n' "$1" > $TMP/update.key
+}
+key $SECRET
+cat > $TMP/.cmdb.conf <<EOF
+DBTYPE=sqlite
+FILE=$TMP/cmdb.sql
+DIR=$TMP/db/
+BIND=$TMP/
+DNSA=dnsa.conf
+REV=dnsa-rev.conf
+RNDC=/bin/true
+CHKC=/bin/true
+UPDATE_KEY=$TMP/update.key
+UPDATE_SERVER=127.0.0.1
+UPDATE_PORT=$PORT
+PRIDNS=10.20.0.1
+PRINS=ns1.z0.example
+HOSTMASTER=hostmaster.z0.example
+EOF
+
+# $TMP/mode changes the reply: tc truncates UDP replies, refuse sends
+# REFUSED and badreply signs with the wrong secret
+cat > $TMP/stub.py <<'EOF'
+import socket, struct, hmac, hashlib, base64, sys, time, threading
+port = int(sys.argv[1]); keyname = sys.argv[2]; secret = base64.b64decode(sys.argv[3])
+log = open(sys.argv[4], 'a', buffering=1); modefile = sys.argv[5]
+alg = 'hmac-sha256.'
+types = {1: 'A', 5: 'CNAME', 6: 'SOA', 15: 'MX', 16: 'TXT', 28: 'AAAA'}
+lock = threading.Lock()
+
+class Bad(Exception):
+    pass
+
+def mode():
+    try:
+        return open(modefile).read().strip()
+    except OSError:
+        return ''
+
+def getname(m, off):
+    labels = []
+    while True:
+        n = m[off]
+        if n & 0xc0:
+            raise Bad('compressed name')
+        off += 1
+        if n == 0:
+            return '.'.join(labels) + '.', off
+        labels.append(m[off:off + n].decode()); off += n
+
+def wire(name):
+    out = b''
+    for l in name.rstrip('.').split('.'):
+        out += bytes([len(l)]) + l.encode()
+    return out + b'\0'
+
+def rdata(t, r):
+    if t == 1:
+        return socket.inet_ntop(socket.AF_INET, r)
+    if t == 28:
+        return socket.inet_ntop(socket.AF_INET6, r)
+    if t == 5:
+        return getname(r, 0)[0]
+    if t == 15:
+        return '%d %s' % (struct.unpack('>H', r[:2])[0], getname(r, 2)[0])
+    if t == 16:
+        out = []; p = 0
+        while p < len(r):
+            out.append('"%s"' % r[p + 1:p + 1 + r[p]].decode()); p += 1 + r[p]
+        return ' '.join(out)
+    if t == 6:
+        mname, p = getname(r, 0); rname, p = getname(r, p)
+        return '%s %s %d %d %d %d %d' % ((mname, rname) + struct.unpack('>IIIII', r[p:p + 20]))
+    raise Bad('type %d' % t)
+
+def rr(m, off):
+    name, off = getname(m, off)
+    t, c, ttl, l = struct.unpack('>HHIH', m[off:off + 10]); off += 10
+    return (name, t, c, ttl, m[off:off + l]), off + l
+
+def tsigvars(t, fudge, error):
+    return wire(keyname) + struct.pack('>HI', 255, 0) + wire(alg) + \
+        struct.pack('>HIHHH', t >> 32, t & 0xffffffff, fudge, error, 0)
+
+def mac(key, data):
+    return hmac.new(key, data, hashlib.sha256).digest()
+
+# Returns the request MAC; anything wrong raises Bad
+def check(m, proto):
+    qid, flags, zo, pr, up, ar = struct.unpack('>HHHHHH', m[:12])
+    if (flags >> 11) & 0xf != 5 or zo != 1 or pr != 0 or ar != 1:
+        raise Bad('header %04x %d %d %d' % (flags, zo, pr, ar))
+    zone, off = getname(m, 12)
+    if struct.unpack('>HH', m[off:off + 4]) != (6, 1):
+        raise Bad('zone section')
+    off += 4
+    rrs = []
+    for i in range(up):
+        r, off = rr(m, off); rrs.append(r)
+    start = off
+    (name, t, c, ttl, r), off = rr(m, off)
+    if off != len(m) or t != 250 or c != 255 or ttl != 0:
+        raise Bad('no TSIG at the end')
+    if name != keyname:
+        raise Bad('key %s' % name)
+    a, p = getname(r, 0)
+    if a != alg:
+        raise Bad('algorithm %s' % a)
+    hi, lo, fudge, size = struct.unpack('>HIHH', r[p:p + 10]); p += 10
+    signed = (hi << 32) | lo; reqmac = r[p:p + size]; p += size
+    orig, error, olen = struct.unpack('>HHH', r[p:p + 6])
+    if abs(signed - time.time()) > fudge or orig != qid or error != 0 or olen != 0:
+        raise Bad('TSIG fields')
+    data = m[:10] + struct.pack('>H', ar - 1) + m[12:start] + tsigvars(signed, fudge, 0)
+    if not hmac.compare_digest(mac(secret, data), reqmac):
+        raise Bad('BADSIG')
+    lines = ['update %s %s' % (proto, zone)]
+    if rrs and rrs[0][1] == 6:
+        name, t, c, ttl, r = rrs.pop(0)
+        if name != zone or c != 1:
+            raise Bad('SOA %s class %d' % (name, c))
+        lines.append('add %s %d SOA %s' % (name, ttl, rdata(6, r)))
+    if not rrs:
+        raise Bad('no RRset')
+    owner, rtype, c, ttl, r = rrs.pop(0)
+    if c != 255 or ttl != 0 or r:
+        raise Bad('RRset is not deleted first')
+    lines.append('delete %s %s' % (owner, types.get(rtype, rtype)))
+    for name, t, c, ttl, r in rrs:
+        if name != owner or t != rtype or c != 1:
+            raise Bad('add %s %d class %d' % (name, t, c))
+        lines.append('add %s %d %s %s' % (name, ttl, types[t], rdata(t, r)))
+    log.write(''.join(l + '\n' for l in lines))
+    return reqmac
+
+def reply(m, end, reqmac, rcode, key):
+    head = m[:2] + struct.pack('>HHHHH', 0x8000 | (5 << 11) | rcode, 1, 0, 0, 0) + m[12:end]
+    now = int(time.time())
+    sig = mac(key, struct.pack('>H', len(reqmac)) + reqmac + head + tsigvars(now, 300, 0))
+    r = wire(alg) + struct.pack('>HIHH', now >> 32, now & 0xffffffff, 300, len(sig)) + sig + m[:2] + struct.pack('>HH', 0, 0)
+    return head[:10] + struct.pack('>H', 1) + head[12:] + wire(keyname) + struct.pack('>HHIH', 250, 255, 0, len(r)) + r
+
+def handle(m, proto):
+    with lock:
+        end = getname(m, 12)[1] + 4
+        if proto == 'udp' and mode() == 'tc':
+            log.write('truncated\n')
+            return m[:2] + struct.pack('>HHHHH', 0x8000 | (5 << 11) | 0x200, 0, 0, 0, 0)
+        try:
+            reqmac = check(m, proto)
+        except Bad as e:
+            log.write('BAD %s\n' % e)
+            # NOTAUTH with an unsigned TSIG carrying BADSIG
+            r = wire(alg) + struct.pack('>HIHH', 0, int(time.time()), 300, 0) + m[:2] + struct.pack('>HH', 16, 0)
+            return m[:2] + struct.pack('>HHHHH', 0x8000 | (5 << 11) | 9, 1, 0, 0, 1) + m[12:end] + \
+                wire(keyname) + struct.pack('>HHIH', 250, 255, 0, len(r)) + r
+        rcode = 5 if mode() == 'refuse' else 0
+        return reply(m, end, reqmac, rcode, b'wrong' if mode() == 'badreply' else secret)
+
+def tcp():
+    s = socket.socket(); s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    s.bind(('127.0.0.1', port)); s.listen(5)
+    while True:
+        c, _ = s.accept()
+        n = struct.unpack('>H', c.recv(2, socket.MSG_WAITALL))[0]
+        out = handle(c.recv(n, socket.MSG_WAITALL), 'tcp')
+        c.sendall(struct.pack('>H', len(out)) + out)
+        c.close()
+
+threading.Thread(target=tcp, daemon=True).start()
+u = socket.socket(socket.AF_INET, socket.SOCK_DGRAM); u.bind(('127.0.0.1', port))
+while True:
+    m, a = u.recvfrom(65535)
+    u.sendto(handle(m, 'udp'), a)
+EOF
+
+python3 $TMP/stub.py $PORT cmdb-update. $SECRET $TMP/log $TMP/mode &
+STUB=$!
+sleep 1
+
+export HOME=$TMP
+FAILED=0
+zone() {
+  sqlite3 -separator ' ' $TMP/cmdb.sql "SELECT $1 FROM zones WHERE name = 'z0.example'"
+}
+# check name rc expected-rc updated expected-log...: the log must hold
+# exactly these lines. SOA at the end of a line is the SOA stored for the
+# zone, or when the update failed the one that was not stored
+check() {
+  NAME=$1; RC=$2; WANT=$3; UPDATED=$4; shift 4
+  SERIAL=$(zone serial)
+  if [ "$UPDATED" = yes ]; then
+    SERIAL=$((SERIAL + 1))
+  fi
+  SOA="$(zone ttl) SOA ns1.z0.example. hostmaster.z0.example. $SERIAL $(zone 'refresh, retry, expire, ttl')"
+  printf '%s\n' "$@" | sed -e '/^$/d' -e "s/ SOA$/ $SOA/" > $TMP/want
+  if [ $RC -ne $WANT ] && [ $WANT -eq 0 -o $RC -eq 0 ]; then
+    echo "FAIL $NAME: dnsa returned $RC"
+    FAILED=$((FAILED + 1))
+  elif [ "$(zone updated)" != "$UPDATED" ]; then
+    echo "FAIL $NAME: zone updated is $(zone updated), not $UPDATED"
+    FAILED=$((FAILED + 1))
+  elif ! cmp -s $TMP/want $TMP/log; then
+    echo "FAIL $NAME: name server saw"
+    sed 's/^/  /' $TMP/log
+    echo "  expected"
+    sed 's/^/  /' $TMP/want
+    FAILED=$((FAILED + 1))
+  else
+    echo "ok   $NAME"
+  fi
+  : > $TMP/log
+  : > $TMP/mode
+}
+
+${BINDIR}dnsa -z -F -n z0.example >/dev/null 2>&1
+${BINDIR}dnsa -a -t A -h ns1 -i 10.20.0.1 -n z0.example >/dev/null 2>&1
+${BINDIR}dnsa -w -F >/dev/null 2>&1
+: > $TMP/log
+TTL=$(zone ttl)
+${BINDIR}dnsa -a -t A -h www -i 10.20.0.5 -n z0.example >/dev/null 2>&1
+check "add A" $? 0 no "update udp z0.example." "add z0.example. SOA" \
+  "delete www.z0.example. A" "add www.z0.example. $TTL A 10.20.0.5"
+${BINDIR}dnsa -a -t A -h www -i 10.20.0.6 -n z0.example >/dev/null 2>&1
+check "replace A RRset" $? 0 no "update udp z0.example." "add z0.example. SOA" \
+  "delete www.z0.example. A" "add www.z0.example. $TTL A 10.20.0.5" "add www.z0.example. $TTL A 10.20.0.6"
+${BINDIR}dnsa -a -t AAAA -h www -i 2001:db8::5 -n z0.example >/dev/null 2>&1
+check "add AAAA" $? 0 no "update udp z0.example." "add z0.example. SOA" \
+  "delete www.z0.example. AAAA" "add www.z0.example. $TTL AAAA 2001:db8::5"
+${BINDIR}dnsa -a -t MX -h mail -i mail -p 10 -n z0.example >/dev/null 2>&1
+check "add MX" $? 0 no "update udp z0.example." "add z0.example. SOA" \
+  "delete z0.example. MX" "add z0.example. $TTL MX 10 mail.z0.example."
+${BINDIR}dnsa -a -t CNAME -h ftp -i www -n z0.example >/dev/null 2>&1
+check "add CNAME" $? 0 no "update udp z0.example." "add z0.example. SOA" \
+  "delete ftp.z0.example. CNAME" "add ftp.z0.example. $TTL CNAME www.z0.example."
+${BINDIR}dnsa -a -t TXT -h txt -i hello -n z0.example >/dev/null 2>&1
+check "add TXT" $? 0 no "update udp z0.example." "add z0.example. SOA" \
+  "delete txt.z0.example. TXT" "add txt.z0.example. $TTL TXT \"hello\""
+${BINDIR}dnsa -r -t A -h www -n z0.example >/dev/null 2>&1
+check "remove A" $? 0 no "update udp z0.example." "add z0.example. SOA" \
+  "delete www.z0.example. A"
+${BINDIR}dnsa -r -t MX -h mail -p 10 -n z0.example >/dev/null 2>&1
+check "remove MX" $? 0 no "update udp z0.example." "add z0.example. SOA" \
+  "delete z0.example. MX"
+
+# The twentieth A record takes the update past 512 bytes
+I=1
+while [ $I -lt 20 ]; do
+  ${BINDIR}dnsa -a -t A -h many -i 10.20.1.$I -n z0.example >/dev/null 2>&1
+  I=$((I + 1))
+done
+: > $TMP/log
+${BINDIR}dnsa -a -t A -h many -i 10.20.1.20 -n z0.example >/dev/null 2>&1
+RC=$?
+set -- "update tcp z0.example." "add z0.example. SOA" "delete many.z0.example. A"
+I=1
+while [ $I -le 20 ]; do
+  set -- "$@" "add many.z0.example. $TTL A 10.20.1.$I"
+  I=$((I + 1))
+done
+check "large update over TCP" $RC 0 no "$@"
+
+echo tc > $TMP/mode
+${BINDIR}dnsa -a -t A -h trunc -i 10.20.0.7 -n z0.example >/dev/null 2>&1
+check "truncated reply" $? 0 no truncated "update tcp z0.example." "add z0.example. SOA" \
+  "delete trunc.z0.example. A" "add trunc.z0.example. $TTL A 10.20.0.7"
+echo refuse > $TMP/mode
+${BINDIR}dnsa -a -t A -h refused -i 10.20.0.8 -n z0.example >/dev/null 2>&1
+check "refused" $? 0 yes "update udp z0.example." "add z0.example. SOA" \
+  "delete refused.z0.example. A" "add refused.z0.example. $TTL A 10.20.0.8"
+${BINDIR}dnsa -w -F >/dev/null 2>&1
+: > $TMP/log
+echo badreply > $TMP/mode
+${BINDIR}dnsa -a -t A -h badreply -i 10.20.0.9 -n z0.example >/dev/null 2>&1
+check "badly signed reply" $? 0 yes "update udp z0.example." "add z0.example. SOA" \
+  "delete badreply.z0.example. A" "add badreply.z0.example. $TTL A 10.20.0.9"
+${BINDIR}dnsa -w -F >/dev/null 2>&1
+: > $TMP/log
+key $(head -c 32 /dev/urandom | base64)
+${BINDIR}dnsa -a -t A -h badkey -i 10.20.0.10 -n z0.example >/dev/null 2>&1
+check "wrong key" $? 0 yes "BAD BADSIG"
+
+if [ $FAILED -ne 0 ]; then
+  echo "$FAILED checks failed"
+  exit 1
+fi
+echo "All checks passed"
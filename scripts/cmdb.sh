@@ -742,7 +742,6 @@ BIND=/etc/bind			# BIND configuration directory
 DNSA=dnsa.conf			# DNSA configuration filename for bind
 REV=dnsa-rev.conf		# Reverse zone configuration file for bind
 RNDC=/usr/sbin/rndc		# Path to rndc command
-CHKZ=/usr/sbin/named-checkzone	# Path to checkzone command
 CHKC=/usr/sbin/named-checkconf	# Path to checkconf command
 REFRESH=28800
 RETRY=7200
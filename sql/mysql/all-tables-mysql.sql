@@ -1122,6 +1122,7 @@ CREATE TABLE `preferred_a` (
   `mtime` timestamp NOT NULL DEFAULT '0000-00-00 00:00:00',
   PRIMARY KEY (`prefa_id`),
   KEY `record_id` (`record_id`),
+  KEY `ip_addr` (`ip_addr`),
   CONSTRAINT `preferred_a_ibfk_1` FOREIGN KEY (`record_id`) REFERENCES `records` (`id`) ON DELETE CASCADE ON UPDATE CASCADE
 ) ENGINE=InnoDB AUTO_INCREMENT=1 DEFAULT CHARSET=latin1;
 /*!40101 SET character_set_client = @saved_cs_client */;
@@ -1172,6 +1173,7 @@ CREATE TABLE `records` (
   `service` varchar(15) DEFAULT NULL,
   `pri` int(7) NOT NULL DEFAULT '0',
   `destination` varchar(255) NOT NULL,
+  `ip_addr` int(4) unsigned NOT NULL DEFAULT '0',
   `valid` varchar(15) NOT NULL DEFAULT 'unknown',
   `cuser` int(11) NOT NULL DEFAULT '0',
   `muser` int(11) NOT NULL DEFAULT '0',
@@ -1179,6 +1181,7 @@ CREATE TABLE `records` (
   `mtime` timestamp NOT NULL DEFAULT '0000-00-00 00:00:00',
   PRIMARY KEY (`id`),
   KEY `zone` (`zone`),
+  KEY `ip_addr` (`ip_addr`),
   CONSTRAINT `records_ibfk_1` FOREIGN KEY (`zone`) REFERENCES `zones` (`id`) ON DELETE CASCADE ON UPDATE CASCADE
 ) ENGINE=InnoDB AUTO_INCREMENT=1 DEFAULT CHARSET=latin1;
 /*!40101 SET character_set_client = @saved_cs_client */;
@@ -1224,7 +1227,7 @@ CREATE TABLE `rev_records` (
   `rev_record_id` int(7) NOT NULL AUTO_INCREMENT,
   `rev_zone` int(7) NOT NULL DEFAULT '0',
   `zone_index` int(7) NOT NULL DEFAULT '0',
-  `host` varchar(11) NOT NULL DEFAULT 'NULL',
+  `host` varchar(32) NOT NULL DEFAULT 'NULL',
   `destination` varchar(255) NOT NULL,
   `valid` varchar(15) NOT NULL DEFAULT 'unknown',
   `cuser` int(11) NOT NULL DEFAULT '0',
@@ -1292,6 +1295,7 @@ CREATE TABLE `rev_zones` (
   `valid` varchar(15) NOT NULL DEFAULT 'yes',
   `owner` int(7) NOT NULL DEFAULT '1',
   `updated` varchar(15) NOT NULL DEFAULT 'unknown',
+  `content_hash` varchar(32) DEFAULT NULL,
   `type` varchar(15) NOT NULL DEFAULT 'master',
   `master` varchar(255) DEFAULT NULL,
   `cuser` int(11) NOT NULL DEFAULT '0',
@@ -1909,6 +1913,7 @@ CREATE TABLE `zones` (
   `valid` varchar(15) NOT NULL DEFAULT 'unknown',
   `owner` int(11) NOT NULL DEFAULT '1',
   `updated` varchar(15) NOT NULL DEFAULT 'yes',
+  `content_hash` varchar(32) DEFAULT NULL,
   `type` varchar(15) NOT NULL DEFAULT 'master',
   `master` varchar(255) DEFAULT NULL,
   `cuser` int(11) NOT NULL DEFAULT '0',
@@ -34,6 +34,7 @@ CREATE TABLE `preferred_a` (
   `mtime` timestamp NOT NULL DEFAULT '0000-00-00 00:00:00',
   PRIMARY KEY (`prefa_id`),
   KEY `record_id` (`record_id`),
+  KEY `ip_addr` (`ip_addr`),
   CONSTRAINT `preferred_a_ibfk_1` FOREIGN KEY (`record_id`) REFERENCES `records` (`id`) ON DELETE CASCADE ON UPDATE CASCADE
 ) ENGINE=InnoDB AUTO_INCREMENT=5 DEFAULT CHARSET=latin1;
 /*!40101 SET character_set_client = @saved_cs_client */;
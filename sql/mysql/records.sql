@@ -31,6 +31,7 @@ CREATE TABLE `records` (
   `service` varchar(15) DEFAULT NULL,
   `pri` int(7) NOT NULL DEFAULT '0',
   `destination` varchar(255) NOT NULL,
+  `ip_addr` int(4) unsigned NOT NULL DEFAULT '0',
   `valid` varchar(15) NOT NULL DEFAULT 'unknown',
   `cuser` int(11) NOT NULL DEFAULT '0',
   `muser` int(11) NOT NULL DEFAULT '0',
@@ -38,6 +39,7 @@ CREATE TABLE `records` (
   `mtime` timestamp NOT NULL DEFAULT '0000-00-00 00:00:00',
   PRIMARY KEY (`id`),
   KEY `zone` (`zone`),
+  KEY `ip_addr` (`ip_addr`),
   CONSTRAINT `records_ibfk_1` FOREIGN KEY (`zone`) REFERENCES `zones` (`id`) ON DELETE CASCADE ON UPDATE CASCADE
 ) ENGINE=InnoDB AUTO_INCREMENT=94 DEFAULT CHARSET=latin1;
 /*!40101 SET character_set_client = @saved_cs_client */;
@@ -40,6 +40,7 @@ CREATE TABLE `rev_zones` (
   `valid` varchar(15) NOT NULL DEFAULT 'yes',
   `owner` int(7) NOT NULL DEFAULT '1',
   `updated` varchar(15) NOT NULL DEFAULT 'unknown',
+  `content_hash` varchar(32) DEFAULT NULL,
   `type` varchar(15) NOT NULL DEFAULT 'master',
   `master` varchar(255) DEFAULT NULL,
   `cuser` int(11) NOT NULL DEFAULT '0',
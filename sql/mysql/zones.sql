@@ -35,6 +35,7 @@ CREATE TABLE `zones` (
   `valid` varchar(15) NOT NULL DEFAULT 'unknown',
   `owner` int(11) NOT NULL DEFAULT '1',
   `updated` varchar(15) NOT NULL DEFAULT 'yes',
+  `content_hash` varchar(32) DEFAULT NULL,
   `type` varchar(15) NOT NULL DEFAULT 'master',
   `master` varchar(255) DEFAULT NULL,
   `cuser` int(11) NOT NULL DEFAULT '0',
@@ -222,6 +222,7 @@ CREATE TABLE zones (
   valid varchar(15) NOT NULL DEFAULT 'unknown',
   owner int NOT NULL DEFAULT '1',
   updated varchar(15) NOT NULL DEFAULT 'yes',
+  content_hash varchar(32) DEFAULT NULL,
   type varchar(15) NOT NULL DEFAULT 'master',
   master varchar(255),
   cuser int NOT NULL DEFAULT 0,
@@ -247,6 +248,7 @@ CREATE TABLE rev_zones (
   valid varchar(15) NOT NULL DEFAULT 'yes',
   owner int NOT NULL DEFAULT '1',
   updated varchar(15) NOT NULL DEFAULT 'unknown',
+  content_hash varchar(32) DEFAULT NULL,
   type varchar(15) NOT NULL DEFAULT 'master',
   master varchar(255),
   cuser int NOT NULL DEFAULT 0,
@@ -263,16 +265,18 @@ CREATE TABLE records (
   service varchar(15),	
   pri int NOT NULL DEFAULT '0',
   destination varchar(255) NOT NULL,
+  ip_addr INT8 NOT NULL DEFAULT '0',
   valid varchar(15) NOT NULL DEFAULT 'unknown',
   cuser int NOT NULL DEFAULT 0,
   muser int NOT NULL DEFAULT 0,
   ctime timestamp NOT NULL DEFAULT '1970-01-01 00:00:00',
   mtime timestamp NOT NULL DEFAULT '1970-01-01 00:00:00'
 );
+CREATE INDEX records_ip_addr ON records (ip_addr);
 CREATE TABLE rev_records (
   rev_record_id INTEGER PRIMARY KEY,
   rev_zone int NOT NULL DEFAULT '0' REFERENCES rev_zones(rev_zone_id) ON UPDATE CASCADE ON DELETE CASCADE,
-  host varchar(11) NOT NULL DEFAULT 'NULL',
+  host varchar(32) NOT NULL DEFAULT 'NULL',
   destination varchar(255) NOT NULL,
   valid varchar(15) NOT NULL DEFAULT 'unknown',
   cuser int NOT NULL DEFAULT 0,
@@ -304,6 +308,7 @@ CREATE TABLE preferred_a (
   ctime timestamp NOT NULL DEFAULT '1970-01-01 00:00:00',
   mtime timestamp NOT NULL DEFAULT '1970-01-01 00:00:00'
 );
+CREATE INDEX preferred_a_ip_addr ON preferred_a (ip_addr);
 CREATE TABLE users (
   id INTEGER PRIMARY KEY,
   uid int NOT NULL,
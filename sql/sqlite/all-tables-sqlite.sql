@@ -409,6 +409,7 @@ CREATE TABLE preferred_a (
 	ip_addr INTEGER NOT NULL DEFAULT 0,
 	record_id INTEGER NOT NULL,
 	fqdn VARCHAR(255) NOT NULL DEFAULT 'none');
+CREATE INDEX preferred_a_ip_addr ON preferred_a (ip_addr);
 CREATE TABLE `records` (
   `id` INTEGER PRIMARY KEY,
   `zone` int(7) NOT NULL DEFAULT '0',
@@ -418,6 +419,7 @@ CREATE TABLE `records` (
   `service` varchar(15),
   `pri` int(7) NOT NULL DEFAULT '0',
   `destination` varchar(255) NOT NULL,
+  `ip_addr` UNSIGNED INTEGER NOT NULL DEFAULT 0,
   `valid` varchar(15) NOT NULL DEFAULT 'unknown',
   `cuser` int(11) NOT NULL DEFAULT 0,
   `muser` int(11) NOT NULL DEFAULT 0,
@@ -429,6 +431,7 @@ CREATE TABLE `records` (
     ON UPDATE CASCADE ON DELETE CASCADE
 
 );
+CREATE INDEX records_ip_addr ON records (ip_addr);
 CREATE TRIGGER insert_records AFTER INSERT ON records
 BEGIN
 UPDATE records SET ctime = CURRENT_TIMESTAMP, mtime = CURRENT_TIMESTAMP WHERE id = new.id;
@@ -441,7 +444,7 @@ CREATE TABLE `rev_records` (
   `rev_record_id` INTEGER PRIMARY KEY,
   `rev_zone` int(7) NOT NULL DEFAULT '0',
   `zone_index` int(7) NOT NULL DEFAULT '0',
-  `host` varchar(11) NOT NULL DEFAULT 'NULL',
+  `host` varchar(32) NOT NULL DEFAULT 'NULL',
   `destination` varchar(255) NOT NULL,
   `valid` varchar(15) NOT NULL DEFAULT 'unknown',
   `cuser` int(11) NOT NULL DEFAULT 0,
@@ -480,6 +483,7 @@ CREATE TABLE `rev_zones` (
   `valid` varchar(15) NOT NULL DEFAULT 'yes',
   `owner` int(7) NOT NULL DEFAULT '1',
   `updated` varchar(15) NOT NULL DEFAULT 'unknown',
+  `content_hash` varchar(32) DEFAULT NULL,
   `type` varchar(15) NOT NULL DEFAULT 'master',
   `master` varchar(255),
   `cuser` int(11) NOT NULL DEFAULT 0,
@@ -736,6 +740,7 @@ CREATE TABLE `zones` (
   `valid` varchar(15) NOT NULL DEFAULT 'unknown',
   `owner` int(11) NOT NULL DEFAULT '1',
   `updated` varchar(15) NOT NULL DEFAULT 'yes',
+  `content_hash` varchar(32) DEFAULT NULL,
   `type` varchar(15) NOT NULL DEFAULT 'master',
   `master` varchar(255),
   `cuser` int(11) NOT NULL DEFAULT 0,
@@ -4,3 +4,4 @@ CREATE TABLE preferred_a (
 	ip_addr INTEGER NOT NULL DEFAULT 0,
 	record_id INTEGER NOT NULL,
 	fqdn VARCHAR(255) NOT NULL DEFAULT 'none');
+CREATE INDEX preferred_a_ip_addr ON preferred_a (ip_addr);
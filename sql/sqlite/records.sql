@@ -7,6 +7,7 @@ CREATE TABLE `records` (
   `service` varchar(15),
   `pri` int(7) NOT NULL DEFAULT '0',
   `destination` varchar(255) NOT NULL,
+  `ip_addr` UNSIGNED INTEGER NOT NULL DEFAULT 0,
   `valid` varchar(15) NOT NULL DEFAULT 'unknown',
   `cuser` int(11) NOT NULL DEFAULT 0,
   `muser` int(11) NOT NULL DEFAULT 0,
@@ -18,6 +19,7 @@ CREATE TABLE `records` (
     ON UPDATE CASCADE ON DELETE CASCADE
 
 );
+CREATE INDEX records_ip_addr ON records (ip_addr);
 CREATE TRIGGER insert_records AFTER INSERT ON records
 BEGIN
 UPDATE records SET ctime = CURRENT_TIMESTAMP, mtime = CURRENT_TIMESTAMP WHERE id = new.id;
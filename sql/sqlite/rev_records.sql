@@ -2,7 +2,7 @@ CREATE TABLE `rev_records` (
   `rev_record_id` INTEGER PRIMARY KEY,
   `rev_zone` int(7) NOT NULL DEFAULT '0',
   `zone_index` int(7) NOT NULL DEFAULT '0',
-  `host` varchar(11) NOT NULL DEFAULT 'NULL',
+  `host` varchar(32) NOT NULL DEFAULT 'NULL',
   `destination` varchar(255) NOT NULL,
   `valid` varchar(15) NOT NULL DEFAULT 'unknown',
   `cuser` int(11) NOT NULL DEFAULT 0,
@@ -0,0 +1,19 @@
+ALTER TABLE zones ADD COLUMN content_hash varchar(32) DEFAULT NULL;
+ALTER TABLE rev_zones ADD COLUMN content_hash varchar(32) DEFAULT NULL;
+-- A records keep their address as a number, so a reverse zone build is an
+-- index range scan. Peel one octet off the address at a time
+ALTER TABLE records ADD COLUMN ip_addr UNSIGNED INTEGER NOT NULL DEFAULT 0;
+CREATE TEMP TABLE ip_1 AS SELECT id,
+  CAST(substr(destination, 1, instr(destination, '.') - 1) AS INTEGER) AS n,
+  substr(destination, instr(destination, '.') + 1) AS rest
+  FROM records WHERE type = 'A';
+CREATE TEMP TABLE ip_2 AS SELECT id,
+  n * 256 + CAST(substr(rest, 1, instr(rest, '.') - 1) AS INTEGER) AS n,
+  substr(rest, instr(rest, '.') + 1) AS rest FROM ip_1;
+CREATE TEMP TABLE ip_3 AS SELECT id,
+  n * 256 + CAST(substr(rest, 1, instr(rest, '.') - 1) AS INTEGER) AS n,
+  substr(rest, instr(rest, '.') + 1) AS rest FROM ip_2;
+UPDATE records SET ip_addr = (SELECT n * 256 + CAST(rest AS INTEGER)
+  FROM ip_3 WHERE ip_3.id = records.id) WHERE type = 'A';
+CREATE INDEX records_ip_addr ON records (ip_addr);
+CREATE INDEX preferred_a_ip_addr ON preferred_a (ip_addr);
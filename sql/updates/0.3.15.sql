@@ -0,0 +1,11 @@
+ALTER TABLE zones ADD COLUMN content_hash varchar(32) DEFAULT NULL;
+ALTER TABLE rev_zones ADD COLUMN content_hash varchar(32) DEFAULT NULL;
+-- IPv6 reverse records hold the whole address as 32 hex digits. sqlite does
+-- not enforce the length; for postgresql use ALTER COLUMN host TYPE varchar(32)
+ALTER TABLE rev_records MODIFY host varchar(32) NOT NULL DEFAULT 'NULL';
+-- A records keep their address as a number, so a reverse zone build is an
+-- index range scan. sqlite has no INET_ATON; use 0.3.15-sqlite.sql there
+ALTER TABLE records ADD COLUMN ip_addr int(4) unsigned NOT NULL DEFAULT '0';
+UPDATE records SET ip_addr = INET_ATON(destination) WHERE type = 'A';
+CREATE INDEX records_ip_addr ON records (ip_addr);
+CREATE INDEX preferred_a_ip_addr ON preferred_a (ip_addr);
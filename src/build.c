@@ -25,6 +25,8 @@
  */
 #include <config.h>
 #include <configmake.h>
+#include <fnmatch.h>
+#include <stddef.h>
 #include <pwd.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -45,6 +47,7 @@
 #include <ailsasql.h>
 #include "cmdb_cbc.h"
 #include "build.h"
+#include "template.h"
 
 /* Hopefully this will be the file to need these variables
    These are used to substitue these values from the database when used as
@@ -65,65 +68,209 @@ const int sp_query[] = { 33, 63, 64, 20, 33 };
 
 const int spvar_no = 5;
 
-static int
-write_preseed_build_file(ailsa_cmdb_s *cmc, cbc_comm_line_s *cml);
+typedef struct cbc_dhcp_host_s {	// A host's line in dhcpd.hosts, as last written
+	char *name;
+	char *stanza;		// NULL for a build with no DHCP details
+	unsigned long int id;	// server_id the line was written for
+} cbc_dhcp_host_s;
+
+typedef struct cbc_batch_rows_s {	// Rows one query returned for one set of arguments
+	char *key;
+	AILLIST *rows;
+} cbc_batch_rows_s;
+
+typedef struct cbc_batch_server_s {	// A host written by cbc -w
+	char *name;
+	unsigned long int id;
+} cbc_batch_server_s;
+
+typedef struct cbc_batch_s {	// Rows read during one cbc -w, so no query runs twice
+	AILHASH rows;
+	AILLIST *servers;
+	AILLIST *templates;	// Compiled once, on first use
+} cbc_batch_s;
+
+typedef struct cbc_batch_bulk_s {	// Reads what query returns, for every build at once
+	unsigned int query;
+	unsigned int bulk;
+	size_t fields;		// Columns query returns; bulk puts the key first
+	short int by_name;	// Keyed on server name, not server_id
+} cbc_batch_bulk_s;
+
+enum {
+	CBC_DHCP_BUCKETS = 1021,
+	CBC_BATCH_BUCKETS = 1021
+};
 
-static int
-write_kickstart_build_file(ailsa_cmdb_s *cmc, cbc_comm_line_s *cml);
+static const cbc_batch_bulk_s cbc_bulk[] = {
+	{ IP_NET_ON_SERVER_ID, IP_NET_ON_ALL_BUILDS, 2, 0 },
+	{ BUILD_OS_DETAILS_ON_SERVER_ID, BUILD_OS_DETAILS_ON_ALL_BUILDS, 3, 0 },
+	{ FULL_LOCALE_DETAILS_ON_SERVER_ID, FULL_LOCALE_DETAILS_ON_ALL_BUILDS, 4, 0 },
+	{ TFTP_DETAILS_ON_SERVER_ID, TFTP_DETAILS_ON_ALL_BUILDS, 5, 0 },
+	{ BUILD_TYPE_ON_SERVER_ID, BUILD_TYPE_ON_ALL_BUILDS, 1, 0 },
+	{ BUILD_DETAILS, BUILD_DETAILS_ON_ALL_BUILDS, 19, 0 },
+	{ IDENTITIES_ON_SERVER_NAME, IDENTITIES_ON_ALL_BUILDS, 4, 1 },
+	{ DISK_DEV_DETAILS_ON_SERVER_ID, DISK_DEV_DETAILS_ON_ALL_BUILDS, 2, 0 },
+	{ BUILD_PARTITIONS_ON_SERVER_ID, BUILD_PARTITIONS_ON_ALL_BUILDS, 6, 0 },
+	{ BUILD_PACKAGES_ON_SERVER_ID, BUILD_PACKAGES_ON_ALL_BUILDS, 1, 0 },
+	{ SYSTEM_PACKAGES_ON_SERVER_ID, SYSTEM_PACKAGES_ON_ALL_BUILDS, 4, 0 },
+	{ DOMAIN_BUILD_ALIAS_ON_SERVER_ID, DOMAIN_BUILD_ALIAS_ON_ALL_BUILDS, 3, 0 }
+};
 
-static int
-cbc_write_kickstart_base(ailsa_cmdb_s *cmc, char *name, int fd, AILLIST *list);
+static const size_t cbc_bulk_total = sizeof(cbc_bulk) / sizeof(cbc_bulk[0]);
+
+typedef struct cbc_build_ctx_s {	// What a build file template can use
+	ailsa_build_s bld;
+	char *disk;
+	char *timezone;
+	char *root_hash;	// Of the first root account, if there is one
+	short int lvm;
+	AILLIST *partitions;
+	AILLIST *packages;
+	AILLIST *system_packages;
+	AILLIST *scripts;	// One entry per script, its arguments joined
+	AILLIST *accounts;
+} cbc_build_ctx_s;
+
+static const cbc_tmpl_field_s cbc_tmpl_partition[] = {
+	{ "minimum", offsetof(ailsa_partition_s, min), CBC_TMPL_NUMBER, NULL },
+	{ "maximum", offsetof(ailsa_partition_s, max), CBC_TMPL_NUMBER, NULL },
+	{ "priority", offsetof(ailsa_partition_s, pri), CBC_TMPL_NUMBER, NULL },
+	{ "mount_point", offsetof(ailsa_partition_s, mount), CBC_TMPL_TEXT, NULL },
+	{ "filesystem", offsetof(ailsa_partition_s, fs), CBC_TMPL_TEXT, NULL },
+	{ "logical_volume", offsetof(ailsa_partition_s, logvol), CBC_TMPL_TEXT, NULL },
+	{ NULL, 0, 0, NULL }
+};
 
-static int
-cbc_write_kickstart_partitions(int fd, AILLIST *disk, AILLIST *part);
+static const cbc_tmpl_field_s cbc_tmpl_package[] = {
+	{ "package", 0, CBC_TMPL_DATA, NULL },
+	{ NULL, 0, 0, NULL }
+};
 
-static int
-cbc_write_kickstart_net(int fd, ailsa_build_s *bld);
+static const cbc_tmpl_field_s cbc_tmpl_syspack[] = {
+	{ "name", offsetof(ailsa_syspack_s, name), CBC_TMPL_TEXT, NULL },
+	{ "field", offsetof(ailsa_syspack_s, field), CBC_TMPL_TEXT, NULL },
+	{ "type", offsetof(ailsa_syspack_s, type), CBC_TMPL_TEXT, NULL },
+	{ "arg", offsetof(ailsa_syspack_s, arg), CBC_TMPL_TEXT, NULL },
+	{ NULL, 0, 0, NULL }
+};
 
-static int
-cbc_write_kickstart_packages(int fd, AILLIST *pack);
+static const cbc_tmpl_field_s cbc_tmpl_script[] = {
+	{ "name", offsetof(ailsa_sysscript_s, name), CBC_TMPL_TEXT, NULL },
+	{ "args", offsetof(ailsa_sysscript_s, arg), CBC_TMPL_TEXT, NULL },
+	{ NULL, 0, 0, NULL }
+};
+
+static const cbc_tmpl_field_s cbc_tmpl_account[] = {
+	{ "username", offsetof(ailsa_account_s, username), CBC_TMPL_TEXT, NULL },
+	{ "hash", offsetof(ailsa_account_s, hash), CBC_TMPL_TEXT, NULL },
+	{ NULL, 0, 0, NULL }
+};
+
+static const cbc_tmpl_field_s cbc_tmpl_build[] = {
+	{ "locale", offsetof(cbc_build_ctx_s, bld.locale), CBC_TMPL_TEXT, NULL },
+	{ "language", offsetof(cbc_build_ctx_s, bld.language), CBC_TMPL_TEXT, NULL },
+	{ "keymap", offsetof(cbc_build_ctx_s, bld.keymap), CBC_TMPL_TEXT, NULL },
+	{ "country", offsetof(cbc_build_ctx_s, bld.country), CBC_TMPL_TEXT, NULL },
+	{ "timezone", offsetof(cbc_build_ctx_s, timezone), CBC_TMPL_TEXT, NULL },
+	{ "interface", offsetof(cbc_build_ctx_s, bld.net_int), CBC_TMPL_TEXT, NULL },
+	{ "ip", offsetof(cbc_build_ctx_s, bld.ip), CBC_TMPL_TEXT, NULL },
+	{ "nameserver", offsetof(cbc_build_ctx_s, bld.ns), CBC_TMPL_TEXT, NULL },
+	{ "netmask", offsetof(cbc_build_ctx_s, bld.nm), CBC_TMPL_TEXT, NULL },
+	{ "gateway", offsetof(cbc_build_ctx_s, bld.gw), CBC_TMPL_TEXT, NULL },
+	{ "ntp", offsetof(cbc_build_ctx_s, bld.do_ntp), CBC_TMPL_SHORT, NULL },
+	{ "ntp_server", offsetof(cbc_build_ctx_s, bld.ntp), CBC_TMPL_TEXT, NULL },
+	{ "hostname", offsetof(cbc_build_ctx_s, bld.host), CBC_TMPL_TEXT, NULL },
+	{ "domain", offsetof(cbc_build_ctx_s, bld.domain), CBC_TMPL_TEXT, NULL },
+	{ "fqdn", offsetof(cbc_build_ctx_s, bld.fqdn), CBC_TMPL_TEXT, NULL },
+	{ "mirror", offsetof(cbc_build_ctx_s, bld.mirror), CBC_TMPL_TEXT, NULL },
+	{ "os", offsetof(cbc_build_ctx_s, bld.os), CBC_TMPL_TEXT, NULL },
+	{ "version", offsetof(cbc_build_ctx_s, bld.version), CBC_TMPL_TEXT, NULL },
+	{ "os_version", offsetof(cbc_build_ctx_s, bld.os_ver), CBC_TMPL_TEXT, NULL },
+	{ "arch", offsetof(cbc_build_ctx_s, bld.arch), CBC_TMPL_TEXT, NULL },
+	{ "url", offsetof(cbc_build_ctx_s, bld.url), CBC_TMPL_TEXT, NULL },
+	{ "disk", offsetof(cbc_build_ctx_s, disk), CBC_TMPL_TEXT, NULL },
+	{ "lvm", offsetof(cbc_build_ctx_s, lvm), CBC_TMPL_SHORT, NULL },
+	{ "root_hash", offsetof(cbc_build_ctx_s, root_hash), CBC_TMPL_TEXT, NULL },
+	{ "partitions", offsetof(cbc_build_ctx_s, partitions), CBC_TMPL_LIST, cbc_tmpl_partition },
+	{ "packages", offsetof(cbc_build_ctx_s, packages), CBC_TMPL_LIST, cbc_tmpl_package },
+	{ "system_packages", offsetof(cbc_build_ctx_s, system_packages), CBC_TMPL_LIST, cbc_tmpl_syspack },
+	{ "scripts", offsetof(cbc_build_ctx_s, scripts), CBC_TMPL_LIST, cbc_tmpl_script },
+	{ "accounts", offsetof(cbc_build_ctx_s, accounts), CBC_TMPL_LIST, cbc_tmpl_account },
+	{ NULL, 0, 0, NULL }
+};
+
+// Kept in DHCPCONF beside dhcpd.hosts; delete it to rebuild from the database
+static const char *dhcp_index = ".cbc-dhcp.index";
+
+// Build types cbc installs a template for; these must have one
+static const char *cbc_shipped_templates[] = { "preseed", "kickstart", NULL };
 
 static int
-cbc_write_kickstart_scripts(int fd, char *url, AILLIST *sys);
+write_build_host(ailsa_cmdb_s *cmc, cbc_batch_s *bat, cbc_comm_line_s *cml);
 
 static int
-cbc_check_gb_keyboard(ailsa_cmdb_s *cmc, char *host, AILLIST *list);
+write_build_configs(ailsa_cmdb_s *cmc, cbc_comm_line_s *cml);
+
+static cbc_batch_s *
+cbc_batch_init(unsigned int buckets);
+
+static void
+cbc_batch_clean(cbc_batch_s *bat);
 
 static int
-write_build_config_file(ailsa_cmdb_s *cbc, cbc_comm_line_s *cml);
+cbc_batch_select(ailsa_cmdb_s *cmc, cbc_batch_s *bat, cbc_comm_line_s *cml);
 
 static int
-get_server_accounts(ailsa_cmdb_s *cmc, cbc_comm_line_s *cbc, AILLIST *acc);
+cbc_batch_prefetch(ailsa_cmdb_s *cmc, cbc_batch_s *bat);
 
 static int
-write_dhcp_config(ailsa_cmdb_s *cmc, cbc_comm_line_s *cml);
+cbc_batch_query(ailsa_cmdb_s *cmc, cbc_batch_s *bat, unsigned int query, AILLIST *args, AILLIST *results);
 
 static int
-write_tftp_config(ailsa_cmdb_s *cmc, cbc_comm_line_s *cml);
+cbc_batch_server_id(ailsa_cmdb_s *cmc, cbc_batch_s *bat, char *name, AILLIST *list);
+
+static void
+cbc_batch_key(char *key, size_t len, unsigned int query, AILELEM *e, size_t n);
+
+static cbc_batch_rows_s *
+cbc_batch_add_rows(cbc_batch_s *bat, const char *key, AILLIST *rows);
 
 static int
-write_preseed_net_mirror(int fd, ailsa_build_s *bld);
+cbc_batch_rows_match(const void *one, const void *two);
+
+static void
+cbc_batch_rows_clean(void *data);
+
+static void
+cbc_batch_server_clean(void *data);
 
 static int
-write_preseed_user_accounts(int fd, AILLIST *acc);
+write_build_config_file(ailsa_cmdb_s *cbc, cbc_batch_s *bat, cbc_comm_line_s *cml);
+
+static cbc_tmpl_s *
+cbc_batch_template(ailsa_cmdb_s *cmc, cbc_batch_s *bat, const char *type, int *retval);
 
 static int
-write_partition_head(int fd, AILLIST *disk, ailsa_build_s *build);
+cbc_fill_build_ctx(ailsa_cmdb_s *cmc, cbc_batch_s *bat, cbc_comm_line_s *cml, cbc_build_ctx_s *ctx);
+
+static void
+cbc_clean_build_ctx(cbc_build_ctx_s *ctx);
 
 static int
-write_preseed_partitions(int fd, AILLIST *disk, AILLIST *part);
+cbc_join_system_scripts(AILLIST *sys, AILLIST *dest);
 
 static int
-write_preseed_system_packages(int fd, AILLIST *sys);
+get_server_accounts(ailsa_cmdb_s *cmc, cbc_batch_s *bat, cbc_comm_line_s *cbc, AILLIST *acc);
 
-static void
-write_preseed_lvm_group(int fd, char *dev);
+static int
+write_dhcp_config(ailsa_cmdb_s *cmc, cbc_batch_s *bat, char *host, int *changed);
 
 static int
-write_preseed_packages(int fd, ailsa_build_s *build, AILLIST *pack);
+write_tftp_config(ailsa_cmdb_s *cmc, cbc_batch_s *bat, cbc_comm_line_s *cml);
 
 static int
-write_build_host_script(ailsa_cmdb_s *cbc, cbc_comm_line_s *cml);
+write_build_host_script(ailsa_cmdb_s *cbc, cbc_batch_s *bat, cbc_comm_line_s *cml);
 
 static int
 cbc_write_script_file(char *file, char *host, AILLIST *domain, AILLIST *sys);
@@ -174,7 +321,28 @@ static int
 cbc_fill_dhcp_conf(AILLIST *db, AILLIST *dhcp);
 
 static int
-cbc_write_dhcp_config_file(char *filename, AILLIST *dhcp);
+cbc_dhcp_read_index(const char *file, AILLIST *hosts, AILHASH *seen);
+
+static int
+cbc_dhcp_update_host(ailsa_cmdb_s *cmc, cbc_batch_s *bat, char *host, AILLIST *hosts, AILHASH *seen);
+
+static int
+cbc_dhcp_fill_all(ailsa_cmdb_s *cmc, AILLIST *builds, AILLIST *hosts, AILHASH *seen);
+
+static int
+cbc_dhcp_index_stale(AILHASH *seen, AILLIST *builds);
+
+static int
+cbc_dhcp_set_host(AILLIST *hosts, AILHASH *seen, char *name, unsigned long int id, const char *stanza);
+
+static cbc_dhcp_host_s *
+cbc_dhcp_find(AILHASH *seen, char *name);
+
+static int
+cbc_dhcp_host_match(const void *one, const void *two);
+
+static void
+cbc_dhcp_host_clean(void *data);
 
 static ailsa_tftp_s *
 cbc_fill_tftp_values(AILLIST *os, AILLIST *loc, AILLIST *tftp);
@@ -552,30 +720,51 @@ list_build_servers(ailsa_cmdb_s *cmc)
 		ailsa_list_full_clean(list);
 }
 
+// A single name keeps the old output. A list, a glob or -A reads each kind
+// of build data once for every host, and dhcpd.hosts is written once
 int
 write_build_config(ailsa_cmdb_s *cmc, cbc_comm_line_s *cml)
+{
+	if (!(cmc) || !(cml))
+		return AILSA_NO_DATA;
+	int retval;
+	cbc_batch_s *bat;
+
+	if ((cml->all) || !(cml->name) || (strpbrk(cml->name, ",*?[")))
+		return write_build_configs(cmc, cml);
+	bat = cbc_batch_init(CBC_BATCH_BUCKETS);
+	retval = write_build_host(cmc, bat, cml);
+	cbc_batch_clean(bat);
+	return retval;
+}
+
+static int
+write_build_host(ailsa_cmdb_s *cmc, cbc_batch_s *bat, cbc_comm_line_s *cml)
 {
 	int retval = NONE;
+	int changed = 0;
 
-	if ((retval = write_dhcp_config(cmc, cml)) != 0) {
+	if ((retval = write_dhcp_config(cmc, bat, cml->name, &changed)) != 0) {
 		ailsa_syslog(LOG_ERR, "Failed to write dhcpd.hosts file");
 		return retval;
-	} else {
+	} else if (changed) {
 		printf("dhcpd.hosts file written\n");
+	} else {
+		printf("dhcpd.hosts file unchanged\n");
 	}
-	if ((retval = write_tftp_config(cmc, cml)) != 0) {
+	if ((retval = write_tftp_config(cmc, bat, cml)) != 0) {
 		ailsa_syslog(LOG_ERR, "Failed to write tftp configuration");
 		return retval;
 	} else {
 		printf("tftp configuration file written\n");
 	}
-	if ((retval = write_build_config_file(cmc, cml)) != 0) {
+	if ((retval = write_build_config_file(cmc, bat, cml)) != 0) {
 		ailsa_syslog(LOG_ERR, "Failed to write build file");
 		return retval;
 	} else {
 		printf("build configuration file written\n");
 	}
-	if ((retval = write_build_host_script(cmc, cml)) != 0) {
+	if ((retval = write_build_host_script(cmc, bat, cml)) != 0) {
 		ailsa_syslog(LOG_ERR, "Failed to write host script");
 		return retval;
 	} else {
@@ -584,225 +773,811 @@ write_build_config(ailsa_cmdb_s *cmc, cbc_comm_line_s *cml)
 	return retval;
 }
 
+// A host that fails is reported and the rest are still written
 static int
-write_dhcp_config(ailsa_cmdb_s *cmc, cbc_comm_line_s *cml)
+write_build_configs(ailsa_cmdb_s *cmc, cbc_comm_line_s *cml)
 {
-	if (!(cmc) || !(cml))
-		return AILSA_NO_DATA;
-	char file[DOMAIN_LEN];
-	int retval;
-	AILLIST *dhcp = ailsa_dhcp_config_list_init();
+	char *name = cml->name;
+	int retval, changed = 0;
+	int failed = 0;
+	unsigned int buckets = CBC_BATCH_BUCKETS;
+	size_t bad = 0;
+	AILELEM *e;
+	AILLIST *count = ailsa_db_data_list_init();
+	cbc_batch_s *bat = NULL;
+	cbc_batch_server_s *server;
 
-	if ((retval = cbc_get_dhcp_info(cmc, dhcp)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot get dhcp info");
+// Each host keeps about 16 sets of rows
+	if ((retval = ailsa_basic_query(cmc, BUILD_COUNT, count)) != 0) {
+		ailsa_syslog(LOG_ERR, "BUILD_COUNT query failed");
 		goto cleanup;
 	}
-	snprintf(file, DOMAIN_LEN, "%sdhcpd.hosts", cmc->dhcpconf);
-	if ((retval = cbc_write_dhcp_config_file(file, dhcp)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot write dhcp config file");
+	if ((count->total > 0) && (((ailsa_data_s *)count->head->data)->data->number > buckets / 16))
+		buckets = (unsigned int)(((ailsa_data_s *)count->head->data)->data->number * 16) | 1;
+	bat = cbc_batch_init(buckets);
+	if ((retval = cbc_batch_select(cmc, bat, cml)) != 0)
+		goto cleanup;
+	if ((retval = cbc_batch_prefetch(cmc, bat)) != 0)
+		goto cleanup;
+	if ((retval = write_dhcp_config(cmc, bat, NULL, &changed)) != 0) {
+		ailsa_syslog(LOG_ERR, "Failed to write dhcpd.hosts file");
 		goto cleanup;
+	} else if (changed) {
+		printf("dhcpd.hosts file written\n");
+	} else {
+		printf("dhcpd.hosts file unchanged\n");
+	}
+	for (e = bat->servers->head; e; e = e->next) {
+		server = e->data;
+		cml->name = server->name;
+		if (((retval = write_tftp_config(cmc, bat, cml)) != 0) ||
+		    ((retval = write_build_config_file(cmc, bat, cml)) != 0) ||
+		    ((retval = write_build_host_script(cmc, bat, cml)) != 0)) {
+			ailsa_syslog(LOG_ERR, "Failed to write build files for %s", server->name);
+			if (failed == 0)
+				failed = retval;
+			bad++;
+		} else {
+			printf("%s: build files written\n", server->name);
+		}
 	}
-
+	cml->name = name;
+	if (bad > 0)
+		ailsa_syslog(LOG_ERR, "%zu of %zu hosts failed", bad, bat->servers->total);
+	retval = failed;
 	cleanup:
-		ailsa_list_full_clean(dhcp);
+		ailsa_list_full_clean(count);
+		cbc_batch_clean(bat);
 		return retval;
 }
 
+static cbc_batch_s *
+cbc_batch_init(unsigned int buckets)
+{
+	cbc_batch_s *bat = ailsa_calloc(sizeof(cbc_batch_s), "bat in cbc_batch_init");
+
+	ailsa_hash_init(&bat->rows, buckets, ailsa_hash, cbc_batch_rows_match, cbc_batch_rows_clean);
+	bat->servers = ailsa_calloc(sizeof(AILLIST), "bat->servers in cbc_batch_init");
+	ailsa_list_init(bat->servers, cbc_batch_server_clean);
+	bat->templates = ailsa_calloc(sizeof(AILLIST), "bat->templates in cbc_batch_init");
+	ailsa_list_init(bat->templates, cbc_tmpl_clean);
+	return bat;
+}
+
+static void
+cbc_batch_clean(cbc_batch_s *bat)
+{
+	if (!(bat))
+		return;
+	ailsa_hash_destroy(&bat->rows);
+	ailsa_list_full_clean(bat->servers);
+	ailsa_list_full_clean(bat->templates);
+	my_free(bat);
+}
+
+// -A takes every build. Otherwise each comma separated name is a glob, or a
+// server that must have a build. Hosts are written in name order, once each
 static int
-cbc_get_dhcp_info(ailsa_cmdb_s *cbc, AILLIST *dhcp)
+cbc_batch_select(ailsa_cmdb_s *cmc, cbc_batch_s *bat, cbc_comm_line_s *cml)
 {
-	if (!(cbc || !(dhcp)))
-		return AILSA_NO_DATA;
-	int retval;
-	AILLIST *db = ailsa_db_data_list_init();
-	if ((retval = ailsa_basic_query(cbc, DHCP_INFORMATION, db)) != 0) {
-		ailsa_syslog(LOG_ERR, "DHCP_INFORMATION query failed in cbc_get_dhcp_info");
+	char key[BUFFER_LEN];
+	char *list = NULL, *name, *save;
+	char **pattern = NULL;
+	int retval, hit;
+	size_t i, n = 0;
+	size_t *found = NULL;
+	AILELEM *e;
+	AILLIST *builds = ailsa_db_data_list_init();
+	AILLIST *id;
+	ailsa_data_s *d;
+	cbc_batch_server_s *server;
+
+	if ((retval = ailsa_basic_query(cmc, SERVER_IDS_WITH_BUILD, builds)) != 0) {
+		ailsa_syslog(LOG_ERR, "SERVER_IDS_WITH_BUILD query failed");
 		goto cleanup;
 	}
-	if ((retval = cbc_fill_dhcp_conf(db, dhcp)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot fill dhcp list");
-		goto cleanup;
+	if (!(cml->all)) {
+		list = strndup(cml->name, CONFIG_LEN);
+		for (name = list; name; name = strchr(name + 1, ','))
+			n++;
+		pattern = ailsa_calloc(n * sizeof(char *), "pattern in cbc_batch_select");
+		found = ailsa_calloc(n * sizeof(size_t), "found in cbc_batch_select");
+		n = 0;
+		for (name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save))
+			pattern[n++] = name;
+	}
+	for (e = builds->head; e && e->next; e = e->next->next) {
+		d = e->data;
+		for (i = 0, hit = (cml->all) ? 1 : 0; i < n; i++) {
+			if (fnmatch(pattern[i], d->data->text, 0) == 0) {
+				found[i]++;
+				hit = 1;
+			}
+		}
+		if (hit == 0)
+			continue;
+		server = ailsa_calloc(sizeof(cbc_batch_server_s), "server in cbc_batch_select");
+		server->name = strndup(d->data->text, HOST_LEN);
+		server->id = ((ailsa_data_s *)e->next->data)->data->number;
+		if ((retval = ailsa_list_insert(bat->servers, server)) != 0) {
+			cbc_batch_server_clean(server);
+			goto cleanup;
+		}
+// Later lookups of this server's id need no query
+		snprintf(key, BUFFER_LEN, "%u\t%s", SERVER_ID_ON_NAME, server->name);
+		id = ailsa_db_data_list_init();
+		if ((retval = ailsa_insert_clone(id, e->next)) != 0) {
+			ailsa_list_full_clean(id);
+			goto cleanup;
+		}
+		if (!(cbc_batch_add_rows(bat, key, id))) {
+			retval = AILSA_NO_DATA;
+			goto cleanup;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		if (found[i] == 0) {
+			ailsa_syslog(LOG_ERR, "No server with a build matches %s", pattern[i]);
+			retval = AILSA_SERVER_NOT_FOUND;
+		}
+	}
+	if ((retval == 0) && (bat->servers->total == 0)) {
+		ailsa_syslog(LOG_ERR, "No servers have a build");
+		retval = AILSA_SERVER_NOT_FOUND;
 	}
-
 	cleanup:
-		ailsa_list_full_clean(db);
+		ailsa_list_full_clean(builds);
+		if (list)
+			my_free(list);
+		if (pattern)
+			my_free(pattern);
+		if (found)
+			my_free(found);
 		return retval;
 }
 
+// Every bulk query is run once and its rows shared out among the hosts
+// being written, so each host finds its rows already read
 static int
-cbc_fill_dhcp_conf(AILLIST *db, AILLIST *dhcp)
+cbc_batch_prefetch(ailsa_cmdb_s *cmc, cbc_batch_s *bat)
 {
-	if (!(db) || !(dhcp))
-		return AILSA_NO_DATA;
+	char key[BUFFER_LEN];
 	int retval;
-	char ip_addr[HOST_LEN];
-	size_t total = 4;
-	uint32_t ip;
-	AILELEM *e = db->head;
-	ailsa_data_s *d = e->data;
-	ailsa_dhcp_conf_s *p;
-
-	if ((db->total % total) != 0)
-		return -1;
-	while (e) {
-		memset(ip_addr, 0, HOST_LEN);
-		d = e->data;
-		p = ailsa_calloc(sizeof(ailsa_dhcp_conf_s), "p in cbc_fill_dhcp_conf");
-		p->name = strndup(d->data->text, DOMAIN_LEN);
-		d = e->next->data;
-		p->mac = strndup(d->data->text, DOMAIN_LEN);
-		d = e->next->next->data;
-		ip = htonl((uint32_t)d->data->number);
-		if (!(inet_ntop(AF_INET, &ip, ip_addr, HOST_LEN)) != 0) {
-			retval = AILSA_IP_CONVERT_FAILED;
-			goto cleanup;
+	size_t i, j;
+	void *data;
+	AILELEM *e;
+	AILLIST *args = ailsa_db_data_list_init();
+	AILLIST *rows;
+	ailsa_sql_batch_s *bulk = ailsa_calloc(sizeof(ailsa_sql_batch_s) * cbc_bulk_total, "bulk in cbc_batch_prefetch");
+	cbc_batch_rows_s probe, *r;
+	cbc_batch_server_s *server;
+
+	for (i = 0; i < cbc_bulk_total; i++) {
+		bulk[i].query_no = cbc_bulk[i].bulk;
+		bulk[i].results = ailsa_db_data_list_init();
+		for (e = bat->servers->head; e; e = e->next) {
+			server = e->data;
+			if (cbc_bulk[i].by_name)
+				retval = cmdb_add_string_to_list(server->name, args);
+			else
+				retval = cmdb_add_number_to_list(server->id, args);
+			if (retval != 0)
+				goto cleanup;
+			cbc_batch_key(key, BUFFER_LEN, cbc_bulk[i].query, args->tail, 1);
+			rows = ailsa_db_data_list_init();
+			if (!(cbc_batch_add_rows(bat, key, rows))) {
+				retval = AILSA_NO_DATA;
+				goto cleanup;
+			}
 		}
-		p->ip = strndup(ip_addr, HOST_LEN);
-		d = e->next->next->next->data;
-		p->domain = strndup(d->data->text, DOMAIN_LEN);
-		if ((retval = ailsa_list_insert(dhcp, p)) != 0) {
-			ailsa_syslog(LOG_ERR, "Cannot insert data into list in cbc_fill_dhcp_conf");
+	}
+	if ((retval = ailsa_query_batch(cmc, bulk, cbc_bulk_total)) != 0) {
+		ailsa_syslog(LOG_ERR, "Build detail queries failed");
+		goto cleanup;
+	}
+	for (i = 0; i < cbc_bulk_total; i++) {
+		rows = bulk[i].results;
+		if ((rows->total % (cbc_bulk[i].fields + 1)) != 0) {
+			ailsa_syslog(LOG_ERR, "Wrong list length for bulk query %u", cbc_bulk[i].bulk);
+			retval = AILSA_WRONG_LIST_LENGHT;
 			goto cleanup;
 		}
-		e = ailsa_move_down_list(e, total);
+		while (rows->head) {
+			cbc_batch_key(key, BUFFER_LEN, cbc_bulk[i].query, rows->head, 1);
+			if ((retval = ailsa_list_remove(rows, rows->head, &data)) != 0)
+				goto cleanup;
+			ailsa_clean_data(data);
+			probe.key = key;
+			data = &probe;
+// Rows of servers not being written are dropped
+			r = (ailsa_hash_lookup(&bat->rows, &data, key) == 0) ? data : NULL;
+			for (j = 0; j < cbc_bulk[i].fields; j++) {
+				if ((retval = ailsa_list_remove(rows, rows->head, &data)) != 0)
+					goto cleanup;
+				if (!(r)) {
+					ailsa_clean_data(data);
+				} else if ((retval = ailsa_list_insert(r->rows, data)) != 0) {
+					ailsa_clean_data(data);
+					goto cleanup;
+				}
+			}
+		}
 	}
 	cleanup:
+		for (i = 0; i < cbc_bulk_total; i++)
+			if (bulk[i].results)
+				ailsa_list_full_clean(bulk[i].results);
+		my_free(bulk);
+		ailsa_list_full_clean(args);
 		return retval;
 }
 
+// Rows already read for this query and these arguments are copied out;
+// anything else is queried and kept for the next host
 static int
-cbc_write_dhcp_config_file(char *filename, AILLIST *dhcp)
+cbc_batch_query(ailsa_cmdb_s *cmc, cbc_batch_s *bat, unsigned int query, AILLIST *args, AILLIST *results)
 {
-	if (!(dhcp))
+	if (!(cmc) || !(bat) || !(args) || !(results))
 		return AILSA_NO_DATA;
-	int retval, fd, flags;
-	mode_t um, mask;
-	AILELEM *e = dhcp->head;
-	ailsa_dhcp_conf_s *d;
-
-	um = umask(0);
-	mask = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
-	flags = O_CREAT | O_WRONLY | O_TRUNC;
-	retval = 0;
-	if ((fd = open(filename, flags, mask)) == -1) {
-		ailsa_syslog(LOG_ERR, "Cannot open dhcp config file %s: %s", filename, strerror(errno));
-		retval = AILSA_FILE_ERROR;
-		return retval;
-	}
-	while (e) {
-		d = e->data;
-		dprintf(fd, "host %s { hardware ethernet %s; fixed-address %s; option domain-name \"%s\"; }\n",
-		  d->name, d->mac, d->ip, d->domain);
-		e = e->next;
+	char key[BUFFER_LEN];
+	int retval;
+	void *data;
+	AILELEM *e;
+	AILLIST *rows;
+	cbc_batch_rows_s probe, *r;
+
+	cbc_batch_key(key, BUFFER_LEN, query, args->head, args->total);
+	probe.key = key;
+	data = &probe;
+	if (ailsa_hash_lookup(&bat->rows, &data, key) == 0) {
+		r = data;
+	} else {
+		rows = ailsa_db_data_list_init();
+		if ((retval = ailsa_argument_query(cmc, query, args, rows)) != 0) {
+			ailsa_list_full_clean(rows);
+			return retval;
+		}
+		if (!(r = cbc_batch_add_rows(bat, key, rows)))
+			return AILSA_NO_DATA;
 	}
-	close(fd);
-	mask = umask(um);
-	return retval;
+	for (e = r->rows->head; e; e = e->next)
+		if ((retval = ailsa_insert_clone(results, e)) != 0)
+			return retval;
+	return 0;
 }
 
 static int
-write_tftp_config(ailsa_cmdb_s *cmc, cbc_comm_line_s *cml)
+cbc_batch_server_id(ailsa_cmdb_s *cmc, cbc_batch_s *bat, char *name, AILLIST *list)
 {
-	if (!(cmc) || !(cml))
+	if (!(cmc) || !(bat) || !(name) || !(list))
 		return AILSA_NO_DATA;
-	char filename[DOMAIN_LEN];
 	int retval;
+	size_t total = list->total;
 	AILLIST *server = ailsa_db_data_list_init();
-	AILLIST *ip = ailsa_db_data_list_init();
-	AILLIST *os = ailsa_db_data_list_init();
-	AILLIST *locale = ailsa_db_data_list_init();
-	AILLIST *tftp = ailsa_db_data_list_init();
-	ailsa_data_s *d;
-	ailsa_tftp_s *l = NULL;
 
-	if ((retval = cmdb_check_add_server_id_to_list(cml->name, cmc, server)) != 0)
-		goto cleanup;
-	if ((retval = ailsa_argument_query(cmc, IP_NET_ON_SERVER_ID, server, ip)) != 0) {
-		ailsa_syslog(LOG_ERR, "IP_NET_ON_SERVER_ID query failed");
-		goto cleanup;
-	}
-	if (ip->total == 0) {
-		ailsa_syslog(LOG_INFO, "Cannot get build IP information");
-		goto cleanup;
-	}
-	if (ip->head->next)
-		d = ip->head->next->data;
-	else
-		goto cleanup;
-	snprintf(filename, DOMAIN_LEN, "%s%s%lX", cmc->tftpdir, cmc->pxe, d->data->number);
-	if ((retval = ailsa_argument_query(cmc, BUILD_OS_DETAILS_ON_SERVER_ID, server, os)) != 0) {
-		ailsa_syslog(LOG_ERR, "BUILD_OS_DETAILS_ON_SERVER_ID query failed");
-		goto cleanup;
-	}
-	d = os->head->data;
-	cml->os = strndup(d->data->text, MAC_LEN);
-	if ((retval = ailsa_argument_query(cmc, FULL_LOCALE_DETAILS_ON_SERVER_ID, server, locale)) != 0) {
-		ailsa_syslog(LOG_ERR, "FULL_LOCALE_DETAILS_ON_SERVER_ID query failed");
-		goto cleanup;
-	}
-	if ((retval = ailsa_argument_query(cmc, TFTP_DETAILS_ON_SERVER_ID, server, tftp)) != 0) {
-		ailsa_syslog(LOG_ERR, "TFTP_DETAILS_ON_SERVER_ID query failed");
+	if ((retval = cmdb_add_string_to_list(name, server)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot add server name to list");
 		goto cleanup;
 	}
-	if (!(l = cbc_fill_tftp_values(os, locale, tftp)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot fill ailsa_tftp_s struct with tftp values");
+	if ((retval = cbc_batch_query(cmc, bat, SERVER_ID_ON_NAME, server, list)) != 0) {
+		ailsa_syslog(LOG_ERR, "SERVER_ID_ON_NAME query failed");
 		goto cleanup;
 	}
-	if ((retval = cbc_write_tftp_config_file(cml, filename, l)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot write tftp boot config file");
-		goto cleanup;
+	if (list->total != (total + 1)) {
+		ailsa_syslog(LOG_ERR, "Cannot find server %s", name);
+		retval = AILSA_SERVER_NOT_FOUND;
 	}
 	cleanup:
-		if (l)
-			ailsa_clean_tftp(l);
 		ailsa_list_full_clean(server);
-		ailsa_list_full_clean(ip);
-		ailsa_list_full_clean(os);
-		ailsa_list_full_clean(locale);
-		ailsa_list_full_clean(tftp);
 		return retval;
 }
 
-static ailsa_tftp_s *
-cbc_fill_tftp_values(AILLIST *os, AILLIST *loc, AILLIST *tftp)
+// The query number and n arguments starting at e
+static void
+cbc_batch_key(char *key, size_t len, unsigned int query, AILELEM *e, size_t n)
 {
-	if (!(os) || !(loc) || !(tftp))
-		return NULL;
-	ailsa_tftp_s *ret = ailsa_calloc(sizeof(ailsa_tftp_s), "ret in cbc_fill_tftp_values");
-	ailsa_data_s *d = os->head->data;
+	int put;
+	size_t i, pos;
+	ailsa_data_s *d;
 
-	if ((os->total == 0) || (loc->total == 0) || (tftp->total == 0)) {
-		ailsa_syslog(LOG_ERR, "Empty list passed into cbc_fill_tftp_values");
-		goto cleanup;
-	}
-	if (((os->total % 3) != 0) || ((loc->total % 4) != 0) || ((tftp->total % 5) != 0)) {
-		ailsa_syslog(LOG_ERR, "Wrong length for lists in cbc_fill_tftp_values");
-		goto cleanup;
+	put = snprintf(key, len, "%u", query);
+	pos = (size_t)put;
+	for (i = 0; (i < n) && e && (pos < len); i++, e = e->next) {
+		d = e->data;
+		if (d->type == AILSA_DB_TEXT)
+			put = snprintf(key + pos, len - pos, "\t%s", d->data->text);
+		else
+			put = snprintf(key + pos, len - pos, "\t%lu", d->data->number);
+		pos += (size_t)put;
 	}
-	ret->alias = strndup(d->data->text, MAC_LEN);
-	d = os->head->next->data;
-	ret->version = strndup(d->data->text, MAC_LEN);
-	d = os->head->next->next->data;
-	ret->arch = strndup(d->data->text, SERVICE_LEN);
-	d = loc->head->data;
-	ret->country = strndup(d->data->text, SERVICE_LEN);
-	d = loc->head->next->data;
-	ret->locale = strndup(d->data->text, SERVICE_LEN);
-	d = loc->head->next->next->data;
-	ret->keymap = strndup(d->data->text, SERVICE_LEN);
-	d = tftp->head->data;
-	ret->boot_line = strndup(d->data->text, CONFIG_LEN);
-	d = tftp->head->next->data;
-	ret->net_int = strndup(d->data->text, SERVICE_LEN);
-	d = tftp->head->next->next->data;
-	ret->arg = strndup(d->data->text, SERVICE_LEN);
-	d = tftp->head->next->next->next->data;
-	ret->url = strndup(d->data->text, CONFIG_LEN);
-	d = tftp->head->next->next->next->next->data;
-	ret->build_type = strndup(d->data->text, MAC_LEN);
-	return ret;
+}
 
-	cleanup:
+// Takes rows over, and frees them if they cannot be stored
+static cbc_batch_rows_s *
+cbc_batch_add_rows(cbc_batch_s *bat, const char *key, AILLIST *rows)
+{
+	cbc_batch_rows_s *r = ailsa_calloc(sizeof(cbc_batch_rows_s), "r in cbc_batch_add_rows");
+
+	r->key = strndup(key, BUFFER_LEN);
+	r->rows = rows;
+	if (ailsa_hash_insert(&bat->rows, r, r->key) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot store rows for %s", key);
+		cbc_batch_rows_clean(r);
+		return NULL;
+	}
+	return r;
+}
+
+static int
+cbc_batch_rows_match(const void *one, const void *two)
+{
+	const cbc_batch_rows_s *a = one, *b = two;
+
+	return strncmp(a->key, b->key, BUFFER_LEN) == 0;
+}
+
+static void
+cbc_batch_rows_clean(void *data)
+{
+	cbc_batch_rows_s *r = data;
+
+	if (!(r))
+		return;
+	my_free(r->key);
+	ailsa_list_full_clean(r->rows);
+	my_free(r);
+}
+
+static void
+cbc_batch_server_clean(void *data)
+{
+	cbc_batch_server_s *s = data;
+
+	if (!(s))
+		return;
+	my_free(s->name);
+	my_free(s);
+}
+
+// Only the host being written is read from the database; every other line
+// comes from the index. If the index does not hold exactly the servers that
+// have a build, some were added or removed without cbc -w, so then the whole
+// file is read again. With no host the whole file is always read again
+static int
+write_dhcp_config(ailsa_cmdb_s *cmc, cbc_batch_s *bat, char *host, int *changed)
+{
+	if (!(cmc) || !(changed))
+		return AILSA_NO_DATA;
+	char file[DOMAIN_LEN], index[DOMAIN_LEN];
+	int retval;
+	AILELEM *e;
+	AILHASH seen;
+	AILLIST *builds = ailsa_db_data_list_init();
+	AILLIST *hosts = ailsa_calloc(sizeof(AILLIST), "hosts in write_dhcp_config");
+	ailsa_string_s *conf = ailsa_calloc(sizeof(ailsa_string_s), "conf in write_dhcp_config");
+	ailsa_string_s *idx = ailsa_calloc(sizeof(ailsa_string_s), "idx in write_dhcp_config");
+	cbc_dhcp_host_s *h;
+
+	*changed = 0;
+	ailsa_list_init(hosts, cbc_dhcp_host_clean);
+	ailsa_hash_init(&seen, CBC_DHCP_BUCKETS, ailsa_hash, cbc_dhcp_host_match, NULL);
+	ailsa_init_string(conf);
+	ailsa_init_string(idx);
+	if ((snprintf(file, DOMAIN_LEN, "%sdhcpd.hosts", cmc->dhcpconf)) >= DOMAIN_LEN)
+		ailsa_syslog(LOG_INFO, "Path truncated in write_dhcp_config");
+	if ((snprintf(index, DOMAIN_LEN, "%s%s", cmc->dhcpconf, dhcp_index)) >= DOMAIN_LEN)
+		ailsa_syslog(LOG_INFO, "Path truncated in write_dhcp_config");
+	if ((retval = ailsa_basic_query(cmc, SERVER_IDS_WITH_BUILD, builds)) != 0) {
+		ailsa_syslog(LOG_ERR, "SERVER_IDS_WITH_BUILD query failed");
+		goto cleanup;
+	}
+	if (host) {
+		if ((retval = cbc_dhcp_read_index(index, hosts, &seen)) != 0)
+			goto cleanup;
+		if ((retval = cbc_dhcp_update_host(cmc, bat, host, hosts, &seen)) != 0)
+			goto cleanup;
+	}
+	if (!(host) || (cbc_dhcp_index_stale(&seen, builds) != 0)) {
+		ailsa_hash_destroy(&seen);
+		ailsa_list_destroy(hosts);
+		ailsa_list_init(hosts, cbc_dhcp_host_clean);
+		ailsa_hash_init(&seen, CBC_DHCP_BUCKETS, ailsa_hash, cbc_dhcp_host_match, NULL);
+		if ((retval = cbc_dhcp_fill_all(cmc, builds, hosts, &seen)) != 0)
+			goto cleanup;
+	}
+	for (e = hosts->head; e; e = e->next) {
+		h = e->data;
+		ailsa_printf_string(idx, "%lu\t%s\t%s", h->id, h->name, h->stanza ? h->stanza : "\n");
+		if (h->stanza)
+			ailsa_printf_string(conf, "%s", h->stanza);
+	}
+	if ((ailsa_cmp_string_file(file, conf) == 0) && (ailsa_cmp_string_file(index, idx) == 0))
+		goto cleanup;
+	if ((retval = ailsa_write_string_file(file, conf)) != 0)
+		goto cleanup;
+	*changed = 1;
+	if ((retval = ailsa_write_string_file(index, idx)) != 0)
+		goto cleanup;
+	if ((cmc->dhcp_reload) && (system(cmc->dhcp_reload) != 0)) {
+		ailsa_syslog(LOG_ERR, "%s failed", cmc->dhcp_reload);
+		retval = AILSA_FILE_ERROR;
+	}
+
+	cleanup:
+		ailsa_hash_destroy(&seen);
+		ailsa_list_full_clean(hosts);
+		ailsa_list_full_clean(builds);
+		ailsa_clean_string(conf);
+		ailsa_clean_string(idx);
+		return retval;
+}
+
+// A missing index just means the whole file is built from the database.
+// Each line is the server_id, the host name and its stanza, split by tabs.
+// A build with no DHCP details has an empty stanza
+static int
+cbc_dhcp_read_index(const char *file, AILLIST *hosts, AILHASH *seen)
+{
+	char line[BUFFER_LEN];
+	char *name, *tab;
+	int retval = 0;
+	unsigned long int id;
+	FILE *index;
+
+	if (!(index = fopen(file, "r")))
+		return retval;
+	while (fgets(line, (int)sizeof(line), index)) {
+		id = strtoul(line, &name, 10);
+		if ((name == line) || (*name != '\t'))
+			continue;
+		name++;
+		if (!(tab = strchr(name, '\t')) || !(strchr(tab, '\n')))
+			continue;
+		*tab = '\0';
+		if ((retval = cbc_dhcp_set_host(hosts, seen, name, id, (tab[1] == '\n') ? NULL : tab + 1)) != 0)
+			break;
+	}
+	fclose(index);
+	return retval;
+}
+
+static int
+cbc_dhcp_update_host(ailsa_cmdb_s *cmc, cbc_batch_s *bat, char *host, AILLIST *hosts, AILHASH *seen)
+{
+	char stanza[BUFFER_LEN];
+	int retval;
+	unsigned long int id;
+	AILLIST *server = ailsa_db_data_list_init();
+	AILLIST *db = ailsa_db_data_list_init();
+	AILLIST *dhcp = ailsa_dhcp_config_list_init();
+	ailsa_dhcp_conf_s *d;
+
+	if ((retval = cbc_batch_server_id(cmc, bat, host, server)) != 0)
+		goto cleanup;
+	id = ((ailsa_data_s *)server->head->data)->data->number;
+	if ((retval = ailsa_argument_query(cmc, DHCP_INFORMATION_ON_SERVER_ID, server, db)) != 0) {
+		ailsa_syslog(LOG_ERR, "DHCP_INFORMATION_ON_SERVER_ID query failed");
+		goto cleanup;
+	}
+	if (db->total == 0) {
+		retval = cbc_dhcp_set_host(hosts, seen, host, id, NULL);
+		goto cleanup;
+	}
+	if ((retval = cbc_fill_dhcp_conf(db, dhcp)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot fill dhcp list");
+		goto cleanup;
+	}
+	if (dhcp->total == 0) {
+		retval = cbc_dhcp_set_host(hosts, seen, host, id, NULL);
+		goto cleanup;
+	}
+	d = dhcp->head->data;
+	snprintf(stanza, BUFFER_LEN, "host %s { hardware ethernet %s; fixed-address %s; option domain-name \"%s\"; }\n",
+	  d->name, d->mac, d->ip, d->domain);
+	retval = cbc_dhcp_set_host(hosts, seen, d->name, id, stanza);
+
+	cleanup:
+		ailsa_list_full_clean(server);
+		ailsa_list_full_clean(db);
+		ailsa_list_full_clean(dhcp);
+		return retval;
+}
+
+// builds is the name and server_id of each server with a build
+static int
+cbc_dhcp_fill_all(ailsa_cmdb_s *cmc, AILLIST *builds, AILLIST *hosts, AILHASH *seen)
+{
+	char stanza[BUFFER_LEN];
+	char *name;
+	int retval;
+	unsigned long int id;
+	AILELEM *e;
+	AILLIST *dhcp = ailsa_dhcp_config_list_init();
+	ailsa_dhcp_conf_s *d;
+	cbc_dhcp_host_s *h;
+
+	if ((retval = cbc_get_dhcp_info(cmc, dhcp)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot get dhcp info");
+		goto cleanup;
+	}
+	for (e = dhcp->head; e; e = e->next) {
+		d = e->data;
+		snprintf(stanza, BUFFER_LEN, "host %s { hardware ethernet %s; fixed-address %s; option domain-name \"%s\"; }\n",
+		  d->name, d->mac, d->ip, d->domain);
+		if ((retval = cbc_dhcp_set_host(hosts, seen, d->name, 0, stanza)) != 0)
+			goto cleanup;
+	}
+	for (e = builds->head; e && e->next; e = e->next->next) {
+		name = ((ailsa_data_s *)e->data)->data->text;
+		id = ((ailsa_data_s *)e->next->data)->data->number;
+		if ((h = cbc_dhcp_find(seen, name)))
+			h->id = id;
+		else if ((retval = cbc_dhcp_set_host(hosts, seen, name, id, NULL)) != 0)
+			goto cleanup;
+	}
+
+	cleanup:
+		ailsa_list_full_clean(dhcp);
+		return retval;
+}
+
+// Non zero unless the index has a line for exactly the servers in builds
+static int
+cbc_dhcp_index_stale(AILHASH *seen, AILLIST *builds)
+{
+	AILELEM *e;
+	cbc_dhcp_host_s *h;
+
+	if (seen->size != builds->total / 2)
+		return 1;
+	for (e = builds->head; e && e->next; e = e->next->next) {
+		if (!(h = cbc_dhcp_find(seen, ((ailsa_data_s *)e->data)->data->text)))
+			return 1;
+		if (h->id != ((ailsa_data_s *)e->next->data)->data->number)
+			return 1;
+	}
+	return 0;
+}
+
+// A NULL stanza keeps the host in the index with no line in dhcpd.hosts,
+// so a build without DHCP details does not make the index look stale
+static int
+cbc_dhcp_set_host(AILLIST *hosts, AILHASH *seen, char *name, unsigned long int id, const char *stanza)
+{
+	int retval = 0;
+	cbc_dhcp_host_s *h;
+
+	if ((h = cbc_dhcp_find(seen, name))) {
+		if (h->stanza)
+			my_free(h->stanza);
+		h->id = id;
+		h->stanza = stanza ? strndup(stanza, BUFFER_LEN) : NULL;
+		return retval;
+	}
+	h = ailsa_calloc(sizeof(cbc_dhcp_host_s), "h in cbc_dhcp_set_host");
+	h->name = strndup(name, HOST_LEN);
+	if (stanza)
+		h->stanza = strndup(stanza, BUFFER_LEN);
+	h->id = id;
+	if ((retval = ailsa_list_insert(hosts, h)) != 0) {
+		cbc_dhcp_host_clean(h);
+		return retval;
+	}
+	return ailsa_hash_insert(seen, h, h->name);
+}
+
+static cbc_dhcp_host_s *
+cbc_dhcp_find(AILHASH *seen, char *name)
+{
+	void *data;
+	cbc_dhcp_host_s probe;
+
+	probe.name = name;
+	data = &probe;
+	if (ailsa_hash_lookup(seen, &data, name) != 0)
+		return NULL;
+	return data;
+}
+
+static int
+cbc_dhcp_host_match(const void *one, const void *two)
+{
+	const cbc_dhcp_host_s *a = one, *b = two;
+
+	return strncmp(a->name, b->name, HOST_LEN) == 0;
+}
+
+static void
+cbc_dhcp_host_clean(void *data)
+{
+	cbc_dhcp_host_s *h = data;
+
+	if (!(h))
+		return;
+	my_free(h->name);
+	if (h->stanza)
+		my_free(h->stanza);
+	my_free(h);
+}
+
+static int
+cbc_get_dhcp_info(ailsa_cmdb_s *cbc, AILLIST *dhcp)
+{
+	if (!(cbc || !(dhcp)))
+		return AILSA_NO_DATA;
+	int retval;
+	AILLIST *db = ailsa_db_data_list_init();
+	if ((retval = ailsa_basic_query(cbc, DHCP_INFORMATION, db)) != 0) {
+		ailsa_syslog(LOG_ERR, "DHCP_INFORMATION query failed in cbc_get_dhcp_info");
+		goto cleanup;
+	}
+	if ((retval = cbc_fill_dhcp_conf(db, dhcp)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot fill dhcp list");
+		goto cleanup;
+	}
+
+	cleanup:
+		ailsa_list_full_clean(db);
+		return retval;
+}
+
+static int
+cbc_fill_dhcp_conf(AILLIST *db, AILLIST *dhcp)
+{
+	if (!(db) || !(dhcp))
+		return AILSA_NO_DATA;
+	int retval = 0;
+	char ip_addr[HOST_LEN];
+	size_t total = 4;
+	uint32_t ip;
+	AILELEM *e = db->head;
+	ailsa_data_s *d = e->data;
+	ailsa_dhcp_conf_s *p;
+
+	if ((db->total % total) != 0)
+		return -1;
+	while (e) {
+		memset(ip_addr, 0, HOST_LEN);
+		// a build whose server, IP or domain has gone has no DHCP details
+		if (!(((ailsa_data_s *)e->data)->data->text) || !(((ailsa_data_s *)e->next->data)->data->text) ||
+		    !(((ailsa_data_s *)e->next->next->next->data)->data->text)) {
+			e = ailsa_move_down_list(e, total);
+			continue;
+		}
+		d = e->data;
+		p = ailsa_calloc(sizeof(ailsa_dhcp_conf_s), "p in cbc_fill_dhcp_conf");
+		p->name = strndup(d->data->text, DOMAIN_LEN);
+		d = e->next->data;
+		p->mac = strndup(d->data->text, DOMAIN_LEN);
+		d = e->next->next->data;
+		ip = htonl((uint32_t)d->data->number);
+		if (!(inet_ntop(AF_INET, &ip, ip_addr, HOST_LEN)) != 0) {
+			retval = AILSA_IP_CONVERT_FAILED;
+			goto cleanup;
+		}
+		p->ip = strndup(ip_addr, HOST_LEN);
+		d = e->next->next->next->data;
+		p->domain = strndup(d->data->text, DOMAIN_LEN);
+		if ((retval = ailsa_list_insert(dhcp, p)) != 0) {
+			ailsa_syslog(LOG_ERR, "Cannot insert data into list in cbc_fill_dhcp_conf");
+			goto cleanup;
+		}
+		e = ailsa_move_down_list(e, total);
+	}
+	cleanup:
+		return retval;
+}
+
+static int
+write_tftp_config(ailsa_cmdb_s *cmc, cbc_batch_s *bat, cbc_comm_line_s *cml)
+{
+	if (!(cmc) || !(cml))
+		return AILSA_NO_DATA;
+	char filename[DOMAIN_LEN];
+	int retval;
+	AILLIST *server = ailsa_db_data_list_init();
+	AILLIST *ip = ailsa_db_data_list_init();
+	AILLIST *os = ailsa_db_data_list_init();
+	AILLIST *locale = ailsa_db_data_list_init();
+	AILLIST *tftp = ailsa_db_data_list_init();
+	ailsa_data_s *d;
+	ailsa_tftp_s *l = NULL;
+
+	if ((retval = cbc_batch_server_id(cmc, bat, cml->name, server)) != 0)
+		goto cleanup;
+	if ((retval = cbc_batch_query(cmc, bat, IP_NET_ON_SERVER_ID, server, ip)) != 0) {
+		ailsa_syslog(LOG_ERR, "IP_NET_ON_SERVER_ID query failed");
+		goto cleanup;
+	}
+	if (ip->total == 0) {
+		ailsa_syslog(LOG_INFO, "Cannot get build IP information");
+		goto cleanup;
+	}
+	if (ip->head->next)
+		d = ip->head->next->data;
+	else
+		goto cleanup;
+	snprintf(filename, DOMAIN_LEN, "%s%s%lX", cmc->tftpdir, cmc->pxe, d->data->number);
+	if ((retval = cbc_batch_query(cmc, bat, BUILD_OS_DETAILS_ON_SERVER_ID, server, os)) != 0) {
+		ailsa_syslog(LOG_ERR, "BUILD_OS_DETAILS_ON_SERVER_ID query failed");
+		goto cleanup;
+	}
+	if (os->total == 0) {
+		ailsa_syslog(LOG_ERR, "Cannot get build OS for %s", cml->name);
+		retval = AILSA_NO_DATA;
+		goto cleanup;
+	}
+	d = os->head->data;
+	if (cml->os)
+		my_free(cml->os);
+	cml->os = strndup(d->data->text, MAC_LEN);
+	if ((retval = cbc_batch_query(cmc, bat, FULL_LOCALE_DETAILS_ON_SERVER_ID, server, locale)) != 0) {
+		ailsa_syslog(LOG_ERR, "FULL_LOCALE_DETAILS_ON_SERVER_ID query failed");
+		goto cleanup;
+	}
+	if ((retval = cbc_batch_query(cmc, bat, TFTP_DETAILS_ON_SERVER_ID, server, tftp)) != 0) {
+		ailsa_syslog(LOG_ERR, "TFTP_DETAILS_ON_SERVER_ID query failed");
+		goto cleanup;
+	}
+	if (!(l = cbc_fill_tftp_values(os, locale, tftp)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot fill ailsa_tftp_s struct with tftp values");
+		goto cleanup;
+	}
+	if ((retval = cbc_write_tftp_config_file(cml, filename, l)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot write tftp boot config file");
+		goto cleanup;
+	}
+	cleanup:
+		if (l)
+			ailsa_clean_tftp(l);
+		ailsa_list_full_clean(server);
+		ailsa_list_full_clean(ip);
+		ailsa_list_full_clean(os);
+		ailsa_list_full_clean(locale);
+		ailsa_list_full_clean(tftp);
+		return retval;
+}
+
+static ailsa_tftp_s *
+cbc_fill_tftp_values(AILLIST *os, AILLIST *loc, AILLIST *tftp)
+{
+	if (!(os) || !(loc) || !(tftp))
+		return NULL;
+	ailsa_tftp_s *ret = ailsa_calloc(sizeof(ailsa_tftp_s), "ret in cbc_fill_tftp_values");
+	ailsa_data_s *d = os->head->data;
+
+	if ((os->total == 0) || (loc->total == 0) || (tftp->total == 0)) {
+		ailsa_syslog(LOG_ERR, "Empty list passed into cbc_fill_tftp_values");
+		goto cleanup;
+	}
+	if (((os->total % 3) != 0) || ((loc->total % 4) != 0) || ((tftp->total % 5) != 0)) {
+		ailsa_syslog(LOG_ERR, "Wrong length for lists in cbc_fill_tftp_values");
+		goto cleanup;
+	}
+	ret->alias = strndup(d->data->text, MAC_LEN);
+	d = os->head->next->data;
+	ret->version = strndup(d->data->text, MAC_LEN);
+	d = os->head->next->next->data;
+	ret->arch = strndup(d->data->text, SERVICE_LEN);
+	d = loc->head->data;
+	ret->country = strndup(d->data->text, SERVICE_LEN);
+	d = loc->head->next->data;
+	ret->locale = strndup(d->data->text, SERVICE_LEN);
+	d = loc->head->next->next->data;
+	ret->keymap = strndup(d->data->text, SERVICE_LEN);
+	d = tftp->head->data;
+	ret->boot_line = strndup(d->data->text, CONFIG_LEN);
+	d = tftp->head->next->data;
+	ret->net_int = strndup(d->data->text, SERVICE_LEN);
+	d = tftp->head->next->next->data;
+	ret->arg = strndup(d->data->text, SERVICE_LEN);
+	d = tftp->head->next->next->next->data;
+	ret->url = strndup(d->data->text, CONFIG_LEN);
+	d = tftp->head->next->next->next->next->data;
+	ret->build_type = strndup(d->data->text, MAC_LEN);
+	return ret;
+
+	cleanup:
 		ailsa_clean_tftp(ret);
 		return NULL;
 }
@@ -860,19 +1635,25 @@ console=ttyS0,115200n8\n\n");
 	return retval;
 }
 
+// The build file is TOPLEVELOS/templates/<build type>.tmpl, filled in
+// for this host
 static int
-write_build_config_file(ailsa_cmdb_s *cbc, cbc_comm_line_s *cml)
+write_build_config_file(ailsa_cmdb_s *cbc, cbc_batch_s *bat, cbc_comm_line_s *cml)
 {
 	if (!(cbc) || !(cml))
 		return AILSA_NO_DATA;
+	char file[DOMAIN_LEN];
 	int retval;
 	AILLIST *server = ailsa_db_data_list_init();
 	AILLIST *build = ailsa_db_data_list_init();
 	ailsa_data_s *d;
+	ailsa_string_s *out = NULL;
+	cbc_build_ctx_s *ctx = NULL;
+	cbc_tmpl_s *tmpl;
 
-	if ((retval = cmdb_check_add_server_id_to_list(cml->name, cbc, server)) != 0)
+	if ((retval = cbc_batch_server_id(cbc, bat, cml->name, server)) != 0)
 		goto cleanup;
-	if ((retval = ailsa_argument_query(cbc, BUILD_TYPE_ON_SERVER_ID, server, build)) != 0) {
+	if ((retval = cbc_batch_query(cbc, bat, BUILD_TYPE_ON_SERVER_ID, server, build)) != 0) {
 		ailsa_syslog(LOG_ERR, "BUILD_TYPE_ON_SERVER_ID query failed");
 		goto cleanup;
 	}
@@ -881,410 +1662,313 @@ write_build_config_file(ailsa_cmdb_s *cbc, cbc_comm_line_s *cml)
 		goto cleanup;
 	}
 	d = build->head->data;
-	if (strcmp(d->data->text, "preseed") == 0) {
-		if ((retval = write_preseed_build_file(cbc, cml)) != 0)
-			goto cleanup;
-	} else if (strcmp(d->data->text, "kickstart") == 0) {
-		if ((retval = write_kickstart_build_file(cbc, cml)) != 0)
-			goto cleanup;
-	} else {
-		ailsa_syslog(LOG_INFO, "Build type %s not supported", d->data->text);
+	if (!(tmpl = cbc_batch_template(cbc, bat, d->data->text, &retval)))
+		goto cleanup;
+	ctx = ailsa_calloc(sizeof(cbc_build_ctx_s), "ctx in write_build_config_file");
+	if ((retval = cbc_fill_build_ctx(cbc, bat, cml, ctx)) != 0)
+		goto cleanup;
+	out = ailsa_calloc(sizeof(ailsa_string_s), "out in write_build_config_file");
+	ailsa_init_string(out);
+	if ((retval = cbc_tmpl_render(tmpl, ctx, out)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot fill in template %s for %s", tmpl->name, cml->name);
+		goto cleanup;
 	}
+	snprintf(file, DOMAIN_LEN, "%sweb/%s.cfg", cbc->toplevelos, cml->name);
+	retval = ailsa_write_string_file(file, out);
 	cleanup:
 		ailsa_list_full_clean(server);
 		ailsa_list_full_clean(build);
+		cbc_clean_build_ctx(ctx);
+		if (out)
+			ailsa_clean_string(out);
 		return retval;
 }
-static int
-write_preseed_build_file(ailsa_cmdb_s *cmc, cbc_comm_line_s *cml)
+
+// Templates in TOPLEVELOS override the installed ones. A build type with no
+// template is skipped, as before, unless cbc ships one for it; a missing
+// shipped template, or one that will not compile, is an error
+static cbc_tmpl_s *
+cbc_batch_template(ailsa_cmdb_s *cmc, cbc_batch_s *bat, const char *type, int *retval)
 {
 	char file[DOMAIN_LEN];
-	int retval, flags;
-	int fd = 0;
+	size_t i;
+	AILELEM *e;
+	cbc_tmpl_s *tmpl;
+
+	*retval = 0;
+	for (e = bat->templates->head; e; e = e->next) {
+		tmpl = e->data;
+		if (strncmp(tmpl->name, type, CONFIG_LEN) != 0)
+			continue;
+		if (!(tmpl->ops))
+			*retval = AILSA_FILE_ERROR;
+		return (tmpl->ops) ? tmpl : NULL;
+	}
+	if ((strchr(type, '/')) || ((snprintf(file, DOMAIN_LEN, "%stemplates/%s.tmpl", cmc->toplevelos, type)) >= DOMAIN_LEN)) {
+		ailsa_syslog(LOG_ERR, "Bad build type %s", type);
+		*retval = AILSA_FILE_ERROR;
+		return NULL;
+	}
+	if (access(file, F_OK) != 0)
+		snprintf(file, DOMAIN_LEN, "%s/lib/cmdb/templates/%s.tmpl", LOCALSTATEDIR, type);
+	tmpl = NULL;
+	if (access(file, F_OK) != 0) {
+		for (i = 0; cbc_shipped_templates[i]; i++)
+			if (strcmp(type, cbc_shipped_templates[i]) == 0)
+				break;
+		if (!(cbc_shipped_templates[i])) {
+			ailsa_syslog(LOG_INFO, "Build type %s not supported: no template in %stemplates", type, cmc->toplevelos);
+			return NULL;
+		}
+		ailsa_syslog(LOG_ERR, "No template for build type %s in %stemplates or %s", type, cmc->toplevelos, file);
+	} else if (!(tmpl = cbc_tmpl_compile(file, type, cbc_tmpl_build))) {
+		ailsa_syslog(LOG_ERR, "Cannot compile template %s", file);
+	}
+// A template that is missing or will not compile is kept without ops, so it
+// is only reported once
+	if (!(tmpl)) {
+		*retval = AILSA_FILE_ERROR;
+		tmpl = ailsa_calloc(sizeof(cbc_tmpl_s), "tmpl in cbc_batch_template");
+		tmpl->name = strndup(type, CONFIG_LEN);
+	}
+	if (ailsa_list_insert(bat->templates, tmpl) != 0) {
+		cbc_tmpl_clean(tmpl);
+		*retval = AILSA_NO_DATA;
+		return NULL;
+	}
+	return (tmpl->ops) ? tmpl : NULL;
+}
+
+// Everything any build type uses is read; the bulk queries have it already
+static int
+cbc_fill_build_ctx(ailsa_cmdb_s *cmc, cbc_batch_s *bat, cbc_comm_line_s *cml, cbc_build_ctx_s *ctx)
+{
+	int retval;
+	AILELEM *e;
 	AILLIST *server = ailsa_db_data_list_init();
 	AILLIST *build = ailsa_db_data_list_init();
-	AILLIST *acc = ailsa_account_list_init();
 	AILLIST *disk = ailsa_db_data_list_init();
+	AILLIST *locale = ailsa_db_data_list_init();
 	AILLIST *partitions = ailsa_db_data_list_init();
-	AILLIST *part = ailsa_partition_list_init();
-	AILLIST *packages = ailsa_db_data_list_init();
 	AILLIST *sys = ailsa_db_data_list_init();
-	AILLIST *syspack = ailsa_syspack_list_init();
-	ailsa_build_s *bld = NULL;
-	mode_t um, mask;
+	AILLIST *domain = ailsa_db_data_list_init();
+	AILLIST *scripts = ailsa_db_data_list_init();
+	AILLIST *sysscript = ailsa_sysscript_list_init();
+	ailsa_account_s *a;
+	ailsa_build_s *bld;
+	ailsa_syspack_s *sp;
 
-	um = umask(0);
-	mask = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
-	flags = O_CREAT | O_WRONLY | O_TRUNC;
-	snprintf(file, DOMAIN_LEN, "%sweb/%s.cfg", cmc->toplevelos,  cml->name);
-	if ((retval = cmdb_check_add_server_id_to_list(cml->name, cmc, server)) != 0)
+	ctx->partitions = ailsa_partition_list_init();
+	ctx->packages = ailsa_db_data_list_init();
+	ctx->system_packages = ailsa_syspack_list_init();
+	ctx->scripts = ailsa_sysscript_list_init();
+	ctx->accounts = ailsa_account_list_init();
+	if ((retval = cbc_batch_server_id(cmc, bat, cml->name, server)) != 0)
 		goto cleanup;
-	if ((retval = ailsa_argument_query(cmc, BUILD_DETAILS, server, build)) != 0) {
+	if ((retval = cbc_batch_query(cmc, bat, BUILD_DETAILS, server, build)) != 0) {
 		ailsa_syslog(LOG_ERR, "BUILD_DETAILS query failed");
 		goto cleanup;
 	}
-	if ((retval = get_server_accounts(cmc, cml, acc)) != 0)
+	if ((retval = get_server_accounts(cmc, bat, cml, ctx->accounts)) != 0)
 		goto cleanup;
-	if ((retval = ailsa_argument_query(cmc, DISK_DEV_DETAILS_ON_SERVER_ID, server, disk)) != 0) {
+	if ((retval = cbc_batch_query(cmc, bat, DISK_DEV_DETAILS_ON_SERVER_ID, server, disk)) != 0) {
 		ailsa_syslog(LOG_ERR, "DISK_DEV_DETAILS_ON_SERVER_ID query failed");
 		goto cleanup;
 	}
-	if ((retval = ailsa_argument_query(cmc, BUILD_PARTITIONS_ON_SERVER_ID, server, partitions)) != 0) {
+	if ((retval = cbc_batch_query(cmc, bat, FULL_LOCALE_DETAILS_ON_SERVER_ID, server, locale)) != 0) {
+		ailsa_syslog(LOG_ERR, "FULL_LOCALE_DETAILS_ON_SERVER_ID query failed");
+		goto cleanup;
+	}
+	if ((retval = cbc_batch_query(cmc, bat, BUILD_PARTITIONS_ON_SERVER_ID, server, partitions)) != 0) {
 		ailsa_syslog(LOG_ERR, "BUILD_PARTITIONS_ON_SERVER_ID query failed");
 		goto cleanup;
 	}
-	if ((retval = ailsa_argument_query(cmc, BUILD_PACKAGES_ON_SERVER_ID, server, packages)) != 0) {
+	if ((retval = cbc_batch_query(cmc, bat, BUILD_PACKAGES_ON_SERVER_ID, server, ctx->packages)) != 0) {
 		ailsa_syslog(LOG_ERR, "BUILD_PACKAGES_ON_SERVER_ID query failed");
 		goto cleanup;
 	}
-	if ((retval = ailsa_argument_query(cmc, SYSTEM_PACKAGES_ON_SERVER_ID, server, sys)) != 0) {
+	if ((retval = cbc_batch_query(cmc, bat, SYSTEM_PACKAGES_ON_SERVER_ID, server, sys)) != 0) {
 		ailsa_syslog(LOG_ERR, "SYSTEM_PACKAGES_ON_SERVER_ID query failed");
 		goto cleanup;
 	}
-	if (!(bld = cbc_fill_build_details(build))) {
-		ailsa_syslog(LOG_ERR, "Cannot fill build details");
+	if ((retval = cbc_batch_query(cmc, bat, DOMAIN_BUILD_ALIAS_ON_SERVER_ID, server, domain)) != 0) {
+		ailsa_syslog(LOG_ERR, "DOMAIN_BUILD_ALIAS_ON_SERVER_ID query failed");
 		goto cleanup;
 	}
-	if ((retval = cbc_fill_partition_details(partitions, part)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot fill partition details");
+	if ((retval = cbc_batch_query(cmc, bat, SYSTEM_SCRIPTS_ON_DOMAIN_AND_BUILD_TYPE, domain, scripts)) != 0) {
+		ailsa_syslog(LOG_ERR, "SYSTEM_SCRIPTS_ON_DOMAIN_AND_BUILD_TYPE query failed");
 		goto cleanup;
 	}
-	if ((retval = cbc_fill_sys_pack_details(sys, syspack, bld)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot fill system package details");
+	if (disk->total < 2) {
+		ailsa_syslog(LOG_ERR, "No disk for %s", cml->name);
+		retval = AILSA_NO_DATA;
 		goto cleanup;
 	}
-	if ((fd = open(file, flags, mask)) == -1) {
-		ailsa_syslog(LOG_ERR, "Cannot open preseed build file %s for writing: %s", file, strerror(errno));
-		retval = AILSA_FILE_ERROR;
+	if ((locale->total == 0) || ((locale->total % 4) != 0)) {
+		ailsa_syslog(LOG_ERR, "No locale for %s", cml->name);
+		retval = AILSA_NO_DATA;
 		goto cleanup;
 	}
-	if ((retval = write_preseed_net_mirror(fd, bld)) != 0)
-		goto cleanup;
-	if ((retval = write_preseed_user_accounts(fd, acc)) != 0)
-		goto cleanup;
-	if ((retval = write_partition_head(fd, disk, bld)) != 0)
-		goto cleanup;
-	if ((retval = write_preseed_partitions(fd, disk, part)) != 0)
-		goto cleanup;
-	if ((retval = write_preseed_packages(fd, bld, packages)) != 0)
-		goto cleanup;
-	if ((retval = write_preseed_system_packages(fd, syspack)) != 0)
-		goto cleanup;
-	cleanup:
-		if (fd > 0)
-			close(fd);
-		mask = umask(um);
-		if (bld)
-			ailsa_clean_build(bld);
-		ailsa_list_full_clean(acc);
-		ailsa_list_full_clean(build);
-		ailsa_list_full_clean(disk);
-		ailsa_list_full_clean(packages);
-		ailsa_list_full_clean(partitions);
-		ailsa_list_full_clean(part);
-		ailsa_list_full_clean(server);
-		ailsa_list_full_clean(sys);
-		ailsa_list_full_clean(syspack);
-		return retval;
-}
-
-static int
-get_server_accounts(ailsa_cmdb_s *cbc, cbc_comm_line_s *cml, AILLIST *acc)
-{
-	if (!(cbc) || !(cml) || !(acc))
-		return AILSA_NO_DATA;
-	int retval = 0;
-	AILLIST *server = ailsa_db_data_list_init();
-	AILLIST *results = ailsa_db_data_list_init();
-	AILLIST *server_id = ailsa_db_data_list_init();
-	size_t len = 4;
-	unsigned long int sid;
-	AILELEM *e;
-	ailsa_data_s *d;
-	ailsa_account_s *a;
-
-
-	if ((retval = cmdb_add_string_to_list(cml->name, server)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot add server name to list");
-		goto cleanup;
-	}
-	if ((retval = cmdb_check_add_server_id_to_list(cml->name, cbc, server_id)) != 0)
-		goto cleanup;
-	e = server_id->head;
-	d = e->data;
-	sid = d->data->number;
-	if ((retval = ailsa_argument_query(cbc, IDENTITIES_ON_SERVER_NAME, server, results)) != 0) {
-		ailsa_syslog(LOG_ERR, "IDENTITIES_ON_SERVER_NAME query failed");
-		goto cleanup;
-	}
-	e = results->head;
-	while (e) {
-		a = ailsa_calloc(sizeof(ailsa_account_s), "a in get_server_accounts");
-		d = e->data;
-		a->username = strndup(d->data->text, CONFIG_LEN);
-		d = e->next->data;
-		a->pass = strndup(d->data->text, SQL_TEXT_MAX);
-		d = e->next->next->data;
-		a->hash = strndup(d->data->text, CONFIG_LEN);
-		d = e->next->next->next->data;
-		a->identity_id = d->data->number;
-		a->server_id = sid;
-		e = ailsa_move_down_list(e, len);
-		if ((retval = ailsa_list_insert(acc, a)) != 0) {
-			ailsa_syslog(LOG_ERR, "Cannot add account into list");
-			goto cleanup;
+	if (!(bld = cbc_fill_build_details(build))) {
+		ailsa_syslog(LOG_ERR, "Cannot fill build details");
+		retval = AILSA_NO_DATA;
+		goto cleanup;
+	}
+	ctx->bld = *bld;
+	my_free(bld);
+	ctx->disk = strndup(((ailsa_data_s *)disk->head->data)->data->text, DOMAIN_LEN);
+	ctx->lvm = (((ailsa_data_s *)disk->head->next->data)->data->number > 0) ? 1 : 0;
+	ctx->timezone = strndup(((ailsa_data_s *)locale->tail->data)->data->text, DOMAIN_LEN);
+	for (e = ctx->accounts->head; e; e = e->next) {
+		a = e->data;
+		if (strncmp("root", a->username, 4) == 0) {
+			ctx->root_hash = a->hash;
+			break;
 		}
 	}
-	cleanup:
-		ailsa_list_full_clean(server);
-		ailsa_list_full_clean(results);
-		ailsa_list_full_clean(server_id);
-		return retval;
-}
-
-static int
-write_preseed_net_mirror(int fd, ailsa_build_s *bld)
-{
-	if (!(bld))
-		return AILSA_NO_DATA;
-	int retval = 0;
-
-	dprintf(fd, "\
-d-i console-setup/ask_detect boolean false\n\
-d-i debian-installer/locale string %s\n\
-d-i debian-installer/language string %s\n\
-d-i debian-installer/country string %s\n\
-d-i console-keymaps-at/keymap select %s\n\
-d-i keyboard-configuration/xkb-keymap select %s\n\
-d-i keymap select %s\n\
-\n", bld->locale, bld->language, bld->country, bld->keymap, bld->keymap, bld->keymap);
-	if (strncmp(bld->os, "debian", SERVICE_LEN) == 0)
-		dprintf(fd, "\
-d-i preseed/early_command string /bin/killall.sh; /bin/netcfg\n");
-	dprintf(fd, "\
-d-i netcfg/enable boolean true\n\
-d-i netcfg/confirm_static boolean true\n\
-d-i netcfg/disable_dhcp boolean true\n\
-d-i netcfg/choose_interface select %s\n\
-d-i netcfg/get_nameservers string %s\n\
-d-i netcfg/get_ipaddress string %s\n\
-d-i netcfg/get_netmask string %s\n\
-d-i netcfg/get_gateway string %s\n\
-d-i netcfg/get_hostname string %s\n\
-d-i netcfg/get_domain string %s\n\
-\n", bld->net_int, bld->ns, bld->ip, bld->nm, bld->gw, bld->host, bld->domain);
-	if (strncmp(bld->os, "debian", SERVICE_LEN) == 0)
-		dprintf(fd, "\
-d-i netcfg/wireless_wep string\n\
-d-i hw-detect/load_firmware boolean true\n");
-	dprintf(fd, "\
-\n\
-d-i mirror/country string manual\n\
-d-i mirror/http/hostname string %s\n\
-d-i mirror/http/directory string /%s\n\
-d-i mirror/suite string %s\n\
-\n\
-d-i time/zone string %s\n\
-", bld->mirror, bld->os, bld->version, bld->country);
-	if (bld->do_ntp > 0)
-		dprintf(fd, "\
-d-i clock-setup/ntp boolean true\n\
-d-i clock-setup/ntp-server string %s\n", bld->ntp);
-	else
-		dprintf(fd, "\
-d-i clock-setup/ntp boolean false\n");
-	dprintf(fd, "\
-d-i clock-setup/utc boolean true\n");
-	return retval;
-}
-static int
-write_preseed_user_accounts(int fd, AILLIST *acc)
-{
-	if ((fd == 0) || !(acc))
-		return AILSA_NO_DATA;
-	int retval = 0;
-	ailsa_account_s *ptr;
-	AILELEM *e;
-	e = acc->head;
-	while (e) {
-		ptr = e->data;
-		if (strncmp("root", ptr->username, 4) == 0)
-			break;
-		e = e->next;
+	if ((retval = cbc_fill_partition_details(partitions, ctx->partitions)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot fill partition details");
+		goto cleanup;
 	}
-	if (e)
-		dprintf(fd, "\
-d-i passwd/root-password-crypted password %s\n", ptr->hash);
-	else
-		dprintf(fd, "\
-d-i passwd/root-password-crypted password $6$SF7COIid$q3o/XlLgy95kfJTuJwqshfRrVmZlhqT3sKDxUiyUd6OV2W0uwphXDJm.T1nXTJgY4.5UaFyhYjaixZvToazrZ/\n");
-	e = acc->head;
-/* Need to think about a default user here; this should be added to all builds
-   with the same username and password. Could do by build domain also. For now
-   we will just do sysadmin */
-	dprintf(fd, "\
-d-i passwd/user-fullname string Admin User\n\
-d-i passwd/username string sysadmin\n\
-d-i passwd/user-password-crypted password $6$loNBON/G$GN9geXUrajd7lPAZETkCz/c2DgkeZqNwMR9W.YpCqxAIxoNXdaHjXj1MH7DM3gMjoUvkIdgeRnkB4QDwrgqUS1\n\
-d-i passwd/user-default-groups string audio cdrom video dip floppy plugdev netdev sudo\n\
-\n");
-	return retval;
-}
-
-static int
-write_partition_head(int fd, AILLIST *disk, ailsa_build_s *build)
-{
-	if ((fd == 0) || !(disk) || !(build))
-		return AILSA_NO_DATA;
-	ailsa_data_s *d = disk->head->data;
-	ailsa_data_s *l = disk->head->next->data;
-	dprintf(fd, "\
-d-i partman-auto/disk string %s\n\
-d-i partman-auto/choose_recipe select monkey\n", d->data->text);
-	if (l->data->number > 0)
-		dprintf(fd, "\
-d-i partman-auto/method string lvm\n");
-	else
-		dprintf(fd, "\
-d-i partman-auto/method string regular\n");
-	dprintf(fd, "\
-d-i partman-auto/purge_lvm_from_device boolean true\n\
-d-i partman-auto-lvm/guided_size string 100%%\n\
-d-i partman-auto-lvm/no_boot boolean true\n\
-d-i partman/choose_partition select finish\n\
-d-i partman/confirm_nooverwrite boolean true\n\
-d-i partman/confirm boolean true\n\
-d-i partman-lvm/confirm boolean true\n\
-d-i partman-lvm/confirm_nooverwrite boolean true\n\
-d-i partman-lvm/device_remove_lvm boolean true\n\
-d-i partman-lvm/device_remove_lvm_span boolean true\n\
-d-i partman-md/device_remove_md boolean true\n\
-d-i partman-md/confirm boolean true\n\
-d-i partman-partitioning/confirm_write_new_label boolean true\n\
-d-i partman/mount_style select uuid\n");
-	return 0;
-}
-
-static int
-write_preseed_partitions(int fd, AILLIST *disk, AILLIST *part)
-{
-	if ((fd == 0) || !(part))
-		return AILSA_NO_DATA;
-	short int lvm = ((ailsa_data_s *)disk->head->next->data)->data->small;
-	char *diskdev = ((ailsa_data_s *)disk->head->data)->data->text;
-	AILELEM *e = part->head;
-	ailsa_partition_s *p;
-	dprintf(fd, "\
-\n\
-d-i partman-auto/expert_recipe string \\\n\
-      monkey :: \\\n");
-	if (lvm > 0)
-		write_preseed_lvm_group(fd, diskdev);
-	while (e) {
-		p = e->data;
-		dprintf(fd, "\
-              %lu %lu %lu %s  \\\n", p->pri, p->min, p->max, p->fs);
-		if (lvm > 0)
-			dprintf(fd, "\
-                       $lvmok \\\n\
-                       in_vg{ systemvg } \\\n\
-                       lv_name{ %s }\\\n", p->logvol);
-		if ((strncmp(p->fs, "swap", BYTE_LEN)) != 0) {
-			dprintf(fd, "\
-                       method{ format } format{ } \\\n\
-                       use_filesystem{ } filesystem{ %s } \\\n\
-                       mountpoint{ %s } \\\n", p->fs, p->mount);
-		} else {
-			dprintf(fd, "\
-                       method{ swap } format{ } \\\n");
+	if ((retval = cbc_fill_sys_pack_details(sys, ctx->system_packages, &(ctx->bld))) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot fill system package details");
+		goto cleanup;
+	}
+// A template only needs the argument with the host's values put in
+	for (e = ctx->system_packages->head; e; e = e->next) {
+		sp = e->data;
+		if (sp->newarg) {
+			my_free(sp->arg);
+			sp->arg = sp->newarg;
+			sp->newarg = NULL;
 		}
-// This would be the place to add the partition options
-		e = e->next;
-		if (e)
-			dprintf(fd, "\
-              . \\\n");
-		else
-			dprintf(fd, "\
-              .\n\n");
 	}
-	dprintf(fd, "\
-d-i grub-installer/only_debian boolean true\n\
-d-i grub-installer/bootdev string %s\n", diskdev);
-	return 0;
+	if ((retval = cbc_fill_system_scripts(scripts, sysscript)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot fill system scripts list");
+		goto cleanup;
+	}
+	if ((retval = cbc_join_system_scripts(sysscript, ctx->scripts)) != 0)
+		goto cleanup;
+	cleanup:
+		ailsa_list_full_clean(server);
+		ailsa_list_full_clean(build);
+		ailsa_list_full_clean(disk);
+		ailsa_list_full_clean(locale);
+		ailsa_list_full_clean(partitions);
+		ailsa_list_full_clean(sys);
+		ailsa_list_full_clean(domain);
+		ailsa_list_full_clean(scripts);
+		ailsa_list_full_clean(sysscript);
+		return retval;
 }
 
 static void
-write_preseed_lvm_group(int fd, char *dev)
+cbc_clean_build_ctx(cbc_build_ctx_s *ctx)
 {
-	dprintf(fd, "\
-              100 1000 1000000000 ext3 \\\n\
-                       $defaultignore{} \\\n\
-                       $primary{} \\\n\
-                       method{ lvm } \\\n\
-                       device{ %s } \\\n\
-                       vg_name{ systemvg }\\\n\
-              . \\\n", dev);
+	ailsa_build_s *bld;
+
+	if (!(ctx))
+		return;
+	bld = ailsa_calloc(sizeof(ailsa_build_s), "bld in cbc_clean_build_ctx");
+	*bld = ctx->bld;
+	ailsa_clean_build(bld);
+	if (ctx->disk)
+		my_free(ctx->disk);
+	if (ctx->timezone)
+		my_free(ctx->timezone);
+	ailsa_list_full_clean(ctx->partitions);
+	ailsa_list_full_clean(ctx->packages);
+	ailsa_list_full_clean(ctx->system_packages);
+	ailsa_list_full_clean(ctx->scripts);
+	ailsa_list_full_clean(ctx->accounts);
+	my_free(ctx);
 }
 
+// Each script starts at argument 1; later arguments are added to its line
 static int
-write_preseed_packages(int fd, ailsa_build_s *bld, AILLIST *pack)
+cbc_join_system_scripts(AILLIST *sys, AILLIST *dest)
 {
-	if (!(bld) || !(pack) || (fd == 0))
-		return AILSA_NO_DATA;
-	AILELEM *e = pack->head;
-	ailsa_data_s *d;
+	int retval;
+	size_t len, used;
+	AILELEM *e;
+	ailsa_sysscript_s *ss, *script = NULL;
 
-	dprintf(fd, "\
-d-i apt-setup/non-free boolean true\n\
-d-i apt-setup/contrib boolean true\n");
-	if (strncmp(bld->os, "debian", BYTE_LEN) == 0)
-		dprintf(fd, "\
-d-i apt-setup/services-select multiselect security\n\
-d-i apt-setup/security_host string security.%s.org\n", bld->os);
-	dprintf(fd, "\
-tasksel tasksel/first multiselect standard\n\n\
-d-i pkgsel/upgrade select none\n\
-d-i pkgsel/include string");
-	while (e) {
-		d = e->data;
-		dprintf(fd, " %s", d->data->text);
-		e = e->next;
+	for (e = sys->head; e; e = e->next) {
+		ss = e->data;
+		if ((ss->no == 1) || !(script)) {
+			script = ailsa_calloc(sizeof(ailsa_sysscript_s), "script in cbc_join_system_scripts");
+			script->name = strndup(ss->name, DOMAIN_LEN);
+			script->arg = strndup(ss->arg, DOMAIN_LEN);
+			script->no = 1;
+			if ((retval = ailsa_list_insert(dest, script)) != 0) {
+				ailsa_clean_sysscript(script);
+				return retval;
+			}
+		} else {
+			used = strlen(script->arg);
+			len = used + strlen(ss->arg) + 2;
+			script->arg = ailsa_realloc(script->arg, len, "script->arg in cbc_join_system_scripts");
+			snprintf(script->arg + used, len - used, " %s", ss->arg);
+		}
 	}
-	dprintf(fd, "\n\
-popularity-contest popularity-contest/participate boolean false\n\
-d-i finish-install/keep-consoles boolean true\n\
-d-i finish-install/reboot_in_progress note\n\
-d-i cdrom-detect/eject boolean false\n\
-d-i preseed/late_command string cd /target/root; \
-wget %shosts/%s.sh && sh /target/root/%s.sh >> /target/root/%s.log 2>&1\n\n", bld->url, bld->host, bld->host, bld->host);
 	return 0;
 }
 
 static int
-write_preseed_system_packages(int fd, AILLIST *sys)
+get_server_accounts(ailsa_cmdb_s *cbc, cbc_batch_s *bat, cbc_comm_line_s *cml, AILLIST *acc)
 {
-	if (!(sys) || (fd == 0))
+	if (!(cbc) || !(cml) || !(acc))
 		return AILSA_NO_DATA;
-	if (sys->total == 0)
-		return 0;
-	AILELEM *e = sys->head;
-	ailsa_syspack_s *pack;
+	int retval = 0;
+	AILLIST *server = ailsa_db_data_list_init();
+	AILLIST *results = ailsa_db_data_list_init();
+	AILLIST *server_id = ailsa_db_data_list_init();
+	size_t len = 4;
+	unsigned long int sid;
+	AILELEM *e;
+	ailsa_data_s *d;
+	ailsa_account_s *a;
 
+	if ((retval = cmdb_add_string_to_list(cml->name, server)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot add server name to list");
+		goto cleanup;
+	}
+	if ((retval = cbc_batch_server_id(cbc, bat, cml->name, server_id)) != 0)
+		goto cleanup;
+	e = server_id->head;
+	d = e->data;
+	sid = d->data->number;
+	if ((retval = cbc_batch_query(cbc, bat, IDENTITIES_ON_SERVER_NAME, server, results)) != 0) {
+		ailsa_syslog(LOG_ERR, "IDENTITIES_ON_SERVER_NAME query failed");
+		goto cleanup;
+	}
+	e = results->head;
 	while (e) {
-		pack = e->data;
-		dprintf(fd, "\
-%s\t%s\t%s\t", pack->name, pack->field, pack->type);
-		if (pack->newarg)
-			dprintf(fd, "%s\n", pack->newarg);
-		else
-			dprintf(fd, "%s\n", pack->arg);
-		e = e->next;
+		a = ailsa_calloc(sizeof(ailsa_account_s), "a in get_server_accounts");
+		d = e->data;
+		a->username = strndup(d->data->text, CONFIG_LEN);
+		d = e->next->data;
+		a->pass = strndup(d->data->text, SQL_TEXT_MAX);
+		d = e->next->next->data;
+		a->hash = strndup(d->data->text, CONFIG_LEN);
+		d = e->next->next->next->data;
+		a->identity_id = d->data->number;
+		a->server_id = sid;
+		e = ailsa_move_down_list(e, len);
+		if ((retval = ailsa_list_insert(acc, a)) != 0) {
+			ailsa_syslog(LOG_ERR, "Cannot add account into list");
+			goto cleanup;
+		}
 	}
-	return 0;
+	cleanup:
+		ailsa_list_full_clean(server);
+		ailsa_list_full_clean(results);
+		ailsa_list_full_clean(server_id);
+		return retval;
 }
 
 static int
-write_build_host_script(ailsa_cmdb_s *cbc, cbc_comm_line_s *cml)
+write_build_host_script(ailsa_cmdb_s *cbc, cbc_batch_s *bat, cbc_comm_line_s *cml)
 {
 	if (!(cbc) || !(cml))
 		return AILSA_NO_DATA;
@@ -1297,13 +1981,13 @@ write_build_host_script(ailsa_cmdb_s *cbc, cbc_comm_line_s *cml)
 
 	memset(file, 0, DOMAIN_LEN);
 	snprintf(file, DOMAIN_LEN, "%shosts/%s.sh", cbc->toplevelos, cml->name);
-	if ((retval = cmdb_check_add_server_id_to_list(cml->name, cbc, server)) != 0)
+	if ((retval = cbc_batch_server_id(cbc, bat, cml->name, server)) != 0)
 		goto cleanup;
-	if ((retval = ailsa_argument_query(cbc, DOMAIN_BUILD_ALIAS_ON_SERVER_ID, server, domain)) != 0) {
+	if ((retval = cbc_batch_query(cbc, bat, DOMAIN_BUILD_ALIAS_ON_SERVER_ID, server, domain)) != 0) {
 		ailsa_syslog(LOG_ERR, "DOMAIN_BUILD_ALIAS_ON_SERVER_ID query failed");
 		goto cleanup;
 	}
-	if ((retval = ailsa_argument_query(cbc, SYSTEM_SCRIPTS_ON_DOMAIN_AND_BUILD_TYPE, domain, script)) != 0) {
+	if ((retval = cbc_batch_query(cbc, bat, SYSTEM_SCRIPTS_ON_DOMAIN_AND_BUILD_TYPE, domain, script)) != 0) {
 		ailsa_syslog(LOG_ERR, "SYSTEM_SCRIPTS_ON_DOMAIN_AND_BUILD_TYPE query failed");
 		goto cleanup;
 	}
@@ -1323,7 +2007,6 @@ write_build_host_script(ailsa_cmdb_s *cbc, cbc_comm_line_s *cml)
 		return retval;
 }
 
-
 static int
 cbc_write_script_file(char *file, char *host, AILLIST *domain, AILLIST *sys)
 {
@@ -1597,289 +2280,6 @@ cbc_fill_system_scripts(AILLIST *list, AILLIST *dest)
 	return retval;
 }
 
-static int
-write_kickstart_build_file(ailsa_cmdb_s *cmc, cbc_comm_line_s *cml)
-{
-	if (!(cmc) || !(cml))
-		return AILSA_NO_DATA;
-	AILLIST *build = ailsa_db_data_list_init();
-	AILLIST *domain = ailsa_db_data_list_init();
-	AILLIST *disk = ailsa_db_data_list_init();
-	AILLIST *locale = ailsa_db_data_list_init();
-	AILLIST *partitions = ailsa_db_data_list_init();
-	AILLIST *part = ailsa_partition_list_init();
-	AILLIST *pack = ailsa_db_data_list_init();
-	AILLIST *server = ailsa_db_data_list_init();
-	AILLIST *scripts = ailsa_db_data_list_init();
-	AILLIST *sys = ailsa_sysscript_list_init();
-	char file[DOMAIN_LEN];
-	int retval, flags;
-	int fd = 0;
-	mode_t um = 0;
-	mode_t mask;
-	ailsa_build_s *bld = NULL;
-
-	if ((retval = cmdb_check_add_server_id_to_list(cml->name, cmc, server)) != 0)
-		goto cleanup;
-	if ((retval = ailsa_argument_query(cmc, FULL_LOCALE_DETAILS_ON_SERVER_ID, server, locale)) != 0) {
-		ailsa_syslog(LOG_ERR, "FULL_LOCALE_DETAILS_ON_SERVER_ID query failed");
-		goto cleanup;
-	}
-	if ((retval = ailsa_argument_query(cmc, DISK_DEV_DETAILS_ON_SERVER_ID, server, disk)) != 0) {
-		ailsa_syslog(LOG_ERR, "DISK_DEV_DETAILS_ON_SERVER_ID query failed");
-		goto cleanup;
-	}
-	if ((retval = ailsa_argument_query(cmc, BUILD_PARTITIONS_ON_SERVER_ID, server, partitions)) != 0) {
-		ailsa_syslog(LOG_ERR, "BUILD_PARTITIONS_ON_SERVER_ID query failed");
-		goto cleanup;
-	}
-	if ((retval = ailsa_argument_query(cmc, BUILD_PACKAGES_ON_SERVER_ID, server, pack)) != 0) {
-		ailsa_syslog(LOG_ERR, "BUILD_PACKAGES_ON_SERVER_ID query failed");
-		goto cleanup;
-	}
-	if ((retval = ailsa_argument_query(cmc, DOMAIN_BUILD_ALIAS_ON_SERVER_ID, server, domain)) != 0) {
-		ailsa_syslog(LOG_ERR, "DOMAIN_BUILD_ALIAS_ON_SERVER_ID query failed");
-		goto cleanup;
-	}
-	if ((retval = ailsa_argument_query(cmc, SYSTEM_SCRIPTS_ON_DOMAIN_AND_BUILD_TYPE, domain, scripts)) != 0) {
-		ailsa_syslog(LOG_ERR, "SYSTEM_SCRIPTS_ON_DOMAIN_AND_BUILD_TYPE query failed");
-		goto cleanup;
-	}
-	if ((retval = ailsa_argument_query(cmc, BUILD_DETAILS, server, build)) != 0) {
-		ailsa_syslog(LOG_ERR, "BUILD_DETAILS query failed");
-		goto cleanup;
-	}
-	if ((retval = cbc_fill_partition_details(partitions, part)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot fill in partitin details");
-		goto cleanup;
-	}
-	if (!(bld = cbc_fill_build_details(build))) {
-		ailsa_syslog(LOG_ERR, "Cannot fill build details");
-		goto cleanup;
-	}
-	if ((retval = cbc_fill_system_scripts(scripts, sys)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot fill system scripts list");
-		goto cleanup;
-	}
-	snprintf(file, DOMAIN_LEN, "%sweb/%s.cfg", cmc->toplevelos,  cml->name);
-	um = umask(0);
-	mask = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH;
-	flags = O_CREAT | O_WRONLY | O_TRUNC;
-	if ((fd = open(file, flags, mask)) == -1) {
-		ailsa_syslog(LOG_ERR, "Cannot open kickstart build file %s for writing: %s", file, strerror(errno));
-		retval = AILSA_FILE_ERROR;
-		goto cleanup;
-	}
-	if ((retval = cbc_write_kickstart_base(cmc, cml->name, fd, locale)) != 0)
-		goto cleanup;
-	if ((retval = cbc_write_kickstart_partitions(fd, disk, part)) != 0)
-		goto cleanup;
-	if ((retval = cbc_write_kickstart_net(fd, bld)) != 0)
-		goto cleanup;
-	if ((retval = cbc_write_kickstart_packages(fd, pack)) != 0)
-		goto cleanup;
-	if ((retval = cbc_write_kickstart_scripts(fd, bld->url, sys)) != 0)
-		goto cleanup;
-
-	cleanup:
-		if (fd > 0)
-			close(fd);
-		if (um > 0)
-			mask = umask(um);
-		if (bld)
-			ailsa_clean_build(bld);
-		ailsa_list_full_clean(build);
-		ailsa_list_full_clean(domain);
-		ailsa_list_full_clean(disk);
-		ailsa_list_full_clean(locale);
-		ailsa_list_full_clean(partitions);
-		ailsa_list_full_clean(pack);
-		ailsa_list_full_clean(part);
-		ailsa_list_full_clean(scripts);
-		ailsa_list_full_clean(server);
-		ailsa_list_full_clean(sys);
-		return retval;
-}
-
-static int
-cbc_write_kickstart_base(ailsa_cmdb_s *cmc, char *name, int fd, AILLIST *list)
-{
-	if (!(cmc) || !(name) || !(list) || (fd == 0))
-		return AILSA_NO_DATA;
-	int retval;
-	char *key, *lang, *time;
-	ailsa_data_s *d;
-	size_t total = 4;
-
-	if ((list->total == 0) || ((list->total % total) != 0))
-		return AILSA_WRONG_LIST_LENGHT;
-	d = list->head->next->data;
-	lang = d->data->text;
-	d = list->head->next->next->data;
-	key = d->data->text;
-	d = list->tail->data;
-	time = d->data->text;
-	if ((retval = cbc_check_gb_keyboard(cmc, name, list)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot check for GB keyboard");
-		return retval;
-	}
-	/* root password is k1Ckstart */
-	dprintf(fd, "\
-auth --useshadow --enablemd5\n\
-bootloader --location=mbr\n\
-text\n\
-firewall --disabled\n\
-firstboot --disable\n\
-keyboard %s\n\
-lang %s\n\
-logging --level=info\n\
-reboot\n\
-rootpw --iscrypted $6$YuyiUAiz$8w/kg1ZGEnp0YqHTPuz2WpveT0OaYG6Vw89P.CYRAox7CaiaQE49xFclS07BgBHoGaDK4lcJEZIMs8ilgqV84.\n\
-selinux --disabled\n\
-skipx\n\
-timezone  %s\n\
-install\n", key, lang, time);
-	return retval;
-}
-
-static int
-cbc_write_kickstart_partitions(int fd, AILLIST *disk, AILLIST *part)
-{
-	if (!(disk) || !(part) || (fd == 0))
-		return AILSA_NO_DATA;
-	AILELEM *e;
-	ailsa_data_s *d;
-	ailsa_partition_s *p;
-	if ((disk->total == 0) || (part->total == 0))
-		return AILSA_NO_DATA;
-	d = disk->head->data;
-	dprintf(fd, "\
-\n\
-zerombr\n\
-bootloader --location=mbr --driveorder=%s\n\
-clearpart --all --initlabel\n", d->data->text);
-	d = disk->head->next->data;
-	e = part->head;
-	if (d->data->small > 0) {
-		dprintf(fd, "\
-part /boot --asprimary --fstype=\"ext3\" --size=512\n\
-part pv.1 --asprimary --size=1 --grow\n\
-volgroup system_vg --pesize=32768 pv.1\n");
-		while (e) {
-			p = e->data;
-			dprintf(fd, "\
-logvol %s --fstype=\"%s\" --name=%s --vgname=system_vg --size=%lu\n\
-", p->mount, p->fs, p->logvol, p->min);
-			e = e->next;
-		}
-	} else {
-		while (e) {
-			p = e->data;
-			dprintf(fd, "\
-part %s --fstype=\"%s\" --size=%lu\n\
-", p->mount, p->fs, p->min);
-			e = e->next;
-		}
-	}
-	dprintf(fd, "\n");
-	return 0;
-}
-
-static int
-cbc_write_kickstart_net(int fd, ailsa_build_s *bld)
-{
-	if (!(bld) || (fd == 0))
-		return AILSA_NO_DATA;
-	dprintf(fd, "\
-\n\
-url --url=http://%s/%s/%s/os/%s\n\
-network --bootproto=static --device=%s --ip=%s --netmask=%s --gateway=%s --nameserver=%s --hostname=%s.%s --onboot=on\n\
-", bld->mirror, bld->os, bld->os_ver, bld->arch, bld->net_int, bld->ip, bld->nm, bld->gw, bld->ns, bld->host, bld->domain);
-	return 0;
-}
-
-static int
-cbc_write_kickstart_packages(int fd, AILLIST *pack)
-{
-	if (!(pack) || (fd == 0))
-		return AILSA_NO_DATA;
-	AILELEM *e;
-	ailsa_data_s *d;
-
-	dprintf(fd, "\
-\n\
-%%packages\n\
-\n\
-@Base\n\
-");
-	e = pack->head;
-	while (e) {
-		d = e->data;
-		dprintf(fd, "%s\n", d->data->text);
-		e = e->next;
-	}
-	dprintf(fd, "\n%%end\n\n");
-	return 0;
-}
-
-static int
-cbc_write_kickstart_scripts(int fd, char *url, AILLIST *sys)
-{
-	if (!(url) || !(sys) || (fd == 0))
-		return AILSA_NO_DATA;
-
-	dprintf(fd, "\
-%%post\n\
-\n\
-WGET=/usr/bin/wget\n\
-cd /root\n\
-$WGET %sscripts/disable_install.php > disable.log 2>&1\n\
-\n\
-$WGET %sscripts/firstboot.sh\n\
-chmod 755 firstboot.sh\n\
-./firstboot.sh > firstboot.log 2>&1\n\
-\n\
-wget %sscripts/motd.sh\n\
-chmod 755 motd.sh\n\
-./motd.sh > motd.log 2>&1\n", url, url, url);
-	cbc_write_system_scripts(url, fd, sys);
-	return 0;
-}
-
-static int
-cbc_check_gb_keyboard(ailsa_cmdb_s *cmc, char *host, AILLIST *list)
-{
-	if (!(cmc) || !(host) || !(list))
-		return AILSA_NO_DATA;
-	int retval;
-	AILLIST *server = ailsa_db_data_list_init();
-	AILLIST *os = ailsa_db_data_list_init();
-	ailsa_data_s *d;
-
-
-	if ((retval = cmdb_check_add_server_id_to_list(host, cmc, server)) != 0)
-		goto cleanup;
-	if ((retval = ailsa_argument_query(cmc, BUILD_OS_DETAILS_ON_SERVER_ID, server, os)) != 0) {
-		ailsa_syslog(LOG_ERR, "BUILD_OS_DETAILS_ON_SERVER_ID query failed");
-		goto cleanup;
-	}
-	if ((os->total == 0) || (os->total < 2)) {
-		ailsa_syslog(LOG_ERR, "OS list wrong length in cbc_check_gb_keyboard");
-		goto cleanup;
-	}
-	d = os->head->next->data;
-	if (strncmp(d->data->text, "6", BYTE_LEN) == 0) {
-		d = list->head->next->next->data;
-		if (strncmp(d->data->text, "gb", BYTE_LEN) == 0) {
-			snprintf(d->data->text, BYTE_LEN, "uk");
-		}
-	}
-	cleanup:
-		ailsa_list_full_clean(server);
-		ailsa_list_full_clean(os);
-		return retval;
-}
-
 int
 view_defaults_for_cbc(ailsa_cmdb_s *cbt, cbc_comm_line_s *cml)
 {
@@ -48,6 +48,15 @@ validate_cbc_comm_line(cbc_comm_line_s *cml);
 static void
 clean_cbc_comm_line(cbc_comm_line_s *cml);
 
+static int
+validate_cbc_write_names(char *names);
+
+static int
+validate_cbc_write_glob(const char *glob);
+
+static int
+validate_cbc_name_char(char c);
+
 int
 main(int argc, char *argv[])
 {
@@ -110,11 +119,12 @@ query_config()
 static int
 parse_cbc_command_line(int argc, char *argv[], cbc_comm_line_s *cb)
 {
-	const char *optstr = "ab:de:ghj:k:lmn:o:p:qrs:t:uvwx:y";
+	const char *optstr = "Aab:de:ghj:k:lmn:o:p:qrs:t:uvwx:y";
 	int retval, opt;
 #ifdef HAVE_GETOPT_H
 	int index;
 	struct option lopts[] = {
+		{"all",			no_argument,		NULL,	'A'},
 		{"add",			no_argument,		NULL,	'a'},
 		{"build-domain",	required_argument,	NULL,	'b'},
 		{"domain",		required_argument,	NULL,	'b'},
@@ -209,6 +219,9 @@ parse_cbc_command_line(int argc, char *argv[], cbc_comm_line_s *cb)
 		case 'y':
 			cb->gui = 1;
 			break;
+		case 'A':
+			cb->all = 1;
+			break;
 		case 'v':
 			cb->action = AILSA_VERSION;
 			break;
@@ -229,7 +242,7 @@ parse_cbc_command_line(int argc, char *argv[], cbc_comm_line_s *cb)
 	else if (cb->action == NONE)
 		return AILSA_NO_ACTION;
 	else if ((cb->action != CMDB_LIST) && (cb->action != CMDB_DEFAULT) &&
-		 (cb->name == 0))
+		 (cb->name == 0) && !((cb->action == CMDB_WRITE) && (cb->all)))
 		return AILSA_NO_NAME_OR_ID;
 	if (cb->action == CMDB_ADD) {
 		if (!(cb->harddisk)) {
@@ -293,9 +306,13 @@ validate_cbc_comm_line(cbc_comm_line_s *cml)
 	if (cml->uuid)
 		if (ailsa_validate_input(cml->uuid, UUID_REGEX) < 0)
 			return UUID_INPUT_INVALID;
-	if (cml->name)
+	if ((cml->name) && (cml->action == CMDB_WRITE)) {
+		if (validate_cbc_write_names(cml->name) != 0)
+			return SERVER_NAME_INVALID;
+	} else if (cml->name) {
 		if (ailsa_validate_input(cml->name, NAME_REGEX) < 0)
 			return SERVER_NAME_INVALID;
+	}
 	if (cml->os)
 		if (ailsa_validate_input(cml->os, NAME_REGEX) < 0)
 			return OS_INVALID;
@@ -329,6 +346,97 @@ validate_cbc_comm_line(cbc_comm_line_s *cml)
 	return 0;
 }
 
+static int
+validate_cbc_write_names(char *names)
+{
+	char *list, *name, *save;
+	size_t len;
+	int retval = 0;
+
+	len = strlen(names);
+	if ((len == 0) || (names[0] == ',') || (names[len - 1] == ','))
+		return -1;
+	if (!(list = strndup(names, len)))
+		return -1;
+	name = strtok_r(list, ",", &save);
+	while (name) {
+		if (strpbrk(name, "*?[")) {
+			if (validate_cbc_write_glob(name) != 0) {
+				retval = -1;
+				goto cleanup;
+			}
+		} else if (ailsa_validate_input(name, NAME_REGEX) < 0) {
+			retval = -1;
+			goto cleanup;
+		}
+		name = strtok_r(NULL, ",", &save);
+	}
+	if (strstr(names, ",,"))
+		retval = -1;
+	cleanup:
+		my_free(list);
+		return retval;
+}
+
+// A glob passes if NAME_REGEX allows each character it names, and also
+// allows the glob once each *, ? and [...] is read as one letter.
+static int
+validate_cbc_write_glob(const char *glob)
+{
+	char *test;
+	const char *p;
+	size_t i = 0;
+	int retval = 0;
+
+	test = ailsa_calloc(strlen(glob) + 1, "test in validate_cbc_write_glob");
+	for (p = glob; *p; p++) {
+		if ((*p == '*') || (*p == '?')) {
+			test[i++] = 'a';
+		} else if (*p == '[') {
+			p++;
+			if ((*p == '!') || (*p == '^'))
+				p++;
+			if (*p == ']') {
+				retval = -1;
+				goto cleanup;
+			}
+			for (; (*p) && (*p != ']'); p++) {
+				if ((*p != '-') && (validate_cbc_name_char(*p) != 0)) {
+					retval = -1;
+					goto cleanup;
+				}
+			}
+			if (!(*p)) {
+				retval = -1;
+				goto cleanup;
+			}
+			test[i++] = 'a';
+		} else if (validate_cbc_name_char(*p) != 0) {
+			retval = -1;
+			goto cleanup;
+		} else {
+			test[i++] = *p;
+		}
+	}
+	if (ailsa_validate_input(test, NAME_REGEX) < 0)
+		retval = -1;
+	cleanup:
+		my_free(test);
+		return retval;
+}
+
+// Can c sit inside a name? Asks NAME_REGEX so the two cannot drift apart
+static int
+validate_cbc_name_char(char c)
+{
+	char test[4];
+
+	snprintf(test, sizeof(test), "a%ca", c);
+	if (ailsa_validate_input(test, NAME_REGEX) < 0)
+		return -1;
+	return 0;
+}
+
 void
 clean_cbc_comm_line(cbc_comm_line_s *cml)
 {
@@ -680,7 +680,7 @@ add_cbc_build_varient(ailsa_cmdb_s *cmc, cbcvari_comm_line_s *cvl)
 		}
 		e = e->next;
 	}
-	if ((retval = ailsa_multiple_query(cmc, insert_queries[INSERT_BUILD_PACKAGE], pack)) != 0)
+	if ((retval = ailsa_bulk_insert(cmc, insert_queries[INSERT_BUILD_PACKAGE], pack)) != 0)
 		ailsa_syslog(LOG_ERR, "Cannot insert build packages for new varient");
 	cleanup:
 		ailsa_list_full_clean(v);
@@ -781,7 +781,7 @@ add_cbc_package(ailsa_cmdb_s *cbc, cbcvari_comm_line_s *cvl)
 		goto cleanup;
 	}
 	if (list->total > 0) {
-		if ((retval = ailsa_multiple_query(cbc, insert_queries[INSERT_BUILD_PACKAGE], list)) != 0 )
+		if ((retval = ailsa_bulk_insert(cbc, insert_queries[INSERT_BUILD_PACKAGE], list)) != 0 )
 			ailsa_syslog(LOG_ERR, "Cannot add build package %s to varient %s for os %s\n", pack, varient, os);
 	}
 	cleanup:
@@ -258,6 +258,8 @@ create_build_config(ailsa_cmdb_s *cbt, cbc_comm_line_s *cml)
 		goto cleanup;
 	}
 // Now the searches will add stuff to the DB. We need to make sure we search first!
+	if ((retval = ailsa_begin(cbt)) != 0)
+		goto cleanup;
 	if ((retval = cbc_add_disk(cbt, cml, b)) != 0)
 		goto cleanup;
 	if ((retval = cbc_get_ip_info(cbt, cml, b)) != 0)
@@ -272,6 +274,10 @@ create_build_config(ailsa_cmdb_s *cbt, cbc_comm_line_s *cml)
 		ailsa_syslog(LOG_ERR, "INSERT_BUILD query failed");
 
 	cleanup:
+		if (retval == 0)
+			retval = ailsa_commit(cbt);
+		if (retval != 0)
+			ailsa_rollback(cbt);
 		my_free(os);
 		ailsa_list_full_clean(b);
 		ailsa_list_full_clean(l);
@@ -446,6 +452,8 @@ cbc_calculate_build_ip(ailsa_cmdb_s *cbt, cbc_comm_line_s *cml, AILLIST *bdom)
 			e = e->next;
 		}
 	}
+	if ((retval = ailsa_begin(cbt)) != 0)
+		goto cleanup;
 	if ((retval = cbc_add_ip_to_build(cbt, cml, ip)) != 0) {
 		ailsa_syslog(LOG_ERR, "Cannot add IP address to build");
 		goto cleanup;
@@ -460,7 +468,10 @@ cbc_calculate_build_ip(ailsa_cmdb_s *cbt, cbc_comm_line_s *cml, AILLIST *bdom)
 		goto cleanup;
 	}
 #endif // HAVE_DNSA
+	retval = ailsa_commit(cbt);
 	cleanup:
+		if (retval != 0)
+			ailsa_rollback(cbt);
 		ailsa_list_full_clean(l);
 		ailsa_list_full_clean(r);
 		ailsa_list_full_clean(m);
@@ -556,10 +567,16 @@ cbc_add_host_to_dns(ailsa_cmdb_s *cbt, char *domain, char *host, unsigned long i
 		ailsa_syslog(LOG_ERR, "Cannot populate cuser and muser in record list");
 		goto cleanup;
 	}
+	if ((retval = cmdb_add_ip_addr_to_list("A", ip_addr, rec)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot add ip_addr to record list");
+		goto cleanup;
+	}
 	if ((retval = ailsa_insert_query(cbt, INSERT_RECORD_BASE, rec)) != 0) {
 		ailsa_syslog(LOG_ERR, "INSERT_RECORD_BASE query failed");
 		goto cleanup;
 	}
+	if (cmdb_push_rrset(cbt, domain, "A", host) == 0)
+		goto cleanup;
 	if ((retval = cmdb_add_number_to_list((unsigned long int)getuid(), zone)) != 0) {
 		ailsa_syslog(LOG_ERR, "Cannot add muser to zone update list");
 		goto cleanup;
@@ -27,6 +27,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
 #ifdef HAVE_GETOPT_H
 # define _GNU_SOURCE
 # include <getopt.h>
@@ -52,6 +55,9 @@ validate_glue_comm_line(dnsa_comm_line_s *comm);
 static int
 validate_rev_comm_line(dnsa_comm_line_s *comm);
 
+static int
+canonical_ipv6_range(dnsa_comm_line_s *comm);
+
 int main(int argc, char *argv[])
 {
 	char *domain = NULL;
@@ -65,6 +71,8 @@ int main(int argc, char *argv[])
 		display_command_line_error(retval, argv[0]);
 	}
 	parse_cmdb_config(dc);
+	if (cm->workers > 0)
+		dc->zone_workers = cm->workers;
 	if (cm->domain)
 		domain = cm->domain;
 	if (cm->type == FORWARD_ZONE) {
@@ -86,6 +94,8 @@ int main(int argc, char *argv[])
 			retval = delete_fwd_zone(dc, cm);
 		} else if (cm->action == DNSA_CNAME) {
 			retval = add_cname_to_root_domain(dc, cm);
+		} else if (cm->action == DNSA_IMPORT) {
+			retval = import_records(dc, cm);
 		} else {
 			printf("Action code %d not implemented\n", cm->action);
 		}
@@ -164,13 +174,15 @@ clean_dnsa_comm_line(void *comm)
 		my_free(dcl->glue_ns);
 	if (dcl->toplevel)
 		my_free(dcl->toplevel);
+	if (dcl->import)
+		my_free(dcl->import);
 	my_free(dcl);
 }
 
 static int
 parse_dnsa_command_line(int argc, char **argv, dnsa_comm_line_s *comp)
 {
-	const char *optstr = "abdeglmruvwxzFGI:M:N:RSTh:i:j:n:o:p:s:t:";
+	const char *optstr = "abdeglmruvwxzFGI:M:N:RSTW:f:h:i:j:n:o:p:s:t:";
 	int opt, retval;
 	retval = 0;
 #ifdef HAVE_GETOPT_H
@@ -180,6 +192,7 @@ parse_dnsa_command_line(int argc, char **argv, dnsa_comm_line_s *comp)
 		{"build",		no_argument,		NULL,	'b'},
 		{"display",		no_argument,		NULL,	'd'},
 		{"add-preferred-a",	no_argument,		NULL,	'e'},
+		{"import",		required_argument,	NULL,	'f'},
 		{"delete-preferred-a",	no_argument,		NULL,	'g'},
 		{"host",		required_argument,	NULL,	'h'},
 		{"destination",		required_argument,	NULL,	'i'},
@@ -210,6 +223,7 @@ parse_dnsa_command_line(int argc, char **argv, dnsa_comm_line_s *comp)
 		{"reverse-zone",	no_argument,		NULL,	'R'},
 		{"slave-zone",		no_argument,		NULL,	'S'},
 		{"test",		no_argument,		NULL,	'T'},
+		{"workers",		required_argument,	NULL,	'W'},
 		{NULL, 0, NULL, 0}
 	};
 
@@ -235,6 +249,11 @@ parse_dnsa_command_line(int argc, char **argv, dnsa_comm_line_s *comp)
 			comp->type = REVERSE_ZONE;
 			comp->rtype = strdup("A");
 			break;
+		case 'f':
+			comp->action = DNSA_IMPORT;
+			comp->type = FORWARD_ZONE;
+			comp->import = strndup(optarg, FILE_LEN);
+			break;
 		case 'g':
 			comp->action = DNSA_DPREFA;
 			comp->type = REVERSE_ZONE;
@@ -302,6 +321,9 @@ parse_dnsa_command_line(int argc, char **argv, dnsa_comm_line_s *comp)
 		case 'p':
 			comp->prefix = strtoul(optarg, NULL, 10);
 			break;
+		case 'W':
+			comp->workers = strtoul(optarg, NULL, 10);
+			break;
 		case 's':
 			comp->service = strndup(optarg, SERVICE_LEN);
 			if (!(comp->host))
@@ -355,8 +377,6 @@ parse_dnsa_command_line(int argc, char **argv, dnsa_comm_line_s *comp)
 		  && (comp->action != DNSA_DISPLAY_MULTI) && (comp->action != DNSA_DPREFA)
 		  && (comp->action != DNSA_COMMIT))
 		retval = AILSA_NO_DOMAIN_NAME;
-	else if ((comp->action == DNSA_DISPLAY_MULTI) && (!(comp->domain)) && (!(comp->dest)))
-		retval = AILSA_NO_DOMAIN_NAME;
 	else if ((comp->action == DNSA_DISPLAY_MULTI) && (comp->domain) && (comp->dest))
 		retval = AILSA_DOMAIN_AND_IP_GIVEN;
 	else if ((comp->action == DNSA_AHOST) && (!(comp->dest)))
@@ -374,9 +394,13 @@ parse_dnsa_command_line(int argc, char **argv, dnsa_comm_line_s *comp)
 		comp->glue_ns = strdup("ns1,ns2");
 		retval = NONE;
 	}
-	if ((comp->prefix > 0) && (comp->action == DNSA_AZONE)) {
-		if ((comp->prefix < 8) && (comp->prefix > 24))
+	if ((comp->prefix > 0) && (comp->action == DNSA_AZONE) && (comp->type == REVERSE_ZONE) && (comp->domain)) {
+		if (strchr(comp->domain, ':')) {
+			if ((comp->prefix < 32) || (comp->prefix > 64) || ((comp->prefix % 4) != 0))
+				retval = AILSA_PREFIX_OUT_OF_RANGE;
+		} else if ((comp->prefix < 8) || (comp->prefix > 32)) {
 			retval = AILSA_PREFIX_OUT_OF_RANGE;
+		}
 	}
 	if (retval == 0)
 		retval = validate_comm_line(comp);
@@ -406,6 +430,7 @@ validate_fwd_comm_line(dnsa_comm_line_s *comm)
 {
 	char *host = NULL;
 	int retval = 0;
+	unsigned char addr[16];
 
 	if (comm)
 		host = comm->host;
@@ -417,7 +442,7 @@ validate_fwd_comm_line(dnsa_comm_line_s *comm)
 	if (comm->domain)
 		if (ailsa_validate_input(comm->domain, DOMAIN_REGEX) < 0)
 			return DOMAIN_INPUT_INVALID;
-/* Test values for different RR's. Still need to add check for AAAA */
+/* Test values for different RR's */
 	if (comm->rtype) {
 		if (strncmp(comm->rtype, "A", BYTE_LEN) == 0) {
 			if (comm->dest)
@@ -432,6 +457,14 @@ validate_fwd_comm_line(dnsa_comm_line_s *comm)
 					if (ailsa_validate_input(comm->host, DOMAIN_REGEX) < 0)
 						return HOST_INPUT_INVALID;
 			}
+		} else if (strncmp(comm->rtype, "AAAA", BYTE_LEN) == 0) {
+			if (comm->dest)
+				if (inet_pton(AF_INET6, comm->dest, addr) != 1)
+					return DEST_INPUT_INVALID;
+			if (strncmp(comm->host, "@", BYTE_LEN) != 0)
+				if (ailsa_validate_input(comm->host, NAME_REGEX) < 0)
+					if (ailsa_validate_input(comm->host, DOMAIN_REGEX) < 0)
+						return HOST_INPUT_INVALID;
 		} else if ((strncmp(comm->rtype, "NS", BYTE_LEN) == 0) ||
 			   (strncmp(comm->rtype, "MX", BYTE_LEN) == 0)) {
 			if (comm->dest)
@@ -561,9 +594,24 @@ static int
 validate_rev_comm_line(dnsa_comm_line_s *comm)
 {
 	int retval = 0;
-	if ((comm->domain) && (comm->action != DNSA_ADD_MULTI) && (comm->action != DNSA_DPREFA))
-		if (ailsa_validate_input(comm->domain, IP_REGEX) < 0)
+	char *list, *range, *save = NULL;
+
+	if ((comm->domain) && (comm->action == DNSA_DISPLAY_MULTI)) {
+		list = strndup(comm->domain, DOMAIN_LEN);
+		for (range = strtok_r(list, ",", &save); range; range = strtok_r(NULL, ",", &save))
+			if (ailsa_validate_input(range, IP_REGEX) < 0)
+				retval = DOMAIN_INPUT_INVALID;
+		my_free(list);
+		if (retval != 0)
+			return retval;
+	} else if ((comm->domain) && (comm->action != DNSA_ADD_MULTI) && (comm->action != DNSA_DPREFA)) {
+		if (strchr(comm->domain, ':')) {
+			if ((retval = canonical_ipv6_range(comm)) != 0)
+				return retval;
+		} else if (ailsa_validate_input(comm->domain, IP_REGEX) < 0) {
 			return DOMAIN_INPUT_INVALID;
+		}
+	}
 	if (comm->action == DNSA_ADD_MULTI) {
 		if (ailsa_validate_input(comm->domain, DOMAIN_REGEX) < 0)
 			return DOMAIN_INPUT_INVALID;
@@ -577,3 +625,17 @@ validate_rev_comm_line(dnsa_comm_line_s *comm)
 			return DEST_INPUT_INVALID;
 	return retval;
 }
+
+// Reverse zones are found by their range, so an IPv6 range is kept in one spelling
+static int
+canonical_ipv6_range(dnsa_comm_line_s *comm)
+{
+	char addr[INET6_ADDRSTRLEN];
+	unsigned char ip[16];
+
+	if ((inet_pton(AF_INET6, comm->domain, ip) != 1) || !(inet_ntop(AF_INET6, ip, addr, INET6_ADDRSTRLEN)))
+		return DOMAIN_INPUT_INVALID;
+	my_free(comm->domain);
+	comm->domain = strndup(addr, INET6_ADDRSTRLEN);
+	return 0;
+}
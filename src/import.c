@@ -0,0 +1,743 @@
+/*
+ *
+ *  dnsa: DNS Administration
+ *  Copyright (C) 2012 - 2020  Iain M Conochie <iain-AT-thargoid.co.uk>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *  import.c: Bulk import of records from zone files and CSV
+ *
+ */
+#include <config.h>
+#include <configmake.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <syslog.h>
+#include <arpa/inet.h>
+#include <ailsacmdb.h>
+#include <ailsasql.h>
+#include "cmdb_dnsa.h"
+
+enum {
+	IMPORT_FIELDS = 6,
+	IMPORT_BUCKETS = 4099,
+	IMPORT_KEY_LEN = DOMAIN_LEN * 3
+};
+
+typedef struct dnsa_import_s {
+	ailsa_cmdb_s *dc;
+	const char *file;
+	char *zone;
+	char apex[DOMAIN_LEN];		// zone name with the trailing .
+	char origin[DOMAIN_LEN];	// current $ORIGIN, always absolute
+	char owner[DOMAIN_LEN];		// last owner seen, absolute
+	char pri_ns[DOMAIN_LEN];	// apex NS records the zone writes itself
+	char sec_ns[DOMAIN_LEN];
+	ailsa_zone_tokens_s t;		// fields of the current entry
+	unsigned long int line;		// line the current entry starts on
+	unsigned long int zone_id;
+	short int blank;		// entry starts with white space
+	AILHASH seen;			// records in the zone and the file so far
+	AILLIST *base;
+	AILLIST *mx;
+	AILLIST *srv;
+	size_t added;
+	size_t present;
+	size_t skipped;
+} dnsa_import_s;
+
+static int
+dnsa_import_setup(ailsa_cmdb_s *dc, char *zone, dnsa_import_s *imp);
+
+static int
+dnsa_import_existing(ailsa_result_s *r, void *ctx);
+
+static int
+dnsa_import_zone_file(dnsa_import_s *imp, FILE *in);
+
+static int
+dnsa_import_entry(dnsa_import_s *imp);
+
+static int
+dnsa_import_directive(dnsa_import_s *imp);
+
+static int
+dnsa_import_rr(dnsa_import_s *imp, const char *host, char *type, char **rdata, size_t n);
+
+static int
+dnsa_import_csv(dnsa_import_s *imp, FILE *in);
+
+static size_t
+dnsa_import_csv_fields(char *line, char **field);
+
+static int
+dnsa_import_record(dnsa_import_s *imp, char *type, const char *host, const char *dest, unsigned long int pri, const char *proto, const char *service);
+
+static void
+dnsa_import_key(char *key, const char *type, const char *host, const char *dest, unsigned long int pri, const char *proto, const char *service);
+
+static int
+dnsa_import_key_match(const void *one, const void *two);
+
+static int
+dnsa_import_fqdn(dnsa_import_s *imp, const char *name, char *fqdn);
+
+static int
+dnsa_import_host(dnsa_import_s *imp, const char *fqdn, char *host);
+
+static int
+dnsa_import_rname(dnsa_import_s *imp, const char *name, char *dest);
+
+static int
+dnsa_import_is_ns(dnsa_import_s *imp, const char *name);
+
+int
+import_records(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
+{
+	if (!(dc) || !(cm) || !(cm->import) || !(cm->domain))
+		return AILSA_NO_DATA;
+	int retval;
+	size_t len;
+	FILE *in = NULL;
+	dnsa_import_s *imp = ailsa_calloc(sizeof(dnsa_import_s), "imp in import_records");
+
+	imp->base = ailsa_db_data_list_init();
+	imp->mx = ailsa_db_data_list_init();
+	imp->srv = ailsa_db_data_list_init();
+	ailsa_hash_init(&(imp->seen), IMPORT_BUCKETS, ailsa_hash, dnsa_import_key_match, free);
+	imp->file = cm->import;
+	if ((retval = dnsa_import_setup(dc, cm->domain, imp)) != 0)
+		goto cleanup;
+	if (!(in = fopen(cm->import, "r"))) {
+		ailsa_syslog(LOG_ERR, "Cannot open %s for reading", cm->import);
+		retval = AILSA_FILE_ERROR;
+		goto cleanup;
+	}
+	len = strlen(cm->import);
+	if ((len > 4) && (strcasecmp(cm->import + len - 4, ".csv") == 0))
+		retval = dnsa_import_csv(imp, in);
+	else
+		retval = dnsa_import_zone_file(imp, in);
+	if (retval != 0)
+		goto cleanup;
+	if (imp->added > 0) {
+		if ((retval = ailsa_begin(dc)) != 0)
+			goto cleanup;
+		if (imp->base->total > 0) {
+			if ((retval = ailsa_bulk_insert(dc, insert_queries[INSERT_RECORD_BASE], imp->base)) != 0) {
+				ailsa_syslog(LOG_ERR, "INSERT_RECORD_BASE bulk query failed");
+				goto cleanup;
+			}
+		}
+		if (imp->mx->total > 0) {
+			if ((retval = ailsa_bulk_insert(dc, insert_queries[INSERT_RECORD_MX], imp->mx)) != 0) {
+				ailsa_syslog(LOG_ERR, "INSERT_RECORD_MX bulk query failed");
+				goto cleanup;
+			}
+		}
+		if (imp->srv->total > 0) {
+			if ((retval = ailsa_bulk_insert(dc, insert_queries[INSERT_RECORD_SRV], imp->srv)) != 0) {
+				ailsa_syslog(LOG_ERR, "INSERT_RECORD_SRV bulk query failed");
+				goto cleanup;
+			}
+		}
+		if ((retval = set_db_row_updated(dc, SET_FWD_ZONE_UPDATED_ON_NAME, cm->domain, 0)) != 0) {
+			ailsa_syslog(LOG_ERR, "Failed to set zone %s as updated", cm->domain);
+			goto cleanup;
+		}
+		if ((retval = ailsa_commit(dc)) != 0)
+			goto cleanup;
+	}
+	ailsa_syslog(LOG_INFO, "Imported %zu records into %s; %zu already there, %zu skipped",
+		     imp->added, cm->domain, imp->present, imp->skipped);
+	cleanup:
+		ailsa_rollback(dc);
+		if (in)
+			fclose(in);
+		ailsa_zone_tokens_free(&(imp->t));
+		ailsa_hash_destroy(&(imp->seen));
+		ailsa_list_full_clean(imp->base);
+		ailsa_list_full_clean(imp->mx);
+		ailsa_list_full_clean(imp->srv);
+		my_free(imp);
+		return retval;
+}
+
+// Resolve the zone once and load what it already holds into the seen hash
+static int
+dnsa_import_setup(ailsa_cmdb_s *dc, char *zone, dnsa_import_s *imp)
+{
+	int retval;
+	const char *name;
+	AILLIST *id = ailsa_db_data_list_init();
+	AILLIST *args = ailsa_db_data_list_init();
+	AILLIST *ns = ailsa_db_data_list_init();
+
+	imp->dc = dc;
+	imp->zone = zone;
+	snprintf(imp->apex, DOMAIN_LEN, "%s.", zone);
+	snprintf(imp->origin, DOMAIN_LEN, "%s", imp->apex);
+	if ((retval = cmdb_check_add_zone_id_to_list(zone, FORWARD_ZONE, "master", dc, id)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot find master zone %s", zone);
+		goto cleanup;
+	}
+	imp->zone_id = ((ailsa_data_s *)id->head->data)->data->number;
+	if ((retval = cmdb_add_string_to_list(zone, args)) != 0)
+		goto cleanup;
+	if ((retval = ailsa_argument_query(dc, NAME_SERVERS_ON_NAME, args, ns)) != 0) {
+		ailsa_syslog(LOG_ERR, "NAME_SERVERS_ON_NAME query failed");
+		goto cleanup;
+	}
+	if (ns->total == 2) {
+		if ((name = ((ailsa_data_s *)ns->head->data)->data->text))
+			snprintf(imp->pri_ns, DOMAIN_LEN, "%s", name);
+		if ((name = ((ailsa_data_s *)ns->head->next->data)->data->text))
+			snprintf(imp->sec_ns, DOMAIN_LEN, "%s", name);
+	}
+	if ((retval = ailsa_query_foreach(dc, RECORDS_ALL_ON_ZONE, args, dnsa_import_existing, imp)) != 0)
+		ailsa_syslog(LOG_ERR, "RECORDS_ALL_ON_ZONE query failed");
+	cleanup:
+		ailsa_list_full_clean(id);
+		ailsa_list_full_clean(args);
+		ailsa_list_full_clean(ns);
+		return retval;
+}
+
+static int
+dnsa_import_existing(ailsa_result_s *r, void *ctx)
+{
+	dnsa_import_s *imp = ctx;
+	char *key;
+	const char *type, *host, *dest, *proto, *service;
+
+	if (r->cols != 6) {
+		ailsa_syslog(LOG_ERR, "Wanted 6 columns; query returned %zu", r->cols);
+		return AILSA_WRONG_LIST_LENGHT;
+	}
+	if (!(type = ailsa_result_text(r, 0, 0)) || !(host = ailsa_result_text(r, 0, 1)) ||
+	    !(dest = ailsa_result_text(r, 0, 2)))
+		return 0;
+	if (!(proto = ailsa_result_text(r, 0, 4)))
+		proto = "";
+	if (!(service = ailsa_result_text(r, 0, 5)))
+		service = "";
+	key = ailsa_calloc(IMPORT_KEY_LEN, "key in dnsa_import_existing");
+	dnsa_import_key(key, type, host, dest, ailsa_result_number(r, 0, 3), proto, service);
+	if (ailsa_hash_insert(&(imp->seen), key, key) != 0)
+		my_free(key);
+	return 0;
+}
+
+// Master file format (RFC 1035 section 5). An entry can run over several
+// lines inside ( ); owners, TTLs and classes may be left out.
+static int
+dnsa_import_zone_file(dnsa_import_s *imp, FILE *in)
+{
+	int retval = 0;
+	char *line = NULL;
+	size_t len = 0;
+	unsigned long int count = 0;
+
+	while (getline(&line, &len, in) != -1) {
+		count++;
+		if (imp->t.total == 0) {
+			imp->line = count;
+			imp->blank = (line[0] == ' ' || line[0] == '\t') ? 1 : 0;
+		}
+		if (ailsa_zone_tokenise(&(imp->t), line) != 0) {
+			ailsa_syslog(LOG_ERR, "%s:%lu: %s", imp->file, count, imp->t.error);
+			retval = AILSA_IMPORT_INVALID;
+			goto cleanup;
+		}
+		if (imp->t.depth > 0)
+			continue;
+		if (imp->t.total > 0) {
+			if ((retval = dnsa_import_entry(imp)) != 0)
+				goto cleanup;
+		}
+		ailsa_zone_tokens_clear(&(imp->t));
+	}
+	if (imp->t.depth > 0) {
+		ailsa_syslog(LOG_ERR, "%s:%lu: No closing )", imp->file, imp->line);
+		retval = AILSA_IMPORT_INVALID;
+	}
+	cleanup:
+		my_free(line);
+		return retval;
+}
+
+static int
+dnsa_import_entry(dnsa_import_s *imp)
+{
+	int retval;
+	size_t stop, i = 0;
+	char host[DOMAIN_LEN], type[SERVICE_LEN];
+	char *p;
+
+	if (imp->t.tok[0][0] == '$')
+		return dnsa_import_directive(imp);
+	if (!(imp->blank)) {
+		if ((retval = dnsa_import_fqdn(imp, imp->t.tok[i++], imp->owner)) != 0)
+			return retval;
+	} else if (!(imp->owner[0])) {
+		ailsa_syslog(LOG_ERR, "%s:%lu: No owner for this record", imp->file, imp->line);
+		return AILSA_IMPORT_INVALID;
+	}
+// TTL and class can come in either order
+	for (stop = i + 2; (i < imp->t.total) && (i < stop); i++) {
+		if (isdigit((unsigned char)imp->t.tok[i][0]))
+			continue;
+		if (strcasecmp(imp->t.tok[i], "IN") == 0)
+			continue;
+		if ((strcasecmp(imp->t.tok[i], "CH") == 0) || (strcasecmp(imp->t.tok[i], "HS") == 0)) {
+			ailsa_syslog(LOG_INFO, "%s:%lu: Skipping %s class record", imp->file, imp->line, imp->t.tok[i]);
+			imp->skipped++;
+			return 0;
+		}
+		break;
+	}
+	if (i >= imp->t.total) {
+		ailsa_syslog(LOG_ERR, "%s:%lu: No record type", imp->file, imp->line);
+		return AILSA_IMPORT_INVALID;
+	}
+	if (strlen(imp->t.tok[i]) >= SERVICE_LEN) {
+		ailsa_syslog(LOG_ERR, "%s:%lu: Invalid record type %s", imp->file, imp->line, imp->t.tok[i]);
+		return AILSA_IMPORT_INVALID;
+	}
+	snprintf(type, SERVICE_LEN, "%s", imp->t.tok[i++]);
+	for (p = type; *p; p++)
+		*p = (char)toupper((unsigned char)*p);
+	if (dnsa_import_host(imp, imp->owner, host) != 0) {
+		ailsa_syslog(LOG_INFO, "%s:%lu: Skipping %s; it is not in %s", imp->file, imp->line, imp->owner, imp->zone);
+		imp->skipped++;
+		return 0;
+	}
+	return dnsa_import_rr(imp, host, type, imp->t.tok + i, imp->t.total - i);
+}
+
+static int
+dnsa_import_directive(dnsa_import_s *imp)
+{
+	char *d = imp->t.tok[0];
+
+	if (strcasecmp(d, "$TTL") == 0) {
+		return 0;	// The zone TTL comes from the zones table
+	} else if (strcasecmp(d, "$ORIGIN") == 0) {
+		if (imp->t.total < 2) {
+			ailsa_syslog(LOG_ERR, "%s:%lu: $ORIGIN without a name", imp->file, imp->line);
+			return AILSA_IMPORT_INVALID;
+		}
+		return dnsa_import_fqdn(imp, imp->t.tok[1], imp->origin);
+	}
+	ailsa_syslog(LOG_ERR, "%s:%lu: %s is not supported", imp->file, imp->line, d);
+	return AILSA_IMPORT_INVALID;
+}
+
+// Hosts are stored the way dnsa -a stores them: relative to the zone, @ for
+// the apex, the service name for SRV. NS, MX and SRV live at the apex.
+static int
+dnsa_import_rr(dnsa_import_s *imp, const char *host, char *type, char **rdata, size_t n)
+{
+	int retval;
+	char dest[DOMAIN_LEN], service[SERVICE_LEN], proto[SERVICE_LEN];
+	char *txt, *p;
+	size_t i, len;
+	unsigned int port;
+
+	if (strcmp(type, "SOA") == 0)
+		return 0;
+	if (n == 0) {
+		ailsa_syslog(LOG_ERR, "%s:%lu: No data for %s record", imp->file, imp->line, type);
+		return AILSA_IMPORT_INVALID;
+	}
+	if (strcmp(type, "NS") == 0) {
+		if (strcmp(host, "@") != 0) {
+			ailsa_syslog(LOG_INFO, "%s:%lu: Skipping NS for %s; add delegations with -G", imp->file, imp->line, host);
+			imp->skipped++;
+			return 0;
+		}
+		if ((retval = dnsa_import_rname(imp, rdata[0], dest)) != 0)
+			return retval;
+		if (dnsa_import_is_ns(imp, dest) == 0) {
+			imp->present++;
+			return 0;
+		}
+		return dnsa_import_record(imp, type, host, dest, 0, NULL, NULL);
+	} else if (strcmp(type, "MX") == 0) {
+		if (strcmp(host, "@") != 0) {
+			ailsa_syslog(LOG_INFO, "%s:%lu: Skipping MX for %s; only the apex is written", imp->file, imp->line, host);
+			imp->skipped++;
+			return 0;
+		}
+		if ((n < 2) || !(isdigit((unsigned char)rdata[0][0]))) {
+			ailsa_syslog(LOG_ERR, "%s:%lu: MX needs a priority and a host", imp->file, imp->line);
+			return AILSA_IMPORT_INVALID;
+		}
+		if ((retval = dnsa_import_rname(imp, rdata[1], dest)) != 0)
+			return retval;
+		return dnsa_import_record(imp, type, host, dest, strtoul(rdata[0], NULL, 10), NULL, NULL);
+	} else if (strcmp(type, "SRV") == 0) {
+		if ((n < 4) || !(isdigit((unsigned char)rdata[0][0])) || !(isdigit((unsigned char)rdata[1][0])) ||
+		    !(isdigit((unsigned char)rdata[2][0]))) {
+			ailsa_syslog(LOG_ERR, "%s:%lu: SRV needs a priority, weight, port and host", imp->file, imp->line);
+			return AILSA_IMPORT_INVALID;
+		}
+		if ((host[0] != '_') || !(p = strchr(host, '.')) || (p[1] != '_') || strchr(p + 1, '.') ||
+		    ((size_t)(p - host) > SERVICE_LEN) || (strlen(p + 2) >= SERVICE_LEN)) {
+			ailsa_syslog(LOG_INFO, "%s:%lu: Skipping SRV for %s; only _service._proto at the apex is written", imp->file, imp->line, host);
+			imp->skipped++;
+			return 0;
+		}
+		memcpy(service, host + 1, (size_t)(p - host - 1));
+		service[p - host - 1] = '\0';
+		snprintf(proto, SERVICE_LEN, "%s", p + 2);
+		if ((strcmp(proto, "tcp") != 0) && (strcmp(proto, "udp") != 0)) {
+			ailsa_syslog(LOG_INFO, "%s:%lu: Skipping SRV with protocol %s", imp->file, imp->line, proto);
+			imp->skipped++;
+			return 0;
+		}
+		if (strtoul(rdata[1], NULL, 10) != 0) {
+			ailsa_syslog(LOG_INFO, "%s:%lu: Skipping SRV for %s; the weight is always written as 0", imp->file, imp->line, host);
+			imp->skipped++;
+			return 0;
+		}
+		if ((cmdb_get_port_number(proto, service, &port) != 0) || (port != strtoul(rdata[2], NULL, 10))) {
+			ailsa_syslog(LOG_INFO, "%s:%lu: Skipping SRV for %s; port %s is not %s/%s in services", imp->file, imp->line, host, rdata[2], service, proto);
+			imp->skipped++;
+			return 0;
+		}
+		if ((retval = dnsa_import_rname(imp, rdata[3], dest)) != 0)
+			return retval;
+		return dnsa_import_record(imp, type, service, dest, strtoul(rdata[0], NULL, 10), proto, service);
+	} else if ((strcmp(type, "CNAME") == 0) || (strcmp(type, "PTR") == 0) || (strcmp(type, "DNAME") == 0)) {
+		if ((retval = dnsa_import_rname(imp, rdata[0], dest)) != 0)
+			return retval;
+		return dnsa_import_record(imp, type, host, dest, 0, NULL, NULL);
+	}
+// Anything else is written back as it reads, so keep the text
+	for (len = 0, i = 0; i < n; i++)
+		len += strlen(rdata[i]) + 1;
+	txt = ailsa_calloc(len, "txt in dnsa_import_rr");
+	for (i = 0; i < n; i++) {
+		if (i > 0)
+			strcat(txt, " ");
+		strcat(txt, rdata[i]);
+	}
+	retval = dnsa_import_record(imp, type, host, txt, 0, NULL, NULL);
+	my_free(txt);
+	return retval;
+}
+
+// host,type,destination[,priority[,protocol,service]] - the same fields as dnsa -a
+static int
+dnsa_import_csv(dnsa_import_s *imp, FILE *in)
+{
+	int retval = 0;
+	char *line = NULL, *p;
+	char *field[IMPORT_FIELDS];
+	char host[DOMAIN_LEN], type[SERVICE_LEN], fqdn[DOMAIN_LEN];
+	char *service;
+	const char *proto;
+	size_t n, rows = 0, len = 0;
+	unsigned long int pri, count = 0;
+
+	while (getline(&line, &len, in) != -1) {
+		imp->line = ++count;
+		if ((n = dnsa_import_csv_fields(line, field)) == 0)
+			continue;
+		if (field[0][0] == '#')
+			continue;
+		if (n < 3) {
+			ailsa_syslog(LOG_ERR, "%s:%lu: Want host, type and destination", imp->file, imp->line);
+			retval = AILSA_IMPORT_INVALID;
+			goto cleanup;
+		}
+		if ((rows++ == 0) && (strcasecmp(field[1], "type") == 0))
+			continue;
+		if (strlen(field[1]) >= SERVICE_LEN) {
+			ailsa_syslog(LOG_ERR, "%s:%lu: Invalid record type %s", imp->file, imp->line, field[1]);
+			retval = AILSA_IMPORT_INVALID;
+			goto cleanup;
+		}
+		snprintf(type, SERVICE_LEN, "%s", field[1]);
+		for (p = type; *p; p++)
+			*p = (char)toupper((unsigned char)*p);
+		if ((field[0][0] == '\0') || (strcmp(field[0], "@") == 0)) {
+			snprintf(host, DOMAIN_LEN, "@");
+		} else if (field[0][strlen(field[0]) - 1] == '.') {
+			if ((retval = dnsa_import_fqdn(imp, field[0], fqdn)) != 0)
+				goto cleanup;
+			if (dnsa_import_host(imp, fqdn, host) != 0) {
+				ailsa_syslog(LOG_INFO, "%s:%lu: Skipping %s; it is not in %s", imp->file, imp->line, fqdn, imp->zone);
+				imp->skipped++;
+				continue;
+			}
+		} else {
+			snprintf(host, DOMAIN_LEN, "%s", field[0]);
+		}
+		pri = 0;
+		proto = service = NULL;
+		if ((strcmp(type, "MX") == 0) || (strcmp(type, "SRV") == 0)) {
+			if ((n > 3) && (field[3][0] != '\0'))
+				pri = strtoul(field[3], NULL, 10);
+			if (pri == 0)
+				pri = 100;
+		}
+		if (strcmp(type, "MX") == 0) {
+			snprintf(host, DOMAIN_LEN, "@");
+		} else if (strcmp(type, "SRV") == 0) {
+			proto = ((n > 4) && (field[4][0] != '\0')) ? field[4] : "tcp";
+			service = ((n > 5) && (field[5][0] != '\0')) ? field[5] : host;
+			if ((strcmp(proto, "tcp") != 0) && (strcmp(proto, "udp") != 0)) {
+				ailsa_syslog(LOG_ERR, "%s:%lu: Protocol must be tcp or udp", imp->file, imp->line);
+				retval = AILSA_IMPORT_INVALID;
+				goto cleanup;
+			}
+			if ((strlen(service) >= SERVICE_LEN) || (ailsa_validate_input(service, NAME_REGEX) < 0)) {
+				ailsa_syslog(LOG_ERR, "%s:%lu: Invalid service %s", imp->file, imp->line, service);
+				retval = AILSA_IMPORT_INVALID;
+				goto cleanup;
+			}
+			if (service != host) {
+				snprintf(host, DOMAIN_LEN, "%s", service);
+				service = host;
+			}
+		}
+		if ((retval = dnsa_import_record(imp, type, host, field[2], pri, proto, service)) != 0)
+			goto cleanup;
+	}
+	cleanup:
+		my_free(line);
+		return retval;
+}
+
+// Split line in place. "" inside a quoted field is a literal quote
+static size_t
+dnsa_import_csv_fields(char *line, char **field)
+{
+	char *in = line, *out, *end;
+	size_t n = 0;
+
+	line[strcspn(line, "\r\n")] = '\0';
+	while (isspace((unsigned char)*in))
+		in++;
+	if (*in == '\0')
+		return 0;
+	while (n < IMPORT_FIELDS) {
+		while ((*in == ' ') || (*in == '\t'))
+			in++;
+		field[n++] = out = in;
+		if (*in == '"') {
+			in++;
+			while (*in) {
+				if ((*in == '"') && (in[1] == '"')) {
+					*out++ = '"';
+					in += 2;
+				} else if (*in == '"') {
+					in++;
+					break;
+				} else {
+					*out++ = *in++;
+				}
+			}
+			while (*in && (*in != ','))
+				in++;
+		} else {
+			while (*in && (*in != ','))
+				*out++ = *in++;
+			end = out;
+			while ((end > field[n - 1]) && isspace((unsigned char)end[-1]))
+				end--;
+			out = end;
+		}
+		if (*in != ',') {
+			*out = '\0';
+			break;
+		}
+		in++;
+		*out = '\0';
+	}
+	return n;
+}
+
+// Queue one record for the bulk insert unless the zone or the file has it
+static int
+dnsa_import_record(dnsa_import_s *imp, char *type, const char *host, const char *dest, unsigned long int pri, const char *proto, const char *service)
+{
+	int retval;
+	unsigned char addr[sizeof(struct in6_addr)];
+	char *key;
+	AILLIST *list;
+
+	if (ailsa_validate_input(type, RESOURCE_TYPE_REGEX) < 0) {
+		ailsa_syslog(LOG_ERR, "%s:%lu: Invalid record type %s", imp->file, imp->line, type);
+		return AILSA_IMPORT_INVALID;
+	}
+	if ((host[0] == '\0') || (strlen(host) >= DOMAIN_LEN) || strpbrk(host, " \t\"\\") ||
+	    (dest[0] == '\0') || (strlen(dest) >= DOMAIN_LEN)) {
+		ailsa_syslog(LOG_ERR, "%s:%lu: Host or destination is empty or not valid", imp->file, imp->line);
+		return AILSA_IMPORT_INVALID;
+	}
+	if (((strcmp(type, "A") == 0) && (inet_pton(AF_INET, dest, addr) != 1)) ||
+	    ((strcmp(type, "AAAA") == 0) && (inet_pton(AF_INET6, dest, addr) != 1))) {
+		ailsa_syslog(LOG_ERR, "%s:%lu: %s is not a valid %s address", imp->file, imp->line, dest, type);
+		return AILSA_IMPORT_INVALID;
+	}
+	key = ailsa_calloc(IMPORT_KEY_LEN, "key in dnsa_import_record");
+	dnsa_import_key(key, type, host, dest, pri, proto ? proto : "", service ? service : "");
+	if ((retval = ailsa_hash_insert(&(imp->seen), key, key)) != 0) {
+		my_free(key);
+		if (retval < 0)
+			return retval;
+		imp->present++;
+		return 0;
+	}
+	if (service)
+		list = imp->srv;
+	else if (strcmp(type, "MX") == 0)
+		list = imp->mx;
+	else
+		list = imp->base;
+	if ((retval = cmdb_add_number_to_list(imp->zone_id, list)) != 0)
+		return retval;
+	if ((retval = cmdb_add_string_to_list(type, list)) != 0)
+		return retval;
+	if ((retval = cmdb_add_string_to_list(host, list)) != 0)
+		return retval;
+	if ((retval = cmdb_add_string_to_list(dest, list)) != 0)
+		return retval;
+	if (list != imp->base) {
+		if ((retval = cmdb_add_number_to_list(pri, list)) != 0)
+			return retval;
+	}
+	if (list == imp->srv) {
+		if ((retval = cmdb_add_string_to_list(proto, list)) != 0)
+			return retval;
+		if ((retval = cmdb_add_string_to_list(service, list)) != 0)
+			return retval;
+	}
+	if ((retval = cmdb_populate_cuser_muser(list)) != 0)
+		return retval;
+	if ((retval = cmdb_add_ip_addr_to_list(type, dest, list)) != 0)
+		return retval;
+	imp->added++;
+	return 0;
+}
+
+// Names compare without case; TXT and other free text data does not
+static void
+dnsa_import_key(char *key, const char *type, const char *host, const char *dest, unsigned long int pri, const char *proto, const char *service)
+{
+	char *p;
+	int fold;
+
+	fold = ((strcmp(type, "A") == 0) || (strcmp(type, "AAAA") == 0) || (strcmp(type, "CNAME") == 0) ||
+		(strcmp(type, "NS") == 0) || (strcmp(type, "MX") == 0) || (strcmp(type, "SRV") == 0) ||
+		(strcmp(type, "PTR") == 0) || (strcmp(type, "DNAME") == 0));
+	snprintf(key, IMPORT_KEY_LEN, "%s\t%s\t%lu\t%s\t%s\t", type, host, pri, proto, service);
+	for (p = key; *p; p++)
+		*p = (char)tolower((unsigned char)*p);
+	snprintf(p, IMPORT_KEY_LEN - (size_t)(p - key), "%s", dest);
+	if (fold)
+		for (; *p; p++)
+			*p = (char)tolower((unsigned char)*p);
+}
+
+static int
+dnsa_import_key_match(const void *one, const void *two)
+{
+	return strcmp(one, two) == 0;
+}
+
+// Absolute form of an owner or $ORIGIN name
+static int
+dnsa_import_fqdn(dnsa_import_s *imp, const char *name, char *fqdn)
+{
+	size_t len = strlen(name);
+
+	if (strcmp(name, "@") == 0)
+		len = (size_t)snprintf(fqdn, DOMAIN_LEN, "%s", imp->origin);
+	else if (name[len - 1] == '.')
+		len = (size_t)snprintf(fqdn, DOMAIN_LEN, "%s", name);
+	else if (strcmp(imp->origin, ".") == 0)
+		len = (size_t)snprintf(fqdn, DOMAIN_LEN, "%s.", name);
+	else
+		len = (size_t)snprintf(fqdn, DOMAIN_LEN, "%s.%s", name, imp->origin);
+	if (len >= DOMAIN_LEN) {
+		ailsa_syslog(LOG_ERR, "%s:%lu: Name %s is too long", imp->file, imp->line, name);
+		return AILSA_IMPORT_INVALID;
+	}
+	return 0;
+}
+
+// 1 if fqdn is not in the zone
+static int
+dnsa_import_host(dnsa_import_s *imp, const char *fqdn, char *host)
+{
+	size_t len = strlen(fqdn), alen = strlen(imp->apex);
+
+	if (strcasecmp(fqdn, imp->apex) == 0) {
+		snprintf(host, DOMAIN_LEN, "@");
+		return 0;
+	}
+	if ((len <= alen + 1) || (fqdn[len - alen - 1] != '.') || (strcasecmp(fqdn + len - alen, imp->apex) != 0))
+		return 1;
+	snprintf(host, DOMAIN_LEN, "%.*s", (int)(len - alen - 1), fqdn);
+	return 0;
+}
+
+// Names in record data stay relative only while $ORIGIN is the zone itself
+static int
+dnsa_import_rname(dnsa_import_s *imp, const char *name, char *dest)
+{
+	size_t len = strlen(name);
+
+	if ((strcmp(name, "@") != 0) && (name[len - 1] != '.') && (strcasecmp(imp->origin, imp->apex) == 0)) {
+		if (len >= DOMAIN_LEN) {
+			ailsa_syslog(LOG_ERR, "%s:%lu: Name %s is too long", imp->file, imp->line, name);
+			return AILSA_IMPORT_INVALID;
+		}
+		snprintf(dest, DOMAIN_LEN, "%s", name);
+		return 0;
+	}
+	return dnsa_import_fqdn(imp, name, dest);
+}
+
+// 0 if name is one of the NS records written from the zone's pri_dns / sec_dns
+static int
+dnsa_import_is_ns(dnsa_import_s *imp, const char *name)
+{
+	char fqdn[DOMAIN_LEN];
+	const char *ns[2] = { imp->pri_ns, imp->sec_ns };
+	size_t i, len;
+
+	if (dnsa_import_fqdn(imp, name, fqdn) != 0)
+		return 1;
+	for (i = 0; i < 2; i++) {
+		len = strlen(ns[i]);
+		if (len == 0)
+			continue;
+		if (ns[i][len - 1] == '.') {
+			if (strcasecmp(fqdn, ns[i]) == 0)
+				return 0;
+		} else if ((strncasecmp(fqdn, ns[i], len) == 0) && (strcmp(fqdn + len, ".") == 0)) {
+			return 0;
+		}
+	}
+	return 1;
+}
@@ -46,6 +46,12 @@ cmdb_populate_hardware_details(cmdb_comm_line_s *cm, AILLIST *list);
 static int
 cmdb_populate_service_details(cmdb_comm_line_s *cm, AILLIST *list);
 
+static int
+cmdb_add_service_ids_to_list(cmdb_comm_line_s *cm, ailsa_cmdb_s *cc, AILLIST *list);
+
+static int
+cmdb_print_server_row(ailsa_result_s *r, void *ctx);
+
 int
 cmdb_add_server_to_database(cmdb_comm_line_s *cm, ailsa_cmdb_s *cc)
 {
@@ -251,11 +257,7 @@ cmdb_add_services_to_database(cmdb_comm_line_s *cm, ailsa_cmdb_s *cc)
 	AILLIST *service = ailsa_db_data_list_init();
 	AILLIST *results = ailsa_db_data_list_init();
 
-	if ((retval = cmdb_check_add_server_id_to_list(cm->name, cc, service)) != 0)
-		goto cleanup;
-	if ((retval = cmdb_check_add_cust_id_to_list(cm->coid, cc, service)) != 0)
-		goto cleanup;
-	if ((retval = cmdb_add_service_type_id_to_list(cm->service, cc, service)) != 0)
+	if ((retval = cmdb_add_service_ids_to_list(cm, cc, service)) != 0)
 		goto cleanup;
 	if ((retval = cmdb_populate_service_details(cm, service)) != 0)
 		goto cleanup;
@@ -276,6 +278,57 @@ cmdb_add_services_to_database(cmdb_comm_line_s *cm, ailsa_cmdb_s *cc)
 		return retval;
 }
 
+// None of these lookups depend on another, so send them as one batch
+static int
+cmdb_add_service_ids_to_list(cmdb_comm_line_s *cm, ailsa_cmdb_s *cc, AILLIST *list)
+{
+	if (!(cm->name) || !(cm->service))
+		return AILSA_NO_DATA;
+	int retval;
+	ailsa_sql_batch_s ids[3];
+	AILLIST *server = ailsa_db_data_list_init();
+	AILLIST *coid = ailsa_db_data_list_init();
+	AILLIST *type = ailsa_db_data_list_init();
+
+	memset(ids, 0, sizeof(ids));
+	if ((retval = cmdb_add_string_to_list(cm->name, server)) != 0)
+		goto cleanup;
+	if ((retval = cmdb_add_string_to_list(cm->service, type)) != 0)
+		goto cleanup;
+	ids[0].query_no = SERVER_ID_ON_NAME;
+	ids[0].args = server;
+	if (cm->coid) {
+		if ((retval = cmdb_add_string_to_list(cm->coid, coid)) != 0)
+			goto cleanup;
+		ids[1].query_no = CUST_ID_ON_COID;
+		ids[1].args = coid;
+	} else {
+		ids[1].query_no = DEFAULT_CUSTOMER;
+	}
+	ids[2].query_no = SERVICE_TYPE_ID_ON_SERVICE;
+	ids[2].args = type;
+	ids[0].results = ids[1].results = ids[2].results = list;
+	if ((retval = ailsa_query_batch(cc, ids, 3)) != 0) {
+		ailsa_syslog(LOG_ERR, "Service ID queries failed");
+		goto cleanup;
+	}
+	if (ids[0].total != 1) {
+		ailsa_syslog(LOG_ERR, "Cannot find server %s", cm->name);
+		retval = AILSA_SERVER_NOT_FOUND;
+	} else if (ids[1].total != 1) {
+		ailsa_syslog(LOG_ERR, "Cannot find customer with coid %s", cm->coid ? cm->coid : "default");
+		retval = AILSA_CUSTOMER_NOT_FOUND;
+	} else if (ids[2].total != 1) {
+		ailsa_syslog(LOG_ERR, "Cannot find service type %s", cm->service);
+		retval = SERVICE_INPUT_INVALID;
+	}
+	cleanup:
+		ailsa_list_full_clean(server);
+		ailsa_list_full_clean(coid);
+		ailsa_list_full_clean(type);
+		return retval;
+}
+
 int
 cmdb_remove_server_from_database(cmdb_comm_line_s *cm, ailsa_cmdb_s *cc)
 {
@@ -300,39 +353,33 @@ void
 cmdb_list_servers(ailsa_cmdb_s *cc)
 {
 	int retval;
-	AILLIST *list = ailsa_db_data_list_init();
-	AILELEM *name, *coid;
-	ailsa_data_s *one, *two;
+	size_t rows = 0;
 
 	if (!(cc))
-		goto cleanup;
-	if ((retval = ailsa_basic_query(cc, SERVER_NAME_COID, list) != 0)) {
+		return;
+	printf("Server Name\t\tCOID\n");
+	if ((retval = ailsa_query_foreach(cc, SERVER_NAME_COID, NULL, cmdb_print_server_row, &rows)) != 0)
 		ailsa_syslog(LOG_ERR, "SQL basic query returned %d", retval);
-		goto cleanup;
-	}
-	name = list->head;
-	if (list->total > 0) {
-		printf("Server Name\t\tCOID\n");
-		while (name) {
-			coid = name->next;
-			one = (ailsa_data_s *)name->data;
-			two = (ailsa_data_s *)coid->data;
-			if (strlen(one->data->text) < 8)
-				printf("%s\t\t\t%s\n",one->data->text, two->data->text);
-			else if (strlen(one->data->text) < 16)
-				printf("%s\t\t%s\n",one->data->text, two->data->text);
-			else
-				printf("%s\t%s\n",one->data->text, two->data->text);
-			name = coid->next;
-			if (name)
-				coid = name->next;
-		}
-	} else {
+	else if (rows == 0)
 		ailsa_syslog(LOG_INFO, "No servers found in the database");
-	}
+}
 
-	cleanup:
-		ailsa_list_full_clean(list);
+static int
+cmdb_print_server_row(ailsa_result_s *r, void *ctx)
+{
+	size_t *rows = ctx;
+	const char *name, *coid;
+
+	if (!(name = ailsa_result_text(r, 0, 0)) || !(coid = ailsa_result_text(r, 0, 1)))
+		return 0;
+	if (strlen(name) < 8)
+		printf("%s\t\t\t%s\n", name, coid);
+	else if (strlen(name) < 16)
+		printf("%s\t\t%s\n", name, coid);
+	else
+		printf("%s\t%s\n", name, coid);
+	(*rows)++;
+	return 0;
 }
 
 void
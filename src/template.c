@@ -0,0 +1,566 @@
+/*
+ *
+ *  cbc: Create Build Configuration
+ *  Copyright (C) 2012 - 2020  Iain M Conochie <iain-AT-thargoid.co.uk>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *  template.c: Build file templates
+ *
+ *  A template is compiled once into a list of operations, with every name
+ *  resolved against a table of fields, and can then be rendered into a
+ *  buffer for any number of hosts.
+ *
+ *  {{name}}                      the value of name
+ *  {{#if name}} .. {{else}} .. {{/if}}
+ *  {{#if name == "text"}}        also !=
+ *  {{#each list}} .. {{/each}}   first and last are set inside the loop
+ *  {{! comment }}
+ *
+ *  A block or comment tag on a line of its own takes the whole line with it.
+ *
+ */
+#include <config.h>
+#include <configmake.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <sys/stat.h>
+#include <ailsacmdb.h>
+#include <ailsasql.h>
+#include "template.h"
+
+enum {
+	CBC_TMPL_OPS = 64,	// Operations allocated at first
+	CBC_TMPL_NUM = 32	// Room for a number as text
+};
+
+typedef struct cbc_tmpl_parse_s {	// State while one template compiles
+	cbc_tmpl_s *tmpl;
+	const char *file;
+	const cbc_tmpl_field_s *scope[CBC_TMPL_DEPTH + 1];
+	size_t block[CBC_TMPL_DEPTH];	// Opening op of each open block
+	size_t other[CBC_TMPL_DEPTH];	// The {{else}} of an open #if
+	unsigned int blocks;
+	unsigned int loops;
+	size_t size;
+} cbc_tmpl_parse_s;
+
+static const cbc_tmpl_field_s cbc_tmpl_loop[] = {
+	{ "first", 0, CBC_TMPL_FIRST, NULL },
+	{ "last", 0, CBC_TMPL_LAST, NULL },
+	{ NULL, 0, 0, NULL }
+};
+
+static char *
+cbc_tmpl_read(const char *file);
+
+static int
+cbc_tmpl_parse(cbc_tmpl_parse_s *p);
+
+static int
+cbc_tmpl_tag(cbc_tmpl_parse_s *p, const char *tag, size_t len, unsigned int line);
+
+static int
+cbc_tmpl_test(cbc_tmpl_parse_s *p, cbc_tmpl_op_s *op, const char *s, size_t len, unsigned int line);
+
+static size_t
+cbc_tmpl_add_op(cbc_tmpl_parse_s *p, short int type);
+
+static const cbc_tmpl_field_s *
+cbc_tmpl_lookup(cbc_tmpl_parse_s *p, const char *name, size_t len, unsigned int *level, unsigned int line);
+
+static const char *
+cbc_tmpl_value(const cbc_tmpl_op_s *op, const void **base, char *num);
+
+static int
+cbc_tmpl_true(const cbc_tmpl_op_s *op, const void **base, AILELEM **elem);
+
+static void
+cbc_tmpl_put(ailsa_string_s *out, const char *text, size_t len);
+
+cbc_tmpl_s *
+cbc_tmpl_compile(const char *file, const char *name, const cbc_tmpl_field_s *fields)
+{
+	if (!(file) || !(name) || !(fields))
+		return NULL;
+	cbc_tmpl_parse_s p;
+	cbc_tmpl_s *tmpl = ailsa_calloc(sizeof(cbc_tmpl_s), "tmpl in cbc_tmpl_compile");
+
+	memset(&p, 0, sizeof(p));
+	tmpl->name = strndup(name, CONFIG_LEN);
+	if (!(tmpl->src = cbc_tmpl_read(file)))
+		goto cleanup;
+	p.tmpl = tmpl;
+	p.file = file;
+	p.scope[0] = fields;
+	p.size = CBC_TMPL_OPS;
+	tmpl->ops = ailsa_calloc(sizeof(cbc_tmpl_op_s) * p.size, "tmpl->ops in cbc_tmpl_compile");
+	if (cbc_tmpl_parse(&p) != 0)
+		goto cleanup;
+	return tmpl;
+
+	cleanup:
+		cbc_tmpl_clean(tmpl);
+		return NULL;
+}
+
+void
+cbc_tmpl_clean(void *data)
+{
+	cbc_tmpl_s *tmpl = data;
+
+	if (!(tmpl))
+		return;
+	if (tmpl->name)
+		my_free(tmpl->name);
+	if (tmpl->src)
+		my_free(tmpl->src);
+	if (tmpl->ops)
+		my_free(tmpl->ops);
+	my_free(tmpl);
+}
+
+// Appends to out. Loop items are found through elem, so nothing is copied
+int
+cbc_tmpl_render(cbc_tmpl_s *tmpl, const void *ctx, ailsa_string_s *out)
+{
+	if (!(tmpl) || !(ctx) || !(out))
+		return AILSA_NO_DATA;
+	char num[CBC_TMPL_NUM];
+	const char *value;
+	const void *base[CBC_TMPL_DEPTH + 1];
+	unsigned int loops = 0;
+	size_t pc = 0;
+	AILELEM *elem[CBC_TMPL_DEPTH + 1];
+	AILLIST *list;
+	cbc_tmpl_op_s *op;
+
+	base[0] = ctx;
+	elem[0] = NULL;
+	while (pc < tmpl->total) {
+		op = &(tmpl->ops[pc]);
+		switch (op->op) {
+		case CBC_TMPL_OP_TEXT:
+			cbc_tmpl_put(out, op->text, op->len);
+			break;
+		case CBC_TMPL_OP_VAR:
+			value = cbc_tmpl_value(op, base, num);
+			cbc_tmpl_put(out, value, strlen(value));
+			break;
+		case CBC_TMPL_OP_IF:
+			if (cbc_tmpl_true(op, base, elem) == 0) {
+				pc = op->jump;
+				continue;
+			}
+			break;
+		case CBC_TMPL_OP_ELSE:
+			pc = op->jump;
+			continue;
+		case CBC_TMPL_OP_EACH:
+			list = *(AILLIST * const *)((const char *)base[op->level] + op->field->offset);
+			if (!(list) || !(list->head)) {
+				pc = op->jump;
+				continue;
+			}
+			loops++;
+			elem[loops] = list->head;
+			base[loops] = list->head->data;
+			break;
+		case CBC_TMPL_OP_NEXT:
+			if ((elem[loops] = elem[loops]->next)) {
+				base[loops] = elem[loops]->data;
+				pc = op->jump + 1;
+				continue;
+			}
+			loops--;
+			break;
+		default:
+			ailsa_syslog(LOG_ERR, "Unknown operation %hd in template %s", op->op, tmpl->name);
+			return AILSA_NO_DATA;
+		}
+		pc++;
+	}
+	return 0;
+}
+
+static char *
+cbc_tmpl_read(const char *file)
+{
+	char *src = NULL;
+	size_t len;
+	struct stat st;
+	FILE *in;
+
+	if (!(in = fopen(file, "r"))) {
+		ailsa_syslog(LOG_ERR, "Cannot open template %s: %s", file, strerror(errno));
+		return NULL;
+	}
+	if (fstat(fileno(in), &st) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot stat template %s: %s", file, strerror(errno));
+		goto cleanup;
+	}
+	len = (size_t)st.st_size;
+	src = ailsa_calloc(len + 1, "src in cbc_tmpl_read");
+	if (fread(src, 1, len, in) != len) {
+		ailsa_syslog(LOG_ERR, "Cannot read template %s", file);
+		my_free(src);
+		src = NULL;
+	}
+	cleanup:
+		fclose(in);
+		return src;
+}
+
+// Text between tags is not copied; the ops point into the source
+static int
+cbc_tmpl_parse(cbc_tmpl_parse_s *p)
+{
+	const char *src = p->tmpl->src;
+	const char *pos = src, *tag, *end, *start, *after;
+	int retval;
+	size_t i;
+	unsigned int line = 1;
+	cbc_tmpl_op_s *op;
+
+	while ((tag = strstr(pos, "{{"))) {
+		for (start = pos; start < tag; start++)
+			if (*start == '\n')
+				line++;
+		if (!(end = strstr(tag + 2, "}}"))) {
+			ailsa_syslog(LOG_ERR, "%s line %u: {{ is not closed", p->file, line);
+			return AILSA_NO_DATA;
+		}
+		after = end + 2;
+// Block and comment tags alone on a line drop the line
+		start = tag;
+		if ((tag[2] == '#') || (tag[2] == '/') || (tag[2] == '!') || (strncmp(tag + 2, "else}}", 6) == 0)) {
+			while ((start > src) && ((start[-1] == ' ') || (start[-1] == '\t')))
+				start--;
+			while ((*after == ' ') || (*after == '\t'))
+				after++;
+			if (((start == src) || (start[-1] == '\n')) && ((*after == '\n') || (*after == '\0'))) {
+				if (*after == '\n')
+					after++;
+			} else {
+				start = tag;
+				after = end + 2;
+			}
+		}
+		if (start > pos) {
+			if (cbc_tmpl_add_op(p, CBC_TMPL_OP_TEXT) == 0)
+				return AILSA_NO_DATA;
+			op = &(p->tmpl->ops[p->tmpl->total - 1]);
+			op->text = pos;
+			op->len = (size_t)(start - pos);
+		}
+		if ((retval = cbc_tmpl_tag(p, tag + 2, (size_t)(end - tag - 2), line)) != 0)
+			return retval;
+		for (i = 0; tag + i < after; i++)
+			if (tag[i] == '\n')
+				line++;
+		pos = after;
+	}
+	if (*pos != '\0') {
+		if (cbc_tmpl_add_op(p, CBC_TMPL_OP_TEXT) == 0)
+			return AILSA_NO_DATA;
+		op = &(p->tmpl->ops[p->tmpl->total - 1]);
+		op->text = pos;
+		op->len = strlen(pos);
+	}
+	if (p->blocks > 0) {
+		ailsa_syslog(LOG_ERR, "%s: {{#if}} or {{#each}} not closed at the end", p->file);
+		return AILSA_NO_DATA;
+	}
+	return 0;
+}
+
+static int
+cbc_tmpl_tag(cbc_tmpl_parse_s *p, const char *tag, size_t len, unsigned int line)
+{
+	const char *file = p->file;
+	size_t i, n;
+	unsigned int level;
+	cbc_tmpl_op_s *op, *open;
+	const cbc_tmpl_field_s *f;
+
+	while ((len > 0) && ((*tag == ' ') || (*tag == '\t'))) {
+		tag++;
+		len--;
+	}
+	while ((len > 0) && ((tag[len - 1] == ' ') || (tag[len - 1] == '\t')))
+		len--;
+	if (len == 0) {
+		ailsa_syslog(LOG_ERR, "%s line %u: empty tag", file, line);
+		return AILSA_NO_DATA;
+	}
+	if (*tag == '!')
+		return 0;
+	if ((len == 4) && (strncmp(tag, "else", 4) == 0)) {
+		if ((p->blocks == 0) || (p->tmpl->ops[p->block[p->blocks - 1]].op != CBC_TMPL_OP_IF) ||
+		    (p->other[p->blocks - 1] != 0)) {
+			ailsa_syslog(LOG_ERR, "%s line %u: {{else}} without {{#if}}", file, line);
+			return AILSA_NO_DATA;
+		}
+		if ((i = cbc_tmpl_add_op(p, CBC_TMPL_OP_ELSE)) == 0)
+			return AILSA_NO_DATA;
+		p->other[p->blocks - 1] = i - 1;
+		return 0;
+	}
+	if ((len == 3) && (strncmp(tag, "/if", 3) == 0)) {
+		if ((p->blocks == 0) || (p->tmpl->ops[p->block[p->blocks - 1]].op != CBC_TMPL_OP_IF)) {
+			ailsa_syslog(LOG_ERR, "%s line %u: {{/if}} without {{#if}}", file, line);
+			return AILSA_NO_DATA;
+		}
+		p->blocks--;
+		open = &(p->tmpl->ops[p->block[p->blocks]]);
+		if ((i = p->other[p->blocks]) != 0) {
+			open->jump = i + 1;
+			p->tmpl->ops[i].jump = p->tmpl->total;
+		} else {
+			open->jump = p->tmpl->total;
+		}
+		return 0;
+	}
+	if ((len == 5) && (strncmp(tag, "/each", 5) == 0)) {
+		if ((p->blocks == 0) || (p->tmpl->ops[p->block[p->blocks - 1]].op != CBC_TMPL_OP_EACH)) {
+			ailsa_syslog(LOG_ERR, "%s line %u: {{/each}} without {{#each}}", file, line);
+			return AILSA_NO_DATA;
+		}
+		if ((i = cbc_tmpl_add_op(p, CBC_TMPL_OP_NEXT)) == 0)
+			return AILSA_NO_DATA;
+		p->blocks--;
+		p->loops--;
+		p->tmpl->ops[i - 1].jump = p->block[p->blocks];
+		p->tmpl->ops[p->block[p->blocks]].jump = i;
+		return 0;
+	}
+	if ((len > 4) && (strncmp(tag, "#if ", 4) == 0)) {
+		if (p->blocks == CBC_TMPL_DEPTH) {
+			ailsa_syslog(LOG_ERR, "%s line %u: blocks nested too deep", file, line);
+			return AILSA_NO_DATA;
+		}
+		if ((i = cbc_tmpl_add_op(p, CBC_TMPL_OP_IF)) == 0)
+			return AILSA_NO_DATA;
+		if (cbc_tmpl_test(p, &(p->tmpl->ops[i - 1]), tag + 4, len - 4, line) != 0)
+			return AILSA_NO_DATA;
+		p->other[p->blocks] = 0;
+		p->block[p->blocks++] = i - 1;
+		return 0;
+	}
+	if ((len > 6) && (strncmp(tag, "#each ", 6) == 0)) {
+		tag += 6;
+		len -= 6;
+		while ((*tag == ' ') || (*tag == '\t')) {
+			tag++;
+			len--;
+		}
+		if ((p->blocks == CBC_TMPL_DEPTH) || (p->loops == CBC_TMPL_DEPTH)) {
+			ailsa_syslog(LOG_ERR, "%s line %u: blocks nested too deep", file, line);
+			return AILSA_NO_DATA;
+		}
+		if (!(f = cbc_tmpl_lookup(p, tag, len, &level, line)))
+			return AILSA_NO_DATA;
+		if (f->type != CBC_TMPL_LIST) {
+			ailsa_syslog(LOG_ERR, "%s line %u: %s is not a list", file, line, f->name);
+			return AILSA_NO_DATA;
+		}
+		if ((i = cbc_tmpl_add_op(p, CBC_TMPL_OP_EACH)) == 0)
+			return AILSA_NO_DATA;
+		op = &(p->tmpl->ops[i - 1]);
+		op->field = f;
+		op->level = level;
+		p->block[p->blocks++] = i - 1;
+		p->scope[++p->loops] = f->item;
+		return 0;
+	}
+	if ((*tag == '#') || (*tag == '/')) {
+		ailsa_syslog(LOG_ERR, "%s line %u: unknown block %.*s", file, line, (int)len, tag);
+		return AILSA_NO_DATA;
+	}
+	for (n = 0; n < len; n++) {
+		if ((tag[n] == ' ') || (tag[n] == '\t')) {
+			ailsa_syslog(LOG_ERR, "%s line %u: bad tag %.*s", file, line, (int)len, tag);
+			return AILSA_NO_DATA;
+		}
+	}
+	if (!(f = cbc_tmpl_lookup(p, tag, len, &level, line)))
+		return AILSA_NO_DATA;
+	if ((f->type == CBC_TMPL_LIST) || (f->type == CBC_TMPL_FIRST) || (f->type == CBC_TMPL_LAST)) {
+		ailsa_syslog(LOG_ERR, "%s line %u: %s can only be tested", file, line, f->name);
+		return AILSA_NO_DATA;
+	}
+	if ((i = cbc_tmpl_add_op(p, CBC_TMPL_OP_VAR)) == 0)
+		return AILSA_NO_DATA;
+	op = &(p->tmpl->ops[i - 1]);
+	op->field = f;
+	op->level = level;
+	return 0;
+}
+
+// name, or name == "text", or name != "text"
+static int
+cbc_tmpl_test(cbc_tmpl_parse_s *p, cbc_tmpl_op_s *op, const char *s, size_t len, unsigned int line)
+{
+	const char *end = s + len, *name, *quote;
+	size_t n;
+
+	while ((s < end) && ((*s == ' ') || (*s == '\t')))
+		s++;
+	for (name = s; (s < end) && (*s != ' ') && (*s != '\t') && (*s != '=') && (*s != '!'); s++) ;
+	if (!(op->field = cbc_tmpl_lookup(p, name, (size_t)(s - name), &(op->level), line)))
+		return AILSA_NO_DATA;
+	while ((s < end) && ((*s == ' ') || (*s == '\t')))
+		s++;
+	if (s == end) {
+		op->test = CBC_TMPL_SET;
+		return 0;
+	}
+	if ((end - s > 2) && (strncmp(s, "==", 2) == 0)) {
+		op->test = CBC_TMPL_EQ;
+	} else if ((end - s > 2) && (strncmp(s, "!=", 2) == 0)) {
+		op->test = CBC_TMPL_NE;
+	} else {
+		ailsa_syslog(LOG_ERR, "%s line %u: expected == or != after %s", p->file, line, op->field->name);
+		return AILSA_NO_DATA;
+	}
+	if ((op->field->type == CBC_TMPL_LIST) || (op->field->type == CBC_TMPL_FIRST) || (op->field->type == CBC_TMPL_LAST)) {
+		ailsa_syslog(LOG_ERR, "%s line %u: %s can only be tested as set", p->file, line, op->field->name);
+		return AILSA_NO_DATA;
+	}
+	for (s += 2; (s < end) && ((*s == ' ') || (*s == '\t')); s++) ;
+	n = (size_t)(end - s);
+	if ((n < 2) || (*s != '"') || (s[n - 1] != '"') || ((quote = memchr(s + 1, '"', n - 1)) != s + n - 1)) {
+		ailsa_syslog(LOG_ERR, "%s line %u: expected a quoted string after %s", p->file, line, op->field->name);
+		return AILSA_NO_DATA;
+	}
+	op->text = s + 1;
+	op->len = n - 2;
+	return 0;
+}
+
+// Returns one past the index of the new op, so 0 is failure
+static size_t
+cbc_tmpl_add_op(cbc_tmpl_parse_s *p, short int type)
+{
+	cbc_tmpl_s *t = p->tmpl;
+
+	if (t->total == p->size) {
+		p->size *= 2;
+		t->ops = ailsa_realloc(t->ops, sizeof(cbc_tmpl_op_s) * p->size, "t->ops in cbc_tmpl_add_op");
+	}
+	memset(&(t->ops[t->total]), 0, sizeof(cbc_tmpl_op_s));
+	t->ops[t->total].op = type;
+	return ++t->total;
+}
+
+// The innermost loop is searched first, then each one out to the context
+static const cbc_tmpl_field_s *
+cbc_tmpl_lookup(cbc_tmpl_parse_s *p, const char *name, size_t len, unsigned int *level, unsigned int line)
+{
+	unsigned int i = p->loops + 1;
+	const cbc_tmpl_field_s *f;
+
+	while (i-- > 0) {
+		for (f = p->scope[i]; f && f->name; f++) {
+			if ((strlen(f->name) == len) && (strncmp(f->name, name, len) == 0)) {
+				*level = i;
+				return f;
+			}
+		}
+		if ((i == p->loops) && (i > 0)) {
+			for (f = cbc_tmpl_loop; f->name; f++) {
+				if ((strlen(f->name) == len) && (strncmp(f->name, name, len) == 0)) {
+					*level = i;
+					return f;
+				}
+			}
+		}
+	}
+	ailsa_syslog(LOG_ERR, "%s line %u: unknown name %.*s", p->file, line, (int)len, name);
+	return NULL;
+}
+
+static const char *
+cbc_tmpl_value(const cbc_tmpl_op_s *op, const void **base, char *num)
+{
+	const char *b = base[op->level];
+	const char *text = NULL;
+	const ailsa_data_s *d;
+
+	switch (op->field->type) {
+	case CBC_TMPL_TEXT:
+		text = *(char * const *)(b + op->field->offset);
+		break;
+	case CBC_TMPL_NUMBER:
+		snprintf(num, CBC_TMPL_NUM, "%lu", *(const unsigned long int *)(b + op->field->offset));
+		text = num;
+		break;
+	case CBC_TMPL_SHORT:
+		snprintf(num, CBC_TMPL_NUM, "%hd", *(const short int *)(b + op->field->offset));
+		text = num;
+		break;
+	case CBC_TMPL_DATA:
+		d = (const ailsa_data_s *)b;
+		if (d->type == AILSA_DB_TEXT) {
+			text = d->data->text;
+		} else {
+			snprintf(num, CBC_TMPL_NUM, "%lu", d->data->number);
+			text = num;
+		}
+		break;
+	}
+	return (text) ? text : "";
+}
+
+static int
+cbc_tmpl_true(const cbc_tmpl_op_s *op, const void **base, AILELEM **elem)
+{
+	char num[CBC_TMPL_NUM];
+	const char *b = base[op->level];
+	const char *value;
+	const AILLIST *list;
+	int set;
+
+	switch (op->field->type) {
+	case CBC_TMPL_LIST:
+		list = *(AILLIST * const *)(b + op->field->offset);
+		return (list) && (list->total > 0);
+	case CBC_TMPL_FIRST:
+		return elem[op->level]->prev == NULL;
+	case CBC_TMPL_LAST:
+		return elem[op->level]->next == NULL;
+	}
+	value = cbc_tmpl_value(op, base, num);
+	if (op->test == CBC_TMPL_SET) {
+		if ((op->field->type == CBC_TMPL_NUMBER) || (op->field->type == CBC_TMPL_SHORT))
+			return strcmp(value, "0") != 0;
+		return *value != '\0';
+	}
+	set = (strlen(value) == op->len) && (strncmp(value, op->text, op->len) == 0);
+	return (op->test == CBC_TMPL_EQ) ? set : !(set);
+}
+
+static void
+cbc_tmpl_put(ailsa_string_s *out, const char *text, size_t len)
+{
+	while (out->len + len >= out->size)
+		ailsa_resize_string(out);
+	memcpy(out->string + out->len, text, len);
+	out->len += len;
+	out->string[out->len] = '\0';
+}
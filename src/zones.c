@@ -39,12 +39,85 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <errno.h>
+#include <pthread.h>
 #include <ailsacmdb.h>
 #include <ailsasql.h>
 #include "cmdb_dnsa.h"
 
+typedef struct cmdb_rev_key_s {	// Forward or reverse record in a reconciliation index
+	unsigned char ip[16];		// IPv4 in the first 4 bytes
+	char *fqdn;
+} cmdb_rev_key_s;
+
+typedef struct cmdb_rev_aaaa_s {	// AAAA records that fall in an IPv6 reverse zone
+	AILLIST *rec;
+	unsigned char net[16];
+	unsigned long int prefix;
+} cmdb_rev_aaaa_s;
+
+typedef struct cmdb_commit_zone_s {	// A zone as it stood at the last commit
+	char *name;
+	char *stamp;
+} cmdb_commit_zone_s;
+
+typedef struct cmdb_zone_job_s {	// One zone for the commit workers
+	char *zone;
+	char *type;
+	unsigned long int prefix;
+	int retval;
+	short int changed;		// Content, and so the serial, changed
+	short int frozen;		// Dynamic zone frozen for the rewrite
+	short int unsent;		// Records changed since named last had the zone
+	char stamp[DOMAIN_LEN];
+} cmdb_zone_job_s;
+
+typedef struct cmdb_zone_pool_s {	// Shared by the commit workers
+	ailsa_cmdb_s *dc;
+	cmdb_zone_job_s *job;
+	size_t total;
+	size_t next;
+	int type;
+	pthread_mutex_t lock;
+} cmdb_zone_pool_s;
+
+typedef struct cmdb_multi_a_zone_s {	// Reverse zone in a duplicate IP report
+	char *range;
+	unsigned long int prefix;
+	u_int32_t start;
+	u_int32_t finish;
+	short int wanted;
+} cmdb_multi_a_zone_s;
+
+typedef struct cmdb_multi_a_s {		// IP address with more than one A record
+	u_int32_t ip;
+	size_t zone;
+	unsigned long int count;
+	char *dest;
+	char *fqdn;			// Preferred A record, if there is one
+} cmdb_multi_a_s;
+
+typedef struct cmdb_multi_a_scan_s {	// Built from one scan of records and preferred_a
+	cmdb_multi_a_zone_s *zone;
+	size_t zones;
+	cmdb_multi_a_s *dup;
+	size_t total;
+	size_t size;
+} cmdb_multi_a_scan_s;
+
+enum {
+	CMDB_COMMIT_BUCKETS = 1021,
+	CMDB_MULTI_A_CHUNK = 256
+};
+
+// Kept in the zone file directory; delete one to force a full commit
+static const char *fwd_commit_state = ".dnsa-fwd.state";
+static const char *rev_commit_state = ".dnsa-rev.state";
+
 static void
-print_fwd_zone_records(AILLIST *r);
+print_fwd_zone_records(ailsa_result_s *r);
+
+static int
+print_zone_row(ailsa_result_s *r, void *ctx);
 
 static void
 print_fwd_ns_mx_srv_records(char *zone, AILLIST *m);
@@ -62,10 +135,22 @@ static int
 multi_a_range(ailsa_cmdb_s *cbc, dnsa_comm_line_s *dcl);
 
 static int
-setup_net_range(ailsa_cmdb_s *dc, char *domain, char *range);
+multi_a_zone_row(ailsa_result_s *r, void *ctx);
+
+static int
+multi_a_select_zones(cmdb_multi_a_scan_s *scan, char *ranges);
+
+static int
+multi_a_dup_row(ailsa_result_s *r, void *ctx);
+
+static int
+multi_a_zone_cmp(const void *one, const void *two);
 
 static int
-get_search_net_range(char *range, char *domain, unsigned long int prefix);
+multi_a_dup_cmp(const void *one, const void *two);
+
+static void
+multi_a_clean(cmdb_multi_a_scan_s *scan);
 
 static int
 multi_a_ip_address(ailsa_cmdb_s *cbc, dnsa_comm_line_s *dcl);
@@ -76,6 +161,9 @@ fill_rev_records(AILLIST *list, AILLIST *rev, unsigned long int index);
 static int
 fill_fwd_records(AILLIST *list, AILLIST *rev, unsigned long int index);
 
+static int
+fill_fwd_ipv6_record(ailsa_result_s *r, void *ctx);
+
 static int
 fill_pref_records(AILLIST *list, AILLIST *pref);
 
@@ -98,7 +186,67 @@ static int
 cmdb_records_to_add(char *range, unsigned long int zone_id, unsigned long int prefix, AILLIST *rec, AILLIST *rev, AILLIST *add);
 
 static int
-cmdb_get_rev_dest_from_search(char *search, char *dest, char *fqdn);
+cmdb_rev_zone_prefixes(char *range, unsigned long int prefix, unsigned long int index, char **pre);
+
+static int
+cmdb_rev_zone_window(char *range, unsigned long int prefix, unsigned long int index, unsigned long int i, unsigned long int *start, unsigned long int *end);
+
+static void
+cmdb_fwd_record_fqdn(ailsa_record_s *forward, char *fqdn);
+
+static int
+cmdb_rev_key_insert(AILHASH *index, const char *ip, const char *fqdn);
+
+static int
+cmdb_rev_key_find(AILHASH *index, const char *ip, char *fqdn);
+
+static int
+cmdb_rev_key_addr(const char *ip, unsigned char *addr);
+
+static int
+cmdb_rev_key_match(const void *one, const void *two);
+
+static void
+cmdb_rev_key_clean(void *data);
+
+static int
+cmdb_pref_match(const void *one, const void *two);
+
+static int
+cmdb_commit_state_read(ailsa_cmdb_s *dc, const char *file, AILHASH *last);
+
+static FILE *
+cmdb_commit_state_open(ailsa_cmdb_s *dc, const char *file);
+
+static int
+cmdb_commit_state_close(ailsa_cmdb_s *dc, const char *file, FILE *state, int keep);
+
+static cmdb_commit_zone_s *
+cmdb_commit_zone_last(AILHASH *last, char *zone);
+
+static int
+cmdb_commit_zone_dirty(ailsa_cmdb_s *dc, cmdb_commit_zone_s *old, char *zone, const char *type, const char *updated, const char *stamp);
+
+static void
+cmdb_commit_stamp(AILELEM *e, size_t n, char *stamp);
+
+static int
+cmdb_commit_zone_match(const void *one, const void *two);
+
+static void
+cmdb_validate_zones(ailsa_cmdb_s *dc, int type, cmdb_zone_job_s *job, size_t total);
+
+static void *
+cmdb_zone_worker(void *data);
+
+static void *
+cmdb_zone_thread(void *data);
+
+static void
+cmdb_commit_zone_clean(void *data);
+
+static void
+cmdb_commit_freeze(ailsa_cmdb_s *dc, cmdb_zone_job_s *job, size_t total, const char *command);
 
 static int
 dnsa_populate_record(ailsa_cmdb_s *cbc, dnsa_comm_line_s *dcl, AILLIST *list);
@@ -119,56 +267,50 @@ void
 list_zones(ailsa_cmdb_s *dc)
 {
 	int retval;
-	size_t total = 5;
-	size_t len;
-	AILLIST *z = ailsa_db_data_list_init();
-	AILELEM *e;
-	char *zone, *valid, *type, *master;
-	unsigned long int serial;
+	size_t rows = 0;
 
-	if ((retval = ailsa_basic_query(dc, ZONE_INFORMATION, z)) != 0) {
-		ailsa_syslog(LOG_ERR, "ZONE_INFORMATION query failed");
-		goto cleanup;
-	}
-	if (z->total == 0) {
-		ailsa_syslog(LOG_INFO, "No forward zones found in the database");
-		goto cleanup;
-	}
-	if ((z->total % total) != 0) {
-		ailsa_syslog(LOG_ERR, "Wanted %zu list factor; list contains %zu", total, z->total);
-		goto cleanup;
-	}
-	e = z->head;
 	printf("Listing zones from database %s on %s\n", dc->db, dc->dbtype);
 	printf("Name\t\t\t\tValid\tSerial\t\tType\tMaster\n");
-	while (e) {
-		zone = ((ailsa_data_s *)e->data)->data->text;
-		valid = ((ailsa_data_s *)e->next->data)->data->text;
-		serial = ((ailsa_data_s *)e->next->next->data)->data->number;
-		type = ((ailsa_data_s *)e->next->next->next->data)->data->text;
-		master = ((ailsa_data_s *)e->next->next->next->next->data)->data->text;
-		len = strlen(zone);
-		if (len < 8)
-			printf("%s\t\t\t\t", zone);
-		else if (len < 16)
-			printf("%s\t\t\t", zone);
-		else if (len < 24)
-			printf("%s\t\t", zone);
-		else if (len < 32)
-			printf("%s\t", zone);
-		else
-			printf("%s\n\t\t\t\t", zone);
-		printf("%s\t%lu\t%s\t", valid, serial, type);
-		if (master)
-			printf("%s", master);
-		else
-			printf("N/A");
-		printf("\n");
-		e = ailsa_move_down_list(e, total);
-	}
-	cleanup:
-		ailsa_list_full_clean(z);
-		return;
+	if ((retval = ailsa_query_foreach(dc, ZONE_INFORMATION, NULL, print_zone_row, &rows)) != 0)
+		ailsa_syslog(LOG_ERR, "ZONE_INFORMATION query failed");
+	else if (rows == 0)
+		ailsa_syslog(LOG_INFO, "No forward zones found in the database");
+}
+
+static int
+print_zone_row(ailsa_result_s *r, void *ctx)
+{
+	size_t len, *rows = ctx;
+	const char *zone, *valid, *type, *master;
+
+	if (r->cols != 5) {
+		ailsa_syslog(LOG_ERR, "Wanted 5 columns; query returned %zu", r->cols);
+		return AILSA_WRONG_LIST_LENGHT;
+	}
+	if (!(zone = ailsa_result_text(r, 0, 0)))
+		return 0;
+	valid = ailsa_result_text(r, 0, 1);
+	type = ailsa_result_text(r, 0, 3);
+	master = ailsa_result_text(r, 0, 4);
+	len = strlen(zone);
+	if (len < 8)
+		printf("%s\t\t\t\t", zone);
+	else if (len < 16)
+		printf("%s\t\t\t", zone);
+	else if (len < 24)
+		printf("%s\t\t", zone);
+	else if (len < 32)
+		printf("%s\t", zone);
+	else
+		printf("%s\n\t\t\t\t", zone);
+	printf("%s\t%lu\t%s\t", valid, ailsa_result_number(r, 0, 2), type);
+	if (master)
+		printf("%s", master);
+	else
+		printf("N/A");
+	printf("\n");
+	(*rows)++;
+	return 0;
 }
 
 void
@@ -236,9 +378,9 @@ display_zone(char *zone, ailsa_cmdb_s *dc)
 		return;
 	AILLIST *g = ailsa_db_data_list_init();
 	AILLIST *m = ailsa_db_data_list_init();
-	AILLIST *r = ailsa_db_data_list_init();
 	AILLIST *s = ailsa_db_data_list_init();
 	AILLIST *z = ailsa_db_data_list_init();
+	ailsa_result_s *r = ailsa_result_init();
 
 	if ((retval = cmdb_add_string_to_list(zone, z)) != 0) {
 		ailsa_syslog(LOG_ERR, "Cannot add zone name to list");
@@ -252,7 +394,7 @@ display_zone(char *zone, ailsa_cmdb_s *dc)
 		ailsa_syslog(LOG_INFO, "zone %s not found in DB", zone);
 		goto cleanup;
 	}
-	if ((retval = ailsa_argument_query(dc, ZONE_RECORDS_ON_NAME, z, r)) != 0) {
+	if ((retval = ailsa_argument_query_result(dc, ZONE_RECORDS_ON_NAME, z, r)) != 0) {
 		ailsa_syslog(LOG_ERR, "ZONE_RECORDS_ON_NAME query failed");
 		goto cleanup;
 	}
@@ -271,9 +413,9 @@ display_zone(char *zone, ailsa_cmdb_s *dc)
 	cleanup:
 		ailsa_list_full_clean(g);
 		ailsa_list_full_clean(m);
-		ailsa_list_full_clean(r);
 		ailsa_list_full_clean(s);
 		ailsa_list_full_clean(z);
+		ailsa_result_clean(r);
 		return;
 }
 
@@ -362,27 +504,25 @@ print_fwd_ns_mx_srv_records(char *zone, AILLIST *m)
 }
 
 static void
-print_fwd_zone_records(AILLIST *r)
+print_fwd_zone_records(ailsa_result_s *r)
 {
 	if (!(r))
 		return;
-	size_t total = 3;
-	size_t len;
-	AILELEM *e = r->head;
-	char *type, *host, *dest;
+	size_t i, len;
+	const char *type, *host, *dest;
 
-	if (r->total == 0) {
+	if (r->rows == 0) {
 		ailsa_syslog(LOG_INFO, "No forward records for this zone");
 		return;
 	}
-	if ((r->total % total) != 0) {
-		ailsa_syslog(LOG_ERR, "Wrong factor in list. wanted %zu, got %zu", total, r->total);
+	if (r->cols != 3) {
+		ailsa_syslog(LOG_ERR, "Wrong number of columns. wanted 3, got %zu", r->cols);
 		return;
 	}
-	while (e) {
-		type = ((ailsa_data_s *)e->data)->data->text;
-		host = ((ailsa_data_s *)e->next->data)->data->text;
-		dest = ((ailsa_data_s *)e->next->next->data)->data->text;
+	for (i = 0; i < r->rows; i++) {
+		if (!(type = ailsa_result_text(r, i, 0)) || !(host = ailsa_result_text(r, i, 1)) ||
+		    !(dest = ailsa_result_text(r, i, 2)))
+			continue;
 		len = strlen(host);
 		if (len >= 24)
 			printf("%s\n\t\t\tIN\t%s\t%s\n", host, type, dest);
@@ -392,7 +532,6 @@ print_fwd_zone_records(AILLIST *r)
 			printf("%s\t\tIN\t%s\t%s\n", host, type, dest);
 		else
 			printf("%s\t\t\tIN\t%s\t%s\n", host, type, dest);
-		e = ailsa_move_down_list(e, total);
 	}
 }
 
@@ -402,7 +541,7 @@ display_rev_zone(char *domain, ailsa_cmdb_s *dc)
 	if (!(domain) || !(dc))
 		return;
 	int retval;
-	char in_addr[MAC_LEN];
+	char in_addr[HOST_LEN];
 	unsigned long int prefix;
 	AILLIST *i = ailsa_db_data_list_init();
 	AILLIST *l = ailsa_db_data_list_init();
@@ -411,7 +550,7 @@ display_rev_zone(char *domain, ailsa_cmdb_s *dc)
 	AILELEM *e;
 	ailsa_data_s *d;
 
-	memset(in_addr, 0, MAC_LEN);
+	memset(in_addr, 0, HOST_LEN);
 	if ((retval = cmdb_add_string_to_list(domain, l)) != 0)
 		goto cleanup;
 	if ((retval = ailsa_argument_query(dc, REV_ZONE_INFO_ON_RANGE, l, z)) != 0)
@@ -464,10 +603,16 @@ print_rev_zone_records(AILLIST *r)
 		return;
 	AILELEM *e = r->head;
 	ailsa_data_s *d;
+	char addr[INET6_ADDRSTRLEN];
+	unsigned char ip[16];
 
 	while (e) {
 		d = e->data;
-		printf("%s\t", d->data->text);
+// IPv6 hosts are packed addresses; show them as addresses
+		if ((convert_hex_ipv6_to_bin(ip, d->data->text) == 0) && (inet_ntop(AF_INET6, ip, addr, INET6_ADDRSTRLEN)))
+			printf("%s\t", addr);
+		else
+			printf("%s\t", d->data->text);
 		e = e->next;
 		d = e->data;
 		printf("%s\n", d->data->text);
@@ -478,86 +623,118 @@ print_rev_zone_records(AILLIST *r)
 int
 check_zone(char *domain, ailsa_cmdb_s *dc)
 {
-	char *command, syscom[CONFIG_LEN];
-	int retval;
-	
-	command = &syscom[0];
-	
-	snprintf(command, CONFIG_LEN, "%s %s %s%s", dc->chkz, domain, dc->dir, domain);
-	retval = system(syscom);
-	if (retval != 0)
-		retval = AILSA_CHKZONE_FAIL;
-	return retval;
+	char file[DOMAIN_LEN + DOMAIN_LEN];
+
+	snprintf(file, sizeof(file), "%s%s", dc->dir, domain);
+	return ailsa_check_zone_file(domain, file);
 }
 
+// Only zones changed since the last commit are written, checked and reloaded
 int
 commit_fwd_zones(ailsa_cmdb_s *dc, char *name)
 {
 	if (!(dc))
 		return AILSA_NO_DATA;
 	int retval;
-	size_t len = 2;
-	char *zone, *type;
-	char *command = ailsa_calloc(CONFIG_LEN, "command in commit_fwd_zones");
-	AILLIST *l = ailsa_db_data_list_init();
+	size_t i, len = 5;
+	unsigned int changed = 0, seen = 0, reconfig = 0, invalid = 0;
+	char *zone, *type, *updated;
+	char stamp[DOMAIN_LEN];
 	AILLIST *r = ailsa_db_data_list_init();
+	AILLIST *names = ailsa_db_data_list_init();
 	AILELEM *e;
+	AILHASH last;
+	FILE *state = NULL;
+	cmdb_commit_zone_s *old;
+	cmdb_zone_job_s *job = NULL;
 
-	if (name) {
-		zone = name;
-		if ((retval = cmdb_add_string_to_list(zone, l)) != 0) {
-			ailsa_syslog(LOG_ERR, "Cannot add zone name to list");
-			goto cleanup;
-		}
-		if ((retval = ailsa_argument_query(dc, ZONE_TYPE_ON_NAME, l, r)) != 0) {
-			ailsa_syslog(LOG_ERR, "ZONE_TYPE_ON_NAME query failed");
-			goto cleanup;
-		}
-		if (r->total == 0) {
-			ailsa_syslog(LOG_INFO, "zone %s not found in database");
-			goto cleanup;
-		}
-		e = r->head;
-		type = ((ailsa_data_s *)e->data)->data->text;
-		if ((retval = cmdb_validate_zone(dc, FORWARD_ZONE, zone, type, 0)) != 0) {
-			ailsa_syslog(LOG_ERR, "Cannot validate zone %s", zone);
-			goto cleanup;
-		}
-	} else {
-		if ((retval = ailsa_basic_query(dc, ZONE_NAME_TYPES, r)) != 0) {
-			ailsa_syslog(LOG_ERR, "ZONE_NAME_TYPES query failed");
-			goto cleanup;
+	ailsa_hash_init(&last, CMDB_COMMIT_BUCKETS, ailsa_hash, cmdb_commit_zone_match, cmdb_commit_zone_clean);
+	if ((retval = cmdb_commit_state_read(dc, fwd_commit_state, &last)) != 0)
+		goto cleanup;
+	if ((retval = ailsa_basic_query(dc, FWD_ZONE_COMMIT_STATE, r)) != 0) {
+		ailsa_syslog(LOG_ERR, "FWD_ZONE_COMMIT_STATE query failed");
+		goto cleanup;
+	}
+	if (r->total == 0) {
+		ailsa_syslog(LOG_INFO, "No zones found in database");
+		goto cleanup;
+	}
+	if ((r->total % len) != 0) {
+		ailsa_syslog(LOG_ERR, "FWD_ZONE_COMMIT_STATE wrong factor. wanted %zu got total %zu", len, r->total);
+		retval = AILSA_WRONG_LIST_LENGHT;
+		goto cleanup;
+	}
+	if (!(state = cmdb_commit_state_open(dc, fwd_commit_state))) {
+		retval = AILSA_FILE_ERROR;
+		goto cleanup;
+	}
+	job = ailsa_calloc(sizeof(cmdb_zone_job_s) * (r->total / len), "job in commit_fwd_zones");
+	e = r->head;
+	while (e) {
+		zone = ((ailsa_data_s *)e->data)->data->text;
+		updated = ((ailsa_data_s *)e->next->data)->data->text;
+		type = ((ailsa_data_s *)e->next->next->data)->data->text;
+		cmdb_commit_stamp(e->next->next, 3, stamp);
+		if ((old = cmdb_commit_zone_last(&last, zone)))
+			seen++;
+		if ((name) ? (strncmp(name, zone, DOMAIN_LEN) == 0) : cmdb_commit_zone_dirty(dc, old, zone, type, updated, stamp)) {
+			job[changed].zone = zone;
+			job[changed].type = type;
+			snprintf(job[changed].stamp, DOMAIN_LEN, "%s", stamp);
+			job[changed].unsent = (old) && (strncmp(old->stamp, stamp, DOMAIN_LEN) != 0);
+			if (!(old) || (strcmp(type, "master") != 0))
+				reconfig++;
+			else if ((dc->update_key) && (dc->rndc_key))
+				job[changed].frozen = 1;
+			changed++;
+		} else if (old) {
+			fprintf(state, "%s\t%s\n", zone, old->stamp);
 		}
-		if (r->total == 0) {
-			ailsa_syslog(LOG_INFO, "No zones found in database");
-			goto cleanup;
+		e = ailsa_move_down_list(e, len);
+	}
+	cmdb_commit_freeze(dc, job, changed, "freeze");
+	cmdb_validate_zones(dc, FORWARD_ZONE, job, changed);
+	cmdb_commit_freeze(dc, job, changed, "thaw");
+// An invalid zone drops out of the config and is retried on the next commit.
+// A zone whose last reload failed is unchanged on disk but still unsent
+	for (i = 0; i < changed; i++) {
+		if (job[i].retval != 0) {
+			ailsa_syslog(LOG_ERR, "Cannot validate zone %s", job[i].zone);
+			invalid++;
+			reconfig++;
+			continue;
 		}
-		if ((r->total % len) != 0) {
-			ailsa_syslog(LOG_ERR, "ZONE_NAME_TYPES wrong factor. wanted %zu got total %zu", len, r->total);
+		fprintf(state, "%s\t%s\n", job[i].zone, job[i].stamp);
+		if (((job[i].changed > 0) || (job[i].unsent > 0)) && (job[i].frozen == 0) && ((retval = cmdb_add_string_to_list(job[i].zone, names)) != 0))
 			goto cleanup;
-		}
-		e = r->head;
-		while (e) {
-			zone = ((ailsa_data_s *)e->data)->data->text;
-			type = ((ailsa_data_s *)e->next->data)->data->text;
-			if ((retval = cmdb_validate_zone(dc, FORWARD_ZONE, zone, type, 0)) != 0) {
-				ailsa_syslog(LOG_ERR, "Cannot validate zone %s", zone);
-			}
-			e = ailsa_move_down_list(e, len);
-		}
+	}
+	if ((name) && (changed == 0)) {
+		ailsa_syslog(LOG_INFO, "zone %s not found in database", name);
+		goto cleanup;
+	}
+	if ((reconfig == 0) && (names->total == 0) && (seen == last.size)) {
+		ailsa_syslog(LOG_INFO, "No zone content changed since the last commit");
+		goto cleanup;
 	}
 	if ((retval = cmdb_write_fwd_zone_config(dc)) != 0) {
 		ailsa_syslog(LOG_ERR, "Cannot write out forward zone configuration");
 		goto cleanup;
 	}
-	snprintf(command, CONFIG_LEN, "%s reload", dc->rndc);
-	if ((retval = system(command)) != 0)
-		ailsa_syslog(LOG_ERR, "Reload of nameserver failed");
+	if ((retval = cmdb_check_zone_config(dc, dc->dnsa)) != 0) {
+		ailsa_syslog(LOG_ERR, "Final check of forward zones failed; not reloading");
+		goto cleanup;
+	}
+	retval = ailsa_rndc_reload(dc, names, (reconfig > 0) || (seen < last.size));
 
 	cleanup:
-		ailsa_list_full_clean(l);
+		if ((state) && (cmdb_commit_state_close(dc, fwd_commit_state, state, (retval == 0) && ((changed > 0) || (seen < last.size))) != 0) && (retval == 0))
+			retval = AILSA_FILE_ERROR;
+		if ((retval == 0) && (invalid > 0))
+			retval = AILSA_CHKZONE_FAIL;
+		ailsa_hash_destroy(&last);
 		ailsa_list_full_clean(r);
-		my_free(command);
+		ailsa_list_full_clean(names);
+		my_free(job);
 		return retval;
 }
 
@@ -567,52 +744,339 @@ commit_rev_zones(ailsa_cmdb_s *dc, char *name)
 	if (!(dc))
 		return AILSA_NO_DATA;
 	int retval;
-	char *comm = ailsa_calloc(DOMAIN_LEN, "comm in commit_rev_zones");
-	char *zone, *type;
-	unsigned long int prefix;
+	size_t i, len = 6;
+	unsigned int changed = 0, seen = 0, reconfig = 0, invalid = 0;
+	char *zone, *type, *updated;
+	char stamp[DOMAIN_LEN];
 	AILLIST *l = ailsa_db_data_list_init();
+	AILLIST *names = ailsa_db_data_list_init();
 	AILELEM *e;
-	ailsa_data_s *d;
+	AILHASH last;
+	FILE *state = NULL;
+	cmdb_commit_zone_s *old;
+	cmdb_zone_job_s *job = NULL;
 
-	if ((retval = ailsa_basic_query(dc, REV_ZONES_NET_RANGE, l)) != 0) {
-		ailsa_syslog(LOG_ERR, "REV_ZONES_NET_RANGE query failed");
+	ailsa_hash_init(&last, CMDB_COMMIT_BUCKETS, ailsa_hash, cmdb_commit_zone_match, cmdb_commit_zone_clean);
+	if ((retval = cmdb_commit_state_read(dc, rev_commit_state, &last)) != 0)
+		goto cleanup;
+	if ((retval = ailsa_basic_query(dc, REV_ZONE_COMMIT_STATE, l)) != 0) {
+		ailsa_syslog(LOG_ERR, "REV_ZONE_COMMIT_STATE query failed");
 		goto cleanup;
 	}
 	if (l->total == 0) {
 		ailsa_syslog(LOG_INFO, "No reverse zones were found");
 		goto cleanup;
 	}
+	if ((l->total % len) != 0) {
+		ailsa_syslog(LOG_ERR, "REV_ZONE_COMMIT_STATE wrong factor. wanted %zu got total %zu", len, l->total);
+		retval = AILSA_WRONG_LIST_LENGHT;
+		goto cleanup;
+	}
+	if (!(state = cmdb_commit_state_open(dc, rev_commit_state))) {
+		retval = AILSA_FILE_ERROR;
+		goto cleanup;
+	}
+	job = ailsa_calloc(sizeof(cmdb_zone_job_s) * (l->total / len), "job in commit_rev_zones");
 	e = l->head;
 	while (e) {
-		d = e->data;
-		zone = d->data->text;
-		d = e->next->data;
-		type = d->data->text;
-		d = e->next->next->data;
-		prefix = strtoul(d->data->text, NULL, 10);
-		if (name) {
-			if (strncmp(name, zone, DOMAIN_LEN) == 0)
-				if ((retval = cmdb_validate_zone(dc, REVERSE_ZONE, zone, type, prefix)) != 0)
-					ailsa_syslog(LOG_ERR, "Unable to validate zone %s");
-		} else {
-			if ((retval = cmdb_validate_zone(dc, REVERSE_ZONE, zone, type, prefix)) != 0)
-				ailsa_syslog(LOG_ERR, "Unable to validate zone %s", zone);
+		zone = ((ailsa_data_s *)e->data)->data->text;
+		updated = ((ailsa_data_s *)e->next->data)->data->text;
+		type = ((ailsa_data_s *)e->next->next->data)->data->text;
+		cmdb_commit_stamp(e->next->next, 4, stamp);
+		if ((old = cmdb_commit_zone_last(&last, zone)))
+			seen++;
+		if ((name) ? (strncmp(name, zone, DOMAIN_LEN) == 0) : cmdb_commit_zone_dirty(dc, old, zone, type, updated, stamp)) {
+			job[changed].zone = zone;
+			job[changed].type = type;
+			job[changed].prefix = strtoul(((ailsa_data_s *)e->next->next->next->data)->data->text, NULL, 10);
+			snprintf(job[changed].stamp, DOMAIN_LEN, "%s", stamp);
+			job[changed].unsent = (old) && (strncmp(old->stamp, stamp, DOMAIN_LEN) != 0);
+			if (!(old) || (strcmp(type, "master") != 0))
+				reconfig++;
+			changed++;
+		} else if (old) {
+			fprintf(state, "%s\t%s\n", zone, old->stamp);
 		}
-		e = ailsa_move_down_list(e, 3);
+		e = ailsa_move_down_list(e, len);
+	}
+	cmdb_validate_zones(dc, REVERSE_ZONE, job, changed);
+	for (i = 0; i < changed; i++) {
+		if (job[i].retval != 0) {
+			ailsa_syslog(LOG_ERR, "Unable to validate zone %s", job[i].zone);
+			invalid++;
+			reconfig++;
+			continue;
+		}
+		fprintf(state, "%s\t%s\n", job[i].zone, job[i].stamp);
+		if (((job[i].changed > 0) || (job[i].unsent > 0)) && ((retval = cmdb_rev_zone_names(job[i].zone, job[i].prefix, names)) != 0))
+			goto cleanup;
+	}
+	if ((name) && (changed == 0)) {
+		ailsa_syslog(LOG_INFO, "Reverse zone %s not found in database", name);
+		goto cleanup;
+	}
+	if ((reconfig == 0) && (names->total == 0) && (seen == last.size)) {
+		ailsa_syslog(LOG_INFO, "No reverse zone content changed since the last commit");
+		goto cleanup;
 	}
 	if ((retval = cmdb_write_rev_zone_config(dc)) != 0) {
 		ailsa_syslog(LOG_ERR, "Unable to create reverse config");
 		goto cleanup;
 	}
-	snprintf(comm, CONFIG_LEN, "%s reload", dc->rndc);
-	if ((retval = system(comm)) != 0)
-		ailsa_syslog(LOG_ERR, "Reload of nameserver failed");
+	if ((retval = cmdb_check_zone_config(dc, dc->rev)) != 0) {
+		ailsa_syslog(LOG_ERR, "Final check of reverse zones failed; not reloading");
+		goto cleanup;
+	}
+	retval = ailsa_rndc_reload(dc, names, (reconfig > 0) || (seen < last.size));
 	cleanup:
+		if ((state) && (cmdb_commit_state_close(dc, rev_commit_state, state, (retval == 0) && ((changed > 0) || (seen < last.size))) != 0) && (retval == 0))
+			retval = AILSA_FILE_ERROR;
+		if ((retval == 0) && (invalid > 0))
+			retval = AILSA_CHKZONE_FAIL;
+		ailsa_hash_destroy(&last);
 		ailsa_list_full_clean(l);
-		my_free(comm);
+		ailsa_list_full_clean(names);
+		my_free(job);
 		return retval;
 }
 
+// A missing state file just means every zone is committed
+static int
+cmdb_commit_state_read(ailsa_cmdb_s *dc, const char *file, AILHASH *last)
+{
+	char path[DOMAIN_LEN], line[DOMAIN_LEN * 2];
+	char *tab, *nl;
+	FILE *state;
+	cmdb_commit_zone_s *z;
+
+	if ((snprintf(path, DOMAIN_LEN, "%s%s", dc->dir, file)) >= DOMAIN_LEN)
+		ailsa_syslog(LOG_INFO, "Path truncated in cmdb_commit_state_read");
+	if (!(state = fopen(path, "r")))
+		return 0;
+	while (fgets(line, (int)sizeof(line), state)) {
+		if (!(tab = strchr(line, '\t')))
+			continue;
+		*tab = '\0';
+		if ((nl = strchr(++tab, '\n')))
+			*nl = '\0';
+		z = ailsa_calloc(sizeof(cmdb_commit_zone_s), "z in cmdb_commit_state_read");
+		z->name = strndup(line, DOMAIN_LEN);
+		z->stamp = strndup(tab, DOMAIN_LEN);
+		if (ailsa_hash_insert(last, z, z->name) != 0)
+			cmdb_commit_zone_clean(z);
+	}
+	fclose(state);
+	return 0;
+}
+
+static FILE *
+cmdb_commit_state_open(ailsa_cmdb_s *dc, const char *file)
+{
+	char path[DOMAIN_LEN + BYTE_LEN];
+	FILE *state;
+
+	if ((snprintf(path, DOMAIN_LEN + BYTE_LEN, "%s%s.new", dc->dir, file)) >= DOMAIN_LEN + BYTE_LEN)
+		ailsa_syslog(LOG_INFO, "Path truncated in cmdb_commit_state_open");
+	if (!(state = fopen(path, "w")))
+		ailsa_syslog(LOG_ERR, "Cannot open %s: %s", path, strerror(errno));
+	return state;
+}
+
+// The new state only replaces the old once the nameserver has the zones
+static int
+cmdb_commit_state_close(ailsa_cmdb_s *dc, const char *file, FILE *state, int keep)
+{
+	char path[DOMAIN_LEN], new[DOMAIN_LEN + BYTE_LEN];
+	int retval = 0;
+
+	snprintf(path, DOMAIN_LEN, "%s%s", dc->dir, file);
+	snprintf(new, DOMAIN_LEN + BYTE_LEN, "%s.new", path);
+	if ((fclose(state) != 0) && (keep)) {
+		ailsa_syslog(LOG_ERR, "Cannot write %s: %s", new, strerror(errno));
+		keep = 0;
+		retval = AILSA_FILE_ERROR;
+	}
+	if (!(keep)) {
+		unlink(new);
+	} else if (rename(new, path) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot rename %s: %s", new, strerror(errno));
+		unlink(new);
+		retval = AILSA_FILE_ERROR;
+	}
+	return retval;
+}
+
+static cmdb_commit_zone_s *
+cmdb_commit_zone_last(AILHASH *last, char *zone)
+{
+	cmdb_commit_zone_s probe;
+	void *data = &probe;
+
+	probe.name = zone;
+	if (ailsa_hash_lookup(last, &data, zone) != 0)
+		return NULL;
+	return data;
+}
+
+// Changed records move the count or the newest mtime; dnsa also flags the zone updated
+static int
+cmdb_commit_zone_dirty(ailsa_cmdb_s *dc, cmdb_commit_zone_s *old, char *zone, const char *type, const char *updated, const char *stamp)
+{
+	char path[DOMAIN_LEN];
+
+	if (!(old) || (strncmp(old->stamp, stamp, DOMAIN_LEN) != 0))
+		return 1;
+	if ((type) && (strncmp(type, "slave", BYTE_LEN) == 0))
+		return 0;
+	if ((updated) && (strncmp(updated, "yes", BYTE_LEN) == 0))
+		return 1;
+	snprintf(path, DOMAIN_LEN, "%s%s", dc->dir, zone);
+	return access(path, F_OK) != 0;
+}
+
+static void
+cmdb_commit_stamp(AILELEM *e, size_t n, char *stamp)
+{
+	size_t i, len = 0;
+	ailsa_data_s *d;
+
+	stamp[0] = '\0';
+	for (i = 0; (i < n) && (e) && (len < DOMAIN_LEN); i++, e = e->next) {
+		d = e->data;
+		switch (d->type) {
+		case AILSA_DB_TEXT:
+			len += (size_t)snprintf(stamp + len, DOMAIN_LEN - len, "%s%s", i > 0 ? "|" : "", d->data->text);
+			break;
+		case AILSA_DB_LINT:
+			len += (size_t)snprintf(stamp + len, DOMAIN_LEN - len, "%s%lu", i > 0 ? "|" : "", d->data->number);
+			break;
+		case AILSA_DB_SINT:
+			len += (size_t)snprintf(stamp + len, DOMAIN_LEN - len, "%s%hd", i > 0 ? "|" : "", d->data->small);
+			break;
+		default:
+			len += (size_t)snprintf(stamp + len, DOMAIN_LEN - len, "%s-", i > 0 ? "|" : "");
+			break;
+		}
+	}
+}
+
+static int
+cmdb_commit_zone_match(const void *one, const void *two)
+{
+	const cmdb_commit_zone_s *a = one, *b = two;
+
+	return strncmp(a->name, b->name, DOMAIN_LEN) == 0;
+}
+
+static void
+cmdb_commit_zone_clean(void *data)
+{
+	cmdb_commit_zone_s *z = data;
+
+	if (!(z))
+		return;
+	my_free(z->name);
+	my_free(z->stamp);
+	my_free(z);
+}
+
+// With UPDATE_KEY, named keeps a journal for master zones and may write
+// the files itself. Freeze them while the commit rewrites them; thaw loads
+// the new file, so a zone that stays frozen needs no reload. A zone that
+// cannot be frozen or thawed drops back to a plain reload
+static void
+cmdb_commit_freeze(ailsa_cmdb_s *dc, cmdb_zone_job_s *job, size_t total, const char *command)
+{
+	char line[CONFIG_LEN];
+	size_t i;
+	ailsa_rndc_s *r = NULL;
+
+	for (i = 0; (i < total) && (job[i].frozen == 0); i++) ;
+	if (i == total)
+		return;
+	if (ailsa_rndc_open(dc, &r) != 0) {
+		for (i = 0; i < total; i++)
+			job[i].frozen = 0;
+		return;
+	}
+	for (; i < total; i++) {
+		if (job[i].frozen == 0)
+			continue;
+		snprintf(line, CONFIG_LEN, "%s %s", command, job[i].zone);
+		if (ailsa_rndc_command(r, line, NULL, 0) != 0)
+			job[i].frozen = 0;
+	}
+	ailsa_rndc_close(r);
+}
+
+// Zones are independent; write and check up to ZONE_WORKERS of them at once
+static void
+cmdb_validate_zones(ailsa_cmdb_s *dc, int type, cmdb_zone_job_s *job, size_t total)
+{
+	size_t i, started = 0, workers = (dc->zone_workers > 0) ? (size_t)dc->zone_workers : 1;
+	int retval;
+	pthread_t *thread;
+	cmdb_zone_pool_s pool;
+
+	memset(&pool, 0, sizeof(cmdb_zone_pool_s));
+	pool.dc = dc;
+	pool.job = job;
+	pool.total = total;
+	pool.type = type;
+	if (workers > total)
+		workers = total;
+	if ((workers > 1) && (ailsa_sql_pool_init(dc, workers) != 0)) {
+		ailsa_syslog(LOG_ERR, "Cannot share the database; writing zones one at a time");
+		workers = 1;
+	}
+	pthread_mutex_init(&pool.lock, NULL);
+	if (workers <= 1) {
+		cmdb_zone_worker(&pool);
+		pthread_mutex_destroy(&pool.lock);
+		return;
+	}
+	thread = ailsa_calloc(sizeof(pthread_t) * workers, "thread in cmdb_validate_zones");
+	for (i = 0; i < workers; i++) {
+		if ((retval = pthread_create(&thread[i], NULL, cmdb_zone_thread, &pool)) != 0) {
+			ailsa_syslog(LOG_ERR, "Cannot start zone worker: %s", strerror(retval));
+			break;
+		}
+		started++;
+	}
+	if (started == 0)
+		cmdb_zone_worker(&pool);
+	for (i = 0; i < started; i++)
+		pthread_join(thread[i], NULL);
+	pthread_mutex_destroy(&pool.lock);
+	my_free(thread);
+}
+
+static void *
+cmdb_zone_worker(void *data)
+{
+	cmdb_zone_pool_s *pool = data;
+	cmdb_zone_job_s *job;
+
+	while (1) {
+		pthread_mutex_lock(&pool->lock);
+		job = (pool->next < pool->total) ? &(pool->job[pool->next++]) : NULL;
+		pthread_mutex_unlock(&pool->lock);
+		if (!(job))
+			break;
+		job->retval = cmdb_validate_zone(pool->dc, pool->type, job->zone, job->type, job->prefix, &job->changed);
+	}
+	return NULL;
+}
+
+// The worker also runs in the main thread, which keeps its database state
+static void *
+cmdb_zone_thread(void *data)
+{
+	cmdb_zone_worker(data);
+	ailsa_sql_thread_end();
+	return NULL;
+}
+
 int
 display_multi_a_records(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 {
@@ -620,147 +1084,204 @@ display_multi_a_records(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 		return AILSA_NO_DATA;
 	int retval = 0;
 
-	if (cm->domain)
-		retval = multi_a_range(dc, cm);
-	else if (cm->dest)
+	if (cm->dest)
 		retval = multi_a_ip_address(dc, cm);
+	else
+		retval = multi_a_range(dc, cm);
 	return retval;
 }
 
+// One scan of the reverse zones and one of the duplicated A records, joined
+// with preferred_a, cover any number of ranges. No -n means every range.
 static int
 multi_a_range(ailsa_cmdb_s *dc, dnsa_comm_line_s *dcl)
 {
 	if (!(dc) || !(dcl))
 		return AILSA_NO_DATA;
-	char *range = ailsa_calloc(MAC_LEN, "range in multi_a_range");
 	int retval;
-	size_t total = 2;
-	AILLIST *net = ailsa_db_data_list_init();
-	AILLIST *pre = ailsa_db_data_list_init();
-	AILLIST *mod = ailsa_db_data_list_init();
-	AILLIST *ip = ailsa_db_data_list_init();
-	AILELEM *e;
-	ailsa_data_s *d;
+	size_t i, z;
+	cmdb_multi_a_scan_s scan;
+	cmdb_multi_a_s *d;
 
-	if ((retval = setup_net_range(dc, dcl->domain, range)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot get search net range");
+	memset(&scan, 0, sizeof(cmdb_multi_a_scan_s));
+	if ((retval = ailsa_query_foreach(dc, REV_ZONE_RANGES, NULL, multi_a_zone_row, &scan)) != 0) {
+		ailsa_syslog(LOG_ERR, "REV_ZONE_RANGES query failed");
 		goto cleanup;
 	}
-	if ((retval = cmdb_add_string_to_list(range, net)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot add range to list");
+	if ((retval = multi_a_select_zones(&scan, dcl->domain)) != 0)
 		goto cleanup;
-	}
-	if ((retval = ailsa_argument_query(dc, DUP_IP_NET_RANGE, net, ip)) != 0) {
-		ailsa_syslog(LOG_ERR, "DUP_IP_NET_RANGE query failed");
+	if (scan.zones == 0) {
+		ailsa_syslog(LOG_INFO, "No reverse zones to check");
 		goto cleanup;
 	}
-	if (ip->total == 0) {
-		ailsa_syslog(LOG_INFO, "No duplicate IP's in range %s", dcl->domain);
+	qsort(scan.zone, scan.zones, sizeof(cmdb_multi_a_zone_s), multi_a_zone_cmp);
+	if ((retval = ailsa_query_foreach(dc, DUP_IP_PREF_A, NULL, multi_a_dup_row, &scan)) != 0) {
+		ailsa_syslog(LOG_ERR, "DUP_IP_PREF_A query failed");
 		goto cleanup;
 	}
-	if ((ip->total % total) != 0) {
-		ailsa_syslog(LOG_ERR, "Wrong number in list. Expected factor of %zu, got %zu", total, ip->total);
-		goto cleanup;
-	}
-	e = ip->head;
-	printf("Destination\t#\thost\n");
-	while (e) {
-		d = e->data;
-		ailsa_list_clean(pre);
-		if ((retval = cmdb_add_string_to_list(d->data->text, pre)) != 0) {
-			ailsa_syslog(LOG_ERR, "Cannot add IP to list");
-			goto cleanup;
-		}
-		if ((retval = ailsa_argument_query(dc, FQDN_PREF_A_ON_IP, pre, mod)) != 0) {
-			ailsa_syslog(LOG_ERR, "FQDN_PREF_A_ON_IP query failed");
-			goto cleanup;
+	qsort(scan.dup, scan.total, sizeof(cmdb_multi_a_s), multi_a_dup_cmp);
+	for (i = 0, z = 0; z < scan.zones; z++) {
+		if ((i == scan.total) || (scan.dup[i].zone != z)) {
+			ailsa_syslog(LOG_INFO, "No duplicate IP's in range %s", scan.zone[z].range);
+			continue;
 		}
-		if (strlen(d->data->text) < 8)
-			printf("%s\t\t", d->data->text);
-		else
-			printf("%s\t", d->data->text);
-		d = e->next->data;
-		printf("%lu\t", d->data->number);
-		if (mod->total > 0) {
-			d = mod->head->data;
-			printf("%s\n", d->data->text);
-		} else {
-			printf("No preferred A record set\n");
+		if (scan.zones > 1)
+			printf("%s/%lu\n", scan.zone[z].range, scan.zone[z].prefix);
+		printf("Destination\t#\thost\n");
+		for (; (i < scan.total) && (scan.dup[i].zone == z); i++) {
+			d = &(scan.dup[i]);
+			if (strlen(d->dest) < 8)
+				printf("%s\t\t", d->dest);
+			else
+				printf("%s\t", d->dest);
+			printf("%lu\t", d->count);
+			if (d->fqdn)
+				printf("%s\n", d->fqdn);
+			else
+				printf("No preferred A record set\n");
 		}
-		e = ailsa_move_down_list(e, total);
-		ailsa_list_clean(mod);
+		if (scan.zones > 1)
+			printf("\n");
 	}
 	cleanup:
-		ailsa_list_full_clean(net);
-		ailsa_list_full_clean(pre);
-		ailsa_list_full_clean(mod);
-		ailsa_list_full_clean(ip);
-		my_free(range);
+		multi_a_clean(&scan);
 		return retval;
 }
 
 static int
-setup_net_range(ailsa_cmdb_s *dc, char *domain, char *range)
+multi_a_zone_row(ailsa_result_s *r, void *ctx)
 {
-	if (!(dc) || !(domain) || !(range))
-		return AILSA_NO_DATA;
-	int retval;
-	unsigned long int prefix;
-	AILLIST *net = ailsa_db_data_list_init();
-	AILLIST *pre = ailsa_db_data_list_init();
-	ailsa_data_s *d;
+	cmdb_multi_a_scan_s *scan = ctx;
+	cmdb_multi_a_zone_s *z;
+	const char *range, *prefix;
+
+	if (r->cols != 4) {
+		ailsa_syslog(LOG_ERR, "Wanted 4 columns; query returned %zu", r->cols);
+		return AILSA_WRONG_LIST_LENGHT;
+	}
+	if (!(range = ailsa_result_text(r, 0, 0)) || (strchr(range, ':')))
+		return 0;
+	if ((scan->zones % CMDB_MULTI_A_CHUNK) == 0)
+		scan->zone = ailsa_realloc(scan->zone, (scan->zones + CMDB_MULTI_A_CHUNK) * sizeof(cmdb_multi_a_zone_s), "scan->zone in multi_a_zone_row");
+	z = &(scan->zone[scan->zones++]);
+	memset(z, 0, sizeof(cmdb_multi_a_zone_s));
+	z->range = strndup(range, MAC_LEN);
+	if ((prefix = ailsa_result_text(r, 0, 1)))
+		z->prefix = strtoul(prefix, NULL, 10);
+	else
+		z->prefix = ailsa_result_number(r, 0, 1);
+	z->start = (u_int32_t)ailsa_result_number(r, 0, 2);
+	z->finish = (u_int32_t)ailsa_result_number(r, 0, 3);
+	return 0;
+}
 
-	if ((retval = cmdb_add_string_to_list(domain, net)) != 0) {
-		ailsa_syslog(LOG_ERR, "Cannot add net range domain to list");
-		goto cleanup;
-	}
-	if ((retval = ailsa_argument_query(dc, PREFIX_ON_NET_RANGE, net, pre)) != 0) {
-		ailsa_syslog(LOG_ERR, "PREFIX_ON_NET_RANGE query failed");
-		goto cleanup;
+// Keep only the comma separated ranges asked for; all of them when there are none
+static int
+multi_a_select_zones(cmdb_multi_a_scan_s *scan, char *ranges)
+{
+	char *list, *range, *save = NULL;
+	size_t i, keep;
+	short int found;
+
+	if (!(ranges))
+		return 0;
+	list = strndup(ranges, CONFIG_LEN);
+	for (range = strtok_r(list, ",", &save); range; range = strtok_r(NULL, ",", &save)) {
+		for (found = 0, i = 0; i < scan->zones; i++) {
+			if (strcmp(scan->zone[i].range, range) == 0) {
+				scan->zone[i].wanted = 1;
+				found = 1;
+			}
+		}
+		if (found == 0)
+			ailsa_syslog(LOG_INFO, "net range %s not found in reverse zones", range);
 	}
-	if (pre->total == 0) {
-		ailsa_syslog(LOG_INFO, "net range %s not found in reverse zones", domain);
-		goto cleanup;
+	my_free(list);
+	for (keep = 0, i = 0; i < scan->zones; i++) {
+		if (scan->zone[i].wanted)
+			scan->zone[keep++] = scan->zone[i];
+		else
+			my_free(scan->zone[i].range);
 	}
-	d = pre->head->data;
-	prefix = strtoul(d->data->text, NULL, 10);
-	if ((retval = get_search_net_range(range, domain, prefix)) != 0)
-		ailsa_syslog(LOG_ERR, "Cannot get search range from %s/%lu", domain, prefix);
+	scan->zones = keep;
+	return 0;
+}
 
-	cleanup:
-		ailsa_list_full_clean(net);
-		ailsa_list_full_clean(pre);
-		return retval;
+static int
+multi_a_dup_row(ailsa_result_s *r, void *ctx)
+{
+	cmdb_multi_a_scan_s *scan = ctx;
+	cmdb_multi_a_s *d;
+	const char *dest, *fqdn;
+	u_int32_t ip;
+	size_t lo, hi, mid;
+
+	if (r->cols != 3) {
+		ailsa_syslog(LOG_ERR, "Wanted 3 columns; query returned %zu", r->cols);
+		return AILSA_WRONG_LIST_LENGHT;
+	}
+	if (!(dest = ailsa_result_text(r, 0, 0)))
+		return 0;
+	if (inet_pton(AF_INET, dest, &ip) != 1)
+		return 0;
+	ip = ntohl(ip);
+// Reverse zones cannot overlap, so the last one starting at or below ip is the only candidate
+	for (lo = 0, hi = scan->zones; lo < hi; ) {
+		mid = lo + (hi - lo) / 2;
+		if (scan->zone[mid].start <= ip)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if ((lo == 0) || (ip > scan->zone[lo - 1].finish))
+		return 0;
+	fqdn = ailsa_result_text(r, 0, 2);
+	if ((scan->total > 0) && (strcmp(scan->dup[scan->total - 1].dest, dest) == 0))
+		return 0;	// More than one preferred A record for the IP
+	if (scan->total == scan->size) {
+		scan->size += CMDB_MULTI_A_CHUNK;
+		scan->dup = ailsa_realloc(scan->dup, scan->size * sizeof(cmdb_multi_a_s), "scan->dup in multi_a_dup_row");
+	}
+	d = &(scan->dup[scan->total++]);
+	d->ip = ip;
+	d->zone = lo - 1;
+	d->count = ailsa_result_number(r, 0, 1);
+	d->dest = strndup(dest, MAC_LEN);
+	d->fqdn = fqdn ? strndup(fqdn, DOMAIN_LEN) : NULL;
+	return 0;
 }
 
 static int
-get_search_net_range(char *range, char *domain, unsigned long int prefix)
+multi_a_zone_cmp(const void *one, const void *two)
 {
-	if (!(range) || !(domain) || (prefix == 0))
-		return AILSA_NO_DATA;
-	char *tmp;
-	int retval = 0;
+	const cmdb_multi_a_zone_s *a = one, *b = two;
 
-	if (snprintf(range, MAC_LEN, "%s", domain) >= MAC_LEN)
-		ailsa_syslog(LOG_ERR, "range truncated in get_search_net_range");
-	tmp = strrchr(range, '.');
-	if (!(tmp))
-		return AILSA_RANGE_ERROR;
-	if (prefix < 24) {
-		*tmp = '\0';
-		tmp = strrchr(range, '.');
-		if (!(tmp))
-			return AILSA_RANGE_ERROR;
-		if (prefix < 16) {
-			*tmp = '\0';
-			tmp = strrchr(range, '.');
-			if (!(tmp))
-				return AILSA_RANGE_ERROR;
-		}
+	return (a->start > b->start) - (a->start < b->start);
+}
+
+static int
+multi_a_dup_cmp(const void *one, const void *two)
+{
+	const cmdb_multi_a_s *a = one, *b = two;
+
+	if (a->zone != b->zone)
+		return (a->zone > b->zone) - (a->zone < b->zone);
+	return (a->ip > b->ip) - (a->ip < b->ip);
+}
+
+static void
+multi_a_clean(cmdb_multi_a_scan_s *scan)
+{
+	size_t i;
+
+	for (i = 0; i < scan->zones; i++)
+		my_free(scan->zone[i].range);
+	for (i = 0; i < scan->total; i++) {
+		my_free(scan->dup[i].dest);
+		my_free(scan->dup[i].fqdn);
 	}
-	tmp++;
-	sprintf(tmp, "%%");
-	return retval;
+	my_free(scan->zone);
+	my_free(scan->dup);
 }
 
 static int
@@ -950,14 +1471,18 @@ add_host(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 		ailsa_syslog(LOG_ERR, "Cannot add cuser and muser to list");
 		goto cleanup;
 	}
+	if ((retval = cmdb_add_ip_addr_to_list(cm->rtype, cm->dest, rec)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot add ip_addr to list");
+		goto cleanup;
+	}
 	switch (rec->total) {
-	case 6:
+	case 7:
 		query = INSERT_RECORD_BASE;
 		break;
-	case 7:
+	case 8:
 		query = INSERT_RECORD_MX;
 		break;
-	case 9:
+	case 10:
 		query = INSERT_RECORD_SRV;
 		break;
 	default:
@@ -969,6 +1494,8 @@ add_host(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 		ailsa_syslog(LOG_ERR, "Insert record query %u failed", query);
 		goto cleanup;
 	}
+	if (cmdb_push_rrset(dc, cm->domain, cm->rtype, cm->host) == 0)
+		goto cleanup;
 	if ((retval = set_db_row_updated(dc, SET_FWD_ZONE_UPDATED_ON_NAME, cm->domain, 0)) != 0)
 		ailsa_syslog(LOG_ERR, "Failed to set zone %s as updated", cm->domain);
 
@@ -1065,10 +1592,16 @@ add_cname_to_root_domain(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 		ailsa_syslog(LOG_ERR, "Cannot populate cuser and muser to list");
 		goto cleanup;
 	}
+	if ((retval = cmdb_add_ip_addr_to_list("CNAME", domain, c)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot add ip_addr to list");
+		goto cleanup;
+	}
 	if ((retval = ailsa_insert_query(dc, INSERT_RECORD_BASE, c)) != 0) {
 		ailsa_syslog(LOG_ERR, "INSERT_RECORD_BASE query failed");
 		goto cleanup;
 	}
+	if (cmdb_push_rrset(dc, cm->toplevel, "CNAME", cm->host) == 0)
+		goto cleanup;
 	e = c->head;
 	data = e->data;
 	if ((retval = set_db_row_updated(dc, SET_FWD_ZONE_UPDATED, NULL, data->data->number)) != 0) {
@@ -1216,6 +1749,8 @@ delete_record(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 	}
 	if ((retval = ailsa_delete_query(dc, delete_queries[delete], rec)) != 0)
 		ailsa_syslog(LOG_ERR, "delete query failed");
+	else if (cmdb_push_rrset(dc, cm->domain, cm->rtype, cm->host) == 0)
+		goto cleanup;
 	if ((retval = set_db_row_updated(dc, SET_FWD_ZONE_UPDATED_ON_NAME, cm->domain, 0)) != 0)
 		ailsa_syslog(LOG_ERR, "Cannot set zone %s to updated", cm->domain);
 	cleanup:
@@ -1239,7 +1774,6 @@ delete_fwd_zone(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 {
 	if (!(dc) || !(cm))
 		return AILSA_NO_DATA;
-	char *command = ailsa_calloc(CONFIG_LEN, "command in delete_fwd_zone");
 	int retval;
 	AILLIST *z = ailsa_db_data_list_init();
 
@@ -1259,13 +1793,10 @@ delete_fwd_zone(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 		ailsa_syslog(LOG_ERR, "Cannot write forward zone's config");
 		goto cleanup;
 	}
-	snprintf(command, CONFIG_LEN, "%s reload", dc->rndc);
-	if ((retval = system(command)) != 0)
-		ailsa_syslog(LOG_ERR, "Reload of nameserver failed");
+	retval = ailsa_rndc_reload(dc, NULL, 1);
 
 	cleanup:
 		ailsa_list_full_clean(z);
-		my_free(command);
 		return retval;
 }
 
@@ -1283,7 +1814,6 @@ delete_reverse_zone(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 {
 	if (!(dc) || !(cm))
 		return AILSA_NO_DATA;
-	char *command = ailsa_calloc(CONFIG_LEN, "command in delete_reverse_zone");
 	int retval;
 	AILLIST *rev = ailsa_db_data_list_init();
 
@@ -1306,13 +1836,10 @@ delete_reverse_zone(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 		ailsa_syslog(LOG_ERR, "Cannot write out reverse zone's config");
 		goto cleanup;
 	}
-	snprintf(command, CONFIG_LEN, "%s reload", dc->rndc);
-	if ((retval = system(command)) != 0)
-		ailsa_syslog(LOG_ERR, "Reload of nameserver failed");
+	retval = ailsa_rndc_reload(dc, NULL, 1);
 
 	cleanup:
 		ailsa_list_full_clean(rev);
-		my_free(command);
 		return retval;
 }
 
@@ -1322,9 +1849,10 @@ build_reverse_zone(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 	if (!(dc) || !(cm))
 		return AILSA_NO_DATA;
 	int retval;
-	char comm[DOMAIN_LEN];
+	short int changed = 0;
 	unsigned long int prefix, index, zone_id;
 	AILLIST *add = ailsa_db_data_list_init();
+	AILLIST *names = ailsa_db_data_list_init();
 	AILLIST *net = ailsa_db_data_list_init();
 	AILLIST *rem = ailsa_db_data_list_init();
 	AILLIST *fix = ailsa_db_data_list_init();
@@ -1369,6 +1897,8 @@ build_reverse_zone(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 		goto cleanup;
 	}
 	if (rem->total > 0 || add->total > 0) {
+		if ((retval = ailsa_begin(dc)) != 0)
+			goto cleanup;
 		if (rem->total > 0) {
 			if ((retval = ailsa_multiple_delete(dc, delete_queries[DELETE_REVERSE_RECORD], rem)) != 0) {
 				ailsa_syslog(LOG_ERR, "DELETE_REVERSE_RECORD multi query failed");
@@ -1376,7 +1906,7 @@ build_reverse_zone(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 			}
 		}
 		if (add->total > 0) {
-			if ((retval = ailsa_multiple_query(dc, insert_queries[INSERT_REVERSE_RECORD], add)) != 0) {
+			if ((retval = ailsa_bulk_insert(dc, insert_queries[INSERT_REVERSE_RECORD], add)) != 0) {
 				ailsa_syslog(LOG_ERR, "INSERT_REVERSE_RECORD multi query failed");
 				goto cleanup;
 			}
@@ -1394,17 +1924,22 @@ build_reverse_zone(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 			ailsa_syslog(LOG_ERR, "Update query SET_REV_ZONE_UPDATED failed");
 			goto cleanup;
 		}
-		if ((retval = cmdb_validate_zone(dc, REVERSE_ZONE, cm->domain, "master", prefix)) != 0) {
+		if ((retval = ailsa_commit(dc)) != 0)
+			goto cleanup;
+		if ((retval = cmdb_validate_zone(dc, REVERSE_ZONE, cm->domain, "master", prefix, &changed)) != 0) {
 			ailsa_syslog(LOG_ERR, "Cannot validate zone %s", cm->domain);
 			goto cleanup;
 		}
-		memset(comm, 0, DOMAIN_LEN);
-		snprintf(comm, CONFIG_LEN, "%s reload", dc->rndc);
-		if ((retval = system(comm)) != 0)
-			ailsa_syslog(LOG_ERR, "Reload of nameserver failed");
+		if (changed > 0) {
+			if ((retval = cmdb_rev_zone_names(cm->domain, prefix, names)) != 0)
+				goto cleanup;
+			retval = ailsa_rndc_reload(dc, names, 0);
+		}
 	}
 	cleanup:
+		ailsa_rollback(dc);
 		ailsa_list_full_clean(add);
+		ailsa_list_full_clean(names);
 		ailsa_list_full_clean(net);
 		ailsa_list_full_clean(rec);
 		ailsa_list_full_clean(rem);
@@ -1478,18 +2013,30 @@ get_fwd_records(ailsa_cmdb_s *dc, AILLIST *r, char *range, unsigned long int pre
 	if (!(dc) || !(r) || !(range) || (prefix == 0))
 		return AILSA_NO_DATA;
 	int retval;
-	char search[HOST_LEN];
 	AILLIST *l = ailsa_db_data_list_init();
 	AILLIST *net = ailsa_db_data_list_init();
-	unsigned long int index, i;
-
+	unsigned long int index, i, start, end;
+	cmdb_rev_aaaa_s aaaa;
+
+// One pass over the AAAA records, matched on the packed address
+	if (strchr(range, ':')) {
+		memset(&aaaa, 0, sizeof(cmdb_rev_aaaa_s));
+		aaaa.rec = r;
+		aaaa.prefix = prefix;
+		if ((retval = convert_text_ipv6_to_bin(aaaa.net, range)) != 0)
+			goto cleanup;
+		if ((retval = ailsa_query_foreach(dc, AAAA_RECORDS, NULL, fill_fwd_ipv6_record, &aaaa)) != 0)
+			ailsa_syslog(LOG_ERR, "AAAA_RECORDS query failed");
+		goto cleanup;
+	}
 	if ((retval = get_zone_index(prefix, &index)) != 0)
 		goto cleanup;
 	for (i = 0; i < index; i++) {
-		memset(search, 0, HOST_LEN);
-		if ((retval = get_range_search_string(range, search, prefix, i)) != 0)
+		if ((retval = cmdb_rev_zone_window(range, prefix, index, i, &start, &end)) != 0)
+			goto cleanup;
+		if ((retval = cmdb_add_number_to_list(start, net)) != 0)
 			goto cleanup;
-		if ((retval = cmdb_add_string_to_list(search, net)) != 0)
+		if ((retval = cmdb_add_number_to_list(end, net)) != 0)
 			goto cleanup;
 		if ((retval = ailsa_argument_query(dc, RECORDS_ON_NET_RANGE, net, l)) != 0)
 			goto cleanup;
@@ -1530,32 +2077,62 @@ fill_fwd_records(AILLIST *list, AILLIST *rec, unsigned long int index)
 	return retval;
 }
 
+static int
+fill_fwd_ipv6_record(ailsa_result_s *r, void *ctx)
+{
+	cmdb_rev_aaaa_s *aaaa = ctx;
+	const char *dest, *host, *domain;
+	char hex[MAC_LEN + 1];
+	unsigned char ip[16];
+	int retval;
+	ailsa_record_s *record;
+
+	if (r->cols != 4) {
+		ailsa_syslog(LOG_ERR, "Wanted 4 columns; query returned %zu", r->cols);
+		return AILSA_WRONG_LIST_LENGHT;
+	}
+	if (!(dest = ailsa_result_text(r, 0, 0)) || !(host = ailsa_result_text(r, 0, 2)) ||
+	    !(domain = ailsa_result_text(r, 0, 3)))
+		return 0;
+	if ((inet_pton(AF_INET6, dest, ip) != 1) || !(cmdb_ipv6_in_range(ip, aaaa->net, aaaa->prefix)))
+		return 0;
+	convert_bin_ipv6_to_hex(ip, hex);
+	record = ailsa_calloc(sizeof(ailsa_record_s), "record in fill_fwd_ipv6_record");
+	record->id = ailsa_result_number(r, 0, 1);
+	record->dest = strndup(hex, MAC_LEN);
+	record->host = strndup(host, DOMAIN_LEN);
+	record->domain = strndup(domain, DOMAIN_LEN);
+	if ((retval = ailsa_list_insert(aaaa->rec, record)) != 0) {
+		ailsa_syslog(LOG_ERR, "Cannot insert record into list");
+		aaaa->rec->destroy(record);
+	}
+	return retval;
+}
+
 static int
 get_pref_records(ailsa_cmdb_s *dc, AILLIST *r, char *range, unsigned long int prefix)
 {
 	if (!(dc) || !(r) || !(range))
 		return AILSA_NO_DATA;
 	int retval;
-	char search[HOST_LEN];
 	AILLIST *l = ailsa_db_data_list_init();
 	AILLIST *p = ailsa_db_data_list_init();
-	unsigned long int index, i;
+	unsigned long int start, end;
 
-	if ((retval = get_zone_index(prefix, &index)) != 0)
+// preferred_a only holds IPv4 addresses
+	if (strchr(range, ':')) {
+		retval = 0;
 		goto cleanup;
-	for (i = 0; i < index; i++) {
-		memset(search, 0, HOST_LEN);
-		if ((retval = get_range_search_string(range, search, prefix, i)) != 0)
-			goto cleanup;
-		if ((retval = cmdb_add_string_to_list(search, l)) != 0)
-			goto cleanup;
-		if ((retval = ailsa_argument_query(dc, PREFER_A_INFO_ON_RANGE, l, p)) != 0)
-			goto cleanup;
-		if ((retval = fill_pref_records(p, r)) != 0)
-			goto cleanup;
-		ailsa_list_clean(l);
-		ailsa_list_clean(p);
 	}
+	if ((retval = cmdb_rev_zone_window(range, prefix, 1, 0, &start, &end)) != 0)
+		goto cleanup;
+	if ((retval = cmdb_add_number_to_list(start, l)) != 0)
+		goto cleanup;
+	if ((retval = cmdb_add_number_to_list(end, l)) != 0)
+		goto cleanup;
+	if ((retval = ailsa_argument_query(dc, PREFER_A_INFO_ON_RANGE, l, p)) != 0)
+		goto cleanup;
+	retval = fill_pref_records(p, r);
 
 	cleanup:
 		ailsa_list_full_clean(l);
@@ -1587,6 +2164,7 @@ fill_pref_records(AILLIST *list, AILLIST *pref)
 	return retval;
 }
 
+// Drop forward records for an IP that has a different preferred A record
 static int
 cmdb_trim_record_list(AILLIST *r, AILLIST *p)
 {
@@ -1594,198 +2172,269 @@ cmdb_trim_record_list(AILLIST *r, AILLIST *p)
 		return AILSA_NO_DATA;
 	int retval = 0;
 	void *data;
-	AILELEM *record, *preferred, *tmp;
-	ailsa_preferred_s *pref;
+	AILHASH pi;
+	AILELEM *record, *next;
+	AILELEM *preferred;
+	ailsa_preferred_s probe;
 	ailsa_record_s *rec;
 	if ((r->total == 0) || (p->total == 0))
 		return retval;
 	if (!(r->destroy))
 		return AILSA_LIST_NO_DESTROY;
-	preferred = p->head;
-	while (preferred) {
-		record = r->head;
-		while (record) {
-			pref = preferred->data;
-			rec = record->data;
-			if (strncmp(pref->ip, rec->dest, DOMAIN_LEN) == 0) {
-				if (rec->id != pref->record_id) {
-					if (record->prev) {
-						tmp = record->prev;
-						if ((retval = ailsa_list_remove(r, tmp->next, &data)) == 0) {
-							r->destroy(data);
-						} else {
-							ailsa_syslog(LOG_ERR, "Cannot remove element from list");
-							return AILSA_LIST_CANNOT_REMOVE;
-						}
-						record = tmp->next;
-					} else {
-						if ((retval = ailsa_list_remove(r, r->head, &data)) == 0) {
-							r->destroy(data);
-						} else {
-							ailsa_syslog(LOG_ERR, "Cannot remove head element from list");
-							return AILSA_LIST_CANNOT_REMOVE;
-						}
-						record = r->head;
-					}
-					continue;
-				}
+	ailsa_hash_init(&pi, (unsigned int)p->total | 1, ailsa_hash, cmdb_pref_match, NULL);
+	for (preferred = p->head; preferred; preferred = preferred->next) {
+		if (ailsa_hash_insert(&pi, preferred->data, ((ailsa_preferred_s *)preferred->data)->ip) < 0) {
+			retval = AILSA_LIST_CANNOT_REMOVE;
+			goto cleanup;
+		}
+	}
+	memset(&probe, 0, sizeof(ailsa_preferred_s));
+	record = r->head;
+	while (record) {
+		next = record->next;
+		rec = record->data;
+		probe.ip = rec->dest;
+		data = &probe;
+		if ((ailsa_hash_lookup(&pi, &data, rec->dest) == 0) && (rec->id != ((ailsa_preferred_s *)data)->record_id)) {
+			if ((retval = ailsa_list_remove(r, record, &data)) != 0) {
+				ailsa_syslog(LOG_ERR, "Cannot remove element from list");
+				retval = AILSA_LIST_CANNOT_REMOVE;
+				goto cleanup;
 			}
-			record = record->next;
+			r->destroy(data);
 		}
-		preferred = preferred->next;
+		record = next;
 	}
-	return retval;
+	cleanup:
+		ailsa_hash_destroy(&pi);
+		return retval;
 }
 
+// Reverse records whose IP and FQDN no longer match a forward record
 static int
 cmdb_records_to_remove(char *range, unsigned long int prefix, AILLIST *rec, AILLIST *rev, AILLIST *remove)
 {
 	if (!(range) || !(rec) || !(rev) || !(remove))
 		return AILSA_NO_DATA;
 	int retval;
-	char search[HOST_LEN];
+	char ip[HOST_LEN];
 	char fqdn[DOMAIN_LEN];
-	char *ptr;
-	unsigned long int index, i;
-	AILELEM *r, *f;
+	char *pre = NULL;
+	unsigned long int index;
+	AILHASH fwd;
+	AILELEM *e;
 	ailsa_record_s *reverse, *forward;
 
 	if ((retval = get_zone_index(prefix, &index)) != 0)
 		return retval;
-	for (i = 0; i < index; i++) {
-		memset(search, 0, HOST_LEN);
-		if ((retval = get_range_search_string(range, search, prefix, i)) != 0)
-			return retval;
-		if (!(ptr =  strrchr(search, '%')))
+	if ((retval = cmdb_rev_zone_prefixes(range, prefix, index, &pre)) != 0)
+		return retval;
+	ailsa_hash_init(&fwd, (unsigned int)rec->total | 1, ailsa_hash, cmdb_rev_key_match, cmdb_rev_key_clean);
+	for (e = rec->head; e; e = e->next) {
+		forward = e->data;
+		cmdb_fwd_record_fqdn(forward, fqdn);
+		if ((retval = cmdb_rev_key_insert(&fwd, forward->dest, fqdn)) < 0)
 			goto cleanup;
-		r = rev->head;
-		while (r) {
-			reverse = r->data;
-			if (reverse->index != i) {
-				r = r->next;
+	}
+	retval = 0;
+	for (e = rev->head; e; e = e->next) {
+		reverse = e->data;
+		if (reverse->index < index) {
+			snprintf(ip, HOST_LEN, "%s%s", pre + (reverse->index * HOST_LEN), reverse->host);
+			if (cmdb_rev_key_find(&fwd, ip, reverse->dest) == 0)
 				continue;
-			}
-			f = rec->head;
-			snprintf(ptr, SERVICE_LEN, "%s", reverse->host);
-			while (f) {
-				forward = f->data;
-				if (strncmp(search, forward->dest, HOST_LEN) == 0){
-					memset(fqdn, 0, DOMAIN_LEN);
-					if (strncmp("@", forward->host, BYTE_LEN) == 0)
-						snprintf(fqdn, DOMAIN_LEN, "%s.", forward->domain);
-					else
-						snprintf(fqdn, DOMAIN_LEN, "%s.%s.", forward->host, forward->domain);
-					if (strncmp(reverse->dest, fqdn, DOMAIN_LEN) == 0)
-						break;
-				}
-				f = f->next;
-			}
-			if (!(f)) {
-				if ((retval = cmdb_add_number_to_list(reverse->id, remove)) != 0)
-					return retval;
-			}
-			r = r->next;
 		}
+		if ((retval = cmdb_add_number_to_list(reverse->id, remove)) != 0)
+			goto cleanup;
 	}
-	return retval;
 	cleanup:
-		ailsa_syslog(LOG_ERR, "String manipulation failed");
-		return AILSA_STRING_FAIL;
+		ailsa_hash_destroy(&fwd);
+		my_free(pre);
+		return retval;
 }
 
+// Forward records with no reverse record for their IP and FQDN
 static int
 cmdb_records_to_add(char *range, unsigned long int zone_id, unsigned long int prefix, AILLIST *rec, AILLIST *rev, AILLIST *add)
 {
 	if (!(range) || !(rec) || !(rev) || !(add))
 		return AILSA_NO_DATA;
 	int retval;
-	char search[DOMAIN_LEN];
+	char ip[HOST_LEN];
 	char fqdn[DOMAIN_LEN];
-	char *ptr, *pts;
-	unsigned long int index, i;
+	char *pre = NULL;
+	const char *start;
+	unsigned long int index;
 	size_t len;
-	AILELEM *r, *f;
+	AILHASH have;
+	AILELEM *e;
 	ailsa_record_s *reverse, *forward;
 
 	if ((retval = get_zone_index(prefix, &index)) != 0)
 		return retval;
+	if ((retval = cmdb_rev_zone_prefixes(range, prefix, index, &pre)) != 0)
+		return retval;
+	ailsa_hash_init(&have, (unsigned int)(rev->total + rec->total) | 1, ailsa_hash, cmdb_rev_key_match, cmdb_rev_key_clean);
+	for (e = rev->head; e; e = e->next) {
+		reverse = e->data;
+		if (reverse->index >= index)
+			continue;
+		snprintf(ip, HOST_LEN, "%s%s", pre + (reverse->index * HOST_LEN), reverse->host);
+		if ((retval = cmdb_rev_key_insert(&have, ip, reverse->dest)) < 0)
+			goto cleanup;
+	}
+// Anything inserted now is missing; the index also stops us adding it twice
+	for (e = rec->head; e; e = e->next) {
+		forward = e->data;
+		if (forward->index >= index)
+			continue;
+		start = pre + (forward->index * HOST_LEN);
+		len = strlen(start);
+		if (strncmp(forward->dest, start, len) != 0)
+			continue;
+		cmdb_fwd_record_fqdn(forward, fqdn);
+		if ((retval = cmdb_rev_key_insert(&have, forward->dest, fqdn)) < 0)
+			goto cleanup;
+		if (retval > 0)
+			continue;
+		if ((retval = cmdb_add_number_to_list(zone_id, add)) != 0)
+			goto cleanup;
+		if ((retval = cmdb_add_number_to_list(forward->index, add)) != 0)
+			goto cleanup;
+		if ((retval = cmdb_add_string_to_list(forward->dest + len, add)) != 0)
+			goto cleanup;
+		if ((retval = cmdb_add_string_to_list(fqdn, add)) != 0)
+			goto cleanup;
+		if ((retval = cmdb_populate_cuser_muser(add)) != 0)
+			goto cleanup;
+	}
+	retval = 0;
+	cleanup:
+		ailsa_hash_destroy(&have);
+		my_free(pre);
+		return retval;
+}
+
+// The text every IP in each zone index starts with, e.g. "192.168.4.".
+// IPv6 records are whole packed addresses, so theirs is empty
+static int
+cmdb_rev_zone_prefixes(char *range, unsigned long int prefix, unsigned long int index, char **pre)
+{
+	int retval;
+	char *ptr;
+	unsigned long int i;
+
+	*pre = ailsa_calloc(index * HOST_LEN, "pre in cmdb_rev_zone_prefixes");
+	if (strchr(range, ':'))
+		return 0;
 	for (i = 0; i < index; i++) {
-		memset(search, 0, DOMAIN_LEN);
-		if ((retval = get_range_search_string(range, search, prefix, i)) != 0)
-			return retval;
-		if (!(ptr = strrchr(search, '%')))
+		if ((retval = get_range_search_string(range, *pre + (i * HOST_LEN), prefix, i)) != 0)
+			goto cleanup;
+		if (!(ptr = strrchr(*pre + (i * HOST_LEN), '%'))) {
+			ailsa_syslog(LOG_ERR, "String manipulation failed");
+			retval = AILSA_STRING_FAIL;
 			goto cleanup;
-		f = rec->head;
-		while (f) {
-			forward = f->data;
-			r = rev->head;
-			while (r) {
-				reverse = r->data;
-				snprintf(ptr, MAC_LEN, "%s", reverse->host);
-				if (strncmp(forward->dest, search, DOMAIN_LEN) == 0) {
-					memset(fqdn, 0, DOMAIN_LEN);
-					if (strncmp(forward->host, "@", BYTE_LEN) == 0)
-						snprintf(fqdn, DOMAIN_LEN, "%s.", forward->domain);
-					else
-						snprintf(fqdn, DOMAIN_LEN, "%s.%s.", forward->host, forward->domain);
-					if ((strncmp(fqdn, reverse->dest, DOMAIN_LEN) == 0))
-						break;
-				}
-				r = r->next;
-			}
-			if (!(r)) {
-				memset(fqdn, 0, DOMAIN_LEN);
-				snprintf(fqdn, DOMAIN_LEN, "%s", search);
-				pts = strrchr(fqdn, '.');
-				*pts = '\0';
-				len = strlen(fqdn);
-				if (strncmp(fqdn, forward->dest, len) == 0) {
-					if ((retval = cmdb_add_number_to_list(zone_id, add)) != 0)
-						return retval;
-					if ((retval = cmdb_add_number_to_list(i, add)) != 0)
-						return retval;
-					memset(fqdn, 0, DOMAIN_LEN);
-					memset(search, 0, DOMAIN_LEN);
-					if ((retval = get_range_search_string(range, search, prefix, i)) != 0)
-						return retval;
-					if ((retval = cmdb_get_rev_dest_from_search(search, forward->dest, fqdn)) != 0)
-						goto cleanup;
-					if ((retval = cmdb_add_string_to_list(fqdn, add)) != 0)
-						goto cleanup;
-					memset(fqdn, 0, DOMAIN_LEN);
-					if (strncmp(forward->host, "@", BYTE_LEN) == 0)
-						snprintf(fqdn, DOMAIN_LEN, "%s.", forward->domain);
-					else
-						snprintf(fqdn, DOMAIN_LEN, "%s.%s.", forward->host, forward->domain);
-					if ((retval = cmdb_add_string_to_list(fqdn, add)) != 0)
-						return retval;
-					if ((retval = cmdb_populate_cuser_muser(add)) != 0)
-						goto cleanup;
-				}
-			}
-			f = f->next;
 		}
+		*ptr = '\0';
 	}
-	return retval;
+	return 0;
 	cleanup:
-		ailsa_syslog(LOG_ERR, "String manipulation failed");
+		my_free(*pre);
 		return retval;
 }
 
+// First and last address, as records.ip_addr holds them, of file i of index
 static int
-cmdb_get_rev_dest_from_search(char *search, char *dest, char *fqdn)
+cmdb_rev_zone_window(char *range, unsigned long int prefix, unsigned long int index, unsigned long int i, unsigned long int *start, unsigned long int *end)
 {
-	if (!(search) || !(dest) || !(fqdn))
-		return AILSA_NO_DATA;
-	size_t len;
-	char *ptr;
+	int retval;
+	unsigned long int base, size;
 
-	len = strlen(search) - 1;
-	ptr = dest + len;
-	snprintf(fqdn, MAC_LEN, "%s", ptr);
+	if ((retval = convert_text_ipv4_to_bin(&base, range)) != 0)
+		return retval;
+	size = get_net_range(prefix) / index;
+	*start = base + (i * size);
+	*end = *start + size - 1;
 	return 0;
 }
 
+static void
+cmdb_fwd_record_fqdn(ailsa_record_s *forward, char *fqdn)
+{
+	if (strncmp(forward->host, "@", BYTE_LEN) == 0)
+		snprintf(fqdn, DOMAIN_LEN, "%s.", forward->domain);
+	else
+		snprintf(fqdn, DOMAIN_LEN, "%s.%s.", forward->host, forward->domain);
+}
+
+// Returns 0 if added, 1 if already there and < 0 on error. Bad IPs are skipped
+static int
+cmdb_rev_key_insert(AILHASH *index, const char *ip, const char *fqdn)
+{
+	int retval;
+	cmdb_rev_key_s *key = ailsa_calloc(sizeof(cmdb_rev_key_s), "key in cmdb_rev_key_insert");
+
+	if (cmdb_rev_key_addr(ip, key->ip) != 0) {
+		my_free(key);
+		return 1;
+	}
+	key->fqdn = strndup(fqdn, DOMAIN_LEN);
+	if ((retval = ailsa_hash_insert(index, key, key->fqdn)) != 0)
+		cmdb_rev_key_clean(key);
+	return retval;
+}
+
+static int
+cmdb_rev_key_find(AILHASH *index, const char *ip, char *fqdn)
+{
+	cmdb_rev_key_s probe;
+	void *data = &probe;
+
+	if (cmdb_rev_key_addr(ip, probe.ip) != 0)
+		return -1;
+	probe.fqdn = fqdn;
+	return ailsa_hash_lookup(index, &data, fqdn);
+}
+
+// A dotted quad, or an IPv6 address as text or as the 32 hex digits rev_records holds
+static int
+cmdb_rev_key_addr(const char *ip, unsigned char *addr)
+{
+	memset(addr, 0, 16);
+	if (inet_pton(AF_INET, ip, addr) == 1)
+		return 0;
+	if (inet_pton(AF_INET6, ip, addr) == 1)
+		return 0;
+	return convert_hex_ipv6_to_bin(addr, ip);
+}
+
+static int
+cmdb_rev_key_match(const void *one, const void *two)
+{
+	const cmdb_rev_key_s *a = one, *b = two;
+
+	return (memcmp(a->ip, b->ip, sizeof(a->ip)) == 0) && (strncmp(a->fqdn, b->fqdn, DOMAIN_LEN) == 0);
+}
+
+static void
+cmdb_rev_key_clean(void *data)
+{
+	cmdb_rev_key_s *key = data;
+
+	if (!(key))
+		return;
+	my_free(key->fqdn);
+	my_free(key);
+}
+
+static int
+cmdb_pref_match(const void *one, const void *two)
+{
+	const ailsa_preferred_s *a = one, *b = two;
+
+	return strncmp(a->ip, b->ip, HOST_LEN) == 0;
+}
+
 int
 add_glue_zone(ailsa_cmdb_s *dc, dnsa_comm_line_s *cm)
 {